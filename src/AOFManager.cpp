@@ -0,0 +1,346 @@
+#include "AOFManager.hpp"
+#include "RDBWriter.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <sstream>
+#include <iostream>
+
+static constexpr size_t PROGRESS_INTERVAL = 1024; // commands replayed between two progress reports
+static constexpr int WRITE_RETRY_DELAY = 1; // seconds before a failed write is tried again
+
+AOFManager::AOFManager(std::shared_ptr<ServerConfig> config_) : config(config_) {
+    if(config->append_fsync == "always") policy = Fsync::ALWAYS;
+    else if(config->append_fsync == "no") policy = Fsync::NO;
+    else policy = Fsync::EVERYSEC;
+}
+
+AOFManager::~AOFManager() {
+    writer_thread = std::jthread(); // flushes what is left and joins
+    if(fd >= 0) close(fd);
+}
+
+std::string AOFManager::path() const {
+    return (config->rdb_file_dir.empty() ? "." : config->rdb_file_dir) + "/" + config->append_filename;
+}
+
+bool AOFManager::exists() const {
+    return access(path().c_str(), F_OK) == 0;
+}
+
+std::string AOFManager::encode(const std::vector<std::string>& args) {
+    std::string out = "*" + std::to_string(args.size()) + "\r\n";
+    for(const std::string& arg : args) {
+        out += "$" + std::to_string(arg.size()) + "\r\n";
+        out += arg;
+        out += "\r\n";
+    }
+    return out;
+}
+
+// where the reply starting at 'pos' ends
+static size_t skip_reply(const std::string& reply, size_t pos) {
+    char type = reply[pos];
+    size_t line_end = reply.find("\r\n", pos);
+    long long n = std::atoll(reply.c_str() + pos + 1);
+
+    switch(type) {
+        case '$': case '=': case '!':
+            return n < 0 ? line_end + 2 : line_end + 2 + n + 2;
+        case '*': case '~': case '>': case '%':
+            pos = line_end + 2;
+            if(type == '%') n *= 2;
+            for(long long i = 0; i < n; i++) pos = skip_reply(reply, pos);
+            return pos;
+        default:
+            return line_end + 2;
+    }
+}
+
+// the elements of an array reply, each a reply of its own (the results of EXEC)
+static std::vector<std::string> split_array_reply(const std::string& reply) {
+    std::vector<std::string> elements;
+    long long n = std::atoll(reply.c_str() + 1);
+    size_t pos = reply.find("\r\n") + 2;
+    for(long long i = 0; i < n; i++) {
+        size_t next = skip_reply(reply, pos);
+        elements.push_back(reply.substr(pos, next - pos));
+        pos = next;
+    }
+    return elements;
+}
+
+std::unique_lock<std::mutex> AOFManager::order(Command* cmd, const std::vector<std::string>& args) {
+    if(!enabled() || !cmd->isWriteCommand() || cmd->mayBlock(args)) return {};
+    return std::unique_lock<std::mutex>(order_mtx);
+}
+
+uint64_t AOFManager::append(const std::string& commands) {
+    std::lock_guard<std::mutex> lock(mtx);
+    buffer += commands;
+    appended += commands.size();
+    wake_writer.notify_one();
+    return appended;
+}
+
+void AOFManager::log(Command* cmd, const std::vector<std::string>& args, const std::string& reply, const std::vector<QueuedCommand>& queued,
+                     std::unique_lock<std::mutex>& order) {
+    std::string commands;
+    if(enabled() && cmd->isWriteCommand() && !reply.empty() && reply[0] != '-') {
+        if(cmd->name() == "EXEC") {
+            // the writes of the transaction between MULTI and EXEC, so a replay applies them together too
+            if(reply[0] == '*' && reply != "*-1\r\n") {
+                std::vector<std::string> results = split_array_reply(reply);
+                std::string body;
+                for(size_t i = 0; i < queued.size() && i < results.size(); i++) {
+                    if(!queued[i].cmd->isWriteCommand() || results[i][0] == '-') continue;
+                    std::vector<std::string> logged = queued[i].cmd->rewriteForAof(queued[i].args, results[i]);
+                    if(!logged.empty()) body += encode(logged);
+                }
+                if(!body.empty()) commands = encode({"MULTI"}) + body + encode({"EXEC"});
+            }
+        } else if(cmd->name() != "MULTI" && cmd->name() != "DISCARD") {
+            std::vector<std::string> logged = cmd->rewriteForAof(args, reply);
+            if(!logged.empty()) commands = encode(logged);
+        }
+    }
+
+    if(commands.empty()) {
+        if(order.owns_lock()) order.unlock();
+        return;
+    }
+
+    if(!order.owns_lock()) order = std::unique_lock<std::mutex>(order_mtx);
+    uint64_t offset = append(commands);
+    order.unlock();
+
+    if(policy == Fsync::ALWAYS) {
+        std::unique_lock<std::mutex> lock(mtx);
+        synced_cv.wait(lock, [&] { return synced >= offset; });
+    }
+}
+
+void AOFManager::writer(std::stop_token stop) {
+    std::string out; // swapped with 'buffer', so appends go on while it is written
+    auto last_fsync = std::chrono::steady_clock::now();
+
+    std::unique_lock<std::mutex> lock(mtx);
+    while(true) {
+        // at least once a second, everysec fsyncs what an earlier round wrote
+        wake_writer.wait_for(lock, stop, std::chrono::seconds(1), [this] { return !buffer.empty(); });
+        bool stopping = stop.stop_requested();
+
+        out.swap(buffer);
+        uint64_t target = appended;
+        bool due = std::chrono::steady_clock::now() - last_fsync >= std::chrono::seconds(1);
+        bool sync = target > synced && (policy == Fsync::ALWAYS || stopping || (policy == Fsync::EVERYSEC && due));
+        lock.unlock();
+
+        size_t done = 0;
+        while(done < out.size()) {
+            ssize_t n = write(fd, out.data() + done, out.size() - done);
+            if(n < 0 && errno == EINTR) continue;
+            if(n <= 0) break;
+            done += n;
+        }
+        bool ok = done == out.size();
+        if(ok && sync) {
+            ok = fdatasync(fd) == 0;
+            last_fsync = std::chrono::steady_clock::now();
+        }
+
+        lock.lock();
+        file_size += done;
+        if(!ok) {
+            // what didn't make it goes back in front of what was appended meanwhile
+            buffer.insert(0, out, done, std::string::npos);
+        }
+        out.clear();
+        if(ok && sync) {
+            synced = target;
+            fsyncs++;
+            synced_cv.notify_all();
+        }
+        last_write_ok = ok;
+
+        if(!ok) {
+            std::cerr << "Error writing to the AOF " << path() << ": " << strerror(errno) << std::endl;
+            if(policy == Fsync::ALWAYS) {
+                // clients were promised their writes are on disk before they get a reply, we can't keep that
+                std::exit(1);
+            }
+            if(!stopping) {
+                wake_writer.wait_for(lock, stop, std::chrono::seconds(WRITE_RETRY_DELAY), [] { return false; });
+                continue;
+            }
+        }
+        if(stopping) break;
+    }
+}
+
+void AOFManager::seed(KeyValueDatabase& db) {
+    std::string temp_path = path() + ".tmp";
+    int temp_fd = open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(temp_fd < 0) throw std::runtime_error("can't create " + temp_path);
+
+    RDBWriter out(temp_fd, config->rdb_compression, config->rdb_checksum);
+    db.SNAPSHOT(out, true);
+    bool ok = out.finish() && fsync(temp_fd) == 0;
+    ok = close(temp_fd) == 0 && ok;
+    if(!ok || rename(temp_path.c_str(), path().c_str()) != 0) {
+        unlink(temp_path.c_str());
+        throw std::runtime_error("can't write " + path());
+    }
+}
+
+void AOFManager::start(KeyValueDatabase& db) {
+    if(!enabled()) return;
+    if(!exists()) seed(db);
+
+    fd = open(path().c_str(), O_WRONLY | O_APPEND);
+    struct stat st;
+    if(fd < 0 || fstat(fd, &st) != 0) throw std::runtime_error("can't open " + path());
+    file_size = st.st_size;
+    writer_thread = std::jthread([this](std::stop_token stop) { writer(stop); });
+}
+
+// the command at 'p' as its arguments, moving 'p' past it. False when the file ends inside it
+static bool parse_command(const char*& p, const char* end, std::vector<std::string>& args) {
+    auto read_number = [&](char prefix, long long& n) {
+        if(p == end) return false;
+        if(*p != prefix) throw std::runtime_error(std::string("expected '") + prefix + "'");
+        const char* nl = static_cast<const char*>(memchr(p, '\n', end - p));
+        if(!nl) return false;
+        if(nl - p < 3 || nl[-1] != '\r') throw std::runtime_error("invalid length line");
+        n = 0;
+        for(const char* d = p + 1; d < nl - 1; d++) {
+            if(*d < '0' || *d > '9' || n > (1LL << 40)) throw std::runtime_error("invalid length");
+            n = n * 10 + (*d - '0');
+        }
+        p = nl + 1;
+        return true;
+    };
+
+    long long argc;
+    if(!read_number('*', argc)) return false;
+    if(argc < 1) throw std::runtime_error("empty command");
+
+    args.clear();
+    for(long long i = 0; i < argc; i++) {
+        long long len;
+        if(!read_number('$', len)) return false;
+        if(end - p < len + 2) return false;
+        if(p[len] != '\r' || p[len + 1] != '\n') throw std::runtime_error("bulk string without its CRLF");
+        args.emplace_back(p, len);
+        p += len + 2;
+    }
+    return true;
+}
+
+void AOFManager::load(CommandRegistry& registry, KeyValueDatabase& db, ModuleManager* modules, const RDBParser::Progress& progress) {
+    std::string file = path();
+    int file_fd = open(file.c_str(), O_RDONLY);
+    struct stat st;
+    if(file_fd < 0 || fstat(file_fd, &st) != 0) {
+        if(file_fd >= 0) close(file_fd);
+        throw std::runtime_error("can't open the AOF");
+    }
+    size_t size = st.st_size;
+
+    // a file we created starts with the snapshot the commands apply to
+    char magic[5];
+    size_t offset = 0;
+    if(size >= 5 && pread(file_fd, magic, 5, 0) == 5 && memcmp(magic, "REDIS", 5) == 0) {
+        RDBParser::load(file, db, modules, progress, &offset);
+    }
+
+    void* mapping = size > offset ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file_fd, 0) : nullptr;
+    close(file_fd);
+    if(mapping == MAP_FAILED) throw std::runtime_error("can't map the AOF");
+    if(mapping) madvise(mapping, size, MADV_SEQUENTIAL);
+
+    const char* data = static_cast<const char*>(mapping);
+    const char* p = data + offset;
+    const char* end = data + size;
+    const char* truncate_at = nullptr;
+    const char* multi_start = nullptr; // the MULTI of a transaction whose EXEC isn't read yet
+    ClientContext context(-1);
+    std::vector<std::string> args;
+    size_t replayed = 0;
+
+    try {
+        while(p < end) {
+            const char* start = p;
+            bool complete;
+            try {
+                complete = parse_command(p, end, args);
+            } catch(const std::runtime_error& e) {
+                throw std::runtime_error("bad AOF format at offset " + std::to_string(start - data) + ": " + e.what());
+            }
+            if(!complete) {
+                truncate_at = start;
+                break;
+            }
+
+            Command* cmd = registry.getCommand(args[0]);
+            if(!cmd || args.size() < (size_t)cmd->min_args()) {
+                throw std::runtime_error("can't replay '" + args[0] + "' at offset " + std::to_string(start - data));
+            }
+
+            if(context.in_transaction && cmd->name() != "EXEC" && cmd->name() != "DISCARD") {
+                std::any bound;
+                std::string error = cmd->bind(args, bound);
+                if(!error.empty()) {
+                    throw std::runtime_error("can't replay '" + args[0] + "' at offset " + std::to_string(start - data));
+                }
+                context.commandQueue.push_back({cmd, std::move(args), std::move(bound)});
+                args = {};
+            } else {
+                if(cmd->name() == "MULTI") multi_start = start;
+                if(cmd->name() == "EXEC" || cmd->name() == "DISCARD") multi_start = nullptr;
+                cmd->execute(context, args, db, true);
+            }
+
+            replayed++;
+            if(progress && replayed % PROGRESS_INTERVAL == 0) progress(p - data, size);
+        }
+    } catch(...) {
+        if(mapping) munmap(mapping, size);
+        throw;
+    }
+
+    // a transaction is appended whole, without its EXEC it was cut off by the crash as well and never ran
+    if(multi_start) {
+        truncate_at = multi_start;
+        context.reset_transaction();
+    }
+    if(mapping) munmap(mapping, size);
+
+    if(truncate_at) {
+        size_t good = truncate_at - data;
+        std::cerr << "The AOF ends in the middle of a command, truncating it from " << size << " to " << good << " bytes" << std::endl;
+        if(truncate(file.c_str(), good) != 0) throw std::runtime_error("can't truncate the AOF");
+    }
+    if(progress) progress(size, size);
+    std::cout << "Finished reading the AOF, " << replayed << " commands replayed" << std::endl;
+}
+
+std::string AOFManager::info() {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::ostringstream oss;
+    oss << "aof_enabled:" << (enabled() ? 1 : 0) << "\r\n";
+    if(enabled()) {
+        oss << "aof_fsync:" << config->append_fsync << "\r\n";
+        oss << "aof_last_write_status:" << (last_write_ok ? "ok" : "err") << "\r\n";
+        oss << "aof_current_size:" << file_size << "\r\n";
+        oss << "aof_buffer_length:" << buffer.size() << "\r\n";
+        oss << "aof_fsyncs:" << fsyncs << "\r\n";
+    }
+    return oss.str();
+}
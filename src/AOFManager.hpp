@@ -0,0 +1,82 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <cstdint>
+#include "Config.hpp"
+#include "KVStore.hpp"
+#include "Command.hpp"
+#include "ClientContext.hpp"
+#include "CommandRegistry.hpp"
+#include "RDBParser.hpp"
+
+class ModuleManager;
+
+/* The append only file: every write that succeeded is appended as the RESP command that redoes it, and replayed at
+startup. Client threads only add to an in-memory buffer, a writer thread writes it out and fsyncs. Everything appended
+while an fsync is running goes out with the next write and fsync, so under load one fsync covers the commands of many
+clients (group commit):
+  always    the client gets its reply once the fsync covering its command is done
+  everysec  fsync at most once a second, a crash loses up to a second of writes
+  no        written, but left to the kernel to flush
+A new file starts with an RDB snapshot of the keyspace it applies to, so enabling the AOF on an existing dataset keeps it.
+Writes are logged in the order they changed the keyspace: a write holds order() while it runs and until it is appended,
+only commands that may block take it just for the append. */
+class AOFManager {
+public:
+    enum class Fsync { ALWAYS, EVERYSEC, NO };
+
+private:
+    std::shared_ptr<ServerConfig> config;
+    Fsync policy;
+    int fd = -1;
+
+    std::mutex order_mtx;
+
+    std::mutex mtx; // guards everything below
+    std::condition_variable_any wake_writer;
+    std::condition_variable synced_cv; // always mode clients waiting for their fsync
+    std::string buffer; // appended, not yet handed to write()
+    uint64_t appended = 0; // bytes ever appended, the offsets in the log that appends and waits refer to
+    uint64_t synced = 0;
+    size_t file_size = 0;
+    long long fsyncs = 0;
+    bool last_write_ok = true;
+
+    std::jthread writer_thread; // declared last so it stops before the members it uses are destroyed
+
+    void writer(std::stop_token stop);
+    uint64_t append(const std::string& commands); // offset after them
+    void seed(KeyValueDatabase& db); // writes a new file holding a snapshot of 'db'
+
+public:
+    AOFManager(std::shared_ptr<ServerConfig> config_);
+    ~AOFManager();
+
+    bool enabled() const { return config->append_only; }
+    std::string path() const;
+    bool exists() const;
+
+    /* Replays the file into 'db' through the commands of 'registry'. A command cut off at the end (a crash in the middle
+    of a write) is dropped and the file truncated before it, anything else that can't be replayed throws
+    std::runtime_error. */
+    void load(CommandRegistry& registry, KeyValueDatabase& db, ModuleManager* modules, const RDBParser::Progress& progress);
+
+    // once loading is done: creates the file if there is none and starts the writer
+    void start(KeyValueDatabase& db);
+
+    // held while a write runs and is logged, see above. Not locked when the AOF is off
+    std::unique_lock<std::mutex> order(Command* cmd, const std::vector<std::string>& args);
+
+    /* Logs what 'cmd' did given its reply, 'queued' are the commands an EXEC ran. Releases 'order' once appended, then
+    with appendfsync always waits until the fsync covers it. */
+    void log(Command* cmd, const std::vector<std::string>& args, const std::string& reply, const std::vector<QueuedCommand>& queued,
+             std::unique_lock<std::mutex>& order);
+
+    std::string info(); // the aof_ lines of INFO persistence
+
+    static std::string encode(const std::vector<std::string>& args); // as a RESP array of bulk strings
+};
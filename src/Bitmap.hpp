@@ -0,0 +1,163 @@
+#pragma once
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include "SimdHelper.hpp"
+
+// Bitmaps are plain string values, bit 0 is the most significant bit of the first byte as in Redis
+
+// strings are limited to 512MB, so bit offsets to 2^32 - 1
+constexpr uint64_t BITMAP_MAX_OFFSET = (1ULL << 32) - 1;
+
+enum class BitfieldOverflow {WRAP, SAT, FAIL};
+
+struct BitfieldOp {
+    enum Kind {GET, SET, INCRBY} kind;
+    bool is_signed;
+    int bits;
+    uint64_t offset;
+    long long value; // SET value or INCRBY increment
+    BitfieldOverflow overflow;
+};
+
+// clamp a [start, end] range with negative indexes counted from the end, false if it is empty
+inline bool bitmap_normalize_range(long long& start, long long& end, long long total) {
+    if(start < 0) start = total + start;
+    if(end < 0) end = total + end;
+    if(start < 0) start = 0;
+    if(end < 0) end = 0;
+    if(end >= total) end = total - 1;
+    return total > 0 && start <= end;
+}
+
+// number of set bits in [start, end], in bits when 'bit_unit' else in bytes, both ends inclusive and already normalized
+inline uint64_t bitmap_count(const std::string& bitmap, long long start, long long end, bool bit_unit) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(bitmap.data());
+    if(!bit_unit) {
+        return simd::popcount(p + start, end - start + 1);
+    }
+
+    long long first_byte = start >> 3, last_byte = end >> 3;
+    uint64_t count = simd::popcount(p + first_byte, last_byte - first_byte + 1);
+    // drop the bits of the edge bytes that lie outside the range
+    if(start & 7) count -= __builtin_popcount(p[first_byte] >> (8 - (start & 7)));
+    if((end & 7) != 7) count -= __builtin_popcount(p[last_byte] & ((1 << (7 - (end & 7))) - 1));
+    return count;
+}
+
+/* First bit set to 'bit' in the bytes [first_byte, last_byte], ignoring the bits before 'start_bit' and after 'end_bit'.
+Whole 8-byte words of 0x00 (looking for a 1) or 0xFF (looking for a 0) are skipped at once. Returns -1 if there is none. */
+inline long long bitmap_find(const std::string& bitmap, int bit, long long start_bit, long long end_bit) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(bitmap.data());
+    long long first_byte = start_bit >> 3, last_byte = end_bit >> 3;
+    uint8_t skip = bit ? 0x00 : 0xFF;
+    uint64_t skip_word = bit ? 0 : UINT64_MAX;
+
+    auto byte_at = [&](long long i) {
+        uint8_t b = p[i];
+        // bits outside the range are forced to the value we are not looking for
+        if(i == first_byte && (start_bit & 7)) {
+            uint8_t outside = (uint8_t)(0xFF << (8 - (start_bit & 7)));
+            b = bit ? (b & ~outside) : (b | outside);
+        }
+        if(i == last_byte && (end_bit & 7) != 7) {
+            uint8_t outside = (uint8_t)((1 << (7 - (end_bit & 7))) - 1);
+            b = bit ? (b & ~outside) : (b | outside);
+        }
+        return b;
+    };
+
+    long long i = first_byte;
+    while(i <= last_byte) {
+        if(i != first_byte && i + 8 <= last_byte) {
+            uint64_t word;
+            std::memcpy(&word, p + i, 8);
+            if(word == skip_word) {
+                i += 8;
+                continue;
+            }
+        }
+        uint8_t b = byte_at(i);
+        if(b != skip) {
+            uint8_t target = bit ? b : (uint8_t)~b;
+            return i * 8 + __builtin_clz((unsigned)target) - 24;
+        }
+        i++;
+    }
+    return -1;
+}
+
+inline uint64_t bitfield_get_unsigned(const std::string& bitmap, uint64_t offset, int bits) {
+    uint64_t value = 0;
+    for(int i = 0; i < bits; i++, offset++) {
+        uint64_t byte = offset >> 3;
+        int bitval = byte < bitmap.size() ? (((uint8_t)bitmap[byte] >> (7 - (offset & 7))) & 1) : 0;
+        value = (value << 1) | bitval;
+    }
+    return value;
+}
+
+inline long long bitfield_get_signed(const std::string& bitmap, uint64_t offset, int bits) {
+    uint64_t value = bitfield_get_unsigned(bitmap, offset, bits);
+    // sign extension
+    if(bits < 64 && (value & (1ULL << (bits - 1)))) value |= ~0ULL << bits;
+    return (long long)value;
+}
+
+// the bitmap must already cover offset + bits
+inline void bitfield_set(std::string& bitmap, uint64_t offset, int bits, uint64_t value) {
+    for(int i = 0; i < bits; i++, offset++) {
+        uint64_t byte = offset >> 3;
+        uint8_t mask = 1 << (7 - (offset & 7));
+        if((value >> (bits - 1 - i)) & 1) {
+            bitmap[byte] = (char)((uint8_t)bitmap[byte] | mask);
+        } else {
+            bitmap[byte] = (char)((uint8_t)bitmap[byte] & ~mask);
+        }
+    }
+}
+
+/* value + incr in a field of 'bits' bits, as Redis' check(Un)signedBitfieldOverflow: returns false on overflow with
+FAIL, otherwise writes the wrapped or saturated result to 'result' */
+inline bool bitfield_add(long long value, long long incr, int bits, bool is_signed, BitfieldOverflow overflow, long long& result) {
+    if(is_signed) {
+        long long max = bits == 64 ? INT64_MAX : (1LL << (bits - 1)) - 1;
+        long long min = -max - 1;
+        // SET passes the new value with incr 0, so the value itself may be out of range
+        bool over = value > max || (incr > 0 && value > max - incr);
+        bool under = value < min || (incr < 0 && value < min - incr);
+        if(!over && !under) {
+            result = value + incr;
+            return true;
+        }
+        if(overflow == BitfieldOverflow::FAIL) return false;
+        if(overflow == BitfieldOverflow::SAT) {
+            result = over ? max : min;
+            return true;
+        }
+        uint64_t wrapped = (uint64_t)value + (uint64_t)incr;
+        if(bits < 64) {
+            uint64_t mask = ~0ULL << bits;
+            if(wrapped & (1ULL << (bits - 1))) wrapped |= mask;
+            else wrapped &= ~mask;
+        }
+        result = (long long)wrapped;
+        return true;
+    }
+
+    // unsigned fields are at most 63 bits, so the arithmetic fits in a signed 64-bit value
+    long long max = (1LL << bits) - 1;
+    bool over = value < 0 || value > max || (incr > 0 && value > max - incr);
+    bool under = !over && incr < 0 && value + incr < 0;
+    if(!over && !under) {
+        result = value + incr;
+        return true;
+    }
+    if(overflow == BitfieldOverflow::FAIL) return false;
+    if(overflow == BitfieldOverflow::SAT) {
+        result = over ? max : 0;
+        return true;
+    }
+    result = (long long)(((uint64_t)value + (uint64_t)incr) & (uint64_t)max);
+    return true;
+}
@@ -0,0 +1,368 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <optional>
+#include <algorithm>
+#include "Command.hpp"
+#include "KVStore.hpp"
+#include "ClientContext.hpp"
+#include "Bitmap.hpp"
+
+// bit offset argument of SETBIT/GETBIT, false if it is not an integer in [0, 2^32)
+inline bool parseBitOffset(const std::string& arg, uint64_t& offset) {
+    long long value;
+    if(!Listpack::stringToInt(arg, value) || value < 0 || (uint64_t)value > BITMAP_MAX_OFFSET) {
+        return false;
+    }
+    offset = value;
+    return true;
+}
+
+// the optional trailing BYTE | BIT argument of BITCOUNT and BITPOS
+inline bool parseBitUnit(const std::string& arg, bool& bit_unit) {
+    std::string unit = arg;
+    std::transform(unit.begin(), unit.end(), unit.begin(), ::toupper);
+    if(unit == "BIT") bit_unit = true;
+    else if(unit == "BYTE") bit_unit = false;
+    else return false;
+    return true;
+}
+
+class SetBitCommand : public Command {
+public:
+    std::string name() const override { return "SETBIT"; }
+    int min_args() const override { return 4; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
+    bool isWriteCommand() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override {
+        //args: SETBIT key offset value, bound to the offset
+        uint64_t offset;
+        if(!parseBitOffset(args[2], offset)) {
+            return "-ERR bit offset is not an integer or out of range\r\n";
+        }
+        if(args[3] != "0" && args[3] != "1") {
+            return "-ERR bit is not an integer or out of range\r\n";
+        }
+        bound = offset;
+        return "";
+    }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        return bindAndExecute(context, args, db, acquire_lock);
+    }
+
+    std::string execute_bound(ClientContext& context, const std::vector<std::string> &args, const std::any& bound, KeyValueDatabase &db, bool acquire_lock) override {
+        std::string key = args[1];
+        uint64_t offset = std::any_cast<uint64_t>(bound);
+
+        try {
+            return ":" + std::to_string(db.SETBIT(key, offset, args[3] == "1", acquire_lock)) + "\r\n";
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+    }
+};
+
+class GetBitCommand : public Command {
+public:
+    std::string name() const override { return "GETBIT"; }
+    int min_args() const override { return 3; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
+    bool isWriteCommand() const override { return false; }
+    bool isReadOnly() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override {
+        uint64_t offset;
+        if(!parseBitOffset(args[2], offset)) {
+            return "-ERR bit offset is not an integer or out of range\r\n";
+        }
+        bound = offset;
+        return "";
+    }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        return bindAndExecute(context, args, db, acquire_lock);
+    }
+
+    std::string execute_bound(ClientContext& context, const std::vector<std::string> &args, const std::any& bound, KeyValueDatabase &db, bool acquire_lock) override {
+        std::string key = args[1];
+        uint64_t offset = std::any_cast<uint64_t>(bound);
+
+        try {
+            return ":" + std::to_string(db.GETBIT(key, offset, acquire_lock)) + "\r\n";
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+    }
+};
+
+// the optional range of BITCOUNT and BITPOS, as bound when the command is queued
+struct BitRange {
+    int bit = 0; // BITPOS only
+    long long start = 0;
+    long long end = -1;
+    bool has_start = false;
+    bool has_end = false;
+    bool bit_unit = false;
+};
+
+class BitCountCommand : public Command {
+public:
+    std::string name() const override { return "BITCOUNT"; }
+    int min_args() const override { return 2; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
+    bool isWriteCommand() const override { return false; }
+    bool isReadOnly() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override {
+        //args: BITCOUNT key [start end [BYTE | BIT]]
+        BitRange range;
+        range.has_start = range.has_end = args.size() > 2;
+
+        if(range.has_start) {
+            if(args.size() != 4 && args.size() != 5) {
+                return "-ERR syntax error\r\n";
+            }
+            if(!Listpack::stringToInt(args[2], range.start) || !Listpack::stringToInt(args[3], range.end)) {
+                return "-ERR value is not an integer or out of range\r\n";
+            }
+            if(args.size() == 5 && !parseBitUnit(args[4], range.bit_unit)) {
+                return "-ERR syntax error\r\n";
+            }
+        }
+
+        bound = range;
+        return "";
+    }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        return bindAndExecute(context, args, db, acquire_lock);
+    }
+
+    std::string execute_bound(ClientContext& context, const std::vector<std::string> &args, const std::any& bound, KeyValueDatabase &db, bool acquire_lock) override {
+        std::string key = args[1];
+        const BitRange& range = std::any_cast<const BitRange&>(bound);
+
+        try {
+            return ":" + std::to_string(db.BITCOUNT(key, range.start, range.end, range.has_start, range.bit_unit, acquire_lock)) + "\r\n";
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+    }
+};
+
+class BitPosCommand : public Command {
+public:
+    std::string name() const override { return "BITPOS"; }
+    int min_args() const override { return 3; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
+    bool isWriteCommand() const override { return false; }
+    bool isReadOnly() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override {
+        //args: BITPOS key bit [start [end [BYTE | BIT]]]
+        if(args[2] != "0" && args[2] != "1") {
+            return "-ERR The bit argument must be 1 or 0.\r\n";
+        }
+        if(args.size() > 6) {
+            return "-ERR syntax error\r\n";
+        }
+
+        BitRange range;
+        range.bit = args[2] == "1";
+        range.has_start = args.size() > 3;
+        range.has_end = args.size() > 4;
+
+        if((range.has_start && !Listpack::stringToInt(args[3], range.start)) || (range.has_end && !Listpack::stringToInt(args[4], range.end))) {
+            return "-ERR value is not an integer or out of range\r\n";
+        }
+        if(args.size() == 6 && !parseBitUnit(args[5], range.bit_unit)) {
+            return "-ERR syntax error\r\n";
+        }
+
+        bound = range;
+        return "";
+    }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        return bindAndExecute(context, args, db, acquire_lock);
+    }
+
+    std::string execute_bound(ClientContext& context, const std::vector<std::string> &args, const std::any& bound, KeyValueDatabase &db, bool acquire_lock) override {
+        std::string key = args[1];
+        const BitRange& range = std::any_cast<const BitRange&>(bound);
+
+        try {
+            return ":" + std::to_string(db.BITPOS(key, range.bit, range.start, range.end, range.has_start, range.has_end, range.bit_unit, acquire_lock)) + "\r\n";
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+    }
+};
+
+class BitOpCommand : public Command {
+public:
+    std::string name() const override { return "BITOP"; }
+    int min_args() const override { return 4; }
+    KeySpec keySpec() const override { return {2, -1, 1}; }
+    bool isWriteCommand() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override {
+        //args: BITOP AND | OR | XOR | NOT destkey key...
+        std::string operation = args[1];
+        std::transform(operation.begin(), operation.end(), operation.begin(), ::toupper);
+
+        simd::BitOp op;
+        if(operation == "AND") op = simd::BitOp::AND;
+        else if(operation == "OR") op = simd::BitOp::OR;
+        else if(operation == "XOR") op = simd::BitOp::XOR;
+        else if(operation == "NOT") op = simd::BitOp::NOT;
+        else return "-ERR syntax error\r\n";
+
+        if(op == simd::BitOp::NOT && args.size() != 4) {
+            return "-ERR BITOP NOT must be called with a single source key.\r\n";
+        }
+
+        bound = op;
+        return "";
+    }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        return bindAndExecute(context, args, db, acquire_lock);
+    }
+
+    std::string execute_bound(ClientContext& context, const std::vector<std::string> &args, const std::any& bound, KeyValueDatabase &db, bool acquire_lock) override {
+        simd::BitOp op = std::any_cast<simd::BitOp>(bound);
+        std::string dest_key = args[2];
+        std::vector<std::string> keys(args.begin() + 3, args.end());
+
+        try {
+            return ":" + std::to_string(db.BITOP(op, dest_key, keys, acquire_lock)) + "\r\n";
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+    }
+};
+
+// BITFIELD key [GET type offset] [SET type offset value] [INCRBY type offset increment] [OVERFLOW WRAP|SAT|FAIL] ...
+// BITFIELD_RO only accepts GET
+class BitFieldCommand : public Command {
+private:
+    bool read_only;
+
+    static bool parseType(const std::string& arg, bool& is_signed, int& bits) {
+        if(arg.size() < 2 || (arg[0] != 'i' && arg[0] != 'I' && arg[0] != 'u' && arg[0] != 'U')) return false;
+        long long value;
+        if(!Listpack::stringToInt(arg.substr(1), value)) return false;
+        is_signed = arg[0] == 'i' || arg[0] == 'I';
+        bits = value;
+        return bits >= 1 && ((is_signed && bits <= 64) || (!is_signed && bits <= 63));
+    }
+
+    // "#n" addresses the n-th field of the type's width
+    static bool parseOffset(const std::string& arg, int bits, uint64_t& offset) {
+        bool multiply = !arg.empty() && arg[0] == '#';
+        long long value;
+        if(!Listpack::stringToInt(multiply ? arg.substr(1) : arg, value) || value < 0) return false;
+        if(multiply) {
+            if((uint64_t)value > BITMAP_MAX_OFFSET / bits) return false;
+            value *= bits;
+        }
+        if((uint64_t)value + bits - 1 > BITMAP_MAX_OFFSET) return false;
+        offset = value;
+        return true;
+    }
+
+public:
+    BitFieldCommand(bool read_only) : read_only(read_only) {}
+
+    std::string name() const override { return read_only ? "BITFIELD_RO" : "BITFIELD"; }
+    int min_args() const override { return 2; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
+    bool isWriteCommand() const override { return !read_only; }
+    bool isReadOnly() const override { return read_only; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override {
+        std::vector<BitfieldOp> ops;
+        BitfieldOverflow overflow = BitfieldOverflow::WRAP;
+
+        for(size_t i = 2; i < args.size(); i++) {
+            std::string sub = args[i];
+            std::transform(sub.begin(), sub.end(), sub.begin(), ::toupper);
+
+            if(sub == "OVERFLOW" && !read_only && i + 1 < args.size()) {
+                std::string type = args[++i];
+                std::transform(type.begin(), type.end(), type.begin(), ::toupper);
+                if(type == "WRAP") overflow = BitfieldOverflow::WRAP;
+                else if(type == "SAT") overflow = BitfieldOverflow::SAT;
+                else if(type == "FAIL") overflow = BitfieldOverflow::FAIL;
+                else return "-ERR Invalid OVERFLOW type specified\r\n";
+                continue;
+            }
+
+            BitfieldOp op;
+            if(sub == "GET" && i + 2 < args.size()) {
+                op.kind = BitfieldOp::GET;
+            } else if((sub == "SET" || sub == "INCRBY") && i + 3 < args.size()) {
+                if(read_only) {
+                    return "-ERR BITFIELD_RO only supports the GET subcommand\r\n";
+                }
+                op.kind = sub == "SET" ? BitfieldOp::SET : BitfieldOp::INCRBY;
+            } else {
+                return "-ERR syntax error\r\n";
+            }
+
+            if(!parseType(args[i + 1], op.is_signed, op.bits)) {
+                return "-ERR Invalid bitfield type. Use something like i16 u8. Note that u64 is not supported but i64 is.\r\n";
+            }
+            if(!parseOffset(args[i + 2], op.bits, op.offset)) {
+                return "-ERR bit offset is not an integer or out of range\r\n";
+            }
+            op.value = 0;
+            if(op.kind != BitfieldOp::GET && !Listpack::stringToInt(args[i + 3], op.value)) {
+                return "-ERR value is not an integer or out of range\r\n";
+            }
+            op.overflow = overflow;
+
+            ops.push_back(op);
+            i += op.kind == BitfieldOp::GET ? 2 : 3;
+        }
+
+        bound = std::move(ops);
+        return "";
+    }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        return bindAndExecute(context, args, db, acquire_lock);
+    }
+
+    std::string execute_bound(ClientContext& context, const std::vector<std::string> &args, const std::any& bound, KeyValueDatabase &db, bool acquire_lock) override {
+        std::string key = args[1];
+        std::vector<BitfieldOp> ops = std::any_cast<const std::vector<BitfieldOp>&>(bound);
+
+        try {
+            std::vector<std::optional<long long> > results = db.BITFIELD(key, ops, acquire_lock);
+
+            std::string response = "*" + std::to_string(results.size()) + "\r\n";
+            for(auto& result : results) {
+                response += result.has_value() ? ":" + std::to_string(*result) + "\r\n" : "$-1\r\n";
+            }
+            return response;
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+    }
+};
@@ -1,38 +1,64 @@
 #pragma once
 #include <mutex>
+#include <string>
+#include <unordered_set>
+#include <memory>
+#include <list>
+#include <vector>
+#include <any>
 #include "Command.hpp"
+#include "ClientOutput.hpp"
 #include "CommandRegistry.hpp"
 
 
 struct QueuedCommand {
     Command* cmd;
     std::vector<std::string> args;
+    std::any bound; // cmd->bind(args) done at queue time
+};
+
+// keys a client WATCHes, registered in the db's watched-keys index until EXEC, DISCARD, UNWATCH or disconnect
+struct WatchState {
+    bool dirty = false; // a watched key was written since WATCH, guarded by the db's watch mutex
+    std::vector<std::pair<std::string, std::list<WatchState*>::iterator> > nodes; // position in each key's list of watchers
 };
 
 class ClientContext {
 public:
     int client_fd;
     int replica_index;
-    int num_channel;
     bool in_subscribe_mode;
     bool is_replica;
     bool in_transaction;
     bool transaction_failed;
     std::string authenticated_user;
-    std::mutex client_mtx;
+    std::shared_ptr<ClientOutput> output; // all writes to client_fd, shared with the pub/sub channels it is subscribed to
     std::vector<QueuedCommand> commandQueue;
+    std::unordered_set<std::string> channels; // SUBSCRIBE channels of this client
+    std::unordered_set<std::string> patterns; // PSUBSCRIBE patterns of this client
+    std::unordered_set<std::string> shard_channels; // SSUBSCRIBE channels of this client
+    WatchState watch;
 
-    ClientContext(int fd) : client_fd(fd) {
+    ClientContext(int fd) : client_fd(fd), output(std::make_shared<ClientOutput>(fd)) {
         in_transaction = false;
         transaction_failed = false;
         is_replica = false;
         in_subscribe_mode = false;
-        num_channel = 0;
         authenticated_user = "";
     }
 
+    // channels + patterns, the count the (P)SUBSCRIBE replies report
+    int num_subscriptions() const {
+        return (int)(channels.size() + patterns.size());
+    }
+
+    bool has_subscriptions() const {
+        return !channels.empty() || !patterns.empty() || !shard_channels.empty();
+    }
+
     void reset_transaction() {
         in_transaction = false;
+        transaction_failed = false;
         commandQueue.clear();
     }
 };
\ No newline at end of file
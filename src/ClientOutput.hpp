@@ -0,0 +1,158 @@
+#pragma once
+#include <sys/socket.h>
+#include <string>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <iostream>
+#include <condition_variable>
+
+/* Everything written to a client socket goes through its ClientOutput.
+Normal clients get their replies sent directly by their own thread. Once a client subscribes, a writer thread is started
+and all output is queued instead: publishers only enqueue a shared, already formatted message and never block on a slow
+subscriber's socket. The queue is bounded like Redis' client-output-buffer-limit for pubsub clients: past the hard limit,
+or above the soft limit for longer than soft_seconds, the subscriber is disconnected. */
+class ClientOutput {
+private:
+    int fd;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::deque<std::shared_ptr<const std::string> > queue;
+    size_t queued_bytes = 0; // queued or being written, counted against the limits
+    bool async = false; // a writer thread owns the socket
+    bool closing = false;
+    std::thread writer;
+
+    size_t hard_limit = 0; // 0 disables the limit
+    size_t soft_limit = 0;
+    long long soft_seconds = 0;
+    long long soft_since = -1; // when the queue went above the soft limit
+
+    static long long now_seconds() {
+        return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static bool send_all(int fd, const std::string& data) {
+        size_t sent = 0;
+        while (sent < data.size()) {
+            ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) return false;
+            sent += n;
+        }
+        return true;
+    }
+
+    // caller holds mtx
+    void disconnect(const char* reason) {
+        if (closing) return;
+        std::cout << "Closing client " << fd << ": " << reason << std::endl;
+        closing = true;
+        queue.clear();
+        // wakes the client's thread out of recv(), which then tears the connection down
+        shutdown(fd, SHUT_RDWR);
+        cv.notify_all();
+    }
+
+    // caller holds mtx
+    bool over_limits(size_t incoming) {
+        size_t total = queued_bytes + incoming;
+        if (hard_limit && total > hard_limit) {
+            disconnect("output buffer over the hard limit");
+            return true;
+        }
+        if (soft_limit && total > soft_limit) {
+            long long now = now_seconds();
+            if (soft_since == -1) {
+                soft_since = now;
+            } else if (now - soft_since >= soft_seconds) {
+                disconnect("output buffer over the soft limit for too long");
+                return true;
+            }
+        } else {
+            soft_since = -1;
+        }
+        return false;
+    }
+
+    void write_loop() {
+        std::unique_lock<std::mutex> lock(mtx);
+        while (true) {
+            cv.wait(lock, [this] { return closing || !queue.empty(); });
+            if (closing) return;
+
+            std::deque<std::shared_ptr<const std::string> > batch;
+            batch.swap(queue);
+            lock.unlock();
+
+            size_t written = 0;
+            bool ok = true;
+            for (const auto& message : batch) {
+                if (!(ok = send_all(fd, *message))) break;
+                written += message->size();
+            }
+
+            lock.lock();
+            if (!ok) {
+                disconnect("write error");
+                return;
+            }
+            queued_bytes -= written;
+        }
+    }
+
+public:
+    ClientOutput(int fd_) : fd(fd_) {}
+
+    ~ClientOutput() { stop(); }
+
+    // switch to queued output, the limits only apply from now on
+    void start_writer(size_t hard, size_t soft, long long seconds) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (async || closing) return;
+        hard_limit = hard;
+        soft_limit = soft;
+        soft_seconds = seconds;
+        async = true;
+        writer = std::thread(&ClientOutput::write_loop, this);
+    }
+
+    // a reply of the client's own command
+    void reply(const std::string& data) {
+        std::unique_lock<std::mutex> lock(mtx);
+        if (closing) return;
+        if (!async) {
+            send_all(fd, data);
+            return;
+        }
+        if (over_limits(data.size())) return;
+        queued_bytes += data.size();
+        queue.push_back(std::make_shared<const std::string>(data));
+        cv.notify_one();
+    }
+
+    // a message shared between all its recipients, false if the client is gone or was just dropped for its limits
+    bool push(const std::shared_ptr<const std::string>& message) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (closing) return false;
+        if (!async) {
+            return send_all(fd, *message);
+        }
+        if (over_limits(message->size())) return false;
+        queued_bytes += message->size();
+        queue.push_back(message);
+        cv.notify_one();
+        return true;
+    }
+
+    // stops the writer thread, must be called before the socket is closed so it never writes to a reused fd
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            closing = true;
+            cv.notify_all();
+        }
+        if (writer.joinable()) writer.join();
+    }
+};
@@ -1,10 +1,23 @@
 #pragma once
 #include <string>
 #include<vector>
+#include <algorithm>
+#include <cstdlib>
+#include <any>
+#include "RESPParser.hpp"
 
 class ClientContext;
 class KeyValueDatabase;
 
+// Where the key names are in a command's arguments, like first/last/step in the Redis command table.
+// A negative 'last' counts from the end (-1 is the last argument), first == 0 means the command takes no keys.
+struct KeySpec {
+    int first = 0;
+    int last = 0;
+    int step = 1;
+    bool whole_keyspace = false; // no key arguments, but the command reads the whole keyspace (KEYS, SCAN)
+};
+
 class Command {
 public:
     virtual ~Command() = default;
@@ -21,4 +34,82 @@ public:
     virtual bool isWriteCommand() const { return false; }
     virtual bool isPubSubCommand() const { return false; }
     virtual bool sendToMaster() const { return false; }
-};
\ No newline at end of file
+
+    // 3. Keys, used by EXEC to plan its locking
+    // A command that declares nothing is assumed to touch the whole keyspace
+    virtual KeySpec keySpec() const { return {0, 0, 1, true}; }
+    virtual bool isReadOnly() const { return false; } // only reads the keyspace, so it can run under a shared db lock
+    // false for the keyless commands that still must not run on a half loaded dataset (SAVE, PSYNC, ...)
+    virtual bool allowedWhileLoading() const { return true; }
+
+    // the key names in 'args', commands with a numkeys argument or a STREAMS section override this
+    virtual std::vector<std::string> keys(const std::vector<std::string>& args) const {
+        KeySpec spec = keySpec();
+        std::vector<std::string> result;
+        if(spec.first <= 0 || spec.first >= (int)args.size()) return result;
+
+        int last = spec.last < 0 ? (int)args.size() + spec.last : std::min(spec.last, (int)args.size() - 1);
+        for(int i = spec.first; i <= last; i += spec.step) {
+            result.push_back(args[i]);
+        }
+        return result;
+    }
+
+    // while the RDB loads only commands that don't touch the keyspace run, the rest get -LOADING
+    bool canRunWhileLoading(const std::vector<std::string>& args) const {
+        return allowedWhileLoading() && !keySpec().whole_keyspace && keys(args).empty();
+    }
+
+    // 4. Argument binding, done once when a command is queued by MULTI so EXEC doesn't parse again
+    // Returns a RESP error for bad arguments (the transaction is then aborted with EXECABORT), or "" with the
+    // parsed arguments in 'bound'. Commands that don't override it parse in execute() as before.
+    virtual std::string bind(const std::vector<std::string>& args, std::any& bound) const { return ""; }
+
+    // runs the command with what bind() produced
+    virtual std::string execute_bound(ClientContext& context, const std::vector<std::string>& args, const std::any& bound, KeyValueDatabase& db, bool acquire_lock) {
+        return execute(context, args, db, acquire_lock);
+    }
+
+    // 5. The append only file
+    // true when execute() may wait for another client's write (BLPOP, ...), the AOF can't hold up other writers meanwhile
+    virtual bool mayBlock(const std::vector<std::string>& args) const { return false; }
+
+    // what the AOF records for a write that succeeded with 'reply'. Replaying it must do the same whenever it runs, so
+    // blocking, random and id generating commands turn into what they actually did. Empty when nothing changed
+    virtual std::vector<std::string> rewriteForAof(const std::vector<std::string>& args, const std::string& reply) const { return args; }
+
+protected:
+    // the strings of a bulk string or flat array reply
+    static std::vector<std::string> replyStrings(const std::string& reply) {
+        RESPParser parser(reply);
+        RESPValue value = parser.parse();
+        if(value.type != RESPType::ARRAY) return {value.value};
+        return parser.extractArgs(value);
+    }
+
+    // rewriteForAof of the commands replying how many things they changed (DEL, SREM, ...): a 0 changed nothing
+    static std::vector<std::string> argsUnlessZero(const std::vector<std::string>& args, const std::string& reply) {
+        if(reply == ":0\r\n") return {};
+        return args;
+    }
+
+    // execute() of the commands that override bind(): outside a transaction both steps run back to back
+    std::string bindAndExecute(ClientContext& context, const std::vector<std::string>& args, KeyValueDatabase& db, bool acquire_lock) {
+        std::any bound;
+        std::string error = bind(args, bound);
+        if(!error.empty()) return error;
+        return execute_bound(context, args, bound, db, acquire_lock);
+    }
+
+
+    // keys counted by the numkeys argument at 'numkeys_pos' (LMPOP, SINTERCARD, ...)
+    static std::vector<std::string> keysAfterNumkeys(const std::vector<std::string>& args, size_t numkeys_pos) {
+        std::vector<std::string> result;
+        if(numkeys_pos >= args.size()) return result;
+        long long numkeys = std::atoll(args[numkeys_pos].c_str());
+        for(size_t i = numkeys_pos + 1; i < args.size() && (long long)result.size() < numkeys; i++) {
+            result.push_back(args[i]);
+        }
+        return result;
+    }
+};
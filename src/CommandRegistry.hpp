@@ -11,6 +11,7 @@
 #include<algorithm>
 #include <string>
 #include <unordered_map>
+#include <memory>
 #include "Command.hpp"
 
 
@@ -18,6 +19,9 @@ class CommandRegistry {
 private:
     // lookup table, map<command_name, ptr to class which inherits from Command class>
     std::unordered_map<std::string, std::unique_ptr<Command>> command_map;
+    // MODULE LOAD registers commands while clients look them up. Commands are never removed, so the pointers
+    // getCommand hands out stay valid after the lock is released
+    mutable std::shared_mutex mtx;
 
 public:
     // Call this once in main() to load all commands
@@ -25,13 +29,23 @@ public:
         // Store command name in uppercase for case-insensitive lookup
         std::string name = cmd->name(); 
         std::transform(name.begin(), name.end(), name.begin(), ::toupper);
+        std::unique_lock<std::shared_mutex> lock(mtx);
         command_map[name] = std::move(cmd);
     }
 
+    // registers 'cmd' unless its name is taken, used for module commands so they can't replace built-in ones
+    bool tryRegisterCommand(std::unique_ptr<Command> cmd) {
+        std::string name = cmd->name();
+        std::transform(name.begin(), name.end(), name.begin(), ::toupper);
+        std::unique_lock<std::shared_mutex> lock(mtx);
+        return command_map.try_emplace(name, std::move(cmd)).second;
+    }
+
     // The new "process_command" logic
-    Command* getCommand(const std::string& commandName) {
+    Command* getCommand(const std::string& commandName) const {
         std::string key = commandName; 
         std::transform(key.begin(), key.end(), key.begin(), ::toupper);
+        std::shared_lock<std::shared_mutex> lock(mtx);
         auto it = command_map.find(key);
         if (it != command_map.end()) {
             return it->second.get();
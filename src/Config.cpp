@@ -2,6 +2,25 @@
 #include <stdexcept>
 #include <vector>
 #include <iostream>
+#include <sstream>
+#include <cctype>
+
+// "32mb" -> bytes, accepts the b/k/kb/m/mb/g/gb suffixes of redis.conf
+static size_t parse_memory(std::string value) {
+    for (auto& c : value) c = std::tolower(c);
+    size_t digits = 0;
+    while (digits < value.size() && std::isdigit((unsigned char)value[digits])) digits++;
+    size_t number = std::stoull(value.substr(0, digits));
+    std::string unit = value.substr(digits);
+    if (unit == "" || unit == "b") return number;
+    if (unit == "k") return number * 1000;
+    if (unit == "kb") return number * 1024;
+    if (unit == "m") return number * 1000 * 1000;
+    if (unit == "mb") return number * 1024 * 1024;
+    if (unit == "g") return number * 1000 * 1000 * 1000;
+    if (unit == "gb") return number * 1024 * 1024 * 1024;
+    throw std::invalid_argument("invalid memory unit: " + value);
+}
 
 std::shared_ptr<ServerConfig> parse_args(int argc, char** argv) {
     // just simply initialising a shared_ptr gives nullptr we need to use make_shared
@@ -23,6 +42,41 @@ std::shared_ptr<ServerConfig> parse_args(int argc, char** argv) {
             config->rdb_file_dir = args[++i];
         } else if(args[i] == "--dbfilename" && i + 1 < args.size()) {
             config->rdb_file_name = args[++i];
+        } else if(args[i] == "--keyindex" && i + 1 < args.size()) {
+            config->key_index = args[++i] == "yes";
+        } else if(args[i] == "--save" && i + 1 < args.size()) {
+            // "900 1 300 10", an empty string turns the automatic snapshots off
+            std::istringstream in(args[++i]);
+            long long seconds, changes;
+            config->save_params.clear();
+            while (in >> seconds >> changes) {
+                config->save_params.push_back({seconds, changes});
+            }
+        } else if(args[i] == "--rdbcompression" && i + 1 < args.size()) {
+            config->rdb_compression = args[++i] == "yes";
+        } else if(args[i] == "--rdbchecksum" && i + 1 < args.size()) {
+            config->rdb_checksum = args[++i] == "yes";
+        } else if(args[i] == "--appendonly" && i + 1 < args.size()) {
+            config->append_only = args[++i] == "yes";
+        } else if(args[i] == "--appendfilename" && i + 1 < args.size()) {
+            config->append_filename = args[++i];
+        } else if(args[i] == "--appendfsync" && i + 1 < args.size()) {
+            config->append_fsync = args[++i];
+            if (config->append_fsync != "always" && config->append_fsync != "everysec" && config->append_fsync != "no") {
+                throw std::invalid_argument("invalid appendfsync: " + config->append_fsync);
+            }
+        } else if(args[i] == "--loadmodule" && i + 1 < args.size()) {
+            config->load_modules.push_back(args[++i]);
+        } else if(args[i] == "--client-output-buffer-limit" && i + 1 < args.size()) {
+            // "pubsub 32mb 8mb 60", only the pubsub class is used
+            std::istringstream in(args[++i]);
+            std::string cls, hard, soft;
+            long long seconds;
+            if (in >> cls >> hard >> soft >> seconds && cls == "pubsub") {
+                config->pubsub_hard_limit = parse_memory(hard);
+                config->pubsub_soft_limit = parse_memory(soft);
+                config->pubsub_soft_seconds = seconds;
+            }
         }
     }
 
@@ -33,6 +33,25 @@ struct ServerConfig {
 
     std::string rdb_file_dir = "";
     std::string rdb_file_name = "";
+
+    bool key_index = false; // keep an ordered index of key names for prefix scans
+
+    // client-output-buffer-limit pubsub <hard> <soft> <soft seconds>, a subscriber whose queue grows past them is dropped
+    size_t pubsub_hard_limit = 32 * 1024 * 1024;
+    size_t pubsub_soft_limit = 8 * 1024 * 1024;
+    long long pubsub_soft_seconds = 60;
+
+    // save <seconds> <changes>: BGSAVE when at least <changes> writes happened and <seconds> passed since the last save
+    std::vector<std::pair<long long, long long> > save_params = {{3600, 1}, {300, 100}, {60, 10000}};
+    bool rdb_compression = true; // LZF compress the strings of RDB files
+    bool rdb_checksum = true; // CRC64 at the end of RDB files, 0 (not computed) when off
+
+    // appendonly: every write is logged to <dir>/<appendfilename>, fsynced as appendfsync says (always, everysec or no)
+    bool append_only = false;
+    std::string append_filename = "appendonly.aof";
+    std::string append_fsync = "everysec";
+
+    std::vector<std::string> load_modules; // --loadmodule "path [args]", loaded before the RDB file
 };
 
 /* we need to return shared_ptr as during returing it will try to move/copy the ptr to the caller function 
@@ -0,0 +1,42 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+// CRC16-CCITT (XMODEM: poly 0x1021, init 0), the checksum Redis Cluster uses to map keys and channels to its 16384 slots
+
+constexpr std::array<uint16_t, 256> make_crc16_table() {
+    std::array<uint16_t, 256> table{};
+    for (int i = 0; i < 256; i++) {
+        uint16_t crc = (uint16_t)(i << 8);
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+        table[i] = crc;
+    }
+    return table;
+}
+
+inline constexpr std::array<uint16_t, 256> CRC16_TABLE = make_crc16_table();
+
+inline uint16_t crc16(std::string_view data) {
+    uint16_t crc = 0;
+    for (unsigned char c : data) {
+        crc = (uint16_t)((crc << 8) ^ CRC16_TABLE[((crc >> 8) ^ c) & 0xFF]);
+    }
+    return crc;
+}
+
+constexpr int CLUSTER_SLOTS = 16384;
+
+// slot of a key or channel, only the part inside the first non-empty {...} is hashed so related names can share a slot
+inline int key_hash_slot(std::string_view key) {
+    size_t open = key.find('{');
+    if (open != std::string_view::npos) {
+        size_t close = key.find('}', open + 1);
+        if (close != std::string_view::npos && close != open + 1) {
+            key = key.substr(open + 1, close - open - 1);
+        }
+    }
+    return crc16(key) & (CLUSTER_SLOTS - 1);
+}
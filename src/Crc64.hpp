@@ -0,0 +1,54 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+/* CRC-64/Jones (reflected poly 0xad93d23594c935a9, init 0, no final xor), the checksum at the end of RDB files.
+crc64(0, "123456789") is 0xe9c6d914c4b8d9ca. Slice-by-8: eight tables let the loop fold 8 input bytes per step with
+independent lookups instead of one dependent lookup per byte. */
+
+constexpr uint64_t CRC64_POLY_REFLECTED = 0x95ac9329ac4bc9b5ULL;
+
+constexpr std::array<std::array<uint64_t, 256>, 8> make_crc64_tables() {
+    std::array<std::array<uint64_t, 256>, 8> tables{};
+    for (int i = 0; i < 256; i++) {
+        uint64_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 1) ? (crc >> 1) ^ CRC64_POLY_REFLECTED : crc >> 1;
+        }
+        tables[0][i] = crc;
+    }
+    // tables[k][i]: the crc of byte i followed by k zero bytes
+    for (int k = 1; k < 8; k++) {
+        for (int i = 0; i < 256; i++) {
+            uint64_t prev = tables[k - 1][i];
+            tables[k][i] = (prev >> 8) ^ tables[0][prev & 0xFF];
+        }
+    }
+    return tables;
+}
+
+inline constexpr std::array<std::array<uint64_t, 256>, 8> CRC64_TABLES = make_crc64_tables();
+
+inline uint64_t crc64_byte(uint64_t crc, uint8_t byte) {
+    return CRC64_TABLES[0][(crc ^ byte) & 0xFF] ^ (crc >> 8);
+}
+
+// continues 'crc' over 'len' bytes, so a file can be checksummed in pieces as it streams
+inline uint64_t crc64(uint64_t crc, const void* data, size_t len) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    const auto& t = CRC64_TABLES;
+
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8); // little endian, like the reflected crc
+        crc ^= word;
+        crc = t[7][crc & 0xFF] ^ t[6][(crc >> 8) & 0xFF] ^ t[5][(crc >> 16) & 0xFF] ^ t[4][(crc >> 24) & 0xFF] ^
+              t[3][(crc >> 32) & 0xFF] ^ t[2][(crc >> 40) & 0xFF] ^ t[1][(crc >> 48) & 0xFF] ^ t[0][crc >> 56];
+        p += 8;
+        len -= 8;
+    }
+    while (len--) crc = crc64_byte(crc, *p++);
+    return crc;
+}
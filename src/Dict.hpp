@@ -0,0 +1,423 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/* Chained hash table with power-of-two bucket arrays, modelled after the Redis dict.
+Growing/shrinking is incremental: a second table is allocated and every mutating operation moves one bucket over,
+so a big table never pauses the server for a full rehash. Lookups never rehash, which keeps them safe under a shared lock.
+The power-of-two sizes are what make scan() cursors stable across rehashes (see scan below). */
+template <typename K, typename V, typename Hash = std::hash<K>, typename KeyEqual = std::equal_to<K> >
+class Dict {
+public:
+    using key_type = K;
+    using mapped_type = V;
+    using value_type = std::pair<const K, V>;
+
+private:
+    struct Node {
+        value_type kv;
+        size_t hash;
+        Node* next;
+    };
+
+    struct Table {
+        std::vector<Node*> buckets;
+        size_t used = 0;
+
+        size_t mask() const { return buckets.size() - 1; }
+    };
+
+    static constexpr size_t INITIAL_SIZE = 4;
+    static constexpr int REHASH_EMPTY_VISITS = 10; // empty buckets skipped per rehash step
+
+    Table tables[2];
+    long long rehash_idx = -1; // bucket of tables[0] to move next, -1 when not rehashing
+    Hash hasher;
+    KeyEqual key_equal;
+
+    bool isRehashing() const { return rehash_idx != -1; }
+
+    static size_t nextPower(size_t size) {
+        size_t power = INITIAL_SIZE;
+        while(power < size) power <<= 1;
+        return power;
+    }
+
+    static uint64_t reverseBits(uint64_t v) {
+        v = ((v >> 1) & 0x5555555555555555ULL) | ((v & 0x5555555555555555ULL) << 1);
+        v = ((v >> 2) & 0x3333333333333333ULL) | ((v & 0x3333333333333333ULL) << 2);
+        v = ((v >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((v & 0x0F0F0F0F0F0F0F0FULL) << 4);
+        return __builtin_bswap64(v);
+    }
+
+    struct Location {
+        int table = 2;
+        size_t bucket = 0;
+        Node* node = nullptr;
+    };
+
+    Location findNode(const K& key, size_t hash) const {
+        for(int t = 0; t <= 1; t++) {
+            const Table& table = tables[t];
+            if(table.buckets.empty()) continue;
+            size_t idx = hash & table.mask();
+            for(Node* node = table.buckets[idx]; node; node = node->next) {
+                if(node->hash == hash && key_equal(node->kv.first, key)) return {t, idx, node};
+            }
+            if(!isRehashing()) break;
+        }
+        return {};
+    }
+
+    // move one non-empty bucket of tables[0] into tables[1]
+    void rehashStep() {
+        if(!isRehashing()) return;
+
+        int empty_visits = REHASH_EMPTY_VISITS;
+        while(rehash_idx < (long long)tables[0].buckets.size() && !tables[0].buckets[rehash_idx]) {
+            rehash_idx++;
+            if(--empty_visits == 0) return;
+        }
+
+        if(rehash_idx < (long long)tables[0].buckets.size()) {
+            Node* node = tables[0].buckets[rehash_idx];
+            while(node) {
+                Node* next = node->next;
+                size_t idx = node->hash & tables[1].mask();
+                node->next = tables[1].buckets[idx];
+                tables[1].buckets[idx] = node;
+                tables[0].used--;
+                tables[1].used++;
+                node = next;
+            }
+            tables[0].buckets[rehash_idx] = nullptr;
+            rehash_idx++;
+        }
+
+        if(tables[0].used == 0) {
+            tables[0] = std::move(tables[1]);
+            tables[1] = Table();
+            rehash_idx = -1;
+        }
+    }
+
+    void resize(size_t size) {
+        if(isRehashing()) return;
+
+        size_t new_size = nextPower(size);
+        if(new_size == tables[0].buckets.size()) return;
+
+        if(tables[0].buckets.empty()) {
+            tables[0].buckets.assign(new_size, nullptr);
+            return;
+        }
+        tables[1].buckets.assign(new_size, nullptr);
+        tables[1].used = 0;
+        rehash_idx = 0;
+    }
+
+    void expandIfNeeded() {
+        if(tables[0].buckets.empty()) {
+            resize(INITIAL_SIZE);
+        } else if(!isRehashing() && tables[0].used >= tables[0].buckets.size()) {
+            resize(tables[0].used * 2);
+        }
+    }
+
+    void shrinkIfNeeded() {
+        if(!isRehashing() && tables[0].buckets.size() > INITIAL_SIZE && tables[0].used * 8 < tables[0].buckets.size()) {
+            resize(tables[0].used);
+        }
+    }
+
+    Location insertNode(Node* node) {
+        rehashStep();
+        expandIfNeeded();
+        int t = isRehashing() ? 1 : 0;
+        Table& table = tables[t];
+        size_t idx = node->hash & table.mask();
+        node->next = table.buckets[idx];
+        table.buckets[idx] = node;
+        table.used++;
+        return {t, idx, node};
+    }
+
+    void unlinkNode(Node* target) {
+        for(int t = 0; t <= 1; t++) {
+            Table& table = tables[t];
+            if(table.buckets.empty()) continue;
+            Node** link = &table.buckets[target->hash & table.mask()];
+            while(*link) {
+                if(*link == target) {
+                    *link = target->next;
+                    table.used--;
+                    return;
+                }
+                link = &(*link)->next;
+            }
+        }
+    }
+
+public:
+    template <bool Const>
+    class Iterator {
+        friend class Dict;
+        using DictPtr = std::conditional_t<Const, const Dict*, Dict*>;
+
+        DictPtr dict = nullptr;
+        int table = 0;
+        size_t bucket = 0;
+        Node* node = nullptr;
+
+        Iterator(DictPtr dict_, int table_, size_t bucket_, Node* node_) : dict(dict_), table(table_), bucket(bucket_), node(node_) {}
+
+        // move to the first node at or after (table, bucket)
+        void settle() {
+            while(!node && table <= 1) {
+                const Table& t = dict->tables[table];
+                if(bucket < t.buckets.size()) {
+                    node = t.buckets[bucket];
+                    if(!node) bucket++;
+                } else {
+                    table++;
+                    bucket = 0;
+                    if(table == 1 && !dict->isRehashing()) table = 2;
+                }
+            }
+        }
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Dict::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = std::conditional_t<Const, const value_type*, value_type*>;
+        using reference = std::conditional_t<Const, const value_type&, value_type&>;
+
+        Iterator() = default;
+        Iterator(const Iterator&) = default;
+        Iterator& operator=(const Iterator&) = default;
+
+        // iterator -> const_iterator
+        template <bool OtherConst> requires (Const && !OtherConst)
+        Iterator(const Iterator<OtherConst>& other) : dict(other.dict), table(other.table), bucket(other.bucket), node(other.node) {}
+
+        reference operator*() const { return node->kv; }
+        pointer operator->() const { return &node->kv; }
+
+        Iterator& operator++() {
+            node = node->next;
+            if(!node) {
+                bucket++;
+                settle();
+            }
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator copy = *this;
+            ++(*this);
+            return copy;
+        }
+
+        bool operator==(const Iterator& other) const { return node == other.node; }
+        bool operator!=(const Iterator& other) const { return node != other.node; }
+
+        friend class Iterator<!Const>;
+    };
+
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+    Dict() = default;
+
+    Dict(const Dict& other) : hasher(other.hasher), key_equal(other.key_equal) {
+        reserve(other.size());
+        for(const auto& kv : other) emplace(kv.first, kv.second);
+    }
+
+    Dict(Dict&& other) noexcept {
+        swap(other);
+    }
+
+    Dict& operator=(Dict other) {
+        swap(other);
+        return *this;
+    }
+
+    ~Dict() { clear(); }
+
+    void swap(Dict& other) noexcept {
+        std::swap(tables[0], other.tables[0]);
+        std::swap(tables[1], other.tables[1]);
+        std::swap(rehash_idx, other.rehash_idx);
+        std::swap(hasher, other.hasher);
+        std::swap(key_equal, other.key_equal);
+    }
+
+    size_t size() const { return tables[0].used + tables[1].used; }
+    bool empty() const { return size() == 0; }
+    size_t bucket_count() const { return tables[0].buckets.size() + tables[1].buckets.size(); }
+
+    iterator begin() { iterator it(this, 0, 0, nullptr); it.settle(); return it; }
+    iterator end() { return iterator(this, 2, 0, nullptr); }
+    const_iterator begin() const { const_iterator it(this, 0, 0, nullptr); it.settle(); return it; }
+    const_iterator end() const { return const_iterator(this, 2, 0, nullptr); }
+
+    iterator find(const K& key) {
+        Location loc = findNode(key, hasher(key));
+        return iterator(this, loc.table, loc.bucket, loc.node);
+    }
+
+    const_iterator find(const K& key) const {
+        Location loc = findNode(key, hasher(key));
+        return const_iterator(this, loc.table, loc.bucket, loc.node);
+    }
+
+    size_t count(const K& key) const { return findNode(key, hasher(key)).node ? 1 : 0; }
+
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(const K& key, Args&&... args) {
+        size_t hash = hasher(key);
+        Location loc = findNode(key, hash);
+        if(loc.node) {
+            return {iterator(this, loc.table, loc.bucket, loc.node), false};
+        }
+        Node* node = new Node{value_type(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...)), hash, nullptr};
+        loc = insertNode(node);
+        return {iterator(this, loc.table, loc.bucket, loc.node), true};
+    }
+
+    template <typename... Args>
+    std::pair<iterator, bool> emplace(const K& key, Args&&... args) {
+        return try_emplace(key, std::forward<Args>(args)...);
+    }
+
+    template <typename M>
+    std::pair<iterator, bool> insert_or_assign(const K& key, M&& value) {
+        auto result = try_emplace(key, std::forward<M>(value));
+        if(!result.second) result.first->second = std::forward<M>(value);
+        return result;
+    }
+
+    V& operator[](const K& key) {
+        return try_emplace(key).first->second;
+    }
+
+    size_t erase(const K& key) {
+        rehashStep();
+        Node* node = findNode(key, hasher(key)).node;
+        if(!node) return 0;
+        unlinkNode(node);
+        delete node;
+        shrinkIfNeeded();
+        return 1;
+    }
+
+    // erasing through an iterator never rehashes, so it is safe to erase while walking the table
+    iterator erase(iterator it) {
+        iterator next = it;
+        ++next;
+        unlinkNode(it.node);
+        delete it.node;
+        return next;
+    }
+
+    void clear() {
+        for(int t = 0; t <= 1; t++) {
+            for(Node* node : tables[t].buckets) {
+                while(node) {
+                    Node* next = node->next;
+                    delete node;
+                    node = next;
+                }
+            }
+            tables[t] = Table();
+        }
+        rehash_idx = -1;
+    }
+
+    // pre-size the table for 'n' elements, e.g. from a known element count while loading
+    void reserve(size_t n) {
+        if(n > tables[0].buckets.size()) resize(n);
+    }
+
+    /* A random element, as dictGetRandomKey: draw buckets until a non-empty one, then a random node of its chain.
+    Elements in long chains are slightly less likely, which is fine for SPOP/SRANDMEMBER. */
+    template <typename RNG>
+    const_iterator random(RNG& rng) const {
+        if(empty()) return end();
+
+        int t = 0;
+        size_t idx = 0;
+        Node* head = nullptr;
+        while(!head) {
+            if(isRehashing()) {
+                // buckets of tables[0] below rehash_idx are already moved and empty
+                size_t size0 = tables[0].buckets.size();
+                size_t r = rehash_idx + rng() % (size0 + tables[1].buckets.size() - rehash_idx);
+                t = r >= size0 ? 1 : 0;
+                idx = r >= size0 ? r - size0 : r;
+            } else {
+                t = 0;
+                idx = rng() & tables[0].mask();
+            }
+            head = tables[t].buckets[idx];
+        }
+
+        size_t len = 0;
+        for(Node* node = head; node; node = node->next) len++;
+        Node* node = head;
+        for(size_t k = rng() % len; k > 0; k--) node = node->next;
+        return const_iterator(this, t, idx, node);
+    }
+
+    /* Incremental iteration, the algorithm of Redis' dictScan. The cursor is a bucket index incremented in reverse-binary order,
+    i.e. from the most significant bit of the mask down. With power-of-two tables, growing or shrinking only adds or removes
+    high bits of the bucket index, so every element present for the whole iteration is returned at least once even when the
+    table is rehashed between calls. Returns the next cursor, 0 once the iteration is complete. */
+    template <typename Fn>
+    uint64_t scan(uint64_t cursor, Fn&& fn) const {
+        if(empty()) return 0;
+
+        auto emit = [&](const Table& table, size_t idx) {
+            for(Node* node = table.buckets[idx]; node; node = node->next) fn(node->kv);
+        };
+
+        if(!isRehashing()) {
+            const Table& t0 = tables[0];
+            uint64_t m0 = t0.mask();
+            emit(t0, cursor & m0);
+
+            // set unmasked bits so incrementing the reversed cursor operates on the masked bits
+            cursor |= ~m0;
+            cursor = reverseBits(cursor);
+            cursor++;
+            cursor = reverseBits(cursor);
+        } else {
+            const Table* t0 = &tables[0];
+            const Table* t1 = &tables[1];
+            if(t0->buckets.size() > t1->buckets.size()) std::swap(t0, t1);
+            uint64_t m0 = t0->mask(), m1 = t1->mask();
+
+            emit(*t0, cursor & m0);
+
+            // visit every bucket of the larger table that is an expansion of the cursor's bucket in the smaller one
+            do {
+                emit(*t1, cursor & m1);
+
+                cursor |= ~m1;
+                cursor = reverseBits(cursor);
+                cursor++;
+                cursor = reverseBits(cursor);
+            } while(cursor & (m0 ^ m1));
+        }
+
+        return cursor;
+    }
+};
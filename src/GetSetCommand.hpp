@@ -12,59 +12,113 @@
 #include <string>
 #include <unordered_map>
 #include <optional>
+#include <climits>
 #include "Command.hpp"
 #include "KVStore.hpp"
 
 class SetCommand : public Command
 {
+private:
+    // EX/PX count from now, EXAT/PXAT are unix times
+    struct Expiry {
+        long long ms = -1; // -1 for none
+        bool absolute = false;
+    };
+
+    static long long now_ms() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
 public:
     std::string name() const override { return "SET"; }
     int min_args() const override { return 3; } // SET key value
+    KeySpec keySpec() const override { return {1, 1, 1}; }
     bool isWriteCommand() const override { return true; }
     bool sendToMaster() const override { return false; }
     bool isPubSubCommand() const override { return false; }
 
-    std::string execute(ClientContext& context, const std::vector<std::string>& args, KeyValueDatabase& db, bool acquire_lock) override
+    std::string bind(const std::vector<std::string>& args, std::any& bound) const override
     {
-
-        std::string key = args[1];
-        std::string val = args[2];
-
-        int PX = -1;
+        //args: SET key value [EX seconds | PX milliseconds | EXAT unix-seconds | PXAT unix-milliseconds]
+        Expiry expiry;
 
         for (size_t i = 3; i < args.size(); i++)
         {
             std::string arg = args[i];
             std::transform(arg.begin(), arg.end(), arg.begin(), ::toupper);
 
-            if (arg == "PX" && i + 1 < args.size())
+            if ((arg == "EX" || arg == "PX" || arg == "EXAT" || arg == "PXAT") && i + 1 < args.size())
             {
-                try
-                {
-                    PX = std::stoll(args[i + 1]);
-                    i++;
-                }
-                catch (...)
+                long long value;
+                bool in_seconds = arg == "EX" || arg == "EXAT";
+                if (!Listpack::stringToInt(args[i + 1], value))
                 {
                     return "-ERR value is not an integer or out of range\r\n";
                 }
-            } else if (arg == "EX" && i + 1 < args.size())
-            {
-                try
+                if (value <= 0 || (in_seconds && value > LLONG_MAX / 1000))
                 {
-                    PX = std::stoll(args[i + 1]) * 1000;
-                    i++;
-                }
-                catch (...)
-                {
-                    return "-ERR value is not an integer or out of range\r\n";
+                    return "-ERR invalid expire time in 'set' command\r\n";
                 }
+                expiry.ms = in_seconds ? value * 1000 : value;
+                expiry.absolute = arg == "EXAT" || arg == "PXAT";
+                i++;
+            }
+        }
+
+        bound = expiry;
+        return "";
+    }
+
+    std::string execute(ClientContext& context, const std::vector<std::string>& args, KeyValueDatabase& db, bool acquire_lock) override
+    {
+        return bindAndExecute(context, args, db, acquire_lock);
+    }
+
+    std::string execute_bound(ClientContext& context, const std::vector<std::string>& args, const std::any& bound, KeyValueDatabase& db, bool acquire_lock) override
+    {
+        std::string key = args[1];
+        std::string val = args[2];
+
+        const Expiry& expiry = std::any_cast<const Expiry&>(bound);
+        long long expire_at = -1;
+        if (expiry.ms != -1)
+        {
+            long long now = now_ms();
+            if (!expiry.absolute && expiry.ms > LLONG_MAX - now)
+            {
+                return "-ERR invalid expire time in 'set' command\r\n";
             }
+            expire_at = expiry.absolute ? expiry.ms : now + expiry.ms;
         }
 
-        db.SET(key, val, acquire_lock, PX);
+        db.SET(key, val, acquire_lock, expire_at);
         return "+OK\r\n";
     }
+
+    // a relative expiry is logged as the PXAT it came to, a replay would otherwise start the clock again
+    std::vector<std::string> rewriteForAof(const std::vector<std::string>& args, const std::string& reply) const override
+    {
+        std::any bound;
+        if (!bind(args, bound).empty()) return args;
+        const Expiry& expiry = std::any_cast<const Expiry&>(bound);
+        if (expiry.ms == -1) return args;
+
+        std::vector<std::string> logged(args.begin(), args.begin() + 3);
+        for (size_t i = 3; i < args.size(); i++)
+        {
+            std::string arg = args[i];
+            std::transform(arg.begin(), arg.end(), arg.begin(), ::toupper);
+            if ((arg == "EX" || arg == "PX" || arg == "EXAT" || arg == "PXAT") && i + 1 < args.size())
+            {
+                i++;
+                continue;
+            }
+            logged.push_back(args[i]);
+        }
+        logged.push_back("PXAT");
+        logged.push_back(std::to_string(expiry.absolute ? expiry.ms : now_ms() + expiry.ms));
+        return logged;
+    }
 };
 
 class GetCommand : public Command
@@ -72,6 +126,7 @@ class GetCommand : public Command
 public:
     std::string name() const override { return "GET"; }
     int min_args() const override { return 2; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
     bool isWriteCommand() const override { return false; }
     bool sendToMaster() const override { return false; }
     bool isPubSubCommand() const override { return false; }
@@ -91,4 +146,66 @@ public:
           return "$-1\r\n";
         }
     }  
-};
\ No newline at end of file
+};
+class MGetCommand : public Command
+{
+public:
+    std::string name() const override { return "MGET"; }
+    int min_args() const override { return 2; }
+    KeySpec keySpec() const override { return {1, -1, 1}; }
+    bool isWriteCommand() const override { return false; }
+    bool isReadOnly() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string execute(ClientContext& context, const std::vector<std::string>& args, KeyValueDatabase& db, bool acquire_lock) override
+    {
+        //args: MGET key [key ...], the reply is built by the db while it holds the lock, values are copied once
+        std::vector<std::string> keys(args.begin() + 1, args.end());
+        std::string response;
+        db.MGET(keys, response, acquire_lock);
+        return response;
+    }
+};
+
+// MSET key value [key value ...] / MSETNX, which sets nothing if any of the keys exists
+class MSetCommand : public Command
+{
+private:
+    bool only_if_none_exist;
+
+public:
+    MSetCommand(bool nx) : only_if_none_exist(nx) {}
+
+    std::string name() const override { return only_if_none_exist ? "MSETNX" : "MSET"; }
+    int min_args() const override { return 3; }
+    KeySpec keySpec() const override { return {1, -1, 2}; }
+    bool isWriteCommand() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    // MSETNX replies 0 when a key existed and it set nothing
+    std::vector<std::string> rewriteForAof(const std::vector<std::string>& args, const std::string& reply) const override { return argsUnlessZero(args, reply); }
+
+    std::string execute(ClientContext& context, const std::vector<std::string>& args, KeyValueDatabase& db, bool acquire_lock) override
+    {
+        if (args.size() % 2 == 0)
+        {
+            return "-ERR wrong number of arguments for '" + std::string(only_if_none_exist ? "msetnx" : "mset") + "' command\r\n";
+        }
+
+        std::vector<std::pair<std::string, std::string> > pairs;
+        pairs.reserve(args.size() / 2);
+        for (size_t i = 1; i + 1 < args.size(); i += 2)
+        {
+            pairs.emplace_back(args[i], args[i + 1]);
+        }
+
+        if (only_if_none_exist)
+        {
+            return db.MSETNX(pairs, acquire_lock) ? ":1\r\n" : ":0\r\n";
+        }
+        db.MSET(pairs, acquire_lock);
+        return "+OK\r\n";
+    }
+};
@@ -0,0 +1,173 @@
+#pragma once
+#include <string_view>
+#include <cctype>
+#include <utility>
+#include <string>
+#include <vector>
+#include <cstring>
+
+// Redis glob-style matching: '*' any sequence, '?' any char, [abc] / [^abc] / [a-z] classes, '\' escapes the next char
+inline bool glob_match_class(std::string_view pattern, size_t& p, char c) {
+    // pattern[p] is the char after '[', leaves p on the closing ']'
+    bool negate = false;
+    bool matched = false;
+    if(p < pattern.size() && pattern[p] == '^') {
+        negate = true;
+        p++;
+    }
+    while(p < pattern.size() && pattern[p] != ']') {
+        if(pattern[p] == '\\' && p + 1 < pattern.size()) {
+            p++;
+            if(pattern[p] == c) matched = true;
+        } else if(p + 2 < pattern.size() && pattern[p + 1] == '-' && pattern[p + 2] != ']') {
+            char lo = pattern[p], hi = pattern[p + 2];
+            if(lo > hi) std::swap(lo, hi);
+            if(c >= lo && c <= hi) matched = true;
+            p += 2;
+        } else if(pattern[p] == c) {
+            matched = true;
+        }
+        p++;
+    }
+    return negate ? !matched : matched;
+}
+
+inline bool glob_match(std::string_view pattern, std::string_view str) {
+    size_t p = 0, s = 0;
+    size_t star_p = std::string_view::npos, star_s = 0; // position after the last '*' and the str position it is matched up to
+
+    while(s < str.size()) {
+        if(p < pattern.size()) {
+            char pc = pattern[p];
+            if(pc == '*') {
+                while(p < pattern.size() && pattern[p] == '*') p++;
+                if(p == pattern.size()) return true;
+                star_p = p;
+                star_s = s;
+                continue;
+            }
+
+            bool ok;
+            size_t next_p = p + 1;
+            if(pc == '?') {
+                ok = true;
+            } else if(pc == '[') {
+                size_t q = p + 1;
+                ok = glob_match_class(pattern, q, str[s]);
+                next_p = q < pattern.size() ? q + 1 : q;
+            } else if(pc == '\\' && p + 1 < pattern.size()) {
+                ok = pattern[p + 1] == str[s];
+                next_p = p + 2;
+            } else {
+                ok = pc == str[s];
+            }
+
+            if(ok) {
+                p = next_p;
+                s++;
+                continue;
+            }
+        }
+
+        // mismatch: let the last '*' absorb one more char
+        if(star_p == std::string_view::npos) return false;
+        p = star_p;
+        s = ++star_s;
+    }
+
+    while(p < pattern.size() && pattern[p] == '*') p++;
+    return p == pattern.size();
+}
+
+/* A glob pattern compiled once per KEYS / SCAN / PSUBSCRIBE call and then tested against many strings.
+Patterns made only of literals and '*' (exact, "prefix*", "*suffix", "user:*:session", "*a*b*") are matched as an anchored
+prefix, an anchored suffix and the middle literals searched left to right with memchr/memmem, which glibc vectorizes.
+Patterns with '?' or classes still reject on their literal prefix and suffix before falling back to glob_match. */
+class GlobPattern {
+private:
+    std::string pattern;
+    std::string prefix; // literal chars before the first wildcard, escapes resolved
+    std::string suffix; // literal chars after the last wildcard
+    std::vector<std::string> middle; // literal segments between '*', only for star-only patterns
+    size_t min_length = 0; // shortest string that can match
+    bool has_star = false;
+    bool star_only = true; // no '?' / '[' so the segment matcher applies
+    bool match_all = false;
+
+    static bool findSegment(std::string_view& str, const std::string& segment) {
+        const char* found;
+        if(segment.size() == 1) {
+            found = static_cast<const char*>(std::memchr(str.data(), segment[0], str.size()));
+        } else {
+            found = static_cast<const char*>(memmem(str.data(), str.size(), segment.data(), segment.size()));
+        }
+        if(!found) return false;
+        str.remove_prefix(found - str.data() + segment.size());
+        return true;
+    }
+
+public:
+    explicit GlobPattern(std::string_view pattern_) : pattern(pattern_) {
+        // split into literal runs separated by wildcards
+        std::vector<std::string> literals(1);
+        size_t p = 0;
+        while(p < pattern.size()) {
+            char c = pattern[p];
+            if(c == '\\' && p + 1 < pattern.size()) {
+                literals.back() += pattern[p + 1];
+                min_length++;
+                p += 2;
+            } else if(c == '*' || c == '?' || c == '[') {
+                if(c == '*') {
+                    has_star = true;
+                } else {
+                    star_only = false;
+                    min_length++;
+                }
+                if(c == '[') {
+                    size_t q = p + 1;
+                    glob_match_class(pattern, q, '\0'); // only to skip to the closing ']'
+                    p = q;
+                }
+                literals.emplace_back();
+                p++;
+            } else {
+                literals.back() += c;
+                min_length++;
+                p++;
+            }
+        }
+
+        prefix = literals.front();
+        if(literals.size() == 1) return; // no wildcard at all
+
+        suffix = literals.back();
+        if(star_only) {
+            for(size_t i = 1; i + 1 < literals.size(); i++) {
+                if(!literals[i].empty()) middle.push_back(literals[i]);
+            }
+            match_all = prefix.empty() && suffix.empty() && middle.empty();
+        }
+    }
+
+    const std::string& source() const { return pattern; }
+    bool matchesAll() const { return match_all; }
+    const std::string& literalPrefix() const { return prefix; } // every match starts with it
+
+    bool match(std::string_view str) const {
+        if(match_all) return true;
+        if(str.size() < min_length) return false;
+        if(!has_star && star_only) return str == prefix;
+        if(!str.starts_with(prefix) || !str.ends_with(suffix)) return false;
+        if(!star_only) {
+            if(has_star || str.size() == min_length) return glob_match(pattern, str);
+            return false;
+        }
+
+        std::string_view rest = str.substr(prefix.size(), str.size() - prefix.size() - suffix.size());
+        for(const std::string& segment : middle) {
+            if(!findSegment(rest, segment)) return false;
+        }
+        return true;
+    }
+};
@@ -0,0 +1,348 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include "SimdHelper.hpp"
+
+/* HyperLogLog counters stored as string values, byte compatible with Redis so GET/SET/RDB round trips work.
+Layout: "HYLL" <encoding u8> <3 unused> <cached cardinality u64 LE, MSB of the last byte set = stale> <registers>
+ - dense: 16384 registers of 6 bits packed LSB first, 12288 bytes
+ - sparse: run length opcodes over the registers, ZERO 00xxxxxx (1-64 zeros), XZERO 01xxxxxx yyyyyyyy (1-16384 zeros),
+   VAL 1vvvvvxx (1-4 registers of value 1-32). Converted to dense when a value does not fit or it grows past SPARSE_MAX_BYTES.
+Multi-key operations unpack registers into one byte each so they can be merged with simd::max_u8. */
+class HyperLogLog {
+public:
+    static constexpr int P = 14;
+    static constexpr int Q = 64 - P;
+    static constexpr int REGISTERS = 1 << P;
+    static constexpr int BITS = 6;
+    static constexpr int REGISTER_MAX = (1 << BITS) - 1;
+    static constexpr size_t HDR_SIZE = 16;
+    static constexpr size_t DENSE_SIZE = HDR_SIZE + (REGISTERS * BITS + 7) / 8;
+    static constexpr size_t SPARSE_MAX_BYTES = 3000;
+    static constexpr uint8_t DENSE = 0;
+    static constexpr uint8_t SPARSE = 1;
+
+private:
+    static constexpr int SPARSE_VAL_MAX_VALUE = 32;
+    static constexpr int SPARSE_VAL_MAX_LEN = 4;
+    static constexpr int SPARSE_ZERO_MAX_LEN = 64;
+    static constexpr int SPARSE_XZERO_MAX_LEN = 16384;
+
+    static uint8_t* registers(std::string& hll) { return reinterpret_cast<uint8_t*>(hll.data()) + HDR_SIZE; }
+    static const uint8_t* registers(const std::string& hll) { return reinterpret_cast<const uint8_t*>(hll.data()) + HDR_SIZE; }
+
+    static int denseGet(const uint8_t* regs, int index) {
+        size_t byte = index * BITS / 8;
+        int fb = index * BITS & 7;
+        unsigned b0 = regs[byte];
+        unsigned b1 = byte + 1 < DENSE_SIZE - HDR_SIZE ? regs[byte + 1] : 0;
+        return ((b0 >> fb) | (b1 << (8 - fb))) & REGISTER_MAX;
+    }
+
+    static void denseSet(uint8_t* regs, int index, int value) {
+        size_t byte = index * BITS / 8;
+        int fb = index * BITS & 7;
+        regs[byte] &= ~(REGISTER_MAX << fb);
+        regs[byte] |= value << fb;
+        if(byte + 1 < DENSE_SIZE - HDR_SIZE) {
+            regs[byte + 1] &= ~(REGISTER_MAX >> (8 - fb));
+            regs[byte + 1] |= value >> (8 - fb);
+        }
+    }
+
+    // decoded sparse opcode
+    struct SparseOp {
+        bool is_val;
+        int value;
+        int len;
+        int size; // bytes
+    };
+
+    static SparseOp sparseDecode(const uint8_t* p) {
+        if((*p & 0xC0) == 0x00) return {false, 0, (*p & 0x3F) + 1, 1};
+        if((*p & 0xC0) == 0x40) return {false, 0, (((*p & 0x3F) << 8) | p[1]) + 1, 2};
+        return {true, ((*p >> 2) & 0x1F) + 1, (*p & 0x03) + 1, 1};
+    }
+
+    static void appendZeros(std::string& out, int len) {
+        while(len > 0) {
+            int run = std::min(len, SPARSE_XZERO_MAX_LEN);
+            if(run <= SPARSE_ZERO_MAX_LEN) {
+                out.push_back((char)(run - 1));
+            } else {
+                out.push_back((char)(0x40 | ((run - 1) >> 8)));
+                out.push_back((char)((run - 1) & 0xFF));
+            }
+            len -= run;
+        }
+    }
+
+    static void appendVal(std::string& out, int value, int len) {
+        while(len > 0) {
+            int run = std::min(len, SPARSE_VAL_MAX_LEN);
+            out.push_back((char)(0x80 | ((value - 1) << 2) | (run - 1)));
+            len -= run;
+        }
+    }
+
+    static void invalidateCache(std::string& hll) { hll[15] = (char)((uint8_t)hll[15] | 0x80); }
+
+    /* Set register 'index' to 'count' if that increases it. Returns 1 if changed, 0 if not, -1 if the value does not fit the
+    sparse encoding or the result would be too large, in which case the caller converts to dense and retries. */
+    static int sparseSet(std::string& hll, int index, int count) {
+        if(count > SPARSE_VAL_MAX_VALUE) return -1;
+
+        size_t pos = HDR_SIZE;
+        int first = 0;
+        SparseOp op{};
+        while(pos < hll.size()) {
+            op = sparseDecode(reinterpret_cast<const uint8_t*>(hll.data()) + pos);
+            if(index < first + op.len) break;
+            first += op.len;
+            pos += op.size;
+        }
+        if(pos >= hll.size()) return -1; // malformed, let the dense path rebuild it
+
+        if(op.is_val && op.value >= count) return 0;
+
+        // replace the opcode with: run before the register, the register itself, run after it
+        std::string seq;
+        int before = index - first;
+        int after = first + op.len - index - 1;
+        if(op.is_val) appendVal(seq, op.value, before);
+        else appendZeros(seq, before);
+        appendVal(seq, count, 1);
+        if(op.is_val) appendVal(seq, op.value, after);
+        else appendZeros(seq, after);
+
+        if(hll.size() - op.size + seq.size() > HDR_SIZE + SPARSE_MAX_BYTES) return -1;
+        hll.replace(pos, op.size, seq);
+
+        // merge adjacent VAL opcodes of the same value
+        std::string merged;
+        merged.reserve(hll.size());
+        merged.append(hll, 0, HDR_SIZE);
+        int pending_value = 0, pending_len = 0;
+        for(size_t p = HDR_SIZE; p < hll.size(); ) {
+            SparseOp cur = sparseDecode(reinterpret_cast<const uint8_t*>(hll.data()) + p);
+            if(cur.is_val && cur.value == pending_value) {
+                pending_len += cur.len;
+            } else {
+                appendVal(merged, pending_value, pending_len);
+                if(cur.is_val) {
+                    pending_value = cur.value;
+                    pending_len = cur.len;
+                } else {
+                    pending_value = pending_len = 0;
+                    merged.append(hll, p, cur.size);
+                }
+            }
+            p += cur.size;
+        }
+        appendVal(merged, pending_value, pending_len);
+        hll.swap(merged);
+        return 1;
+    }
+
+    // position of the element's register and the length of the run of zeros + 1, as hllPatLen
+    static void patLen(std::string_view element, int& index, int& count) {
+        uint64_t hash = murmurHash64A(element.data(), element.size(), 0xadc83b19ULL);
+        index = hash & (REGISTERS - 1);
+        hash >>= P;
+        hash |= 1ULL << Q; // guarantees the loop ends
+        count = __builtin_ctzll(hash) + 1;
+    }
+
+    static double sigma(double x) {
+        if(x == 1.0) return INFINITY;
+        double z_prime, y = 1, z = x;
+        do {
+            x *= x;
+            z_prime = z;
+            z += x * y;
+            y += y;
+        } while(z_prime != z);
+        return z;
+    }
+
+    static double tau(double x) {
+        if(x == 0.0 || x == 1.0) return 0.0;
+        double z_prime, y = 1.0, z = 1 - x;
+        do {
+            x = std::sqrt(x);
+            z_prime = z;
+            y *= 0.5;
+            z -= std::pow(1 - x, 2) * y;
+        } while(z_prime != z);
+        return z / 3;
+    }
+
+public:
+    static uint64_t murmurHash64A(const void* key, size_t len, uint64_t seed) {
+        const uint64_t m = 0xc6a4a7935bd1e995ULL;
+        const int r = 47;
+        uint64_t h = seed ^ (len * m);
+        const uint8_t* data = static_cast<const uint8_t*>(key);
+        const uint8_t* end = data + (len - (len & 7));
+
+        while(data != end) {
+            uint64_t k = 0;
+            for(int i = 0; i < 8; i++) k |= (uint64_t)data[i] << (8 * i); // little endian regardless of the host
+            k *= m;
+            k ^= k >> r;
+            k *= m;
+            h ^= k;
+            h *= m;
+            data += 8;
+        }
+
+        switch(len & 7) {
+            case 7: h ^= (uint64_t)data[6] << 48; [[fallthrough]];
+            case 6: h ^= (uint64_t)data[5] << 40; [[fallthrough]];
+            case 5: h ^= (uint64_t)data[4] << 32; [[fallthrough]];
+            case 4: h ^= (uint64_t)data[3] << 24; [[fallthrough]];
+            case 3: h ^= (uint64_t)data[2] << 16; [[fallthrough]];
+            case 2: h ^= (uint64_t)data[1] << 8; [[fallthrough]];
+            case 1: h ^= (uint64_t)data[0]; h *= m;
+        }
+
+        h ^= h >> r;
+        h *= m;
+        h ^= h >> r;
+        return h;
+    }
+
+    // empty counter: one XZERO opcode covering every register
+    static std::string create() {
+        std::string hll(HDR_SIZE, '\0');
+        std::memcpy(hll.data(), "HYLL", 4);
+        hll[4] = (char)SPARSE;
+        appendZeros(hll, REGISTERS);
+        return hll;
+    }
+
+    static bool isValid(const std::string& hll) {
+        if(hll.size() < HDR_SIZE || std::memcmp(hll.data(), "HYLL", 4) != 0) return false;
+        uint8_t encoding = hll[4];
+        if(encoding == DENSE) return hll.size() == DENSE_SIZE;
+        if(encoding != SPARSE) return false;
+
+        // the opcodes must cover exactly all the registers
+        long long covered = 0;
+        for(size_t p = HDR_SIZE; p < hll.size(); ) {
+            const uint8_t* op = reinterpret_cast<const uint8_t*>(hll.data()) + p;
+            if((*op & 0xC0) == 0x40 && p + 1 >= hll.size()) return false;
+            SparseOp cur = sparseDecode(op);
+            covered += cur.len;
+            p += cur.size;
+        }
+        return covered == REGISTERS;
+    }
+
+    static std::string toDense(const std::string& hll) {
+        uint8_t regs[REGISTERS] = {};
+        mergeInto(hll, regs);
+        return fromRegisters(regs);
+    }
+
+    // returns 1 if a register changed
+    static int add(std::string& hll, std::string_view element) {
+        int index, count;
+        patLen(element, index, count);
+
+        if(hll[4] == (char)SPARSE) {
+            int changed = sparseSet(hll, index, count);
+            if(changed >= 0) {
+                if(changed) invalidateCache(hll);
+                return changed;
+            }
+            hll = toDense(hll);
+        }
+
+        uint8_t* regs = registers(hll);
+        if(denseGet(regs, index) >= count) return 0;
+        denseSet(regs, index, count);
+        invalidateCache(hll);
+        return 1;
+    }
+
+    // max the counter's registers into 'regs', one byte per register
+    static void mergeInto(const std::string& hll, uint8_t* regs) {
+        if(hll[4] == (char)DENSE) {
+            const uint8_t* packed = registers(hll);
+            uint8_t unpacked[REGISTERS];
+            // every 3 bytes hold 4 registers
+            for(int i = 0, byte = 0; i < REGISTERS; i += 4, byte += 3) {
+                uint32_t word = packed[byte] | (packed[byte + 1] << 8) | (packed[byte + 2] << 16);
+                unpacked[i] = word & 63;
+                unpacked[i + 1] = (word >> 6) & 63;
+                unpacked[i + 2] = (word >> 12) & 63;
+                unpacked[i + 3] = (word >> 18) & 63;
+            }
+            simd::max_u8(regs, unpacked, REGISTERS);
+            return;
+        }
+
+        int index = 0;
+        for(size_t p = HDR_SIZE; p < hll.size() && index < REGISTERS; ) {
+            SparseOp op = sparseDecode(reinterpret_cast<const uint8_t*>(hll.data()) + p);
+            if(op.is_val) {
+                for(int i = 0; i < op.len && index + i < REGISTERS; i++) {
+                    regs[index + i] = std::max<uint8_t>(regs[index + i], op.value);
+                }
+            }
+            index += op.len;
+            p += op.size;
+        }
+    }
+
+    static std::string fromRegisters(const uint8_t* regs) {
+        std::string hll(DENSE_SIZE, '\0');
+        std::memcpy(hll.data(), "HYLL", 4);
+        hll[4] = (char)DENSE;
+        uint8_t* packed = registers(hll);
+        for(int i = 0, byte = 0; i < REGISTERS; i += 4, byte += 3) {
+            uint32_t word = regs[i] | (regs[i + 1] << 6) | (regs[i + 2] << 12) | (regs[i + 3] << 18);
+            packed[byte] = word & 0xFF;
+            packed[byte + 1] = (word >> 8) & 0xFF;
+            packed[byte + 2] = (word >> 16) & 0xFF;
+        }
+        invalidateCache(hll);
+        return hll;
+    }
+
+    // cardinality estimate from unpacked registers, Ertl's improved estimator as used by Redis
+    static uint64_t estimate(const uint8_t* regs) {
+        int histogram[64] = {};
+        for(int i = 0; i < REGISTERS; i++) histogram[regs[i]]++;
+
+        double m = REGISTERS;
+        double z = m * tau((m - histogram[Q + 1]) / m);
+        for(int j = Q; j >= 1; j--) {
+            z += histogram[j];
+            z *= 0.5;
+        }
+        z += m * sigma(histogram[0] / m);
+        return (uint64_t)std::llroundl(0.721347520444481703680 * m * m / z);
+    }
+
+    // PFCOUNT of a single key, served from the cached value while no register changed
+    static uint64_t count(std::string& hll) {
+        const uint8_t* card = reinterpret_cast<const uint8_t*>(hll.data()) + 8;
+        if((card[7] & 0x80) == 0) {
+            uint64_t cached = 0;
+            for(int i = 0; i < 8; i++) cached |= (uint64_t)card[i] << (8 * i);
+            return cached;
+        }
+
+        uint8_t regs[REGISTERS] = {};
+        mergeInto(hll, regs);
+        uint64_t result = estimate(regs);
+        for(int i = 0; i < 8; i++) hll[8 + i] = (char)((result >> (8 * i)) & 0xFF);
+        return result;
+    }
+};
@@ -0,0 +1,73 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "Command.hpp"
+#include "KVStore.hpp"
+#include "ClientContext.hpp"
+
+class PFAddCommand : public Command {
+public:
+    std::string name() const override { return "PFADD"; }
+    int min_args() const override { return 2; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
+    bool isWriteCommand() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+    std::vector<std::string> rewriteForAof(const std::vector<std::string>& args, const std::string& reply) const override { return argsUnlessZero(args, reply); }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        //args: PFADD key [element ...]
+        std::string key = args[1];
+        std::vector<std::string> elements(args.begin() + 2, args.end());
+
+        try {
+            return ":" + std::to_string(db.PFADD(key, elements, acquire_lock)) + "\r\n";
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+    }
+};
+
+class PFCountCommand : public Command {
+public:
+    std::string name() const override { return "PFCOUNT"; }
+    int min_args() const override { return 2; }
+    KeySpec keySpec() const override { return {1, -1, 1}; }
+    bool isWriteCommand() const override { return false; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        //args: PFCOUNT key [key ...], several keys count their union
+        std::vector<std::string> keys(args.begin() + 1, args.end());
+
+        try {
+            return ":" + std::to_string(db.PFCOUNT(keys, acquire_lock)) + "\r\n";
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+    }
+};
+
+class PFMergeCommand : public Command {
+public:
+    std::string name() const override { return "PFMERGE"; }
+    int min_args() const override { return 2; }
+    KeySpec keySpec() const override { return {1, -1, 1}; }
+    bool isWriteCommand() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        //args: PFMERGE destkey [sourcekey ...]
+        std::string dest_key = args[1];
+        std::vector<std::string> source_keys(args.begin() + 2, args.end());
+
+        try {
+            db.PFMERGE(dest_key, source_keys, acquire_lock);
+            return "+OK\r\n";
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+    }
+};
@@ -0,0 +1,209 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <optional>
+#include <unordered_map>
+#include <stdexcept>
+#include "Listpack.hpp"
+#include "Dict.hpp"
+
+/* Field -> value map of a HASH key. Small hashes are kept as one listpack of alternating field/value entries,
+which costs a few bytes per field instead of a heap node each. Past MAX_LISTPACK_ENTRIES fields or once a field or value
+longer than MAX_LISTPACK_VALUE is stored, the hash is converted to a Dict for good, as in Redis.
+Fields with a TTL (HEXPIRE) are tracked in field_expiry. Expired fields are hidden by the readers and removed by purgeExpired(). */
+class RedisHash {
+public:
+    static constexpr size_t MAX_LISTPACK_ENTRIES = 128;
+    static constexpr size_t MAX_LISTPACK_VALUE = 64;
+
+private:
+    Listpack lp;
+    Dict<std::string, std::string> table;
+    bool is_listpack = true;
+    std::unordered_map<std::string, long long> field_expiry; // field -> unix time in ms
+
+    void convertToTable() {
+        table.reserve(lp.size() / 2 + 1);
+        for(size_t pos = lp.first(); pos != lp.endPos(); ) {
+            size_t value_pos = lp.next(pos);
+            table.insert_or_assign(lp.get(pos), lp.get(value_pos));
+            pos = lp.next(value_pos);
+        }
+        lp = Listpack();
+        is_listpack = false;
+    }
+
+    // offset of the field entry inside the listpack, npos if missing
+    size_t findField(std::string_view field) const {
+        return lp.find(field, lp.first(), 1);
+    }
+
+public:
+    // adopt a field/value listpack (e.g. from an RDB file) as is, converted only when it is past the listpack limits
+    static RedisHash fromListpack(Listpack listpack) {
+        if(listpack.size() % 2 != 0) throw std::runtime_error("invalid hash listpack");
+        RedisHash hash;
+        hash.lp = std::move(listpack);
+        bool fits = hash.lp.size() / 2 <= MAX_LISTPACK_ENTRIES;
+        for(size_t pos = hash.lp.first(); fits && pos != hash.lp.endPos(); pos = hash.lp.next(pos)) {
+            std::string_view str;
+            long long ival;
+            if(hash.lp.get(pos, str, ival) && str.size() > MAX_LISTPACK_VALUE) fits = false;
+        }
+        if(!fits) hash.convertToTable();
+        return hash;
+    }
+
+    bool isListpack() const { return is_listpack; }
+    std::string encoding() const { return is_listpack ? "listpack" : "hashtable"; }
+    const Listpack& listpack() const { return lp; }
+
+    bool hasFieldExpiry() const { return !field_expiry.empty(); }
+
+    bool isExpired(const std::string& field, long long now) const {
+        if(field_expiry.empty()) return false;
+        auto it = field_expiry.find(field);
+        return it != field_expiry.end() && it->second <= now;
+    }
+
+    // number of stored fields, including the expired ones not purged yet
+    size_t size() const { return is_listpack ? lp.size() / 2 : table.size(); }
+
+    size_t size(long long now) const {
+        size_t expired = 0;
+        for(auto& [field, at] : field_expiry) {
+            if(at <= now) expired++;
+        }
+        return size() - expired;
+    }
+
+    bool empty() const { return size() == 0; }
+
+    // every field had a TTL that passed: Redis deletes the key then, so it reads as missing. O(1) unless all fields have a TTL
+    bool allExpired(long long now) const {
+        if(field_expiry.size() < size()) return false;
+        return size(now) == 0;
+    }
+
+    std::optional<std::string> get(const std::string& field, long long now) const {
+        if(isExpired(field, now)) return std::nullopt;
+
+        if(is_listpack) {
+            size_t pos = findField(field);
+            if(pos == std::string::npos) return std::nullopt;
+            return lp.get(lp.next(pos));
+        }
+
+        auto it = table.find(field);
+        if(it == table.end()) return std::nullopt;
+        return it->second;
+    }
+
+    bool exists(const std::string& field, long long now) const {
+        if(isExpired(field, now)) return false;
+        if(is_listpack) return findField(field) != std::string::npos;
+        return table.count(field) > 0;
+    }
+
+    // returns true if the field is new. Overwriting a field clears its TTL, as HSET does in Redis
+    bool set(const std::string& field, const std::string& value) {
+        if(is_listpack && (field.size() > MAX_LISTPACK_VALUE || value.size() > MAX_LISTPACK_VALUE)) {
+            convertToTable();
+        }
+
+        if(!field_expiry.empty()) field_expiry.erase(field);
+
+        if(is_listpack) {
+            size_t pos = findField(field);
+            if(pos != std::string::npos) {
+                lp.replace(lp.next(pos), value);
+                return false;
+            }
+            lp.append(field);
+            lp.append(value);
+            if(lp.size() / 2 > MAX_LISTPACK_ENTRIES) convertToTable();
+            return true;
+        }
+
+        return table.insert_or_assign(field, value).second;
+    }
+
+    bool del(const std::string& field) {
+        if(!field_expiry.empty()) field_expiry.erase(field);
+
+        if(is_listpack) {
+            size_t pos = findField(field);
+            if(pos == std::string::npos) return false;
+            lp.erase(pos, 2);
+            return true;
+        }
+        return table.erase(field) > 0;
+    }
+
+    // visit every live field/value pair
+    template <typename Fn>
+    void forEach(long long now, Fn&& fn) const {
+        if(is_listpack) {
+            for(size_t pos = lp.first(); pos != lp.endPos(); ) {
+                size_t value_pos = lp.next(pos);
+                std::string field = lp.get(pos);
+                if(!isExpired(field, now)) fn(field, lp.get(value_pos));
+                pos = lp.next(value_pos);
+            }
+            return;
+        }
+        for(auto& [field, value] : table) {
+            if(!isExpired(field, now)) fn(field, value);
+        }
+    }
+
+    /* One HSCAN step. A listpack hash is small enough to be returned whole with cursor 0, the table is walked
+    with Dict::scan so fields are not missed when it is resized between calls. */
+    template <typename Fn>
+    uint64_t scan(uint64_t cursor, size_t count, long long now, Fn&& fn) const {
+        if(is_listpack) {
+            forEach(now, fn);
+            return 0;
+        }
+
+        size_t visited = 0;
+        size_t max_steps = count * 10; // bound the work on a sparse table, like Redis does
+        do {
+            cursor = table.scan(cursor, [&](const std::pair<const std::string, std::string>& kv) {
+                if(!isExpired(kv.first, now)) {
+                    fn(kv.first, kv.second);
+                    visited++;
+                }
+            });
+        } while(cursor != 0 && visited < count && --max_steps > 0);
+        return cursor;
+    }
+
+    // TTL of a field in ms since epoch, -1 if it has none. The field must exist
+    long long expiry(const std::string& field) const {
+        auto it = field_expiry.find(field);
+        return it == field_expiry.end() ? -1 : it->second;
+    }
+
+    void setExpiry(const std::string& field, long long at) { field_expiry[field] = at; }
+
+    bool persist(const std::string& field) { return field_expiry.erase(field) > 0; }
+
+    // drop the fields whose TTL has passed, callers must hold the db lock exclusively
+    void purgeExpired(long long now) {
+        for(auto it = field_expiry.begin(); it != field_expiry.end(); ) {
+            if(it->second <= now) {
+                std::string field = it->first;
+                it = field_expiry.erase(it);
+                if(is_listpack) {
+                    size_t pos = findField(field);
+                    if(pos != std::string::npos) lp.erase(pos, 2);
+                } else {
+                    table.erase(field);
+                }
+            } else {
+                ++it;
+            }
+        }
+    }
+};
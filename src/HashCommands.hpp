@@ -0,0 +1,521 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <optional>
+#include <chrono>
+#include <algorithm>
+#include "Command.hpp"
+#include "KVStore.hpp"
+#include "ClientContext.hpp"
+#include "ScanArgs.hpp"
+
+// RESP array of field/value pairs, flattened as HGETALL replies
+inline std::string hashPairsToRESP(const std::vector<std::pair<std::string, std::string> >& pairs, bool with_values = true) {
+    std::string ans = "*" + std::to_string(pairs.size() * (with_values ? 2 : 1)) + "\r\n";
+    for(const auto& [field, value] : pairs) {
+        ans += "$" + std::to_string(field.length()) + "\r\n" + field + "\r\n";
+        if(with_values) {
+            ans += "$" + std::to_string(value.length()) + "\r\n" + value + "\r\n";
+        }
+    }
+    return ans;
+}
+
+// parses "FIELDS numfields field1 field2 ..." starting at args[idx], returns an error reply or an empty string
+inline std::string parseHashFieldsArg(const std::vector<std::string>& args, size_t idx, std::vector<std::string>& fields) {
+    if(idx >= args.size()) {
+        return "-ERR wrong number of arguments\r\n";
+    }
+    std::string keyword = args[idx];
+    std::transform(keyword.begin(), keyword.end(), keyword.begin(), ::toupper);
+    if(keyword != "FIELDS" || idx + 1 >= args.size()) {
+        return "-ERR Mandatory argument FIELDS is missing or not at the right position\r\n";
+    }
+
+    long long num_fields;
+    if(!Listpack::stringToInt(args[idx + 1], num_fields) || num_fields <= 0) {
+        return "-ERR Parameter `numFields` should be greater than 0\r\n";
+    }
+    if((size_t)num_fields != args.size() - idx - 2) {
+        return "-ERR The `numfields` parameter must match the number of arguments\r\n";
+    }
+
+    fields.assign(args.begin() + idx + 2, args.end());
+    return "";
+}
+
+class HSetCommand : public Command {
+public:
+    std::string name() const override { return "HSET"; }
+    int min_args() const override { return 4; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
+    bool isWriteCommand() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        //args: HSET key field value [field value ...]
+        std::string hash_key = args[1];
+
+        if((args.size() - 2) & 1) {
+            return "-ERR wrong number of arguments for 'hset' command\r\n";
+        }
+
+        std::vector<std::pair<std::string, std::string> > fields;
+        for(size_t i = 2; i < args.size(); i += 2) {
+            fields.push_back({args[i], args[i + 1]});
+        }
+
+        try {
+            int added = db.HSET(hash_key, fields, acquire_lock);
+            return ":" + std::to_string(added) + "\r\n";
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+    }
+};
+
+class HGetCommand : public Command {
+public:
+    std::string name() const override { return "HGET"; }
+    int min_args() const override { return 3; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
+    bool isWriteCommand() const override { return false; }
+    bool isReadOnly() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        std::string hash_key = args[1];
+        std::string field = args[2];
+
+        try {
+            std::optional<std::string> value = db.HGET(hash_key, field, acquire_lock);
+            if(!value.has_value()) {
+                return "$-1\r\n";
+            }
+            return "$" + std::to_string(value->length()) + "\r\n" + *value + "\r\n";
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+    }
+};
+
+class HMGetCommand : public Command {
+public:
+    std::string name() const override { return "HMGET"; }
+    int min_args() const override { return 3; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
+    bool isWriteCommand() const override { return false; }
+    bool isReadOnly() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        std::string hash_key = args[1];
+        std::vector<std::string> fields(args.begin() + 2, args.end());
+
+        try {
+            std::vector<std::optional<std::string> > values = db.HMGET(hash_key, fields, acquire_lock);
+
+            std::string response = "*" + std::to_string(values.size()) + "\r\n";
+            for(auto& value : values) {
+                if(value.has_value()) {
+                    response += "$" + std::to_string(value->length()) + "\r\n" + *value + "\r\n";
+                } else {
+                    response += "$-1\r\n";
+                }
+            }
+            return response;
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+    }
+};
+
+class HDelCommand : public Command {
+public:
+    std::string name() const override { return "HDEL"; }
+    int min_args() const override { return 3; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
+    bool isWriteCommand() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+    std::vector<std::string> rewriteForAof(const std::vector<std::string>& args, const std::string& reply) const override { return argsUnlessZero(args, reply); }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        std::string hash_key = args[1];
+        std::vector<std::string> fields(args.begin() + 2, args.end());
+
+        try {
+            int deleted = db.HDEL(hash_key, fields, acquire_lock);
+            return ":" + std::to_string(deleted) + "\r\n";
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+    }
+};
+
+class HGetAllCommand : public Command {
+public:
+    std::string name() const override { return "HGETALL"; }
+    int min_args() const override { return 2; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
+    bool isWriteCommand() const override { return false; }
+    bool isReadOnly() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        std::string hash_key = args[1];
+
+        try {
+            return hashPairsToRESP(db.HGETALL(hash_key, acquire_lock));
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+    }
+};
+
+class HIncrByCommand : public Command {
+public:
+    std::string name() const override { return "HINCRBY"; }
+    int min_args() const override { return 4; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
+    bool isWriteCommand() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override {
+        long long increment;
+        if(!Listpack::stringToInt(args[3], increment)) {
+            return "-ERR value is not an integer or out of range\r\n";
+        }
+        bound = increment;
+        return "";
+    }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        return bindAndExecute(context, args, db, acquire_lock);
+    }
+
+    std::string execute_bound(ClientContext& context, const std::vector<std::string> &args, const std::any& bound, KeyValueDatabase &db, bool acquire_lock) override {
+        std::string hash_key = args[1];
+        std::string field = args[2];
+        long long increment = std::any_cast<long long>(bound);
+
+        try {
+            long long value = db.HINCRBY(hash_key, field, increment, acquire_lock);
+            return ":" + std::to_string(value) + "\r\n";
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+    }
+};
+
+class HLenCommand : public Command {
+public:
+    std::string name() const override { return "HLEN"; }
+    int min_args() const override { return 2; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
+    bool isWriteCommand() const override { return false; }
+    bool isReadOnly() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        std::string hash_key = args[1];
+
+        try {
+            return ":" + std::to_string(db.HLEN(hash_key, acquire_lock)) + "\r\n";
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+    }
+};
+
+class HExistsCommand : public Command {
+public:
+    std::string name() const override { return "HEXISTS"; }
+    int min_args() const override { return 3; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
+    bool isWriteCommand() const override { return false; }
+    bool isReadOnly() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        std::string hash_key = args[1];
+        std::string field = args[2];
+
+        try {
+            return db.HEXISTS(hash_key, field, acquire_lock) ? ":1\r\n" : ":0\r\n";
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+    }
+};
+
+class HScanCommand : public Command {
+public:
+    std::string name() const override { return "HSCAN"; }
+    int min_args() const override { return 3; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
+    bool isWriteCommand() const override { return false; }
+    bool isReadOnly() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override {
+        //args: HSCAN key cursor [MATCH pattern] [COUNT count] [NOVALUES]
+        ScanArgs scan;
+        std::string error = parseScanArgs(args, 2, ScanOption::NOVALUES, scan);
+        if(!error.empty()) {
+            return error;
+        }
+        bound = std::move(scan);
+        return "";
+    }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        return bindAndExecute(context, args, db, acquire_lock);
+    }
+
+    std::string execute_bound(ClientContext& context, const std::vector<std::string> &args, const std::any& bound, KeyValueDatabase &db, bool acquire_lock) override {
+        std::string hash_key = args[1];
+        const ScanArgs& scan = std::any_cast<const ScanArgs&>(bound);
+
+        try {
+            std::vector<std::pair<std::string, std::string> > result;
+            uint64_t next_cursor = db.HSCAN(hash_key, scan.cursor, scan.pattern, scan.count, result, acquire_lock);
+
+            std::string next = std::to_string(next_cursor);
+            return "*2\r\n$" + std::to_string(next.length()) + "\r\n" + next + "\r\n" + hashPairsToRESP(result, !scan.novalues);
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+    }
+};
+
+// HEXPIRE / HPEXPIRE key time [NX | XX | GT | LT] FIELDS numfields field...
+// HEXPIREAT / HPEXPIREAT take a unix time instead
+class HExpireCommand : public Command {
+private:
+    bool in_ms;
+    bool absolute;
+
+    static long long now_ms() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    // what bind() parses: the time argument in ms, still relative unless 'absolute'
+    struct Bound {
+        long long time_ms;
+        std::string condition; // NX, XX, GT, LT or empty
+        std::vector<std::string> fields;
+    };
+
+    // the time argument in ms, false (with 'error' set) when it is invalid
+    bool parseTime(const std::string& arg, long long& time_ms, std::string& error) const {
+        long long time;
+        if(!Listpack::stringToInt(arg, time) || time < 0 || (!in_ms && time > LLONG_MAX / 1000)) {
+            error = "-ERR value is not an integer or out of range\r\n";
+            return false;
+        }
+        time_ms = in_ms ? time : time * 1000;
+        return true;
+    }
+
+    // the unix time in ms a parsed time stands for when the command runs, -1 (with 'error' set) when it overflows
+    long long resolve(long long time_ms, std::string& error) const {
+        if(absolute) return time_ms;
+
+        long long now = now_ms();
+        if(time_ms > LLONG_MAX - now) {
+            error = "-ERR invalid expire time in '" + name() + "' command\r\n";
+            return -1;
+        }
+        return now + time_ms;
+    }
+
+public:
+    HExpireCommand(bool in_ms, bool absolute = false) : in_ms(in_ms), absolute(absolute) {}
+
+    std::string name() const override {
+        if(absolute) return in_ms ? "HPEXPIREAT" : "HEXPIREAT";
+        return in_ms ? "HPEXPIRE" : "HEXPIRE";
+    }
+    int min_args() const override { return 6; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
+    bool isWriteCommand() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override {
+        Bound parsed;
+        std::string error;
+        if(!parseTime(args[2], parsed.time_ms, error)) {
+            return error;
+        }
+
+        size_t idx = 3;
+        parsed.condition = args[idx];
+        std::transform(parsed.condition.begin(), parsed.condition.end(), parsed.condition.begin(), ::toupper);
+        if(parsed.condition == "NX" || parsed.condition == "XX" || parsed.condition == "GT" || parsed.condition == "LT") {
+            idx++;
+        } else {
+            parsed.condition.clear();
+        }
+
+        error = parseHashFieldsArg(args, idx, parsed.fields);
+        if(!error.empty()) {
+            return error;
+        }
+
+        bound = std::move(parsed);
+        return "";
+    }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        return bindAndExecute(context, args, db, acquire_lock);
+    }
+
+    std::string execute_bound(ClientContext& context, const std::vector<std::string> &args, const std::any& bound, KeyValueDatabase &db, bool acquire_lock) override {
+        std::string hash_key = args[1];
+        Bound parsed = std::any_cast<const Bound&>(bound);
+
+        // a relative time counts from when the command runs, not from when it was queued
+        std::string error;
+        long long expire_at = resolve(parsed.time_ms, error);
+        if(expire_at == -1) {
+            return error;
+        }
+
+        try {
+            std::vector<int> result = db.HEXPIRE(hash_key, expire_at, parsed.condition, parsed.fields, acquire_lock);
+
+            std::string response = "*" + std::to_string(result.size()) + "\r\n";
+            for(int code : result) {
+                response += ":" + std::to_string(code) + "\r\n";
+            }
+            return response;
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+    }
+
+    // logged as the HPEXPIREAT it came to, a replay would otherwise start the clock again
+    std::vector<std::string> rewriteForAof(const std::vector<std::string>& args, const std::string& reply) const override {
+        // one reply per field, 1 set a TTL and 2 deleted the field: with neither nothing changed
+        std::vector<std::string> results = replyStrings(reply);
+        if(std::none_of(results.begin(), results.end(), [](const std::string& r) { return r == "1" || r == "2"; })) return {};
+
+        std::string error;
+        long long time_ms;
+        if(!parseTime(args[2], time_ms, error)) return args;
+        long long expire_at = resolve(time_ms, error);
+        if(expire_at == -1) return args;
+
+        std::vector<std::string> logged = args;
+        logged[0] = "HPEXPIREAT";
+        logged[2] = std::to_string(expire_at);
+        return logged;
+    }
+};
+
+// HTTL / HPTTL key FIELDS numfields field...
+class HTTLCommand : public Command {
+private:
+    bool in_ms;
+
+public:
+    HTTLCommand(bool in_ms) : in_ms(in_ms) {}
+
+    std::string name() const override { return in_ms ? "HPTTL" : "HTTL"; }
+    int min_args() const override { return 5; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
+    bool isWriteCommand() const override { return false; }
+    bool isReadOnly() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override {
+        std::vector<std::string> fields;
+        std::string error = parseHashFieldsArg(args, 2, fields);
+        if(!error.empty()) {
+            return error;
+        }
+        bound = std::move(fields);
+        return "";
+    }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        return bindAndExecute(context, args, db, acquire_lock);
+    }
+
+    std::string execute_bound(ClientContext& context, const std::vector<std::string> &args, const std::any& bound, KeyValueDatabase &db, bool acquire_lock) override {
+        std::string hash_key = args[1];
+        std::vector<std::string> fields = std::any_cast<const std::vector<std::string>&>(bound);
+
+        try {
+            std::vector<long long> result = db.HTTL(hash_key, fields, in_ms, acquire_lock);
+
+            std::string response = "*" + std::to_string(result.size()) + "\r\n";
+            for(long long ttl : result) {
+                response += ":" + std::to_string(ttl) + "\r\n";
+            }
+            return response;
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+    }
+};
+
+class HPersistCommand : public Command {
+public:
+    std::string name() const override { return "HPERSIST"; }
+    int min_args() const override { return 5; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
+    bool isWriteCommand() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    // one reply per field, 1 where a TTL was removed
+    std::vector<std::string> rewriteForAof(const std::vector<std::string>& args, const std::string& reply) const override {
+        std::vector<std::string> results = replyStrings(reply);
+        if(std::find(results.begin(), results.end(), "1") == results.end()) return {};
+        return args;
+    }
+
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override {
+        //args: HPERSIST key FIELDS numfields field...
+        std::vector<std::string> fields;
+        std::string error = parseHashFieldsArg(args, 2, fields);
+        if(!error.empty()) {
+            return error;
+        }
+        bound = std::move(fields);
+        return "";
+    }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        return bindAndExecute(context, args, db, acquire_lock);
+    }
+
+    std::string execute_bound(ClientContext& context, const std::vector<std::string> &args, const std::any& bound, KeyValueDatabase &db, bool acquire_lock) override {
+        std::string hash_key = args[1];
+        std::vector<std::string> fields = std::any_cast<const std::vector<std::string>&>(bound);
+
+        try {
+            std::vector<int> result = db.HPERSIST(hash_key, fields, acquire_lock);
+
+            std::string response = "*" + std::to_string(result.size()) + "\r\n";
+            for(int code : result) {
+                response += ":" + std::to_string(code) + "\r\n";
+            }
+            return response;
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+    }
+};
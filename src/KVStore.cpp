@@ -3,6 +3,14 @@
 #include "Command.hpp"
 #include "ClientContext.hpp"
 #include "GeoHelper.hpp"
+#include "GlobMatcher.hpp"
+#include "SimdHelper.hpp"
+#include "ModuleManager.hpp"
+#include "RDBWriter.hpp"
+#include <unistd.h>
+#include <random>
+#include <cmath>
+#include <unordered_set>
 
 
 KeyValueDatabase db;
@@ -14,21 +22,18 @@ long long KeyValueDatabase::current_time_ms()
         .count();
 }
 
-void KeyValueDatabase::SET(const std::string &key, const std::string &value, bool acquire_lock, long long px_duration)
+void KeyValueDatabase::SET(const std::string &key, const std::string &value, bool acquire_lock, long long expire_at_ms)
 {
     std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock); // we use unique_lock to acquire the mutex EXCLUSIVELY as we are WRITING
 
     if(acquire_lock) {
         db_lock.lock();
     }
-    
-    long long expiry = -1; // -1 means it has expiry as INF
-    if (px_duration > 0)
-    {
-        expiry = current_time_ms() + px_duration;
-    }
+    touch(key);
+
+    // -1 means it has expiry as INF, a time already past leaves a key the next lookup expires
     Value myVar = value;
-    map[key] = {myVar, ObjType::STRING, expiry};
+    map[key] = {myVar, ObjType::STRING, expire_at_ms};
 }
 
 std::optional<std::string> KeyValueDatabase::GET(const std::string &key, bool acquire_lock)
@@ -46,6 +51,7 @@ std::optional<std::string> KeyValueDatabase::GET(const std::string &key, bool ac
     }
     if (it->second.expiry_at != -1 && it->second.expiry_at < current_time_ms())
     {
+        touch(key); // an expired watched key counts as modified, like in Redis
         map.erase(it); // key exists but has expired
         return std::nullopt;
     }
@@ -68,6 +74,7 @@ int KeyValueDatabase::RPUSH(std::string &list_key, std::vector<std::string> &ite
     auto it = map.find(list_key);
 
     if(it != map.end() && it->second.type != ObjType::LIST) return -1;
+    touch(list_key);
 
     if(it == map.end()) {
         RedisList dq;
@@ -76,30 +83,14 @@ int KeyValueDatabase::RPUSH(std::string &list_key, std::vector<std::string> &ite
     } 
 
     RedisList& dq = get<RedisList>(it->second.value);
-    std::list<BlockingContextList*>& waiters = blocking_map[list_key];
-
-    //#items which were to be added but weren't as they were popped by blpop
-    int handed_off_count = 0;
-
-    for(auto item : items) {
-        if(!waiters.empty()) {
-            BlockingContextList* ctx = waiters.front();
-            waiters.pop_front();
-            ctx->is_fulfilled = true;
-            ctx->list = list_key;
-            ctx->item = item;
-            ctx->cv.notify_one();
-            handed_off_count++;
-        } else {
-            dq.push_back(item);
-        }
-    }
-
-    if (dq.empty()) {
-        map.erase(it);
+    for(auto& item : items) {
+        dq.push_back(item);
     }
 
-    return dq.size() + handed_off_count;
+    // the reply is the length after the push, even if blocked clients take the items right away
+    int size = dq.size();
+    serve_list_waiters(list_key);
+    return size;
 }
 
 int KeyValueDatabase::LPUSH(std::string &list_key, std::vector<std::string> &items, bool acquire_lock) {
@@ -112,6 +103,7 @@ int KeyValueDatabase::LPUSH(std::string &list_key, std::vector<std::string> &ite
     auto it = map.find(list_key);
 
     if(it != map.end() && it->second.type != ObjType::LIST) return -1;
+    touch(list_key);
 
     if(it == map.end()) {
         RedisList dq;
@@ -120,29 +112,14 @@ int KeyValueDatabase::LPUSH(std::string &list_key, std::vector<std::string> &ite
     } 
 
     RedisList& dq = get<RedisList>(it->second.value);
-    std::list<BlockingContextList*>& waiters = blocking_map[list_key];
-
-    int handed_off_count = 0;
-
-    for(auto item : items) {
-        if(!waiters.empty()) {
-            BlockingContextList* ctx = waiters.front();
-            waiters.pop_front();
-            ctx->is_fulfilled = true;
-            ctx->list = list_key;
-            ctx->item = item;
-            ctx->cv.notify_one();
-            handed_off_count++;
-        } else {
-            dq.push_front(item);
-        }
+    for(auto& item : items) {
+        dq.push_front(item);
     }
 
-    if (dq.empty()) {
-        map.erase(it);
-    }
-
-    return dq.size() + handed_off_count;
+    // the reply is the length after the push, even if blocked clients take the items right away
+    int size = dq.size();
+    serve_list_waiters(list_key);
+    return size;
 }
 
 std::vector<std::string> KeyValueDatabase::LRANGE(std::string &list_key, int start, int end, bool acquire_lock) {
@@ -181,6 +158,21 @@ int KeyValueDatabase::LLEN(std::string &list_key, bool acquire_lock) {
     return size;
 }
 
+std::vector<std::string> KeyValueDatabase::pop_items(RedisList& dq, bool left, int count) {
+    std::vector<std::string> removed_items;
+    count = std::min(count, (int)dq.size());
+    for(int i = 0; i < count; i++) {
+        if(left) {
+            removed_items.push_back(std::move(dq.front()));
+            dq.pop_front();
+        } else {
+            removed_items.push_back(std::move(dq.back()));
+            dq.pop_back();
+        }
+    }
+    return removed_items;
+}
+
 std::vector<std::string> KeyValueDatabase::LPOP(std::string &list_key, int num_remove_item, bool acquire_lock) {
     std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock); 
 
@@ -192,12 +184,32 @@ std::vector<std::string> KeyValueDatabase::LPOP(std::string &list_key, int num_r
     std::vector<std::string> removed_items;
 
     if(it != map.end() && it->second.type == ObjType::LIST) {
+        touch(list_key);
         RedisList& dq = get<RedisList>(it->second.value);
-        num_remove_item = std::min(num_remove_item, (int)dq.size());
-        for(int i = 0; i < num_remove_item; i++) {
-            removed_items.push_back(dq.front());
-            dq.pop_front();
+        removed_items = pop_items(dq, true, num_remove_item);
+
+        if(dq.empty()) {
+            map.erase(it);
         }
+    }
+
+    return removed_items;
+}
+
+std::vector<std::string> KeyValueDatabase::RPOP(std::string &list_key, int num_remove_item, bool acquire_lock) {
+    std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock); 
+
+    if(acquire_lock) {
+        db_lock.lock();
+    }
+
+    auto it = map.find(list_key);
+    std::vector<std::string> removed_items;
+
+    if(it != map.end() && it->second.type == ObjType::LIST) {
+        touch(list_key);
+        RedisList& dq = get<RedisList>(it->second.value);
+        removed_items = pop_items(dq, false, num_remove_item);
 
         if(dq.empty()) {
             map.erase(it);
@@ -207,7 +219,198 @@ std::vector<std::string> KeyValueDatabase::LPOP(std::string &list_key, int num_r
     return removed_items;
 }
 
-std::optional<std::pair<std::string, std::string> > KeyValueDatabase::BLPOP(std::vector<std::string>& list_keys, double wait_time, bool acquire_lock) {
+void KeyValueDatabase::unregister_list_waiter(BlockingListWaiter& waiter, const std::string& serving_key) {
+    for(auto& [key, node] : waiter.nodes) {
+        auto it = blocking_map.find(key);
+        if(it == blocking_map.end()) continue;
+
+        it->second.erase(node);
+        // the push serving this key is still walking its list and prunes it itself
+        if(it->second.empty() && key != serving_key) {
+            blocking_map.erase(it);
+        }
+    }
+    waiter.nodes.clear();
+
+    if(waiter.timer) {
+        list_timers.cancel(*waiter.timer);
+        waiter.timer.reset();
+    }
+}
+
+void KeyValueDatabase::touch(const std::string& key) {
+    dirty.fetch_add(1, std::memory_order_relaxed);
+
+    // fast path for the common case of nobody watching anything, WATCH registers under a db lock so this read is ordered
+    if(num_watched_keys.load(std::memory_order_relaxed) == 0) return;
+
+    std::lock_guard<std::mutex> lock(watch_mutex);
+    auto it = watched_keys.find(key);
+    if(it == watched_keys.end()) return;
+    for(WatchState* state : it->second) {
+        state->dirty = true;
+    }
+}
+
+void KeyValueDatabase::WATCH(WatchState& state, const std::vector<std::string>& keys, bool acquire_lock) {
+    // a shared lock is enough to order the registration against writers, which touch under the unique lock
+    std::shared_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+
+    if(acquire_lock) {
+        db_lock.lock();
+    }
+
+    std::lock_guard<std::mutex> lock(watch_mutex);
+    for(const std::string& key : keys) {
+        bool registered = false;
+        for(auto& [watched_key, node] : state.nodes) {
+            if(watched_key == key) registered = true;
+        }
+        if(registered) continue;
+
+        auto [it, inserted] = watched_keys.try_emplace(key);
+        if(inserted) num_watched_keys++;
+        it->second.push_back(&state);
+        state.nodes.push_back({key, std::prev(it->second.end())});
+    }
+}
+
+void KeyValueDatabase::UNWATCH(WatchState& state) {
+    std::lock_guard<std::mutex> lock(watch_mutex);
+    for(auto& [key, node] : state.nodes) {
+        auto it = watched_keys.find(key);
+        it->second.erase(node);
+        if(it->second.empty()) {
+            watched_keys.erase(it);
+            num_watched_keys--;
+        }
+    }
+    state.nodes.clear();
+    state.dirty = false;
+}
+
+RedisList* KeyValueDatabase::find_list(const std::string& list_key) {
+    auto it = map.find(list_key);
+    if(it == map.end()) {
+        return nullptr;
+    }
+    if(it->second.type != ObjType::LIST) {
+        throw std::runtime_error("WRONGTYPE Operation against a key holding the wrong kind of value");
+    }
+    return &std::get<RedisList>(it->second.value);
+}
+
+void KeyValueDatabase::push_item(const std::string& list_key, std::string&& item, bool left) {
+    auto it = map.find(list_key);
+    if(it == map.end()) {
+        it = map.try_emplace(list_key, Entry{Value(RedisList()), ObjType::LIST, -1}).first;
+    }
+    RedisList& dq = std::get<RedisList>(it->second.value);
+    if(left) {
+        dq.push_front(std::move(item));
+    } else {
+        dq.push_back(std::move(item));
+    }
+}
+
+/* Caller holds the db lock uniquely, the list may be erased if the waiters drain it.
+BLMOVE waiters push into another list which may have waiters of its own, so keys are served from a queue of ready keys
+(like handleClientsBlockedOnKeys in Redis) rather than recursively, which would pull the list out from under the outer loop */
+void KeyValueDatabase::serve_list_waiters(const std::string& list_key) {
+    std::deque<std::string> ready = {list_key};
+
+    while(!ready.empty()) {
+        std::string key = std::move(ready.front());
+        ready.pop_front();
+
+        auto waiting = blocking_map.find(key);
+        if(waiting == blocking_map.end()) continue;
+
+        auto it = map.find(key);
+        if(it == map.end() || it->second.type != ObjType::LIST) continue;
+        RedisList& dq = std::get<RedisList>(it->second.value); // nodes of the dict are stable, unlike 'it' once a destination is created
+        std::list<BlockingListWaiter*>& waiters = waiting->second;
+
+        // clients are served in the order they blocked, each takes what it asked for while the list lasts
+        while(!waiters.empty() && !dq.empty()) {
+            BlockingListWaiter* waiter = waiters.front();
+
+            std::lock_guard<std::mutex> waiter_lock(waiter->lock);
+            unregister_list_waiter(*waiter, key);
+            waiter->list = key;
+            waiter->is_fulfilled = true;
+
+            if(!waiter->is_move) {
+                waiter->items = pop_items(dq, waiter->left, waiter->count);
+            } else {
+                auto dest = map.find(waiter->move_to);
+                if(dest != map.end() && dest->second.type != ObjType::LIST) {
+                    waiter->error = "WRONGTYPE Operation against a key holding the wrong kind of value";
+                } else {
+                    waiter->items = pop_items(dq, waiter->left, 1);
+                    touch(waiter->move_to);
+                    push_item(waiter->move_to, std::string(waiter->items[0]), waiter->move_to_left);
+                    if(waiter->move_to != key) {
+                        ready.push_back(waiter->move_to);
+                    }
+                }
+            }
+            waiter->cv.notify_one();
+        }
+
+        if(waiters.empty()) {
+            blocking_map.erase(waiting);
+        }
+        if(dq.empty()) {
+            map.erase(key);
+        }
+    }
+}
+
+void KeyValueDatabase::wait_for_lists(std::unique_lock<std::shared_mutex>& db_lock, BlockingListWaiter& waiter, const std::vector<std::string>& list_keys, double timeout) {
+    for(const std::string& key : list_keys) {
+        bool registered = false;
+        for(auto& [waiting_key, node] : waiter.nodes) {
+            if(waiting_key == key) registered = true;
+        }
+        if(registered) continue;
+
+        std::list<BlockingListWaiter*>& waiters = blocking_map[key];
+        waiters.push_back(&waiter);
+        waiter.nodes.push_back({key, std::prev(waiters.end())});
+    }
+
+    if(timeout > 0) {
+        std::call_once(list_timer_started, [this] {
+            list_timer_thread = std::jthread([this](std::stop_token stop) { expire_list_waiters(stop); });
+        });
+        waiter.timer = list_timers.schedule((long long)std::ceil(timeout * 1000), &waiter);
+    }
+
+    db_lock.unlock();
+
+    std::unique_lock<std::mutex> waiter_lock(waiter.lock);
+    waiter.cv.wait(waiter_lock, [&]{ return waiter.is_fulfilled; });
+}
+
+void KeyValueDatabase::expire_list_waiters(std::stop_token stop) {
+    while(!stop.stop_requested()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(TimerWheel<BlockingListWaiter*>::TICK_MS));
+        if(!list_timers.due()) continue;
+
+        // one db lock for every client timing out in this tick, a waiter that was served meanwhile already cancelled its timer
+        std::unique_lock<std::shared_mutex> db_lock(rw_lock);
+        list_timers.expire([this](BlockingListWaiter* waiter) {
+            std::lock_guard<std::mutex> waiter_lock(waiter->lock);
+            waiter->timer.reset();
+            unregister_list_waiter(*waiter);
+            waiter->is_fulfilled = true;
+            waiter->cv.notify_one();
+        });
+    }
+}
+
+std::optional<std::pair<std::string, std::vector<std::string> > > KeyValueDatabase::BLMPOP(std::vector<std::string>& list_keys, bool left, int count, bool block, double timeout, bool acquire_lock) {
     std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock); 
 
     if(acquire_lock) {
@@ -220,74 +423,268 @@ std::optional<std::pair<std::string, std::string> > KeyValueDatabase::BLPOP(std:
         if(it == map.end() || it->second.type != ObjType::LIST) continue;
         RedisList& dq = std::get<RedisList>(it->second.value);
         if(!dq.empty()) {
-            std::string item = dq.front();
-            dq.pop_front();
-
-            std::string key_list = key;
+            touch(key);
+            std::vector<std::string> items = pop_items(dq, left, count);
             if(dq.empty()) {
                 map.erase(it);
             }
+            return {{key, std::move(items)}};
+        }
+    }
+
+    // inside EXEC we hold the db lock on behalf of the whole transaction, so we can't sleep here
+    if(!block || !acquire_lock) {
+        return std::nullopt;
+    }
+
+    //No non-empty list, queue a waiter record on every key and let the thread sleep until a push or the timer wheel fills it
+    BlockingListWaiter waiter;
+    waiter.left = left;
+    waiter.count = count;
+    wait_for_lists(db_lock, waiter, list_keys, timeout);
+
+    if(waiter.items.empty()) {
+        return std::nullopt;
+    }
+    return {{waiter.list, std::move(waiter.items)}};
+}
+
+std::optional<std::string> KeyValueDatabase::LMOVE(std::string& source, std::string& destination, bool from_left, bool to_left, bool block, double timeout, bool acquire_lock) {
+    std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+
+    if(acquire_lock) {
+        db_lock.lock();
+    }
 
-            return {{key_list, item}};
+    RedisList* src = find_list(source);
+    if(src && !src->empty()) {
+        find_list(destination); // type check before anything is popped
+        touch(source);
+        touch(destination);
+        std::string item = pop_items(*src, from_left, 1)[0];
+        if(src->empty() && source != destination) {
+            map.erase(source);
         }
+        push_item(destination, std::string(item), to_left);
+        serve_list_waiters(destination);
+        return item;
+    }
+
+    // inside EXEC we hold the db lock on behalf of the whole transaction, so we can't sleep here
+    if(!block || !acquire_lock) {
+        return std::nullopt;
     }
 
-    //No non-empty list, block this thread and let it sleep
-    BlockingContextList ctx;
+    find_list(destination);
 
-    for(std::string& key : list_keys) {
-        blocking_map[key].push_back(&ctx);
+    BlockingListWaiter waiter;
+    waiter.left = from_left;
+    waiter.count = 1;
+    waiter.is_move = true;
+    waiter.move_to = destination;
+    waiter.move_to_left = to_left;
+    wait_for_lists(db_lock, waiter, {source}, timeout);
+
+    if(!waiter.error.empty()) {
+        throw std::runtime_error(waiter.error);
     }
+    if(waiter.items.empty()) {
+        return std::nullopt;
+    }
+    return std::move(waiter.items[0]);
+}
 
-    if(wait_time > 0.00001) {
-        // wait till wait_time or till condition is satisfied
-        ctx.cv.wait_for(db_lock, std::chrono::duration<double>(wait_time), [&]{return ctx.is_fulfilled;});
-    } else {
-        // wait forever till the condition is satisfied
-        ctx.cv.wait(db_lock, [&]{ return ctx.is_fulfilled; });
+std::optional<std::string> KeyValueDatabase::LINDEX(std::string& list_key, long long index, bool acquire_lock) {
+    std::shared_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+
+    if(acquire_lock) {
+        db_lock.lock();
     }
 
-    // remove this blocking context from all the lists that we added it to earlier
-    for(std::string& key : list_keys) {
-        auto it = blocking_map.find(key);
-        if (it != blocking_map.end()) {
-            it->second.remove(&ctx);
-            if(it->second.empty()) {
-                blocking_map.erase(it);
+    RedisList* dq = find_list(list_key);
+    if(!dq) return std::nullopt;
+
+    long long size = dq->size();
+    if(index < 0) index += size;
+    if(index < 0 || index >= size) return std::nullopt;
+    return (*dq)[index];
+}
+
+void KeyValueDatabase::LSET(std::string& list_key, long long index, std::string& element, bool acquire_lock) {
+    std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+
+    if(acquire_lock) {
+        db_lock.lock();
+    }
+
+    RedisList* dq = find_list(list_key);
+    if(!dq) {
+        throw std::runtime_error("ERR no such key");
+    }
+
+    long long size = dq->size();
+    if(index < 0) index += size;
+    if(index < 0 || index >= size) {
+        throw std::runtime_error("ERR index out of range");
+    }
+    touch(list_key);
+    (*dq)[index] = element;
+}
+
+int KeyValueDatabase::LREM(std::string& list_key, long long count, std::string& element, bool acquire_lock) {
+    std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+
+    if(acquire_lock) {
+        db_lock.lock();
+    }
+
+    RedisList* dq = find_list(list_key);
+    if(!dq) return 0;
+
+    // compact in place in one pass, scanning from the tail when count is negative
+    size_t limit = count == 0 ? dq->size() : (size_t)std::llabs(count);
+    size_t removed = 0;
+    if(count >= 0) {
+        auto out = dq->begin();
+        for(auto in = dq->begin(); in != dq->end(); in++) {
+            if(removed < limit && *in == element) {
+                removed++;
+                continue;
+            }
+            if(out != in) *out = std::move(*in);
+            out++;
+        }
+        dq->erase(out, dq->end());
+    } else {
+        auto out = dq->rbegin();
+        for(auto in = dq->rbegin(); in != dq->rend(); in++) {
+            if(removed < limit && *in == element) {
+                removed++;
+                continue;
             }
+            if(out != in) *out = std::move(*in);
+            out++;
         }
+        dq->erase(dq->begin(), out.base());
+    }
+
+    if(removed > 0) touch(list_key);
+    if(dq->empty()) {
+        map.erase(list_key);
+    }
+    return removed;
+}
+
+void KeyValueDatabase::LTRIM(std::string& list_key, long long start, long long stop, bool acquire_lock) {
+    std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+
+    if(acquire_lock) {
+        db_lock.lock();
     }
 
-    if(ctx.is_fulfilled) {
-        return make_pair(ctx.list, ctx.item);
+    RedisList* dq = find_list(list_key);
+    if(!dq) return;
+
+    long long size = dq->size();
+    if(start < 0) start += size;
+    if(stop < 0) stop += size;
+    if(start < 0) start = 0;
+
+    if(start > stop || start >= size) {
+        touch(list_key);
+        map.erase(list_key);
+        return;
     }
+    if(stop >= size) stop = size - 1;
+    if(start == 0 && stop == size - 1) return; // nothing trimmed
 
-    return std::nullopt;
+    touch(list_key);
+    dq->erase(dq->begin() + stop + 1, dq->end());
+    dq->erase(dq->begin(), dq->begin() + start);
 }
 
-std::string KeyValueDatabase::TYPE(std::string& key, bool acquire_lock) {
-    std::shared_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock); 
+std::vector<long long> KeyValueDatabase::LPOS(std::string& list_key, std::string& element, long long rank, long long count, long long maxlen, bool acquire_lock) {
+    std::shared_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
 
     if(acquire_lock) {
         db_lock.lock();
     }
-    
-    auto it = map.find(key);
-    if(it == map.end()) {
-        return "none";
+
+    std::vector<long long> positions;
+    RedisList* dq = find_list(list_key);
+    if(!dq) return positions;
+
+    long long size = dq->size();
+    long long skip = std::llabs(rank) - 1; // matches to pass over before collecting
+    long long scanned = 0;
+    for(long long n = 0; n < size && (maxlen == 0 || scanned < maxlen); n++, scanned++) {
+        long long i = rank > 0 ? n : size - 1 - n;
+        if((*dq)[i] != element) continue;
+        if(skip > 0) {
+            skip--;
+            continue;
+        }
+        positions.push_back(i);
+        if(count != 0 && (long long)positions.size() == count) break;
+    }
+    return positions;
+}
+
+int KeyValueDatabase::LINSERT(std::string& list_key, bool before, std::string& pivot, std::string& element, bool acquire_lock) {
+    std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+
+    if(acquire_lock) {
+        db_lock.lock();
     }
 
-    switch(it->second.type) {
+    RedisList* dq = find_list(list_key);
+    if(!dq) return 0;
+
+    auto pos = std::find(dq->begin(), dq->end(), pivot);
+    if(pos == dq->end()) return -1;
+
+    touch(list_key);
+    if(!before) pos++;
+    dq->insert(pos, element);
+    return dq->size();
+}
+
+const char* KeyValueDatabase::type_name(ObjType type) {
+    switch(type) {
         case ObjType::STRING: return "string";
         case ObjType::HASH: return "hash";
         case ObjType::LIST: return "list";
         case ObjType::STREAM: return "stream";
         case ObjType::ZSET: return "zset";
+        case ObjType::SET: return "set";
 
         default: return "none";
     }
 }
 
+bool KeyValueDatabase::is_expired(const Entry& entry, long long now) {
+    if(entry.expiry_at != -1 && entry.expiry_at < now) return true;
+    return entry.type == ObjType::HASH && std::get<RedisHash>(entry.value).allExpired(now);
+}
+
+std::string KeyValueDatabase::TYPE(std::string& key, bool acquire_lock) {
+    std::shared_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock); 
+
+    if(acquire_lock) {
+        db_lock.lock();
+    }
+    
+    auto it = map.find(key);
+    if(it == map.end() || is_expired(it->second, current_time_ms())) {
+        return "none";
+    }
+    if(it->second.type == ObjType::MODULE) {
+        return std::get<ModuleValue>(it->second.value).type->name;
+    }
+
+    return type_name(it->second.type);
+}
+
 StreamId KeyValueDatabase::XADD(std::string& stream_key, std::string& stream_id, std::vector<std::pair<std::string, std::string> >& fields, bool acquire_lock) {
     std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock); 
 
@@ -331,26 +728,78 @@ StreamId KeyValueDatabase::XADD(std::string& stream_key, std::string& stream_id,
     }
 
     StreamId new_id = stream.add(id_param, fields);
+    if (new_id.ms == 0 && new_id.seq <= 0) {
+        return new_id; // nothing was appended, nobody to wake up
+    }
+    touch(stream_key);
+
+    //serve XREADGROUP clients blocked on this stream in the order they blocked, each consumer takes what its group has not delivered yet
+    auto group_waiters = blocking_group_map.find(stream_key);
+    if(group_waiters != blocking_group_map.end()) {
+        long long now = current_time_ms();
+        std::list<BlockingGroupWaiter*>& waiters = group_waiters->second;
+
+        for(auto node = waiters.begin(); node != waiters.end(); ) {
+            BlockingGroupWaiter* waiter = *node;
+            node++; // the current node is erased when the waiter is served
 
-    /* As there are other stream as well which will try to update blocking stream context map we need to acquire lock for it. Though in 
-    current implementation we have already acquired UNIQUE db_lock first to reach here (either on our own or through EXEC) and still hold it
-    we have already assured concurrency but ideally we should have unlocked db and let others have it since we no longer want to update map 
-    and acquire this lock instead */
-
-    //check is some client is waiting for this stream entry
-    std::lock_guard<std::mutex> stream_lock(stream_blocking_mutex);
-    if(blocking_stream_map.count(stream_key)) {
-        std::list<BlockingStreamNode>& waiters = blocking_stream_map[stream_key];
-        for(auto& node : waiters) {
-            if(node.threshold_id < new_id) {
-                //There can be multiple streams waiting to notify this client so we first acquire lock to the clients block controller
-                std::lock_guard<std::mutex> client_lock(node.controller->lock);
-                node.controller->is_fulfilled = true;
-                node.controller->cv.notify_one();
+            auto group = stream.groups.find(waiter->group);
+            if(group == stream.groups.end()) continue;
+
+            std::vector<StreamEntry> delivered = stream.readGroup(group->second, waiter->consumer, waiter->count, waiter->noack, now);
+            if(delivered.empty()) continue; // an earlier consumer of the same group already took the new entries
+
+            std::lock_guard<std::mutex> waiter_lock(waiter->lock);
+            unregister_group_waiter(*waiter, stream_key);
+            waiter->result = {stream_key, std::move(delivered)};
+            waiter->is_fulfilled = true;
+            waiter->cv.notify_one();
+        }
+
+        if(waiters.empty()) {
+            blocking_group_map.erase(group_waiters);
+        }
+    }
+
+    /* XREAD waiters are indexed by the id they wait past, so the ones satisfied by new_id are exactly the prefix of the index below it.
+    They get the new entry handed over directly and are notified in one batch once the db lock is released */
+    const StreamEntry& new_entry = stream.entries.rbegin()->second;
+    std::vector<std::shared_ptr<BlockingStreamController> > woken;
+    {
+        std::lock_guard<std::mutex> stream_lock(stream_blocking_mutex);
+        auto waiters = blocking_stream_map.find(stream_key);
+        if(waiters != blocking_stream_map.end()) {
+            StreamWaiterIndex& index = waiters->second;
+            auto satisfied_end = index.lower_bound(new_id);
+
+            for(auto node = index.begin(); node != satisfied_end; ) {
+                std::shared_ptr<BlockingStreamController> controller = node->second;
+                node++; // the current node is erased below together with the client's nodes on other streams
+
+                {
+                    std::lock_guard<std::mutex> client_lock(controller->lock);
+                    controller->result.push_back({stream_key, {new_entry}});
+                    controller->is_fulfilled = true;
+                }
+                unregister_stream_waiter(*controller, stream_key);
+                woken.push_back(std::move(controller));
+            }
+
+            if(index.empty()) {
+                blocking_stream_map.erase(stream_key);
             }
         }
     }
 
+    if(!woken.empty()) {
+        if(db_lock.owns_lock()) {
+            db_lock.unlock();
+        }
+        for(auto& controller : woken) {
+            controller->cv.notify_one();
+        }
+    }
+
     return new_id;
 }
 
@@ -383,9 +832,10 @@ std::vector<StreamEntry> KeyValueDatabase::XRANGE(std::string& stream_key, std::
 }
 
 std::vector<std::pair<std::string, std::vector<StreamEntry>>> KeyValueDatabase::XREAD(int count, bool block, int64_t ms, const std::vector<std::string>& keys, const std::vector<std::string>& ids_str, bool acquire_lock) { 
-    // we need to resolve '$' and also store them incase for retry later 
+    // we need to resolve '$' to the last id of the stream, it is the threshold we block on
     std::vector<std::string> resolved_ids_str = ids_str; 
     std::vector<StreamId> threshold_ids;
+    std::shared_ptr<BlockingStreamController> controller = std::make_shared<BlockingStreamController>();
 
     //scope for read lock
     {
@@ -422,378 +872,2018 @@ std::vector<std::pair<std::string, std::vector<StreamEntry>>> KeyValueDatabase::
             }
         }
 
-        if(!response.empty() || !block) {
+        // inside EXEC we hold the db lock on behalf of the whole transaction, so we can't sleep here
+        if(!response.empty() || !block || !acquire_lock) {
             return response;
         }
-        
-    } // db locks goes out of scope, and is released
-    
-
-    /* Unlike BLPOP here for each key we have a unique parameter corresponding to each stream kay: threshold stream_id, so we need a different blocking context for each 
-    instead of just creating a separate context with its own cv and fulfilled bool we create a controller which contains cv and bool as
-    they are common for each key. For the unique parameter we create a new struct which hold the threshold id and a pointer to this controller struct
-    (which contains common info). Since there are multiple streams which may try to update the controller we also need a mutex lock for it */
-    
-    BlockingStreamController controller;
-    std::vector<std::pair<std::string, std::list<BlockingStreamNode>::iterator>> my_iterators;
 
-    {
+        /* Unlike BLPOP here for each key we have a unique parameter corresponding to each stream kay: threshold stream_id. The client shares one
+        controller (cv, fulfilled flag and the handed over entries) between all its nodes, and each node sits in the key's index under its threshold id.
+        We register while still holding the db lock so no XADD can slip in between our read and the registration */
         std::lock_guard<std::mutex> map_lock(stream_blocking_mutex); // lock stream blocking map
-        
+
         for(size_t i = 0; i < keys.size(); i++) {
-            BlockingStreamNode node;
-            node.threshold_id = threshold_ids[i]; // use resolved ids (removed $)
-            node.controller = &controller;
-            
-            blocking_stream_map[keys[i]].push_back(node);
+            bool registered = false;
+            for(auto& [waiting_key, node] : controller->nodes) {
+                if(waiting_key == keys[i]) registered = true;
+            }
+            if(registered) continue;
 
-            //storing iterator to clean the blocking list later for this key
-            auto it = std::prev(blocking_stream_map[keys[i]].end());
-            my_iterators.push_back({keys[i], it});
+            // use resolved ids (removed $)
+            auto node = blocking_stream_map[keys[i]].emplace(threshold_ids[i], controller);
+            controller->nodes.push_back({keys[i], node});
         }
-    }
+    } // db locks goes out of scope, and is released
 
     // sleep untill timeout or woke up by another thread. no DB locks are held here. safe to sleep.
-    std::unique_lock<std::mutex> thread_lock(controller.lock);
-    if(ms > 0) {
-        controller.cv.wait_for(thread_lock, std::chrono::milliseconds(ms), 
-                               [&]{ return controller.is_fulfilled; });
-    } else {
-        controller.cv.wait(thread_lock, [&]{ return controller.is_fulfilled; });
-    }
-
-    //clean the stream blocking map to remove the current thread from blocking list of all stream keys
     {
-        std::lock_guard<std::mutex> map_lock(stream_blocking_mutex);
-        for (auto& [key, it] : my_iterators) {
-            if (blocking_stream_map.count(key)) {
-                blocking_stream_map[key].erase(it);
-                if (blocking_stream_map[key].empty()) {
-                    blocking_stream_map.erase(key);
-                }
-            }
+        std::unique_lock<std::mutex> thread_lock(controller->lock);
+        if(ms > 0) {
+            controller->cv.wait_for(thread_lock, std::chrono::milliseconds(ms), 
+                                   [&]{ return controller->is_fulfilled; });
+        } else {
+            controller->cv.wait(thread_lock, [&]{ return controller->is_fulfilled; });
+        }
+
+        if(controller->is_fulfilled) {
+            return std::move(controller->result);
         }
     }
 
-    // we need to pass resolved ids, if we pass ids_str (containing $), it will resolve to the new id and miss the data.
-    return XREAD(count, false, 0, keys, resolved_ids_str, acquire_lock);
+    // timed out, XADD may still serve us until we are off the indexes of all stream keys
+    std::lock_guard<std::mutex> map_lock(stream_blocking_mutex);
+    std::lock_guard<std::mutex> thread_lock(controller->lock);
+    if(controller->is_fulfilled) {
+        return std::move(controller->result);
+    }
+    unregister_stream_waiter(*controller);
+    return {};
 }
 
-std::optional<long long> KeyValueDatabase::INCR(std::string& key, bool acquire_lock) {
-    std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+Stream* KeyValueDatabase::find_stream(const std::string& stream_key) {
+    auto it = map.find(stream_key);
+    if(it == map.end()) {
+        return nullptr;
+    }
+    if(it->second.type != ObjType::STREAM) {
+        throw std::runtime_error("WRONGTYPE Operation against a key holding the wrong kind of value");
+    }
+    return &std::get<Stream>(it->second.value);
+}
 
-    if(acquire_lock) {
-        db_lock.lock();
+StreamConsumerGroup& KeyValueDatabase::find_group(const std::string& stream_key, const std::string& group) {
+    Stream* stream = find_stream(stream_key);
+    if(stream) {
+        auto it = stream->groups.find(group);
+        if(it != stream->groups.end()) {
+            return it->second;
+        }
     }
+    throw std::runtime_error("NOGROUP No such key '" + stream_key + "' or consumer group '" + group + "'");
+}
 
-    auto it = map.find(key);
-    
+RedisHash* KeyValueDatabase::find_hash(const std::string& hash_key, bool reclaim) {
+    auto it = map.find(hash_key);
     if(it == map.end()) {
-        map[key] = {1LL, ObjType::STRING, -1};
-        return 1;
-    } 
-
-    Entry& obj = it->second;
-
-    if(obj.type != ObjType::STRING) {
-        return std::nullopt;
+        return nullptr;
     }
-
-    try {
-        if(std::holds_alternative<long long>(obj.value)) {
-            long long& val = std::get<long long>(obj.value);
-            if (val == LLONG_MAX) throw std::out_of_range("overflow");
-            return ++val;
-        } else {
-            std::string& str_val = std::get<std::string>(obj.value);
-            long long val = std::stoll(str_val);
-            val++;
-            obj.value = val;
-            return val;
+    if(it->second.type != ObjType::HASH) {
+        throw std::runtime_error("WRONGTYPE Operation against a key holding the wrong kind of value");
+    }
+    // the last field expired, so the key is gone; readers only hold the lock shared and leave it for a writer to erase
+    if(std::get<RedisHash>(it->second.value).allExpired(current_time_ms())) {
+        if(reclaim) {
+            touch(hash_key);
+            map.erase(it);
         }
-    } catch(...) {
-        throw std::invalid_argument("value is not an integer");
+        return nullptr;
     }
+    return &std::get<RedisHash>(it->second.value);
 }
 
-std::vector<std::string> KeyValueDatabase::EXEC(std::vector<QueuedCommand>& commandQueue, ClientContext& context, KeyValueDatabase& db, bool acquire_lock) {
-    std::unique_lock<std::shared_mutex> db_lock(rw_lock);
-    std::vector<std::string> results;
-
-    for(auto& queued : commandQueue) {
-        results.push_back(queued.cmd->execute(context, queued.args, db, false));
+RedisSet* KeyValueDatabase::find_set(const std::string& set_key) {
+    auto it = map.find(set_key);
+    if(it == map.end()) {
+        return nullptr;
+    }
+    if(it->second.type != ObjType::SET) {
+        throw std::runtime_error("WRONGTYPE Operation against a key holding the wrong kind of value");
     }
+    return &std::get<RedisSet>(it->second.value);
+}
 
-    return results;
-};
+const std::string* KeyValueDatabase::read_string(const std::string& key, std::string& scratch) {
+    auto it = map.find(key);
+    if(it == map.end() || (it->second.expiry_at != -1 && it->second.expiry_at < current_time_ms())) {
+        return nullptr;
+    }
+    if(it->second.type != ObjType::STRING) {
+        throw std::runtime_error("WRONGTYPE Operation against a key holding the wrong kind of value");
+    }
+    if(std::holds_alternative<long long>(it->second.value)) {
+        scratch = std::to_string(std::get<long long>(it->second.value));
+        return &scratch;
+    }
+    return &std::get<std::string>(it->second.value);
+}
 
-std::vector<std::string> KeyValueDatabase::KEYS(std::string& pattern, bool acquire_lock) {
-    std::shared_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
-    
-    if(acquire_lock) {
-        db_lock.lock();
+std::string& KeyValueDatabase::write_string(const std::string& key) {
+    auto it = map.find(key);
+    if(it == map.end() || (it->second.expiry_at != -1 && it->second.expiry_at < current_time_ms())) {
+        map[key] = {Value(std::string()), ObjType::STRING, -1};
+        return std::get<std::string>(map[key].value);
+    }
+    if(it->second.type != ObjType::STRING) {
+        throw std::runtime_error("WRONGTYPE Operation against a key holding the wrong kind of value");
     }
+    // bit operations work on the raw bytes, so an INCR counter goes back to its string form
+    if(std::holds_alternative<long long>(it->second.value)) {
+        it->second.value = std::to_string(std::get<long long>(it->second.value));
+    }
+    return std::get<std::string>(it->second.value);
+}
 
-    std::vector<std::string> results;
+const std::string* KeyValueDatabase::find_hll(const std::string& key, std::string& scratch) {
+    const std::string* hll = read_string(key, scratch);
+    if(hll && !HyperLogLog::isValid(*hll)) {
+        throw std::runtime_error("WRONGTYPE Key is not a valid HyperLogLog string value.");
+    }
+    return hll;
+}
 
-    long long now = std::chrono::duration_cast<std::chrono::milliseconds>(
-        std::chrono::system_clock::now().time_since_epoch()).count();
+void KeyValueDatabase::unregister_stream_waiter(BlockingStreamController& controller, const std::string& serving_key) {
+    for(auto& [key, node] : controller.nodes) {
+        auto it = blocking_stream_map.find(key);
+        if(it == blocking_stream_map.end()) continue;
 
-    for (auto it = map.begin(); it != map.end(); ) {
-        if (it->second.expiry_at != -1 && it->second.expiry_at < now) {
-            it = map.erase(it); 
-            continue;
+        it->second.erase(node);
+        // XADD is still walking the index of the key it serves and prunes it itself
+        if(it->second.empty() && key != serving_key) {
+            blocking_stream_map.erase(it);
         }
+    }
+    controller.nodes.clear();
+}
 
-        const std::string& key = it->first;
+void KeyValueDatabase::unregister_group_waiter(BlockingGroupWaiter& waiter, const std::string& serving_key) {
+    for(auto& [key, node] : waiter.nodes) {
+        auto it = blocking_group_map.find(key);
+        if(it == blocking_group_map.end()) continue;
 
-        if (pattern == "*") {
-            results.push_back(key);
-        } else if (pattern.back() == '*') {
-            // avoid making a deep copy
-            std::string_view prefix(pattern.data(), pattern.size() - 1);
-            if (std::string_view(key).starts_with(prefix)) {
-                results.push_back(key);
-            }
-        } else if (key == pattern) {
-            // exact match
-            results.push_back(key);
+        it->second.erase(node);
+        // XADD is still walking the list of the key it serves and prunes it itself
+        if(it->second.empty() && key != serving_key) {
+            blocking_group_map.erase(it);
         }
+    }
+    waiter.nodes.clear();
+}
+
+void KeyValueDatabase::fail_group_waiters(const std::string& stream_key, const std::string* group) {
+    auto waiting = blocking_group_map.find(stream_key);
+    if(waiting == blocking_group_map.end()) return;
+
+    std::list<BlockingGroupWaiter*>& waiters = waiting->second;
+    for(auto node = waiters.begin(); node != waiters.end(); ) {
+        BlockingGroupWaiter* waiter = *node;
+        node++; // the current node is erased with the waiter's other nodes
 
-        ++it;
+        if(group && waiter->group != *group) continue;
+
+        std::lock_guard<std::mutex> waiter_lock(waiter->lock);
+        unregister_group_waiter(*waiter, stream_key);
+        waiter->error = "NOGROUP the consumer group this client was blocked on no longer exists";
+        waiter->is_fulfilled = true;
+        waiter->cv.notify_one();
+    }
+
+    if(waiters.empty()) {
+        blocking_group_map.erase(waiting);
     }
-    return results;
 }
 
+void KeyValueDatabase::XGROUP_CREATE(std::string& stream_key, std::string& group, std::string& id, bool mkstream, bool acquire_lock) {
+    // validate the id before the stream gets created by MKSTREAM
+    StreamId last_delivered_id = {0, 0};
+    if(id != "$") {
+        last_delivered_id = StreamId::parse(id, false);
+    }
 
-int KeyValueDatabase::ZADD(std::string& set_key, std::vector<std::string>& members, std::vector<double>& scores, bool acquire_lock) {
     std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
 
     if(acquire_lock) {
         db_lock.lock();
     }
 
-    auto it = map.find(set_key);
+    Stream* stream = find_stream(stream_key);
+    if(!stream) {
+        if(!mkstream) {
+            throw std::runtime_error("ERR The XGROUP subcommand requires the key to exist. Note that for CREATE you may want to use the MKSTREAM option to create an empty stream automatically.");
+        }
+        map[stream_key] = {Value(Stream()), ObjType::STREAM, -1};
+        stream = &std::get<Stream>(map[stream_key].value);
+    }
 
-    if(it == map.end()) {
-        map[set_key] = {Value(ZSet{}), ObjType::ZSET, -1};
-        it = map.find(set_key);
+    if(stream->groups.count(group)) {
+        throw std::runtime_error("BUSYGROUP Consumer Group name already exists");
     }
 
-    ZSet& zset = std::get<ZSet>(it->second.value);
+    if(id == "$") {
+        last_delivered_id = stream->last_id;
+    }
+    touch(stream_key);
+    stream->groups[group].last_delivered_id = last_delivered_id;
+}
 
-    int inserted = 0;
+int KeyValueDatabase::XGROUP_DESTROY(std::string& stream_key, std::string& group, bool acquire_lock) {
+    std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
 
-    for(int i = 0; i < members.size(); i++) {
-        bool already_present = false;
+    if(acquire_lock) {
+        db_lock.lock();
+    }
 
-        if(zset.score_map.find(members[i]) != zset.score_map.end()) {
-            zset.score_set.erase({members[i], zset.score_map[members[i]]});
-            already_present = true;
-        }
+    Stream* stream = find_stream(stream_key);
+    if(!stream) {
+        throw std::runtime_error("ERR The XGROUP subcommand requires the key to exist");
+    }
 
-        zset.score_map[members[i]] = scores[i];
-        zset.score_set.insert({members[i], zset.score_map[members[i]]});
+    int destroyed = stream->groups.erase(group);
+    if(destroyed) {
+        touch(stream_key);
+        fail_group_waiters(stream_key, &group);
+    }
+    return destroyed;
+}
 
-        if(!already_present) inserted++;
+int KeyValueDatabase::XGROUP_CREATECONSUMER(std::string& stream_key, std::string& group, std::string& consumer, bool acquire_lock) {
+    std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+
+    if(acquire_lock) {
+        db_lock.lock();
     }
 
-    return inserted;
+    StreamConsumerGroup& cg = find_group(stream_key, group);
+    if(cg.consumers.count(consumer)) {
+        return 0;
+    }
+
+    touch(stream_key);
+    cg.getConsumer(consumer, current_time_ms());
+    return 1;
 }
 
-int KeyValueDatabase::ZRANK(std::string& set_key, std::string& member, bool acquire_lock) {
-    std::shared_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+int64_t KeyValueDatabase::XGROUP_DELCONSUMER(std::string& stream_key, std::string& group, std::string& consumer, bool acquire_lock) {
+    std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
 
     if(acquire_lock) {
         db_lock.lock();
     }
 
-    auto it = map.find(set_key);
-
-    if(it == map.end()) {
-        //sorted set does not exist
-        return -1;
+    StreamConsumerGroup& cg = find_group(stream_key, group);
+    auto it = cg.consumers.find(consumer);
+    if(it == cg.consumers.end()) {
+        return 0;
     }
+    touch(stream_key);
 
-    ZSet& zset = std::get<ZSet>(it->second.value);
+    // the pending entries of a deleted consumer are dropped from the group PEL as well
+    int64_t pending = it->second.pending.size();
+    for(const StreamId& id : it->second.pending) {
+        cg.pel.erase(id);
+    }
+    cg.consumers.erase(it);
 
-    auto it_member = zset.score_map.find(member);
+    return pending;
+}
 
-    if(it_member == zset.score_map.end()) {
-        //given member does not exist inside the sorted set
-        return -1;
+void KeyValueDatabase::XGROUP_SETID(std::string& stream_key, std::string& group, std::string& id, bool acquire_lock) {
+    StreamId last_delivered_id = {0, 0};
+    if(id != "$") {
+        last_delivered_id = StreamId::parse(id, false);
     }
 
-    double score = zset.score_map[member];
-
-    auto it_set = zset.score_set.find({member, score});
+    std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
 
-    int rank = std::distance(zset.score_set.begin(), it_set);
+    if(acquire_lock) {
+        db_lock.lock();
+    }
 
-    return rank;
+    StreamConsumerGroup& cg = find_group(stream_key, group);
+    touch(stream_key);
+    if(id == "$") {
+        last_delivered_id = find_stream(stream_key)->last_id;
+    }
+    cg.last_delivered_id = last_delivered_id;
 }
 
-std::vector<std::string> KeyValueDatabase::ZRANGE(std::string& set_key, int start, int end, bool acquire_lock) {
-    std::shared_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+std::vector<std::pair<std::string, std::vector<StreamEntry>>> KeyValueDatabase::XREADGROUP(const std::string& group, const std::string& consumer, int count, bool block, int64_t ms, bool noack, const std::vector<std::string>& keys, const std::vector<std::string>& ids_str, bool acquire_lock) {
+    // '>' asks for never delivered entries, anything else re-reads the consumer's pending entries after that id
+    std::vector<StreamId> start_ids;
+    bool only_new = true;
+    for(const std::string& id : ids_str) {
+        if(id == ">") {
+            start_ids.push_back({0, 0});
+        } else {
+            start_ids.push_back(StreamId::parse(id, false));
+            only_new = false;
+        }
+    }
+
+    // unique lock as reading moves the delivered entries into the group PEL
+    std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
 
     if(acquire_lock) {
         db_lock.lock();
     }
 
-    auto it = map.find(set_key);
-
-    if(it == map.end()) {
-        //sorted set does not exist
-        return {};
+    // resolve every group first so a missing one fails the command before anything is delivered
+    std::vector<StreamConsumerGroup*> groups;
+    for(const std::string& key : keys) {
+        groups.push_back(&find_group(key, group));
     }
 
-    ZSet& zset = std::get<ZSet>(it->second.value);
+    long long now = current_time_ms();
+    std::vector<std::pair<std::string, std::vector<StreamEntry>>> response;
 
-    int size = zset.score_map.size();
+    for(size_t i = 0; i < keys.size(); i++) {
+        Stream& stream = *find_stream(keys[i]);
+        if(ids_str[i] == ">") {
+            std::vector<StreamEntry> new_entries = stream.readGroup(*groups[i], consumer, count, noack, now);
+            if(!new_entries.empty()) {
+                touch(keys[i]);
+                response.push_back({keys[i], std::move(new_entries)});
+            }
+        } else {
+            // history is always replied, even when the consumer has nothing pending
+            std::vector<StreamEntry> pending = stream.readPending(*groups[i], consumer, count, start_ids[i], now);
+            if(!pending.empty()) touch(keys[i]);
+            response.push_back({keys[i], std::move(pending)});
+        }
+    }
 
-    start = (start < 0) ? (size + start) : start;
-    end = (end < 0) ? (size + end) : end;
+    // inside EXEC we hold the db lock on behalf of the whole transaction, so we can't sleep here
+    if(!response.empty() || !block || !only_new || !acquire_lock) {
+        return response;
+    }
 
-    if(start < 0) start = 0;
-    if(end >= size) end = size - 1;
+    BlockingGroupWaiter waiter;
+    waiter.group = group;
+    waiter.consumer = consumer;
+    waiter.count = count;
+    waiter.noack = noack;
 
-    if(start >= size || start > end) {
-        return {};
+    for(const std::string& key : keys) {
+        bool registered = false;
+        for(auto& [waiting_key, node] : waiter.nodes) {
+            if(waiting_key == key) registered = true;
+        }
+        if(registered) continue;
+
+        std::list<BlockingGroupWaiter*>& waiters = blocking_group_map[key];
+        waiters.push_back(&waiter);
+        waiter.nodes.push_back({key, std::prev(waiters.end())});
     }
 
-    std::vector<std::string> members;
+    db_lock.unlock();
 
-    auto it_start = std::next(zset.score_set.begin(), start);
-    int num_elements = end - start + 1;
+    {
+        std::unique_lock<std::mutex> waiter_lock(waiter.lock);
+        if(ms > 0) {
+            waiter.cv.wait_for(waiter_lock, std::chrono::milliseconds(ms), [&]{ return waiter.is_fulfilled; });
+        } else {
+            waiter.cv.wait(waiter_lock, [&]{ return waiter.is_fulfilled; });
+        }
 
-    for (int i = 0; i < num_elements; i++) {
-        members.push_back(it_start->member);
-        it_start++;
+        if(waiter.is_fulfilled) {
+            if(!waiter.error.empty()) throw std::runtime_error(waiter.error);
+            return {std::move(waiter.result)};
+        }
     }
-    
-    return members;
+
+    // timed out, XADD may still serve us until we are off the waiting lists
+    db_lock.lock();
+    std::lock_guard<std::mutex> waiter_lock(waiter.lock);
+    if(waiter.is_fulfilled) {
+        if(!waiter.error.empty()) throw std::runtime_error(waiter.error);
+        return {std::move(waiter.result)};
+    }
+    unregister_group_waiter(waiter);
+    return {};
 }
 
-int KeyValueDatabase::ZCARD(std::string& set_key, bool acquire_lock) {
-    std::shared_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+int KeyValueDatabase::XACK(std::string& stream_key, std::string& group, std::vector<StreamId>& ids, bool acquire_lock) {
+    std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
 
     if(acquire_lock) {
         db_lock.lock();
     }
 
-    auto it = map.find(set_key);
-
-    if(it == map.end()) {
-        //sorted set does not exist
+    // no key or no group means nothing to acknowledge
+    Stream* stream = find_stream(stream_key);
+    if(!stream) {
+        return 0;
+    }
+    auto it = stream->groups.find(group);
+    if(it == stream->groups.end()) {
         return 0;
     }
 
-    ZSet& zset = std::get<ZSet>(it->second.value);
-
-    return zset.score_map.size();
+    int acked = stream->ack(it->second, ids);
+    if(acked > 0) touch(stream_key);
+    return acked;
 }
 
-std::optional<double> KeyValueDatabase::ZSCORE(std::string& set_key, std::string& member, bool acquire_lock) {
+StreamPendingSummary KeyValueDatabase::XPENDING(std::string& stream_key, std::string& group, bool acquire_lock) {
     std::shared_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
 
     if(acquire_lock) {
         db_lock.lock();
     }
 
-    auto it = map.find(set_key);
-
-    if(it == map.end()) {
-        //sorted set does not exist
-        return std::nullopt;
+    StreamConsumerGroup& cg = find_group(stream_key, group);
+    StreamPendingSummary summary;
+    summary.count = cg.pel.size();
+    if(!cg.pel.empty()) {
+        summary.min_id = cg.pel.begin()->first;
+        summary.max_id = cg.pel.rbegin()->first;
     }
+    for(auto& [name, consumer] : cg.consumers) {
+        if(!consumer.pending.empty()) {
+            summary.consumers.push_back({name, (int64_t)consumer.pending.size()});
+        }
+    }
+    return summary;
+}
 
-    ZSet& zset = std::get<ZSet>(it->second.value);
-
-    auto it_member = zset.score_map.find(member);
+std::vector<StreamPendingInfo> KeyValueDatabase::XPENDING(std::string& stream_key, std::string& group, int64_t min_idle, StreamId start, StreamId end, int count, const std::string& consumer, bool acquire_lock) {
+    std::shared_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
 
-    if(it_member == zset.score_map.end()) {
-        //given member does not exist inside the sorted set
-        return std::nullopt;
+    if(acquire_lock) {
+        db_lock.lock();
     }
 
-    double score = zset.score_map[member];
+    StreamConsumerGroup& cg = find_group(stream_key, group);
+    long long now = current_time_ms();
+    std::vector<StreamPendingInfo> pending;
 
-    return score;    
+    for(auto it = cg.pel.lower_bound(start); it != cg.pel.end() && !(end < it->first) && (int)pending.size() < count; it++) {
+        const StreamPendingEntry& nack = it->second;
+        if(!consumer.empty() && nack.consumer != consumer) continue;
+
+        int64_t idle = now - nack.delivery_time;
+        if(idle < min_idle) continue;
+
+        pending.push_back({it->first, nack.consumer, idle, nack.delivery_count});
+    }
+    return pending;
 }
 
-int KeyValueDatabase::ZREM(std::string& set_key, std::vector<std::string>& members, bool acquire_lock) {
+std::vector<StreamEntry> KeyValueDatabase::XCLAIM(std::string& stream_key, std::string& group, std::string& consumer, int64_t min_idle, std::vector<StreamId>& ids, int64_t idle, int64_t time, int64_t retry_count, bool force, bool justid, bool acquire_lock) {
     std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
 
     if(acquire_lock) {
         db_lock.lock();
     }
 
-    auto it = map.find(set_key);
-
-    if(it == map.end()) {
-        //sorted set does not exist
-        return 0;
-    }
+    StreamConsumerGroup& cg = find_group(stream_key, group);
+    Stream& stream = *find_stream(stream_key);
+    long long now = current_time_ms();
 
-    ZSet& zset = std::get<ZSet>(it->second.value);
+    // IDLE and TIME both set the new delivery time, by default it is now
+    int64_t delivery_time = now;
+    if(idle >= 0) delivery_time = now - idle;
+    if(time >= 0) delivery_time = time;
 
-    int removed = 0;
+    StreamConsumer& owner = cg.getConsumer(consumer, now);
+    owner.seen_time = now;
+    std::vector<StreamEntry> claimed;
+    bool dropped = false;
 
-    for(auto& member : members) {
-        auto it_member = zset.score_map.find(member);
+    for(const StreamId& id : ids) {
+        auto entry = stream.entries.find(id);
+        auto nack = cg.pel.find(id);
 
-        if(it_member == zset.score_map.end()) {
-            //given member does not exist inside the sorted set
+        if(entry == stream.entries.end()) {
+            // the entry was deleted while pending, there is nothing left to claim
+            if(nack != cg.pel.end()) {
+                stream.ack(cg, {id});
+                dropped = true;
+            }
             continue;
         }
 
-        double score = zset.score_map[member];
-        zset.score_set.erase({member, score});
-        zset.score_map.erase(it_member);
-        removed++;
+        bool created = false;
+        if(nack == cg.pel.end()) {
+            if(!force) continue;
+            nack = cg.pel.emplace(id, StreamPendingEntry{consumer, now, 0}).first;
+            created = true;
+        }
+
+        // a PEL entry created by FORCE has never been delivered, so it is not subject to the idle check
+        if(!created && min_idle > 0 && now - nack->second.delivery_time < min_idle) continue;
+
+        cg.assign(id, nack->second, owner);
+        nack->second.delivery_time = delivery_time;
+        if(retry_count >= 0) {
+            nack->second.delivery_count = retry_count;
+        } else if(!justid) {
+            nack->second.delivery_count++;
+        }
+        owner.active_time = now;
+
+        if(justid) {
+            claimed.push_back({id, {}});
+        } else {
+            claimed.push_back(entry->second);
+        }
     }
-    
-    return removed;
+    if(!claimed.empty() || dropped) touch(stream_key);
+    return claimed;
 }
 
-std::vector<std::string> KeyValueDatabase::GEOSEARCH(std::string& set_key, double center_lon, double center_lat, double radius_meters, bool sort_asc, bool acquire_lock) {
-    std::shared_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
-    if(acquire_lock) db_lock.lock();
+StreamAutoClaimResult KeyValueDatabase::XAUTOCLAIM(std::string& stream_key, std::string& group, std::string& consumer, int64_t min_idle, StreamId start, int count, bool justid, bool acquire_lock) {
+    std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+
+    if(acquire_lock) {
+        db_lock.lock();
+    }
+
+    StreamConsumerGroup& cg = find_group(stream_key, group);
+    Stream& stream = *find_stream(stream_key);
+    long long now = current_time_ms();
+
+    StreamConsumer& owner = cg.getConsumer(consumer, now);
+    owner.seen_time = now;
+    StreamAutoClaimResult result;
+
+    // bound the PEL walk so a large PEL full of non-idle entries can't stall the server
+    long long attempts = (long long)count * 10;
+    auto it = cg.pel.lower_bound(start);
+
+    while(it != cg.pel.end() && count > 0 && attempts-- > 0) {
+        StreamId id = it->first;
+        auto entry = stream.entries.find(id);
+
+        if(entry == stream.entries.end()) {
+            result.deleted.push_back(id);
+            it++;
+            stream.ack(cg, {id});
+            continue;
+        }
+
+        StreamPendingEntry& nack = it->second;
+        it++;
+        if(now - nack.delivery_time < min_idle) continue;
+
+        cg.assign(id, nack, owner);
+        nack.delivery_time = now;
+        if(!justid) nack.delivery_count++;
+        owner.active_time = now;
+
+        if(justid) {
+            result.claimed.push_back({id, {}});
+        } else {
+            result.claimed.push_back(entry->second);
+        }
+        count--;
+    }
+
+    if(!result.claimed.empty() || !result.deleted.empty()) touch(stream_key);
+    if(it != cg.pel.end()) {
+        result.next_id = it->first;
+    }
+    return result;
+}
+
+std::optional<long long> KeyValueDatabase::INCR(std::string& key, bool acquire_lock) {
+    std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+
+    if(acquire_lock) {
+        db_lock.lock();
+    }
+
+    auto it = map.find(key);
+    
+    if(it == map.end()) {
+        touch(key);
+        map[key] = {1LL, ObjType::STRING, -1};
+        return 1;
+    } 
+
+    Entry& obj = it->second;
+
+    if(obj.type != ObjType::STRING) {
+        return std::nullopt;
+    }
+
+    try {
+        if(std::holds_alternative<long long>(obj.value)) {
+            long long& val = std::get<long long>(obj.value);
+            if (val == LLONG_MAX) throw std::out_of_range("overflow");
+            touch(key);
+            return ++val;
+        } else {
+            std::string& str_val = std::get<std::string>(obj.value);
+            long long val = std::stoll(str_val);
+            val++;
+            touch(key);
+            obj.value = val;
+            return val;
+        }
+    } catch(...) {
+        throw std::invalid_argument("value is not an integer");
+    }
+}
+
+std::optional<std::vector<std::string> > KeyValueDatabase::EXEC(std::vector<QueuedCommand>& commandQueue, ClientContext& context, KeyValueDatabase& db, bool acquire_lock) {
+    /* Plan the locking from the keys the queued commands declare. The keyspace is a single lock domain, so the plan is no lock
+    when no command touches a key (PING, PUBLISH, ...), the shared lock when every command that does only reads, and the
+    unique lock otherwise. */
+    bool touches_keys = false;
+    bool read_only = true;
+    for(auto& queued : commandQueue) {
+        if(queued.cmd->keySpec().whole_keyspace || !queued.cmd->keys(queued.args).empty()) {
+            touches_keys = true;
+            read_only = read_only && queued.cmd->isReadOnly();
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> write_lock(rw_lock, std::defer_lock);
+    std::shared_lock<std::shared_mutex> read_lock(rw_lock, std::defer_lock);
+    if(touches_keys) {
+        if(read_only) read_lock.lock();
+        else write_lock.lock();
+    }
+
+    // writers mark watchers dirty under the unique lock, so nothing can slip in between this check and the commands
+    bool aborted;
+    {
+        std::lock_guard<std::mutex> lock(watch_mutex);
+        aborted = context.watch.dirty;
+    }
+    UNWATCH(context.watch);
+    if(aborted) {
+        return std::nullopt;
+    }
+
+    std::vector<std::string> results;
+
+    for(auto& queued : commandQueue) {
+        results.push_back(queued.cmd->execute_bound(context, queued.args, queued.bound, db, false));
+    }
+
+    return results;
+};
+
+std::vector<std::string> KeyValueDatabase::KEYS(std::string& pattern, bool acquire_lock) {
+    std::shared_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+    
+    if(acquire_lock) {
+        db_lock.lock();
+    }
+
+    std::vector<std::string> results;
+
+    long long now = current_time_ms();
+    GlobPattern matcher(pattern);
+
+    // with the key index only the keys under the pattern's literal prefix are visited
+    const RadixTree* index = map.keyIndex();
+    if (index && !matcher.literalPrefix().empty()) {
+        index->forEachWithPrefix(matcher.literalPrefix(), "", [&](const std::string& key) {
+            auto it = map.find(key);
+            if (is_expired(it->second, now)) return true;
+            if (matcher.match(key)) results.push_back(key);
+            return true;
+        });
+        return results;
+    }
+
+    // we only hold the lock shared, so expired keys are skipped here and left for a writer to erase
+    for (auto it = map.begin(); it != map.end(); ++it) {
+        if (is_expired(it->second, now)) {
+            continue;
+        }
+        if (matcher.match(it->first)) {
+            results.push_back(it->first);
+        }
+    }
+    return results;
+}
+
+void KeyValueDatabase::ENABLE_KEY_INDEX() {
+    std::unique_lock<std::shared_mutex> db_lock(rw_lock);
+    map.enableIndex();
+}
+
+std::vector<std::string> KeyValueDatabase::SCANPREFIX(const std::string& prefix, const std::string& after, int count, bool acquire_lock) {
+    std::shared_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+
+    if(acquire_lock) {
+        db_lock.lock();
+    }
+
+    const RadixTree* index = map.keyIndex();
+    if(!index) {
+        throw std::runtime_error("ERR the key index is disabled, start the server with --keyindex yes");
+    }
+
+    std::vector<std::string> results;
+    long long now = current_time_ms();
+
+    index->forEachWithPrefix(prefix, after, [&](const std::string& key) {
+        auto it = map.find(key);
+        if(!is_expired(it->second, now)) {
+            results.push_back(key);
+        }
+        return results.size() < (size_t)count;
+    });
+    return results;
+}
+
+/* One SCAN step: visits buckets of the keyspace from 'cursor' until about 'count' keys were seen, so each call holds the shared
+lock for a bounded time instead of the whole walk KEYS does. The reverse-binary cursor of Dict::scan guarantees that a key present
+for the whole iteration is returned at least once, even if the keyspace is rehashed between calls; a key may be returned twice. */
+uint64_t KeyValueDatabase::SCAN(uint64_t cursor, const std::string& pattern, int count, const std::string& type, std::vector<std::string>& result, bool acquire_lock) {
+    std::shared_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+
+    if(acquire_lock) {
+        db_lock.lock();
+    }
+
+    GlobPattern matcher(pattern.empty() ? "*" : pattern);
+    long long now = current_time_ms();
+    size_t visited = 0;
+    size_t max_steps = (size_t)count * 10; // bound the work on a sparse table, like Redis does
+
+    do {
+        cursor = map.scan(cursor, [&](const std::pair<const std::string, Entry>& kv) {
+            visited++;
+            const Entry& entry = kv.second;
+            if(is_expired(entry, now)) return;
+            if(!type.empty() && type != type_name(entry.type)) return;
+            if(!matcher.match(kv.first)) return;
+            result.push_back(kv.first);
+        });
+    } while(cursor != 0 && visited < (size_t)count && --max_steps > 0);
+
+    return cursor;
+}
+
+int KeyValueDatabase::ZADD(std::string& set_key, std::vector<std::string>& members, std::vector<double>& scores, bool acquire_lock) {
+    std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+
+    if(acquire_lock) {
+        db_lock.lock();
+    }
 
     auto it = map.find(set_key);
-    if(it == map.end() || it->second.type != ObjType::ZSET) {
+
+    if(it == map.end()) {
+        map[set_key] = {Value(ZSet{}), ObjType::ZSET, -1};
+        it = map.find(set_key);
+    } else if(it->second.type != ObjType::ZSET) {
+        throw std::runtime_error("WRONGTYPE Operation against a key holding the wrong kind of value");
+    }
+    touch(set_key);
+
+    ZSet& zset = std::get<ZSet>(it->second.value);
+
+    int inserted = 0;
+
+    for(int i = 0; i < members.size(); i++) {
+        bool already_present = false;
+
+        if(zset.score_map.find(members[i]) != zset.score_map.end()) {
+            zset.score_set.erase({members[i], zset.score_map[members[i]]});
+            already_present = true;
+        }
+
+        zset.score_map[members[i]] = scores[i];
+        zset.score_set.insert({members[i], zset.score_map[members[i]]});
+
+        if(!already_present) inserted++;
+    }
+
+    return inserted;
+}
+
+int KeyValueDatabase::ZRANK(std::string& set_key, std::string& member, bool acquire_lock) {
+    std::shared_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+
+    if(acquire_lock) {
+        db_lock.lock();
+    }
+
+    auto it = map.find(set_key);
+
+    if(it == map.end()) {
+        //sorted set does not exist
+        return -1;
+    }
+
+    ZSet& zset = std::get<ZSet>(it->second.value);
+
+    auto it_member = zset.score_map.find(member);
+
+    if(it_member == zset.score_map.end()) {
+        //given member does not exist inside the sorted set
+        return -1;
+    }
+
+    double score = zset.score_map[member];
+
+    auto it_set = zset.score_set.find({member, score});
+
+    int rank = std::distance(zset.score_set.begin(), it_set);
+
+    return rank;
+}
+
+std::vector<std::string> KeyValueDatabase::ZRANGE(std::string& set_key, int start, int end, bool acquire_lock) {
+    std::shared_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+
+    if(acquire_lock) {
+        db_lock.lock();
+    }
+
+    auto it = map.find(set_key);
+
+    if(it == map.end()) {
+        //sorted set does not exist
         return {};
     }
 
     ZSet& zset = std::get<ZSet>(it->second.value);
 
-    std::vector<std::pair<double, std::string>> valid_members;
+    int size = zset.score_map.size();
 
-    for (const auto& node : zset.score_set) {
-        uint64_t geo_code = static_cast<uint64_t>(node.score);
-        Coordinates current_coord = decode(geo_code); 
+    start = (start < 0) ? (size + start) : start;
+    end = (end < 0) ? (size + end) : end;
 
-        double distance = calculate_distance(
-            center_lon, center_lat, 
-            current_coord.longitude, current_coord.latitude
-        );
+    if(start < 0) start = 0;
+    if(end >= size) end = size - 1;
 
-        if (distance <= radius_meters) {
-            valid_members.push_back({distance, node.member});
-        }
+    if(start >= size || start > end) {
+        return {};
     }
 
-    std::sort(valid_members.begin(), valid_members.end(), 
-        [sort_asc](const std::pair<double, std::string>& a, const std::pair<double, std::string>& b) {
-            if (sort_asc) return a.first < b.first;  // ASC
-            return a.first > b.first;                // DESC
-        }
-    );
+    std::vector<std::string> members;
 
-    std::vector<std::string> final_results;
-    for (const auto& item : valid_members) {
-        final_results.push_back(item.second);
+    auto it_start = std::next(zset.score_set.begin(), start);
+    int num_elements = end - start + 1;
+
+    for (int i = 0; i < num_elements; i++) {
+        members.push_back(it_start->member);
+        it_start++;
     }
+    
+    return members;
+}
 
-    return final_results;
-}
\ No newline at end of file
+int KeyValueDatabase::ZCARD(std::string& set_key, bool acquire_lock) {
+    std::shared_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+
+    if(acquire_lock) {
+        db_lock.lock();
+    }
+
+    auto it = map.find(set_key);
+
+    if(it == map.end()) {
+        //sorted set does not exist
+        return 0;
+    }
+
+    ZSet& zset = std::get<ZSet>(it->second.value);
+
+    return zset.score_map.size();
+}
+
+std::optional<double> KeyValueDatabase::ZSCORE(std::string& set_key, std::string& member, bool acquire_lock) {
+    std::shared_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+
+    if(acquire_lock) {
+        db_lock.lock();
+    }
+
+    auto it = map.find(set_key);
+
+    if(it == map.end()) {
+        //sorted set does not exist
+        return std::nullopt;
+    }
+
+    ZSet& zset = std::get<ZSet>(it->second.value);
+
+    auto it_member = zset.score_map.find(member);
+
+    if(it_member == zset.score_map.end()) {
+        //given member does not exist inside the sorted set
+        return std::nullopt;
+    }
+
+    double score = zset.score_map[member];
+
+    return score;    
+}
+
+int KeyValueDatabase::ZREM(std::string& set_key, std::vector<std::string>& members, bool acquire_lock) {
+    std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+
+    if(acquire_lock) {
+        db_lock.lock();
+    }
+
+    auto it = map.find(set_key);
+
+    if(it == map.end()) {
+        //sorted set does not exist
+        return 0;
+    }
+    if(it->second.type != ObjType::ZSET) {
+        throw std::runtime_error("WRONGTYPE Operation against a key holding the wrong kind of value");
+    }
+
+    ZSet& zset = std::get<ZSet>(it->second.value);
+
+    int removed = 0;
+
+    for(auto& member : members) {
+        auto it_member = zset.score_map.find(member);
+
+        if(it_member == zset.score_map.end()) {
+            //given member does not exist inside the sorted set
+            continue;
+        }
+
+        double score = zset.score_map[member];
+        zset.score_set.erase({member, score});
+        zset.score_map.erase(it_member);
+        removed++;
+    }
+
+    if(removed > 0) touch(set_key);
+    return removed;
+}
+
+std::vector<std::string> KeyValueDatabase::GEOSEARCH(std::string& set_key, double center_lon, double center_lat, double radius_meters, bool sort_asc, bool acquire_lock) {
+    std::shared_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+    if(acquire_lock) db_lock.lock();
+
+    auto it = map.find(set_key);
+    if(it == map.end() || it->second.type != ObjType::ZSET) {
+        return {};
+    }
+
+    ZSet& zset = std::get<ZSet>(it->second.value);
+
+    std::vector<std::pair<double, std::string>> valid_members;
+
+    for (const auto& node : zset.score_set) {
+        uint64_t geo_code = static_cast<uint64_t>(node.score);
+        Coordinates current_coord = decode(geo_code); 
+
+        double distance = calculate_distance(
+            center_lon, center_lat, 
+            current_coord.longitude, current_coord.latitude
+        );
+
+        if (distance <= radius_meters) {
+            valid_members.push_back({distance, node.member});
+        }
+    }
+
+    std::sort(valid_members.begin(), valid_members.end(), 
+        [sort_asc](const std::pair<double, std::string>& a, const std::pair<double, std::string>& b) {
+            if (sort_asc) return a.first < b.first;  // ASC
+            return a.first > b.first;                // DESC
+        }
+    );
+
+    std::vector<std::string> final_results;
+    for (const auto& item : valid_members) {
+        final_results.push_back(item.second);
+    }
+
+    return final_results;
+}
+
+int KeyValueDatabase::HSET(std::string& hash_key, std::vector<std::pair<std::string, std::string> >& fields, bool acquire_lock) {
+    std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+    if(acquire_lock) db_lock.lock();
+
+    RedisHash* hash = find_hash(hash_key, true);
+    if(!hash) {
+        map[hash_key] = {Value(RedisHash{}), ObjType::HASH, -1};
+        hash = &std::get<RedisHash>(map[hash_key].value);
+    }
+    hash->purgeExpired(current_time_ms());
+    touch(hash_key);
+
+    int added = 0;
+    for(auto& [field, value] : fields) {
+        if(hash->set(field, value)) added++;
+    }
+    return added;
+}
+
+std::optional<std::string> KeyValueDatabase::HGET(std::string& hash_key, std::string& field, bool acquire_lock) {
+    std::shared_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+    if(acquire_lock) db_lock.lock();
+
+    RedisHash* hash = find_hash(hash_key);
+    if(!hash) return std::nullopt;
+
+    return hash->get(field, current_time_ms());
+}
+
+std::vector<std::optional<std::string> > KeyValueDatabase::HMGET(std::string& hash_key, std::vector<std::string>& fields, bool acquire_lock) {
+    std::shared_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+    if(acquire_lock) db_lock.lock();
+
+    RedisHash* hash = find_hash(hash_key);
+    long long now = current_time_ms();
+
+    std::vector<std::optional<std::string> > values;
+    for(auto& field : fields) {
+        values.push_back(hash ? hash->get(field, now) : std::nullopt);
+    }
+    return values;
+}
+
+int KeyValueDatabase::HDEL(std::string& hash_key, std::vector<std::string>& fields, bool acquire_lock) {
+    std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+    if(acquire_lock) db_lock.lock();
+
+    RedisHash* hash = find_hash(hash_key, true);
+    if(!hash) return 0;
+    hash->purgeExpired(current_time_ms());
+
+    int deleted = 0;
+    for(auto& field : fields) {
+        if(hash->del(field)) deleted++;
+    }
+
+    if(deleted > 0) touch(hash_key);
+    if(hash->empty()) {
+        map.erase(hash_key);
+    }
+    return deleted;
+}
+
+std::vector<std::pair<std::string, std::string> > KeyValueDatabase::HGETALL(std::string& hash_key, bool acquire_lock) {
+    std::shared_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+    if(acquire_lock) db_lock.lock();
+
+    std::vector<std::pair<std::string, std::string> > result;
+    RedisHash* hash = find_hash(hash_key);
+    if(!hash) return result;
+
+    hash->forEach(current_time_ms(), [&](const std::string& field, const std::string& value) {
+        result.push_back({field, value});
+    });
+    return result;
+}
+
+long long KeyValueDatabase::HINCRBY(std::string& hash_key, std::string& field, long long increment, bool acquire_lock) {
+    std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+    if(acquire_lock) db_lock.lock();
+
+    RedisHash* hash = find_hash(hash_key, true);
+    if(!hash) {
+        map[hash_key] = {Value(RedisHash{}), ObjType::HASH, -1};
+        hash = &std::get<RedisHash>(map[hash_key].value);
+    }
+    hash->purgeExpired(current_time_ms());
+
+    long long value = 0;
+    std::optional<std::string> current = hash->get(field, current_time_ms());
+    if(current && !Listpack::stringToInt(*current, value)) {
+        throw std::runtime_error("ERR hash value is not an integer");
+    }
+
+    if((increment > 0 && value > LLONG_MAX - increment) || (increment < 0 && value < LLONG_MIN - increment)) {
+        throw std::runtime_error("ERR increment or decrement would overflow");
+    }
+    value += increment;
+    touch(hash_key);
+
+    // unlike HSET, incrementing keeps the field's TTL
+    long long expiry = current ? hash->expiry(field) : -1;
+    hash->set(field, std::to_string(value));
+    if(expiry != -1) hash->setExpiry(field, expiry);
+
+    return value;
+}
+
+int KeyValueDatabase::HLEN(std::string& hash_key, bool acquire_lock) {
+    std::shared_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+    if(acquire_lock) db_lock.lock();
+
+    RedisHash* hash = find_hash(hash_key);
+    if(!hash) return 0;
+    return hash->size(current_time_ms());
+}
+
+bool KeyValueDatabase::HEXISTS(std::string& hash_key, std::string& field, bool acquire_lock) {
+    std::shared_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+    if(acquire_lock) db_lock.lock();
+
+    RedisHash* hash = find_hash(hash_key);
+    return hash && hash->exists(field, current_time_ms());
+}
+
+uint64_t KeyValueDatabase::HSCAN(std::string& hash_key, uint64_t cursor, const std::string& pattern, int count, std::vector<std::pair<std::string, std::string> >& result, bool acquire_lock) {
+    std::shared_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+    if(acquire_lock) db_lock.lock();
+
+    RedisHash* hash = find_hash(hash_key);
+    if(!hash) return 0;
+
+    GlobPattern matcher(pattern.empty() ? "*" : pattern);
+    return hash->scan(cursor, count, current_time_ms(), [&](const std::string& field, const std::string& value) {
+        if(matcher.match(field)) {
+            result.push_back({field, value});
+        }
+    });
+}
+
+std::vector<int> KeyValueDatabase::HEXPIRE(std::string& hash_key, long long expire_at_ms, const std::string& condition, std::vector<std::string>& fields, bool acquire_lock) {
+    std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+    if(acquire_lock) db_lock.lock();
+
+    // per field: -2 no such field, 0 condition not met, 1 TTL set, 2 deleted because the time is already in the past
+    std::vector<int> result(fields.size(), -2);
+    RedisHash* hash = find_hash(hash_key, true);
+    if(!hash) return result;
+
+    long long now = current_time_ms();
+    hash->purgeExpired(now);
+
+    for(size_t i = 0; i < fields.size(); i++) {
+        if(!hash->exists(fields[i], now)) continue;
+
+        long long current = hash->expiry(fields[i]);
+        // a field without TTL counts as never expiring for GT/LT
+        if((condition == "NX" && current != -1) ||
+           (condition == "XX" && current == -1) ||
+           (condition == "GT" && (current == -1 || expire_at_ms <= current)) ||
+           (condition == "LT" && current != -1 && expire_at_ms >= current)) {
+            result[i] = 0;
+            continue;
+        }
+
+        if(expire_at_ms <= now) {
+            hash->del(fields[i]);
+            result[i] = 2;
+        } else {
+            hash->setExpiry(fields[i], expire_at_ms);
+            result[i] = 1;
+        }
+    }
+
+    if(std::any_of(result.begin(), result.end(), [](int r) { return r > 0; })) touch(hash_key);
+    if(hash->empty()) {
+        map.erase(hash_key);
+    }
+    return result;
+}
+
+std::vector<long long> KeyValueDatabase::HTTL(std::string& hash_key, std::vector<std::string>& fields, bool in_ms, bool acquire_lock) {
+    std::shared_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+    if(acquire_lock) db_lock.lock();
+
+    // per field: -2 no such field, -1 no TTL, otherwise the remaining time
+    std::vector<long long> result(fields.size(), -2);
+    RedisHash* hash = find_hash(hash_key);
+    if(!hash) return result;
+
+    long long now = current_time_ms();
+    for(size_t i = 0; i < fields.size(); i++) {
+        if(!hash->exists(fields[i], now)) continue;
+
+        long long at = hash->expiry(fields[i]);
+        if(at == -1) {
+            result[i] = -1;
+        } else {
+            result[i] = in_ms ? at - now : (at - now + 999) / 1000;
+        }
+    }
+    return result;
+}
+
+std::vector<int> KeyValueDatabase::HPERSIST(std::string& hash_key, std::vector<std::string>& fields, bool acquire_lock) {
+    std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+    if(acquire_lock) db_lock.lock();
+
+    // per field: -2 no such field, -1 no TTL to remove, 1 TTL removed
+    std::vector<int> result(fields.size(), -2);
+    RedisHash* hash = find_hash(hash_key, true);
+    if(!hash) return result;
+
+    long long now = current_time_ms();
+    for(size_t i = 0; i < fields.size(); i++) {
+        if(!hash->exists(fields[i], now)) continue;
+        result[i] = hash->persist(fields[i]) ? 1 : -1;
+    }
+    if(std::find(result.begin(), result.end(), 1) != result.end()) touch(hash_key);
+    return result;
+}
+
+// random source for SPOP/SRANDMEMBER, one per client thread so no locking is needed
+static std::mt19937_64& set_rng() {
+    static thread_local std::mt19937_64 rng(std::random_device{}());
+    return rng;
+}
+
+int KeyValueDatabase::SADD(std::string& set_key, std::vector<std::string>& members, bool acquire_lock) {
+    std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+    if(acquire_lock) db_lock.lock();
+
+    RedisSet* set = find_set(set_key);
+    if(!set) {
+        map[set_key] = {Value(RedisSet{}), ObjType::SET, -1};
+        set = &std::get<RedisSet>(map[set_key].value);
+    }
+
+    int added = 0;
+    for(auto& member : members) {
+        if(set->add(member)) added++;
+    }
+    if(added > 0) touch(set_key);
+    return added;
+}
+
+int KeyValueDatabase::SREM(std::string& set_key, std::vector<std::string>& members, bool acquire_lock) {
+    std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+    if(acquire_lock) db_lock.lock();
+
+    RedisSet* set = find_set(set_key);
+    if(!set) return 0;
+
+    int removed = 0;
+    for(auto& member : members) {
+        if(set->remove(member)) removed++;
+    }
+
+    if(removed > 0) touch(set_key);
+    if(set->empty()) {
+        map.erase(set_key);
+    }
+    return removed;
+}
+
+std::vector<bool> KeyValueDatabase::SMISMEMBER(std::string& set_key, std::vector<std::string>& members, bool acquire_lock) {
+    std::shared_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+    if(acquire_lock) db_lock.lock();
+
+    RedisSet* set = find_set(set_key);
+
+    std::vector<bool> result;
+    for(auto& member : members) {
+        result.push_back(set && set->contains(member));
+    }
+    return result;
+}
+
+std::vector<std::string> KeyValueDatabase::SMEMBERS(std::string& set_key, bool acquire_lock) {
+    std::shared_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+    if(acquire_lock) db_lock.lock();
+
+    std::vector<std::string> result;
+    RedisSet* set = find_set(set_key);
+    if(!set) return result;
+
+    result.reserve(set->size());
+    set->forEach([&](const std::string& member) { result.push_back(member); });
+    return result;
+}
+
+int KeyValueDatabase::SCARD(std::string& set_key, bool acquire_lock) {
+    std::shared_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+    if(acquire_lock) db_lock.lock();
+
+    RedisSet* set = find_set(set_key);
+    return set ? set->size() : 0;
+}
+
+std::vector<std::string> KeyValueDatabase::SPOP(std::string& set_key, int count, bool acquire_lock) {
+    std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+    if(acquire_lock) db_lock.lock();
+
+    std::vector<std::string> result;
+    RedisSet* set = find_set(set_key);
+    if(!set) return result;
+    touch(set_key);
+
+    if((size_t)count >= set->size()) {
+        // popping everything: hand over the whole set
+        set->forEach([&](const std::string& member) { result.push_back(member); });
+        map.erase(set_key);
+        return result;
+    }
+
+    for(int i = 0; i < count; i++) {
+        result.push_back(set->pop(set_rng()));
+    }
+    return result;
+}
+
+std::vector<std::string> KeyValueDatabase::SRANDMEMBER(std::string& set_key, long long count, bool acquire_lock) {
+    std::shared_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+    if(acquire_lock) db_lock.lock();
+
+    std::vector<std::string> result;
+    RedisSet* set = find_set(set_key);
+    if(!set || count == 0) return result;
+
+    std::mt19937_64& rng = set_rng();
+
+    if(count < 0) {
+        for(long long i = 0; i < -count; i++) {
+            result.push_back(set->random(rng));
+        }
+        return result;
+    }
+
+    if((size_t)count >= set->size()) {
+        set->forEach([&](const std::string& member) { result.push_back(member); });
+        return result;
+    }
+
+    if((size_t)count * 3 > set->size()) {
+        // asking for most of the set: shuffle a copy instead of drawing until 'count' distinct members came up
+        set->forEach([&](const std::string& member) { result.push_back(member); });
+        std::shuffle(result.begin(), result.end(), rng);
+        result.resize(count);
+        return result;
+    }
+
+    std::unordered_set<std::string> picked;
+    while(picked.size() < (size_t)count) {
+        std::string member = set->random(rng);
+        if(picked.insert(member).second) {
+            result.push_back(std::move(member));
+        }
+    }
+    return result;
+}
+
+uint64_t KeyValueDatabase::SSCAN(std::string& set_key, uint64_t cursor, const std::string& pattern, int count, std::vector<std::string>& result, bool acquire_lock) {
+    std::shared_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+    if(acquire_lock) db_lock.lock();
+
+    RedisSet* set = find_set(set_key);
+    if(!set) return 0;
+
+    GlobPattern matcher(pattern.empty() ? "*" : pattern);
+    return set->scan(cursor, count, [&](const std::string& member) {
+        if(matcher.match(member)) {
+            result.push_back(member);
+        }
+    });
+}
+
+RedisSet KeyValueDatabase::compute_set_op(SetOp op, std::vector<std::string>& keys, size_t limit) {
+    std::vector<RedisSet*> sets;
+    for(auto& key : keys) {
+        sets.push_back(find_set(key));
+    }
+
+    bool all_intsets = std::all_of(sets.begin(), sets.end(), [](RedisSet* set) { return !set || set->isIntset(); });
+
+    if(op == SetOp::INTER) {
+        // any missing key makes the intersection empty
+        if(std::find(sets.begin(), sets.end(), nullptr) != sets.end()) return RedisSet{};
+
+        // smallest first, so every step works on the shortest candidate list
+        std::sort(sets.begin(), sets.end(), [](RedisSet* a, RedisSet* b) { return a->size() < b->size(); });
+
+        if(all_intsets) {
+            std::vector<int64_t> current = sets[0]->intset();
+            std::vector<int64_t> next;
+            for(size_t i = 1; i < sets.size() && !current.empty(); i++) {
+                const std::vector<int64_t>& other = sets[i]->intset();
+                next.resize(std::min(current.size(), other.size()));
+                next.resize(simd::intersect_sorted(current.data(), current.size(), other.data(), other.size(), next.data()));
+                current.swap(next);
+            }
+            if(limit > 0 && current.size() > limit) current.resize(limit);
+            return RedisSet::fromSortedInts(std::move(current));
+        }
+
+        RedisSet result;
+        sets[0]->forEach([&](const std::string& member) {
+            if(limit > 0 && result.size() >= limit) return;
+            for(size_t i = 1; i < sets.size(); i++) {
+                if(!sets[i]->contains(member)) return;
+            }
+            result.add(member);
+        });
+        return result;
+    }
+
+    if(op == SetOp::UNION) {
+        if(all_intsets) {
+            std::vector<int64_t> current, merged;
+            for(RedisSet* set : sets) {
+                if(!set) continue;
+                merged.clear();
+                std::set_union(current.begin(), current.end(), set->intset().begin(), set->intset().end(), std::back_inserter(merged));
+                current.swap(merged);
+            }
+            return RedisSet::fromSortedInts(std::move(current));
+        }
+
+        RedisSet result;
+        for(RedisSet* set : sets) {
+            if(set) set->forEach([&](const std::string& member) { result.add(member); });
+        }
+        return result;
+    }
+
+    // DIFF: members of the first set that are in none of the others
+    if(!sets[0]) return RedisSet{};
+
+    if(all_intsets) {
+        std::vector<int64_t> current = sets[0]->intset();
+        std::vector<int64_t> remaining;
+        for(size_t i = 1; i < sets.size() && !current.empty(); i++) {
+            if(!sets[i]) continue;
+            remaining.clear();
+            std::set_difference(current.begin(), current.end(), sets[i]->intset().begin(), sets[i]->intset().end(), std::back_inserter(remaining));
+            current.swap(remaining);
+        }
+        return RedisSet::fromSortedInts(std::move(current));
+    }
+
+    RedisSet result;
+    sets[0]->forEach([&](const std::string& member) {
+        for(size_t i = 1; i < sets.size(); i++) {
+            if(sets[i] && sets[i]->contains(member)) return;
+        }
+        result.add(member);
+    });
+    return result;
+}
+
+int KeyValueDatabase::store_set(const std::string& dest_key, RedisSet&& result) {
+    int size = result.size();
+    if(size == 0) {
+        map.erase(dest_key);
+    } else {
+        map[dest_key] = {Value(std::move(result)), ObjType::SET, -1};
+    }
+    return size;
+}
+
+std::vector<std::string> KeyValueDatabase::SETOP(SetOp op, std::vector<std::string>& keys, bool acquire_lock) {
+    std::shared_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+    if(acquire_lock) db_lock.lock();
+
+    RedisSet result = compute_set_op(op, keys);
+
+    std::vector<std::string> members;
+    members.reserve(result.size());
+    result.forEach([&](const std::string& member) { members.push_back(member); });
+    return members;
+}
+
+int KeyValueDatabase::SETOPSTORE(SetOp op, std::string& dest_key, std::vector<std::string>& keys, bool acquire_lock) {
+    std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+    if(acquire_lock) db_lock.lock();
+
+    RedisSet result = compute_set_op(op, keys);
+    touch(dest_key);
+    return store_set(dest_key, std::move(result));
+}
+
+int KeyValueDatabase::SINTERCARD(std::vector<std::string>& keys, size_t limit, bool acquire_lock) {
+    std::shared_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+    if(acquire_lock) db_lock.lock();
+
+    return compute_set_op(SetOp::INTER, keys, limit).size();
+}
+
+int KeyValueDatabase::SETBIT(std::string& key, uint64_t offset, int bit, bool acquire_lock) {
+    std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+    if(acquire_lock) db_lock.lock();
+
+    std::string& bitmap = write_string(key);
+    touch(key);
+    uint64_t byte = offset >> 3;
+    if(byte >= bitmap.size()) {
+        bitmap.resize(byte + 1, '\0');
+    }
+
+    uint8_t mask = 1 << (7 - (offset & 7));
+    int previous = ((uint8_t)bitmap[byte] & mask) ? 1 : 0;
+    if(bit) {
+        bitmap[byte] = (char)((uint8_t)bitmap[byte] | mask);
+    } else {
+        bitmap[byte] = (char)((uint8_t)bitmap[byte] & ~mask);
+    }
+    return previous;
+}
+
+int KeyValueDatabase::GETBIT(std::string& key, uint64_t offset, bool acquire_lock) {
+    std::shared_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+    if(acquire_lock) db_lock.lock();
+
+    std::string scratch;
+    const std::string* bitmap = read_string(key, scratch);
+    uint64_t byte = offset >> 3;
+    if(!bitmap || byte >= bitmap->size()) return 0;
+
+    return ((uint8_t)(*bitmap)[byte] >> (7 - (offset & 7))) & 1;
+}
+
+long long KeyValueDatabase::BITCOUNT(std::string& key, long long start, long long end, bool has_range, bool bit_unit, bool acquire_lock) {
+    std::shared_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+    if(acquire_lock) db_lock.lock();
+
+    std::string scratch;
+    const std::string* bitmap = read_string(key, scratch);
+    if(!bitmap || bitmap->empty()) return 0;
+
+    if(!has_range) {
+        return simd::popcount(reinterpret_cast<const uint8_t*>(bitmap->data()), bitmap->size());
+    }
+
+    long long total = bit_unit ? (long long)bitmap->size() * 8 : (long long)bitmap->size();
+    if(!bitmap_normalize_range(start, end, total)) return 0;
+
+    return bitmap_count(*bitmap, start, end, bit_unit);
+}
+
+long long KeyValueDatabase::BITPOS(std::string& key, int bit, long long start, long long end, bool has_start, bool has_end, bool bit_unit, bool acquire_lock) {
+    std::shared_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+    if(acquire_lock) db_lock.lock();
+
+    std::string scratch;
+    const std::string* bitmap = read_string(key, scratch);
+    // a missing key is an infinite run of zeros
+    if(!bitmap || bitmap->empty()) return bit ? -1 : 0;
+
+    long long total = bit_unit ? (long long)bitmap->size() * 8 : (long long)bitmap->size();
+    if(!has_start) {
+        start = 0;
+        end = total - 1;
+    } else if(!has_end) {
+        end = total - 1;
+    }
+    if(!bitmap_normalize_range(start, end, total)) return -1;
+
+    long long start_bit = bit_unit ? start : start * 8;
+    long long end_bit = bit_unit ? end : end * 8 + 7;
+
+    long long pos = bitmap_find(*bitmap, bit, start_bit, end_bit);
+
+    // looking for a zero without an explicit end, the string counts as padded with zeros on the right
+    if(pos == -1 && bit == 0 && !has_end) {
+        return end_bit + 1;
+    }
+    return pos;
+}
+
+long long KeyValueDatabase::BITOP(simd::BitOp op, std::string& dest_key, std::vector<std::string>& keys, bool acquire_lock) {
+    std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+    if(acquire_lock) db_lock.lock();
+
+    std::vector<std::string> scratch(keys.size());
+    std::vector<const std::string*> sources;
+    size_t max_len = 0;
+    for(size_t i = 0; i < keys.size(); i++) {
+        const std::string* source = read_string(keys[i], scratch[i]);
+        sources.push_back(source);
+        if(source) max_len = std::max(max_len, source->size());
+    }
+    touch(dest_key);
+
+    if(max_len == 0) {
+        map.erase(dest_key);
+        return 0;
+    }
+
+    // missing keys and shorter strings count as zero padded up to the longest one
+    std::string result(max_len, '\0');
+    uint8_t* out = reinterpret_cast<uint8_t*>(result.data());
+
+    if(op == simd::BitOp::NOT) {
+        simd::bitop(op, out, reinterpret_cast<const uint8_t*>(sources[0]->data()), max_len);
+    } else {
+        if(sources[0]) std::memcpy(out, sources[0]->data(), sources[0]->size());
+        for(size_t i = 1; i < sources.size(); i++) {
+            size_t len = sources[i] ? sources[i]->size() : 0;
+            if(len > 0) {
+                simd::bitop(op, out, reinterpret_cast<const uint8_t*>(sources[i]->data()), len);
+            }
+            // x & 0 = 0, while OR and XOR with the padding leave the tail as it is
+            if(op == simd::BitOp::AND && len < max_len) {
+                std::memset(out + len, 0, max_len - len);
+            }
+        }
+    }
+
+    map[dest_key] = {Value(std::move(result)), ObjType::STRING, -1};
+    return max_len;
+}
+
+std::vector<std::optional<long long> > KeyValueDatabase::BITFIELD(std::string& key, std::vector<BitfieldOp>& ops, bool acquire_lock) {
+    bool writes = std::any_of(ops.begin(), ops.end(), [](const BitfieldOp& op) { return op.kind != BitfieldOp::GET; });
+
+    std::unique_lock<std::shared_mutex> write_lock(rw_lock, std::defer_lock);
+    std::shared_lock<std::shared_mutex> read_lock(rw_lock, std::defer_lock);
+    if(acquire_lock) {
+        if(writes) write_lock.lock();
+        else read_lock.lock();
+    }
+
+    std::string scratch;
+    const std::string* bitmap = nullptr;
+    std::string* writable = nullptr;
+
+    if(writes) {
+        // as Redis, the string is zero padded up to the furthest written field before running the ops
+        writable = &write_string(key);
+        touch(key);
+        uint64_t needed = 0;
+        for(auto& op : ops) {
+            if(op.kind != BitfieldOp::GET) needed = std::max<uint64_t>(needed, ((op.offset + op.bits - 1) >> 3) + 1);
+        }
+        if(needed > writable->size()) writable->resize(needed, '\0');
+        bitmap = writable;
+    } else {
+        bitmap = read_string(key, scratch);
+    }
+
+    static const std::string empty;
+    std::vector<std::optional<long long> > results;
+
+    for(auto& op : ops) {
+        const std::string& current = bitmap ? *bitmap : empty;
+        long long old_value = op.is_signed ? bitfield_get_signed(current, op.offset, op.bits)
+                                           : (long long)bitfield_get_unsigned(current, op.offset, op.bits);
+
+        if(op.kind == BitfieldOp::GET) {
+            results.push_back(old_value);
+            continue;
+        }
+
+        long long new_value;
+        bool ok = op.kind == BitfieldOp::SET ? bitfield_add(op.value, 0, op.bits, op.is_signed, op.overflow, new_value)
+                                             : bitfield_add(old_value, op.value, op.bits, op.is_signed, op.overflow, new_value);
+        if(!ok) {
+            results.push_back(std::nullopt);
+            continue;
+        }
+
+        bitfield_set(*writable, op.offset, op.bits, (uint64_t)new_value);
+        // SET replies with the old value, INCRBY with the new one
+        results.push_back(op.kind == BitfieldOp::SET ? old_value : new_value);
+    }
+    return results;
+}
+
+int KeyValueDatabase::PFADD(std::string& key, std::vector<std::string>& elements, bool acquire_lock) {
+    std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+    if(acquire_lock) db_lock.lock();
+
+    std::string scratch;
+    bool created = find_hll(key, scratch) == nullptr;
+
+    std::string& hll = write_string(key);
+    if(created) {
+        hll = HyperLogLog::create();
+    }
+
+    int changed = created ? 1 : 0;
+    for(auto& element : elements) {
+        if(HyperLogLog::add(hll, element)) changed = 1;
+    }
+    if(changed) touch(key);
+    return changed;
+}
+
+long long KeyValueDatabase::PFCOUNT(std::vector<std::string>& keys, bool acquire_lock) {
+    // exclusive even though it reads: a single key count refreshes the cardinality cached in the string
+    std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+    if(acquire_lock) db_lock.lock();
+
+    std::string scratch;
+    if(keys.size() == 1) {
+        if(!find_hll(keys[0], scratch)) return 0;
+        return HyperLogLog::count(write_string(keys[0]));
+    }
+
+    // union of several counters: max their registers, nothing is cached
+    std::vector<uint8_t> regs(HyperLogLog::REGISTERS, 0);
+    for(auto& key : keys) {
+        const std::string* hll = find_hll(key, scratch);
+        if(hll) HyperLogLog::mergeInto(*hll, regs.data());
+    }
+    return HyperLogLog::estimate(regs.data());
+}
+
+void KeyValueDatabase::PFMERGE(std::string& dest_key, std::vector<std::string>& source_keys, bool acquire_lock) {
+    std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+    if(acquire_lock) db_lock.lock();
+
+    // the destination takes part in the union, as in Redis
+    std::vector<uint8_t> regs(HyperLogLog::REGISTERS, 0);
+    std::string scratch;
+    const std::string* dest = find_hll(dest_key, scratch);
+    if(dest) HyperLogLog::mergeInto(*dest, regs.data());
+
+    for(auto& key : source_keys) {
+        const std::string* hll = find_hll(key, scratch);
+        if(hll) HyperLogLog::mergeInto(*hll, regs.data());
+    }
+
+    touch(dest_key);
+    write_string(dest_key) = HyperLogLog::fromRegisters(regs.data());
+}
+
+/* The multi-key commands below take rw_lock once for the whole batch and read the clock once, instead of a lock
+round trip and an expiry check per key as N single-key commands would. */
+
+void KeyValueDatabase::MGET(const std::vector<std::string>& keys, std::string& response, bool acquire_lock) {
+    // read-only, expired keys are reported as missing and left for a writer to reclaim
+    std::shared_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+
+    if(acquire_lock) {
+        db_lock.lock();
+    }
+
+    long long now = current_time_ms();
+    response.reserve(response.size() + keys.size() * 16);
+    response += "*" + std::to_string(keys.size()) + "\r\n";
+
+    for(const std::string& key : keys) {
+        auto it = map.find(key);
+        if(it == map.end() || it->second.type != ObjType::STRING || (it->second.expiry_at != -1 && it->second.expiry_at < now)) {
+            response += "$-1\r\n";
+            continue;
+        }
+        std::string scratch;
+        const std::string& value = std::holds_alternative<long long>(it->second.value)
+            ? (scratch = std::to_string(std::get<long long>(it->second.value)))
+            : std::get<std::string>(it->second.value);
+        response += "$";
+        response += std::to_string(value.size());
+        response += "\r\n";
+        response += value;
+        response += "\r\n";
+    }
+}
+
+void KeyValueDatabase::MSET(const std::vector<std::pair<std::string, std::string> >& pairs, bool acquire_lock) {
+    std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+
+    if(acquire_lock) {
+        db_lock.lock();
+    }
+    for(const auto& [key, value] : pairs) touch(key);
+
+    for(auto& [key, value] : pairs) {
+        map.insert_or_assign(key, Entry{Value(value), ObjType::STRING, -1});
+    }
+}
+
+bool KeyValueDatabase::MSETNX(const std::vector<std::pair<std::string, std::string> >& pairs, bool acquire_lock) {
+    std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+
+    if(acquire_lock) {
+        db_lock.lock();
+    }
+
+    long long now = current_time_ms();
+    for(auto& [key, value] : pairs) {
+        auto it = map.find(key);
+        if(it != map.end() && !is_expired(it->second, now)) {
+            return false;
+        }
+    }
+
+    for(auto& [key, value] : pairs) {
+        touch(key);
+        map.insert_or_assign(key, Entry{Value(value), ObjType::STRING, -1});
+    }
+    return true;
+}
+
+int KeyValueDatabase::DEL(const std::vector<std::string>& keys, bool acquire_lock) {
+    std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+
+    if(acquire_lock) {
+        db_lock.lock();
+    }
+
+    long long now = current_time_ms();
+    int deleted = 0;
+
+    for(const std::string& key : keys) {
+        auto it = map.find(key);
+        if(it == map.end()) continue;
+        touch(key);
+        // an expired key is reclaimed but doesn't count as deleted
+        if(!is_expired(it->second, now)) deleted++;
+        if(it->second.type == ObjType::STREAM) fail_group_waiters(key, nullptr);
+        map.erase(it);
+    }
+    return deleted;
+}
+
+int KeyValueDatabase::UNLINK(const std::vector<std::string>& keys, bool acquire_lock) {
+    // big lists/sets/streams are moved out under the lock and destroyed once it is released
+    std::vector<Value> garbage;
+    int deleted = 0;
+
+    {
+        std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+
+        if(acquire_lock) {
+            db_lock.lock();
+        }
+
+        long long now = current_time_ms();
+        garbage.reserve(keys.size());
+
+        for(const std::string& key : keys) {
+            auto it = map.find(key);
+            if(it == map.end()) continue;
+            touch(key);
+            if(!is_expired(it->second, now)) deleted++;
+            if(it->second.type == ObjType::STREAM) fail_group_waiters(key, nullptr);
+            garbage.push_back(std::move(it->second.value));
+            map.erase(it);
+        }
+    }
+    return deleted;
+}
+
+int KeyValueDatabase::EXISTS(const std::vector<std::string>& keys, bool acquire_lock) {
+    std::shared_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+
+    if(acquire_lock) {
+        db_lock.lock();
+    }
+
+    long long now = current_time_ms();
+    int count = 0;
+
+    for(const std::string& key : keys) {
+        auto it = map.find(key);
+        if(it != map.end() && !is_expired(it->second, now)) count++;
+    }
+    return count;
+}
+
+int KeyValueDatabase::TOUCH(const std::vector<std::string>& keys, bool acquire_lock) {
+    // entries carry no access time yet, so touching a key only reports whether it exists
+    return EXISTS(keys, acquire_lock);
+}
+
+uint64_t KeyValueDatabase::ZSCAN(std::string& set_key, uint64_t cursor, const std::string& pattern, int count, std::vector<std::pair<std::string, double> >& result, bool acquire_lock) {
+    std::shared_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+    if(acquire_lock) db_lock.lock();
+
+    auto it = map.find(set_key);
+    if(it == map.end()) return 0;
+    if(it->second.type != ObjType::ZSET) {
+        throw std::runtime_error("WRONGTYPE Operation against a key holding the wrong kind of value");
+    }
+
+    const ZSet& zset = std::get<ZSet>(it->second.value);
+    GlobPattern matcher(pattern.empty() ? "*" : pattern);
+    size_t visited = 0;
+    size_t max_steps = (size_t)count * 10;
+
+    do {
+        cursor = zset.score_map.scan(cursor, [&](const std::pair<const std::string, double>& kv) {
+            visited++;
+            if(matcher.match(kv.first)) {
+                result.push_back({kv.first, kv.second});
+            }
+        });
+    } while(cursor != 0 && visited < (size_t)count && --max_steps > 0);
+
+    return cursor;
+}
+
+void* KeyValueDatabase::MODULE_GET(const std::string& key, const ModuleType* type, bool acquire_lock) {
+    std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+    if(acquire_lock) db_lock.lock();
+
+    auto it = map.find(key);
+    if(it == map.end() || (it->second.expiry_at != -1 && it->second.expiry_at < current_time_ms())) {
+        return nullptr;
+    }
+    if(it->second.type != ObjType::MODULE || std::get<ModuleValue>(it->second.value).type != type) {
+        throw std::runtime_error("WRONGTYPE Operation against a key holding the wrong kind of value");
+    }
+    return std::get<ModuleValue>(it->second.value).value.get();
+}
+
+void KeyValueDatabase::MODULE_SET(const std::string& key, const ModuleType* type, void* value, bool acquire_lock) {
+    std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+    if(acquire_lock) db_lock.lock();
+    touch(key);
+
+    auto free_value = type->methods.free;
+    std::shared_ptr<void> owned(value, [free_value](void* p) { free_value(p); });
+    map[key] = {Value(ModuleValue{type, std::move(owned)}), ObjType::MODULE, -1};
+}
+
+void KeyValueDatabase::MODULE_CALL(const std::function<void()>& fn, bool acquire_lock) {
+    // inside EXEC the transaction already holds the lock
+    std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+    if(acquire_lock) db_lock.lock();
+    fn();
+}
+
+void KeyValueDatabase::LOAD_KEYS(std::vector<LoadedKey>& keys, bool acquire_lock) {
+    // loading restores what was already saved, so no touch(): nothing is dirty and nobody can be watching yet
+    std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+    if(acquire_lock) db_lock.lock();
+    for(LoadedKey& loaded : keys) {
+        map[loaded.key] = {std::move(loaded.value), loaded.type, loaded.expiry_at};
+    }
+}
+
+void KeyValueDatabase::RESERVE(size_t more_keys, bool acquire_lock) {
+    std::unique_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+    if(acquire_lock) db_lock.lock();
+    map.reserve(map.size() + more_keys);
+}
+
+void KeyValueDatabase::SNAPSHOT(RDBWriter& out, bool acquire_lock) {
+    std::shared_lock<std::shared_mutex> db_lock(rw_lock, std::defer_lock);
+    if(acquire_lock) db_lock.lock();
+
+    long long now = current_time_ms();
+    size_t expires = 0;
+    for(const auto& [key, entry] : map) {
+        if(entry.expiry_at != -1) expires++;
+    }
+    out.writeHeader(map.size(), expires);
+
+    for(const auto& [key, entry] : map) {
+        if(is_expired(entry, now)) continue;
+
+        switch(entry.type) {
+            case ObjType::STRING: {
+                out.writeKey(key, entry.expiry_at, RDBWriter::TYPE_STRING);
+                if(std::holds_alternative<long long>(entry.value)) out.writeInteger(std::get<long long>(entry.value));
+                else out.writeString(std::get<std::string>(entry.value));
+                break;
+            }
+            case ObjType::LIST: {
+                const RedisList& list = std::get<RedisList>(entry.value);
+                if(list.empty()) break;
+                out.writeKey(key, entry.expiry_at, RDBWriter::TYPE_LIST_QUICKLIST_2);
+                out.writeList(list);
+                break;
+            }
+            case ObjType::SET: {
+                const RedisSet& set = std::get<RedisSet>(entry.value);
+                if(set.empty()) break;
+                out.writeKey(key, entry.expiry_at, RDBWriter::typeOf(set));
+                out.writeSet(set);
+                break;
+            }
+            case ObjType::ZSET: {
+                const ZSet& zset = std::get<ZSet>(entry.value);
+                if(zset.score_set.empty()) break;
+                out.writeKey(key, entry.expiry_at, RDBWriter::TYPE_ZSET_2);
+                out.writeZSet(zset);
+                break;
+            }
+            case ObjType::HASH: {
+                const RedisHash& hash = std::get<RedisHash>(entry.value);
+                if(hash.size(now) == 0) break;
+                out.writeKey(key, entry.expiry_at, RDBWriter::typeOf(hash));
+                out.writeHash(hash, now);
+                break;
+            }
+            case ObjType::STREAM: {
+                out.writeKey(key, entry.expiry_at, RDBWriter::TYPE_STREAM_LISTPACKS_3);
+                out.writeStream(std::get<Stream>(entry.value));
+                break;
+            }
+            case ObjType::MODULE: {
+                out.writeKey(key, entry.expiry_at, RDBWriter::TYPE_MODULE_2);
+                out.writeModuleValue(std::get<ModuleValue>(entry.value));
+                break;
+            }
+        }
+    }
+}
+
+pid_t KeyValueDatabase::FORK_SNAPSHOT(long long& dirty_at_fork) {
+    // no writer can be halfway through a change while we hold the shared lock, readers carry on
+    std::shared_lock<std::shared_mutex> db_lock(rw_lock);
+    dirty_at_fork = DIRTY();
+    return fork();
+}
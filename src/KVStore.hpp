@@ -10,17 +10,40 @@
 #include <deque>
 #include <vector>
 #include <list> 
+#include <map>
+#include <memory>
 #include <algorithm>
 #include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <sys/types.h>
 #include "Stream.hpp"
 #include "ClientContext.hpp"
 #include "SortedSet.hpp"
+#include "Hash.hpp"
+#include "Set.hpp"
+#include "Bitmap.hpp"
+#include "HLL.hpp"
+#include "Dict.hpp"
+#include "Keyspace.hpp"
+#include "TimerWheel.hpp"
+#include "ModuleAPI.hpp"
 
 
-enum class ObjType {STRING, LIST, HASH, STREAM, ZSET};
+enum class ObjType {STRING, LIST, HASH, STREAM, ZSET, SET, MODULE};
 
 using RedisList = std::deque<std::string>;
-using Value = std::variant<std::string, RedisList, Stream, ZSet, long long>;
+
+// a value of a module's custom type, released with the type's free() when the last copy goes
+struct ModuleValue {
+    const ModuleType* type;
+    std::shared_ptr<void> value;
+};
+
+using Value = std::variant<std::string, RedisList, Stream, ZSet, long long, RedisHash, RedisSet, ModuleValue>;
+class RDBWriter;
+
 class KeyValueDatabase {
 private:
     struct Entry {
@@ -29,56 +52,193 @@ private:
         long long expiry_at = -1;
     };
 
-    //Store info about sleeping clients waiting for list
-    struct BlockingContextList {
-        std::condition_variable_any cv; //The conditional variable to wake/notify the client
-        bool is_fulfilled = false; //Updated by RPUSH/LPUSH when the list l is being updated and it finds a sleeping client blocking context in the list associated with blocking_map[l]
-        std::string list; //Stores the name of list from which the client pops the value
-        std::string item; //Stores the popped item
+    //Record of a client blocked on lists (BLPOP/BRPOP/BLMPOP). Pushes pop for it in place and its timeout lives in the
+    //timer wheel, both under the db lock, so the client's thread only wakes up to send the reply
+    struct BlockingListWaiter {
+        std::mutex lock;
+        std::condition_variable cv;
+        bool is_fulfilled = false; // served by a push, or timed out when 'items' is empty
+        bool left; // which end to pop from
+        int count;
+        bool is_move = false; // BLMOVE: the popped item is pushed to 'move_to' instead of being returned alone
+        std::string move_to;
+        bool move_to_left;
+        std::string error; // set instead of 'items' when the move failed
+        std::string list; // the list the items were popped from
+        std::vector<std::string> items;
+        std::vector<std::pair<std::string, std::list<BlockingListWaiter*>::iterator> > nodes; // position in each key's waiting list
+        std::optional<TimerWheel<BlockingListWaiter*>::Handle> timer; // nullopt when blocking forever or once fired
     };
 
     //Store info about sleeping clients waiting for stream
+    struct BlockingStreamController;
+
+    // waiters of a stream ordered by the id they wait past, XADD only visits the prefix its new entry satisfies
+    using StreamWaiterIndex = std::multimap<StreamId, std::shared_ptr<BlockingStreamController> >;
+
     struct BlockingStreamController {
         std::mutex lock;
-        std::condition_variable_any cv;
+        std::condition_variable cv;
         bool is_fulfilled = false;
+        std::vector<std::pair<std::string, std::vector<StreamEntry> > > result; // entries handed over by XADD
+        std::vector<std::pair<std::string, StreamWaiterIndex::iterator> > nodes; // position in each key's index, guarded by stream_blocking_mutex
     };
 
-    struct BlockingStreamNode {
-        StreamId threshold_id;
-        BlockingStreamController* controller;
+    //Store info about sleeping XREADGROUP clients, served in FIFO order by XADD while it holds the db lock
+    struct BlockingGroupWaiter {
+        std::mutex lock;
+        std::condition_variable cv;
+        bool is_fulfilled = false;
+        std::string group;
+        std::string consumer;
+        int count;
+        bool noack;
+        std::pair<std::string, std::vector<StreamEntry> > result; // stream key and the entries delivered by XADD
+        std::string error; // set instead of result when the group or its stream went away
+        std::vector<std::pair<std::string, std::list<BlockingGroupWaiter*>::iterator> > nodes; // position in each key's waiting list
     };
 
-    std::unordered_map<std::string, std::list<BlockingContextList*> > blocking_map; // stores for each list: Blocking Context of the clients waiting for it
-    std::unordered_map<std::string, std::list<BlockingStreamNode> > blocking_stream_map; // stores for each stream key the blocking 
-    std::unordered_map<std::string, Entry> map; // database which stores everything
+    std::unordered_map<std::string, std::list<BlockingListWaiter*> > blocking_map; // stores for each list the clients blocked on it in FIFO order, guarded by rw_lock
+    std::unordered_map<std::string, StreamWaiterIndex> blocking_stream_map; // stores for each stream key the XREAD waiters indexed by threshold id
+    std::unordered_map<std::string, std::list<BlockingGroupWaiter*> > blocking_group_map; // stores for each stream key the XREADGROUP waiters, guarded by rw_lock
+    Keyspace<Entry> map; // database which stores everything, a Dict so SCAN cursors stay valid while it grows or shrinks, plus the optional key index
     std::mutex stream_blocking_mutex; // mutex for blocking global stream map which contains list of waiters for each stream_key
     std::shared_mutex rw_lock; // Unlike std::mutex, which can be acquired only by one user, shared_mutex can be acquired by multiple users TO READ, it has to be uniquely acquired to WRITE
+    TimerWheel<BlockingListWaiter*> list_timers; // timeouts of blocked list clients, scheduled and cancelled under rw_lock
+    std::once_flag list_timer_started;
+    std::mutex watch_mutex; // guards watched_keys and the WatchState of every client
+    std::unordered_map<std::string, std::list<WatchState*> > watched_keys; // WATCHed key -> clients watching it, marked dirty when the key is written
+    std::atomic<size_t> num_watched_keys{0};
+    std::atomic<long long> dirty{0}; // writes since startup, the save triggers count the ones since the last save
+    std::jthread list_timer_thread; // declared last so it stops before the members it uses are destroyed
 
     long long current_time_ms();
+    static const char* type_name(ObjType type); // the name TYPE reports
+    static bool is_expired(const Entry& entry, long long now); // past its TTL, or a hash whose fields all expired: reads as missing
+    Stream* find_stream(const std::string& stream_key); // throws WRONGTYPE, nullptr if the key doesn't exist
+    StreamConsumerGroup& find_group(const std::string& stream_key, const std::string& group); // throws WRONGTYPE/NOGROUP
+    RedisHash* find_hash(const std::string& hash_key, bool reclaim = false); // throws WRONGTYPE, nullptr if the key doesn't exist or all its fields expired, which 'reclaim' (writers) then erases
+    RedisSet* find_set(const std::string& set_key); // throws WRONGTYPE, nullptr if the key doesn't exist
+    RedisSet compute_set_op(SetOp op, std::vector<std::string>& keys, size_t limit = 0); // limit > 0 stops an intersection early
+    int store_set(const std::string& dest_key, RedisSet&& result);
+    const std::string* read_string(const std::string& key, std::string& scratch); // throws WRONGTYPE, nullptr if missing or expired; integers are rendered into 'scratch'
+    std::string& write_string(const std::string& key); // throws WRONGTYPE, creates an empty string if missing
+    const std::string* find_hll(const std::string& key, std::string& scratch); // read_string + HLL format check
+    void unregister_stream_waiter(BlockingStreamController& controller, const std::string& serving_key = "");
+    void unregister_group_waiter(BlockingGroupWaiter& waiter, const std::string& serving_key = "");
+    void fail_group_waiters(const std::string& stream_key, const std::string* group); // wakes the XREADGROUP clients of a destroyed group with NOGROUP, of every group of the key when 'group' is null
+    void unregister_list_waiter(BlockingListWaiter& waiter, const std::string& serving_key = "");
+    void serve_list_waiters(const std::string& list_key); // hands the items of a list that just grew to the clients blocked on it
+    void wait_for_lists(std::unique_lock<std::shared_mutex>& db_lock, BlockingListWaiter& waiter, const std::vector<std::string>& list_keys, double timeout); // releases the db lock while sleeping
+    RedisList* find_list(const std::string& list_key); // throws WRONGTYPE, nullptr if the key doesn't exist
+    void touch(const std::string& key); // marks the transactions watching 'key' dirty, called with the db lock held uniquely by every write once it changes the key
+    void push_item(const std::string& list_key, std::string&& item, bool left); // creates the list, the type was checked by the caller
+    void expire_list_waiters(std::stop_token stop); // body of list_timer_thread
+    static std::vector<std::string> pop_items(RedisList& dq, bool left, int count);
 
 public:
-    void SET(const std::string& key, const std::string& value, bool acquire_lock, long long px_duration = -1);
+    void SET(const std::string& key, const std::string& value, bool acquire_lock, long long expire_at_ms = -1); // unix time in ms, -1 for none
     std::optional<std::string> GET(const std::string& key, bool acquire_lock);
+    void MGET(const std::vector<std::string>& keys, std::string& response, bool acquire_lock); // appends one bulk string (or nil) per key to 'response'
+    void MSET(const std::vector<std::pair<std::string, std::string> >& pairs, bool acquire_lock);
+    bool MSETNX(const std::vector<std::pair<std::string, std::string> >& pairs, bool acquire_lock); // false if any key already exists
+    int DEL(const std::vector<std::string>& keys, bool acquire_lock);
+    int UNLINK(const std::vector<std::string>& keys, bool acquire_lock); // DEL, but values are freed after the lock is released
+    int EXISTS(const std::vector<std::string>& keys, bool acquire_lock); // a key given twice is counted twice
+    int TOUCH(const std::vector<std::string>& keys, bool acquire_lock);
     int RPUSH(std::string& list_key, std::vector<std::string>& items, bool acquire_lock); // Appends 'items' in the RedisList list at the back and returns the size of 'list'
     int LPUSH(std::string& list_key, std::vector<std::string>& items, bool acquire_lock); // Appends 'items' in the RedisList list at the front and returns the size of 'list'
     std::vector<std::string> LRANGE(std::string& list_key, int start, int end, bool acquire_lock); 
     int LLEN(std::string& list_key, bool acquire_lock);
     std::vector<std::string> LPOP(std::string& list_key, int num_remove_item, bool acquire_lock);
-    std::optional<std::pair<std::string, std::string> > BLPOP(std::vector<std::string>& list_keys, double wait_time, bool acquire_lock);
+    std::vector<std::string> RPOP(std::string& list_key, int num_remove_item, bool acquire_lock);
+    // pops up to 'count' items from the first non-empty list, blocking up to 'timeout' seconds (0 = forever) when 'block' is set
+    std::optional<std::pair<std::string, std::vector<std::string> > > BLMPOP(std::vector<std::string>& list_keys, bool left, int count, bool block, double timeout, bool acquire_lock);
+    // atomically pops from one end of 'source' and pushes to one end of 'destination', BLMOVE/BRPOPLPUSH when 'block' is set
+    std::optional<std::string> LMOVE(std::string& source, std::string& destination, bool from_left, bool to_left, bool block, double timeout, bool acquire_lock);
+    std::optional<std::string> LINDEX(std::string& list_key, long long index, bool acquire_lock);
+    void LSET(std::string& list_key, long long index, std::string& element, bool acquire_lock);
+    int LREM(std::string& list_key, long long count, std::string& element, bool acquire_lock); // count < 0 removes from the tail
+    void LTRIM(std::string& list_key, long long start, long long stop, bool acquire_lock);
+    std::vector<long long> LPOS(std::string& list_key, std::string& element, long long rank, long long count, long long maxlen, bool acquire_lock); // count 0 = all matches, maxlen 0 = whole list
+    int LINSERT(std::string& list_key, bool before, std::string& pivot, std::string& element, bool acquire_lock); // -1 without the pivot, 0 without the key
     std::string TYPE(std::string& key, bool acquire_lock);
     StreamId XADD(std::string& stream_key, std::string& stream_id, std::vector<std::pair<std::string, std::string> >& fields, bool acquire_lock);
     std::vector<StreamEntry> XRANGE(std::string& stream_key, std::string& start, std::string& end, bool acquire_lock);
     std::vector<std::pair<std::string, std::vector<StreamEntry> > > XREAD(int count, bool block, int64_t ms, const std::vector<std::string>& keys, const std::vector<std::string>& ids_str, bool acquire_lock);
+    void XGROUP_CREATE(std::string& stream_key, std::string& group, std::string& id, bool mkstream, bool acquire_lock);
+    int XGROUP_DESTROY(std::string& stream_key, std::string& group, bool acquire_lock);
+    int XGROUP_CREATECONSUMER(std::string& stream_key, std::string& group, std::string& consumer, bool acquire_lock);
+    int64_t XGROUP_DELCONSUMER(std::string& stream_key, std::string& group, std::string& consumer, bool acquire_lock);
+    void XGROUP_SETID(std::string& stream_key, std::string& group, std::string& id, bool acquire_lock);
+    std::vector<std::pair<std::string, std::vector<StreamEntry> > > XREADGROUP(const std::string& group, const std::string& consumer, int count, bool block, int64_t ms, bool noack, const std::vector<std::string>& keys, const std::vector<std::string>& ids_str, bool acquire_lock);
+    int XACK(std::string& stream_key, std::string& group, std::vector<StreamId>& ids, bool acquire_lock);
+    StreamPendingSummary XPENDING(std::string& stream_key, std::string& group, bool acquire_lock);
+    std::vector<StreamPendingInfo> XPENDING(std::string& stream_key, std::string& group, int64_t min_idle, StreamId start, StreamId end, int count, const std::string& consumer, bool acquire_lock);
+    std::vector<StreamEntry> XCLAIM(std::string& stream_key, std::string& group, std::string& consumer, int64_t min_idle, std::vector<StreamId>& ids, int64_t idle, int64_t time, int64_t retry_count, bool force, bool justid, bool acquire_lock);
+    StreamAutoClaimResult XAUTOCLAIM(std::string& stream_key, std::string& group, std::string& consumer, int64_t min_idle, StreamId start, int count, bool justid, bool acquire_lock);
     std::optional<long long> INCR(std::string& key, bool acquire_lock);
-    std::vector<std::string> EXEC(std::vector<QueuedCommand>& commandQueue, ClientContext& context, KeyValueDatabase& db, bool acquire_lock);
+    std::optional<std::vector<std::string> > EXEC(std::vector<QueuedCommand>& commandQueue, ClientContext& context, KeyValueDatabase& db, bool acquire_lock); // nullopt when a watched key changed
+    void WATCH(WatchState& state, const std::vector<std::string>& keys, bool acquire_lock);
+    void UNWATCH(WatchState& state); // also clears the dirty flag
     std::vector<std::string> KEYS(std::string &pattern, bool acquire_lock);
+    uint64_t SCAN(uint64_t cursor, const std::string& pattern, int count, const std::string& type, std::vector<std::string>& result, bool acquire_lock); // empty pattern/type match everything
+    void ENABLE_KEY_INDEX(); // builds the ordered key index, KEYS prefix* and SCANPREFIX then skip the rest of the keyspace
+    std::vector<std::string> SCANPREFIX(const std::string& prefix, const std::string& after, int count, bool acquire_lock); // keys after 'after' in lexicographic order, throws if there is no index
     int ZADD(std::string& set_key, std::vector<std::string>& members, std::vector<double>& scores, bool acquire_lock);
     int ZRANK(std::string& set_key, std::string& member, bool acquire_lock);
     std::vector<std::string> ZRANGE(std::string& set_key, int start, int end, bool acquire_lock);
     int ZCARD(std::string& set_key, bool acquire_lock);
     std::optional<double> ZSCORE(std::string& set_key, std::string& member, bool acquire_lock);
     int ZREM(std::string& set_key, std::vector<std::string>& members, bool acquire_lock);
+    uint64_t ZSCAN(std::string& set_key, uint64_t cursor, const std::string& pattern, int count, std::vector<std::pair<std::string, double> >& result, bool acquire_lock);
+    int HSET(std::string& hash_key, std::vector<std::pair<std::string, std::string> >& fields, bool acquire_lock); // returns the number of new fields
+    std::optional<std::string> HGET(std::string& hash_key, std::string& field, bool acquire_lock);
+    std::vector<std::optional<std::string> > HMGET(std::string& hash_key, std::vector<std::string>& fields, bool acquire_lock);
+    int HDEL(std::string& hash_key, std::vector<std::string>& fields, bool acquire_lock);
+    std::vector<std::pair<std::string, std::string> > HGETALL(std::string& hash_key, bool acquire_lock);
+    long long HINCRBY(std::string& hash_key, std::string& field, long long increment, bool acquire_lock);
+    int HLEN(std::string& hash_key, bool acquire_lock);
+    bool HEXISTS(std::string& hash_key, std::string& field, bool acquire_lock);
+    uint64_t HSCAN(std::string& hash_key, uint64_t cursor, const std::string& pattern, int count, std::vector<std::pair<std::string, std::string> >& result, bool acquire_lock);
+    std::vector<int> HEXPIRE(std::string& hash_key, long long expire_at_ms, const std::string& condition, std::vector<std::string>& fields, bool acquire_lock);
+    std::vector<long long> HTTL(std::string& hash_key, std::vector<std::string>& fields, bool in_ms, bool acquire_lock);
+    std::vector<int> HPERSIST(std::string& hash_key, std::vector<std::string>& fields, bool acquire_lock);
+    int SADD(std::string& set_key, std::vector<std::string>& members, bool acquire_lock);
+    int SREM(std::string& set_key, std::vector<std::string>& members, bool acquire_lock);
+    std::vector<bool> SMISMEMBER(std::string& set_key, std::vector<std::string>& members, bool acquire_lock);
+    std::vector<std::string> SMEMBERS(std::string& set_key, bool acquire_lock);
+    int SCARD(std::string& set_key, bool acquire_lock);
+    std::vector<std::string> SPOP(std::string& set_key, int count, bool acquire_lock);
+    std::vector<std::string> SRANDMEMBER(std::string& set_key, long long count, bool acquire_lock); // negative count allows repetitions
+    uint64_t SSCAN(std::string& set_key, uint64_t cursor, const std::string& pattern, int count, std::vector<std::string>& result, bool acquire_lock);
+    std::vector<std::string> SETOP(SetOp op, std::vector<std::string>& keys, bool acquire_lock); // SINTER / SUNION / SDIFF
+    int SETOPSTORE(SetOp op, std::string& dest_key, std::vector<std::string>& keys, bool acquire_lock); // SINTERSTORE / SUNIONSTORE / SDIFFSTORE
+    int SINTERCARD(std::vector<std::string>& keys, size_t limit, bool acquire_lock);
+    int SETBIT(std::string& key, uint64_t offset, int bit, bool acquire_lock); // returns the previous bit
+    int GETBIT(std::string& key, uint64_t offset, bool acquire_lock);
+    long long BITCOUNT(std::string& key, long long start, long long end, bool has_range, bool bit_unit, bool acquire_lock);
+    long long BITPOS(std::string& key, int bit, long long start, long long end, bool has_start, bool has_end, bool bit_unit, bool acquire_lock);
+    long long BITOP(simd::BitOp op, std::string& dest_key, std::vector<std::string>& keys, bool acquire_lock); // returns the length of the result
+    std::vector<std::optional<long long> > BITFIELD(std::string& key, std::vector<BitfieldOp>& ops, bool acquire_lock); // nullopt for a failed OVERFLOW FAIL op
+    int PFADD(std::string& key, std::vector<std::string>& elements, bool acquire_lock); // 1 if a register changed or the key was created
+    long long PFCOUNT(std::vector<std::string>& keys, bool acquire_lock);
+    void PFMERGE(std::string& dest_key, std::vector<std::string>& source_keys, bool acquire_lock);
+    void* MODULE_GET(const std::string& key, const ModuleType* type, bool acquire_lock); // throws WRONGTYPE unless the key holds 'type', nullptr if missing
+    void MODULE_SET(const std::string& key, const ModuleType* type, void* value, bool acquire_lock); // the key owns 'value' from now on
+    // a key decoded from an RDB file, expiry_at in ms since epoch or -1
+    struct LoadedKey {
+        std::string key;
+        Value value;
+        ObjType type;
+        long long expiry_at;
+    };
+    void LOAD_KEYS(std::vector<LoadedKey>& keys, bool acquire_lock); // moves a whole batch in under one lock
+    void RESERVE(size_t more_keys, bool acquire_lock); // presize the keyspace, e.g. from the RDB resize hint
+    void SNAPSHOT(RDBWriter& out, bool acquire_lock); // writes every live key, the caller finishes the file
+    pid_t FORK_SNAPSHOT(long long& dirty_at_fork); // fork() under the shared lock, the child sees the keyspace of that instant
+    long long DIRTY() const { return dirty.load(std::memory_order_relaxed); }
+    void MODULE_CALL(const std::function<void()>& fn, bool acquire_lock); // runs a module command under the exclusive db lock
     std::vector<std::string> GEOSEARCH(std::string& set_key, double center_lon, double center_lat, double radius_meters, bool sort_asc, bool acquire_lock);
 };
 
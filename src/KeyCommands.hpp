@@ -0,0 +1,179 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "Command.hpp"
+#include "KVStore.hpp"
+#include "ClientContext.hpp"
+#include "ScanArgs.hpp"
+
+// Generic keyspace commands that work on keys of any type
+
+class DelCommand : public Command {
+private:
+    bool lazy; // UNLINK frees the values outside the db lock
+
+public:
+    DelCommand(bool lazy) : lazy(lazy) {}
+
+    std::string name() const override { return lazy ? "UNLINK" : "DEL"; }
+    int min_args() const override { return 2; }
+    KeySpec keySpec() const override { return {1, -1, 1}; }
+    bool isWriteCommand() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+    std::vector<std::string> rewriteForAof(const std::vector<std::string>& args, const std::string& reply) const override { return argsUnlessZero(args, reply); }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        //args: DEL key [key ...]
+        std::vector<std::string> keys(args.begin() + 1, args.end());
+        int deleted = lazy ? db.UNLINK(keys, acquire_lock) : db.DEL(keys, acquire_lock);
+        return ":" + std::to_string(deleted) + "\r\n";
+    }
+};
+
+class ExistsCommand : public Command {
+public:
+    std::string name() const override { return "EXISTS"; }
+    int min_args() const override { return 2; }
+    KeySpec keySpec() const override { return {1, -1, 1}; }
+    bool isWriteCommand() const override { return false; }
+    bool isReadOnly() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        std::vector<std::string> keys(args.begin() + 1, args.end());
+        return ":" + std::to_string(db.EXISTS(keys, acquire_lock)) + "\r\n";
+    }
+};
+
+class TouchCommand : public Command {
+public:
+    std::string name() const override { return "TOUCH"; }
+    int min_args() const override { return 2; }
+    KeySpec keySpec() const override { return {1, -1, 1}; }
+    bool isWriteCommand() const override { return false; }
+    bool isReadOnly() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        std::vector<std::string> keys(args.begin() + 1, args.end());
+        return ":" + std::to_string(db.TOUCH(keys, acquire_lock)) + "\r\n";
+    }
+};
+
+// SCAN cursor [MATCH pattern] [COUNT count] [TYPE type]
+class ScanCommand : public Command {
+public:
+    std::string name() const override { return "SCAN"; }
+    int min_args() const override { return 2; }
+    KeySpec keySpec() const override { return {0, 0, 1, true}; }
+    bool isWriteCommand() const override { return false; }
+    bool isReadOnly() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override {
+        ScanArgs scan;
+        std::string error = parseScanArgs(args, 1, ScanOption::TYPE, scan);
+        if(!error.empty()) {
+            return error;
+        }
+        bound = std::move(scan);
+        return "";
+    }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        return bindAndExecute(context, args, db, acquire_lock);
+    }
+
+    std::string execute_bound(ClientContext& context, const std::vector<std::string> &args, const std::any& bound, KeyValueDatabase &db, bool acquire_lock) override {
+        const ScanArgs& scan = std::any_cast<const ScanArgs&>(bound);
+
+        std::vector<std::string> keys;
+        uint64_t next_cursor = db.SCAN(scan.cursor, scan.pattern, scan.count, scan.type, keys, acquire_lock);
+
+        std::string next = std::to_string(next_cursor);
+        std::string response = "*2\r\n$" + std::to_string(next.length()) + "\r\n" + next + "\r\n";
+        response += "*" + std::to_string(keys.size()) + "\r\n";
+        for(auto& key : keys) {
+            response += "$" + std::to_string(key.length()) + "\r\n" + key + "\r\n";
+        }
+        return response;
+    }
+};
+
+/* SCANPREFIX prefix [AFTER key] [COUNT count], needs --keyindex yes
+Keys starting with 'prefix' in lexicographic order. The reply is [last key returned, keys], pass the last key back as AFTER
+to continue; it is nil once the prefix is exhausted. */
+class ScanPrefixCommand : public Command {
+private:
+    struct Bound {
+        std::string after;
+        long long count = 10;
+    };
+
+public:
+    std::string name() const override { return "SCANPREFIX"; }
+    int min_args() const override { return 2; }
+    KeySpec keySpec() const override { return {0, 0, 1, true}; }
+    bool isWriteCommand() const override { return false; }
+    bool isReadOnly() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override {
+        Bound parsed;
+
+        for(size_t i = 2; i < args.size(); i++) {
+            std::string option = args[i];
+            std::transform(option.begin(), option.end(), option.begin(), ::toupper);
+
+            if(option == "AFTER" && i + 1 < args.size()) {
+                parsed.after = args[++i];
+            } else if(option == "COUNT" && i + 1 < args.size()) {
+                if(!Listpack::stringToInt(args[++i], parsed.count)) {
+                    return "-ERR value is not an integer or out of range\r\n";
+                }
+                if(parsed.count < 1) {
+                    return "-ERR syntax error\r\n";
+                }
+            } else {
+                return "-ERR syntax error\r\n";
+            }
+        }
+
+        bound = std::move(parsed);
+        return "";
+    }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        return bindAndExecute(context, args, db, acquire_lock);
+    }
+
+    std::string execute_bound(ClientContext& context, const std::vector<std::string> &args, const std::any& bound, KeyValueDatabase &db, bool acquire_lock) override {
+        std::string prefix = args[1];
+        const Bound& parsed = std::any_cast<const Bound&>(bound);
+        long long count = parsed.count;
+
+        try {
+            std::vector<std::string> keys = db.SCANPREFIX(prefix, parsed.after, count, acquire_lock);
+
+            std::string response = "*2\r\n";
+            if((long long)keys.size() == count) {
+                response += "$" + std::to_string(keys.back().length()) + "\r\n" + keys.back() + "\r\n";
+            } else {
+                response += "$-1\r\n";
+            }
+            response += "*" + std::to_string(keys.size()) + "\r\n";
+            for(auto& key : keys) {
+                response += "$" + std::to_string(key.length()) + "\r\n" + key + "\r\n";
+            }
+            return response;
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+    }
+};
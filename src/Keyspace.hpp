@@ -0,0 +1,73 @@
+#pragma once
+#include <string>
+#include <memory>
+#include <utility>
+#include "Dict.hpp"
+#include "RadixTree.hpp"
+
+/* The keyspace dict plus an optional ordered index of its key names (--keyindex yes). Only the calls that add or remove
+keys are wrapped, so the index can never drift from the dict; everything else goes straight to the Dict. */
+template <typename V>
+class Keyspace {
+private:
+    using Table = Dict<std::string, V>;
+
+    Table table;
+    std::unique_ptr<RadixTree> index; // nullptr when the index is disabled
+
+public:
+    using iterator = typename Table::iterator;
+    using const_iterator = typename Table::const_iterator;
+
+    void enableIndex() {
+        if(index) return;
+        index = std::make_unique<RadixTree>();
+        for(const auto& kv : table) index->insert(kv.first);
+    }
+
+    const RadixTree* keyIndex() const { return index.get(); }
+
+    size_t size() const { return table.size(); }
+    bool empty() const { return table.empty(); }
+    void reserve(size_t n) { table.reserve(n); }
+
+    iterator begin() { return table.begin(); }
+    iterator end() { return table.end(); }
+    const_iterator begin() const { return table.begin(); }
+    const_iterator end() const { return table.end(); }
+
+    iterator find(const std::string& key) { return table.find(key); }
+    const_iterator find(const std::string& key) const { return table.find(key); }
+
+    template <typename Fn>
+    uint64_t scan(uint64_t cursor, Fn&& fn) const { return table.scan(cursor, std::forward<Fn>(fn)); }
+
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(const std::string& key, Args&&... args) {
+        auto result = table.try_emplace(key, std::forward<Args>(args)...);
+        if(result.second && index) index->insert(key);
+        return result;
+    }
+
+    template <typename M>
+    std::pair<iterator, bool> insert_or_assign(const std::string& key, M&& value) {
+        auto result = table.insert_or_assign(key, std::forward<M>(value));
+        if(result.second && index) index->insert(key);
+        return result;
+    }
+
+    V& operator[](const std::string& key) {
+        return try_emplace(key).first->second;
+    }
+
+    size_t erase(const std::string& key) {
+        size_t erased = table.erase(key);
+        if(erased && index) index->erase(key);
+        return erased;
+    }
+
+    iterator erase(iterator it) {
+        if(index) index->erase(it->first);
+        return table.erase(it);
+    }
+};
@@ -13,6 +13,7 @@
 #include <unordered_map>
 #include <optional>
 #include <sstream>
+#include <climits>
 #include "Command.hpp"
 #include "KVStore.hpp"
 #include "ClientContext.hpp"
@@ -20,6 +21,9 @@
 #include "PubSubManager.hpp"
 #include "GeoHelper.hpp"
 #include "ACLManager.hpp"
+#include "PersistenceManager.hpp"
+#include "AOFManager.hpp"
+#include "ScanArgs.hpp"
 
 
 class RPUSH : public Command
@@ -27,6 +31,7 @@ class RPUSH : public Command
 public:
     std::string name() const override { return "RPUSH"; }
     int min_args() const override { return 3; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
     bool isWriteCommand() const override { return true; }
     bool sendToMaster() const override { return false; }
     bool isPubSubCommand() const override { return false; }
@@ -55,6 +60,7 @@ class LPUSH : public Command
 public:
     std::string name() const override { return "LPUSH"; }
     int min_args() const override { return 3; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
     bool isWriteCommand() const override { return true; }
     bool sendToMaster() const override { return false; }
     bool isPubSubCommand() const override { return false; }
@@ -83,22 +89,32 @@ class LRANGE : public Command
 public:
     std::string name() const override { return "LRANGE"; }
     int min_args() const override { return 4; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
     bool isWriteCommand() const override { return false; }
+    bool isReadOnly() const override { return true; }
     bool sendToMaster() const override { return false; }
     bool isPubSubCommand() const override { return false; }
 
-    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override
     {
         //args: LRANGE list_key st en
-        std::string list_key = args[1];
-        int start, end;
-    
         try {
-            start = std::stoi(args[2]);
-            end = std::stoi(args[3]);
+            bound = std::pair<int, int>(std::stoi(args[2]), std::stoi(args[3]));
         } catch (...) {
             return "-ERR value is not an integer or out of range\r\n";
         }
+        return "";
+    }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override
+    {
+        return bindAndExecute(context, args, db, acquire_lock);
+    }
+
+    std::string execute_bound(ClientContext& context, const std::vector<std::string> &args, const std::any& bound, KeyValueDatabase &db, bool acquire_lock) override
+    {
+        std::string list_key = args[1];
+        auto [start, end] = std::any_cast<std::pair<int, int>>(bound);
         std::vector<std::string> items = db.LRANGE(list_key, start, end, acquire_lock);
         
         std::string ans = "*" + std::to_string(items.size()) + "\r\n";
@@ -114,7 +130,9 @@ class LLEN : public Command
 public:
     std::string name() const override { return "LLEN"; }
     int min_args() const override { return 2; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
     bool isWriteCommand() const override { return false; }
+    bool isReadOnly() const override { return true; }
     bool sendToMaster() const override { return false; }
     bool isPubSubCommand() const override { return false; }
 
@@ -127,73 +145,146 @@ public:
     }  
 };
 
-class LPOP : public Command
+// LPOP / RPOP
+class ListPopCommand : public Command
 {
+private:
+    bool left;
+
+    struct Args {
+        int count = 1;
+        bool has_count = false; // with a count the reply is always an array
+    };
 public:
-    std::string name() const override { return "LPOP"; }
+    ListPopCommand(bool left_) : left(left_) {}
+    std::string name() const override { return left ? "LPOP" : "RPOP"; }
     int min_args() const override { return 2; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
     bool isWriteCommand() const override { return true; }
     bool sendToMaster() const override { return false; }
     bool isPubSubCommand() const override { return false; }
 
-    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override
-    {
-        //args: LPOP list_key number
-        std::string list_key = args[1];
-        int num_remove_item = 1;
+    std::vector<std::string> rewriteForAof(const std::vector<std::string>& args, const std::string& reply) const override {
+        if(reply == "$-1\r\n" || reply == "*-1\r\n") return {};
+        return args;
+    }
 
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override
+    {
+        //args: LPOP list_key [count]
+        Args parsed;
         if(args.size() >= 3) {
-            try {
-                num_remove_item = std::stoi(args[2]);
-            } catch (...) {
+            long long count = 0;
+            if(!Listpack::stringToInt(args[2], count) || count > INT_MAX) {
                 return "-ERR value is not an integer or out of range\r\n";
             }
+            if(count < 0) {
+                return "-ERR value is out of range, must be positive\r\n";
+            }
+            parsed.count = count;
+            parsed.has_count = true;
         }
+        bound = parsed;
+        return "";
+    }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override
+    {
+        return bindAndExecute(context, args, db, acquire_lock);
+    }
 
-        std::vector<std::string> items = db.LPOP(list_key, num_remove_item, acquire_lock);
+    std::string execute_bound(ClientContext& context, const std::vector<std::string> &args, const std::any& bound, KeyValueDatabase &db, bool acquire_lock) override
+    {
+        const Args& parsed = std::any_cast<const Args&>(bound);
+        std::string list_key = args[1];
+        std::vector<std::string> items = left ? db.LPOP(list_key, parsed.count, acquire_lock) : db.RPOP(list_key, parsed.count, acquire_lock);
 
-        if(items.empty()) {
-            return "$-1\r\n";
-        } else if(items.size() == 1) {
+        if(!parsed.has_count) {
+            if(items.empty()) return "$-1\r\n";
             return "$" + std::to_string(items[0].length()) + "\r\n" + items[0] + "\r\n";
         }
-        
+        if(items.empty()) {
+            return "*-1\r\n";
+        }
+
         std::string ans = "*" + std::to_string(items.size()) + "\r\n";
         for(const auto& str : items) {
             ans += "$" + std::to_string(str.length()) + "\r\n" + str + "\r\n";
         }
         return ans;
-    }  
+    }
 };
 
-class BLPOP : public Command {
+// the timeout argument of the blocking list commands, in seconds
+static bool parse_block_timeout(const std::string& arg, double& timeout, std::string& error) {
+    try {
+        size_t pos = 0;
+        timeout = std::stod(arg, &pos);
+        if(pos != arg.size()) throw std::invalid_argument(arg);
+    } catch (...) {
+        error = "-ERR timeout is not a float or out of range\r\n";
+        return false;
+    }
+    if(timeout < 0) {
+        error = "-ERR timeout is negative\r\n";
+        return false;
+    }
+    return true;
+}
+
+// LEFT / RIGHT of the list commands that take a direction
+static bool parse_list_side(std::string arg, bool& left) {
+    std::transform(arg.begin(), arg.end(), arg.begin(), ::toupper);
+    if(arg != "LEFT" && arg != "RIGHT") return false;
+    left = arg == "LEFT";
+    return true;
+}
+
+// BLPOP / BRPOP
+class BlockingPopCommand : public Command {
+private:
+    bool left;
 public:
-    std::string name() const override { return "BLPOP"; }
+    BlockingPopCommand(bool left_) : left(left_) {}
+    std::string name() const override { return left ? "BLPOP" : "BRPOP"; }
     int min_args() const override { return 3; }
+    KeySpec keySpec() const override { return {1, -2, 1}; }
     bool isWriteCommand() const override { return true; }
     bool sendToMaster() const override { return false; }
     bool isPubSubCommand() const override { return false; }
+    bool mayBlock(const std::vector<std::string>& args) const override { return true; }
 
-    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override
-    {
-        std::vector<std::string> list_keys;
-        for(int i = 1; i < args.size() - 1; i++) {
-            list_keys.push_back(args[i]);
-        }
+    // logged as the pop that happened, BLPOP would block forever on an empty list when replayed
+    std::vector<std::string> rewriteForAof(const std::vector<std::string>& args, const std::string& reply) const override {
+        if(reply == "*-1\r\n") return {};
+        return {left ? "LPOP" : "RPOP", replyStrings(reply)[0]};
+    }
 
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override
+    {
+        //args: BLPOP key [key ...] timeout
         double wait_time = 0;
-
-        try {
-            wait_time = std::stod(args.back());
-        } catch (...) {
-            return "-ERR timeout is not a float or out of range\r\n";
+        std::string error;
+        if(!parse_block_timeout(args.back(), wait_time, error)) {
+            return error;
         }
+        bound = wait_time;
+        return "";
+    }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override
+    {
+        return bindAndExecute(context, args, db, acquire_lock);
+    }
 
-        std::optional<std::pair<std::string, std::string> > result = db.BLPOP(list_keys, wait_time, acquire_lock);
+    std::string execute_bound(ClientContext& context, const std::vector<std::string> &args, const std::any& bound, KeyValueDatabase &db, bool acquire_lock) override
+    {
+        std::vector<std::string> list_keys(args.begin() + 1, args.end() - 1);
+        auto result = db.BLMPOP(list_keys, left, 1, true, std::any_cast<double>(bound), acquire_lock);
 
         if(result.has_value()) {
-            std::string list = result.value().first;
-            std::string item = result.value().second;
+            std::string& list = result.value().first;
+            std::string& item = result.value().second[0];
 
             std::string ans = "*2\r\n";
 
@@ -207,190 +298,1333 @@ public:
     }
 };
 
-class TypeCommand : public Command {
+// LMPOP / BLMPOP
+class MultiPopCommand : public Command {
+private:
+    bool block;
+
+    struct Args {
+        double timeout = 0;
+        std::vector<std::string> keys;
+        bool left = true;
+        int count = 1;
+    };
 public:
-    std::string name() const override { return "TYPE"; }
-    int min_args() const override { return 2; }
-    bool isWriteCommand() const override { return false; }
+    MultiPopCommand(bool block_) : block(block_) {}
+    std::string name() const override { return block ? "BLMPOP" : "LMPOP"; }
+    int min_args() const override { return block ? 5 : 4; }
+    KeySpec keySpec() const override { return {}; }
+    std::vector<std::string> keys(const std::vector<std::string>& args) const override { return keysAfterNumkeys(args, block ? 2 : 1); }
+    bool isWriteCommand() const override { return true; }
     bool sendToMaster() const override { return false; }
     bool isPubSubCommand() const override { return false; }
+    bool mayBlock(const std::vector<std::string>& args) const override { return block; }
+
+    std::vector<std::string> rewriteForAof(const std::vector<std::string>& args, const std::string& reply) const override {
+        if(reply == "*-1\r\n") return {};
+        if(!block) return args;
+        std::vector<std::string> lmpop = {"LMPOP"};
+        lmpop.insert(lmpop.end(), args.begin() + 2, args.end()); // without the timeout
+        return lmpop;
+    }
+
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override
+    {
+        //args: BLMPOP timeout numkeys key [key ...] LEFT|RIGHT [COUNT count], LMPOP has no timeout
+        Args parsed;
+        size_t idx = 1;
+        if(block) {
+            std::string error;
+            if(!parse_block_timeout(args[idx++], parsed.timeout, error)) {
+                return error;
+            }
+        }
+
+        long long numkeys = 0;
+        if(!Listpack::stringToInt(args[idx++], numkeys) || numkeys <= 0) {
+            return "-ERR numkeys should be greater than 0\r\n";
+        }
+        if(numkeys >= (long long)(args.size() - idx)) {
+            return "-ERR syntax error\r\n";
+        }
+        parsed.keys.assign(args.begin() + idx, args.begin() + idx + numkeys);
+        idx += numkeys;
+
+        if(!parse_list_side(args[idx++], parsed.left)) {
+            return "-ERR syntax error\r\n";
+        }
+
+        if(idx < args.size()) {
+            std::string option = args[idx++];
+            std::transform(option.begin(), option.end(), option.begin(), ::toupper);
+            if(option != "COUNT" || idx + 1 != args.size()) {
+                return "-ERR syntax error\r\n";
+            }
+            long long count = 0;
+            if(!Listpack::stringToInt(args[idx], count) || count <= 0 || count > INT_MAX) {
+                return "-ERR count should be greater than 0\r\n";
+            }
+            parsed.count = count;
+        }
+
+        bound = std::move(parsed);
+        return "";
+    }
 
     std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override
     {
-        std::string key = args[1];
-        std::string type = db.TYPE(key, acquire_lock);
-        return "+" + type + "\r\n";
+        return bindAndExecute(context, args, db, acquire_lock);
+    }
+
+    std::string execute_bound(ClientContext& context, const std::vector<std::string> &args, const std::any& bound, KeyValueDatabase &db, bool acquire_lock) override
+    {
+        Args parsed = std::any_cast<const Args&>(bound);
+        auto result = db.BLMPOP(parsed.keys, parsed.left, parsed.count, block, parsed.timeout, acquire_lock);
+        if(!result.has_value()) {
+            return "*-1\r\n";
+        }
+
+        const std::string& list = result.value().first;
+        std::string ans = "*2\r\n$" + std::to_string(list.length()) + "\r\n" + list + "\r\n";
+        ans += "*" + std::to_string(result.value().second.size()) + "\r\n";
+        for(const auto& item : result.value().second) {
+            ans += "$" + std::to_string(item.length()) + "\r\n" + item + "\r\n";
+        }
+        return ans;
     }
 };
 
-class XADDCommand : public Command {
+// LMOVE / BLMOVE
+class LMoveCommand : public Command {
+private:
+    bool block;
+
+    struct Args {
+        bool from_left = false;
+        bool to_left = true;
+        double timeout = 0;
+    };
 public:
-    std::string name() const override { return "XADD"; }
-    int min_args() const override { return 5; }
+    LMoveCommand(bool block_) : block(block_) {}
+    std::string name() const override { return block ? "BLMOVE" : "LMOVE"; }
+    int min_args() const override { return block ? 6 : 5; }
+    KeySpec keySpec() const override { return {1, 2, 1}; }
     bool isWriteCommand() const override { return true; }
     bool sendToMaster() const override { return false; }
     bool isPubSubCommand() const override { return false; }
+    bool mayBlock(const std::vector<std::string>& args) const override { return block; }
+
+    std::vector<std::string> rewriteForAof(const std::vector<std::string>& args, const std::string& reply) const override {
+        if(reply == "*-1\r\n" || reply == "$-1\r\n") return {};
+        if(!block) return args;
+        return {"LMOVE", args[1], args[2], args[3], args[4]};
+    }
+
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override
+    {
+        //args: LMOVE source destination LEFT|RIGHT LEFT|RIGHT, BLMOVE adds a timeout
+        Args parsed;
+        if(!parse_list_side(args[3], parsed.from_left) || !parse_list_side(args[4], parsed.to_left)) {
+            return "-ERR syntax error\r\n";
+        }
+
+        std::string error;
+        if(block && !parse_block_timeout(args[5], parsed.timeout, error)) {
+            return error;
+        }
+        bound = parsed;
+        return "";
+    }
 
     std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override
     {
-        std::string stream_key = args[1];
-        std::string stream_id = args[2];
-        std::vector<std::pair<std::string, std::string> > fields;
-        for(int i = 3; i < args.size(); i += 2) {
-            if(i + 1 == args.size()) {
-                return "-wrong number of arguments for 'xadd' command\r\n";
+        return bindAndExecute(context, args, db, acquire_lock);
+    }
+
+    std::string execute_bound(ClientContext& context, const std::vector<std::string> &args, const std::any& bound, KeyValueDatabase &db, bool acquire_lock) override
+    {
+        const Args& parsed = std::any_cast<const Args&>(bound);
+        return move_reply(db, args[1], args[2], parsed.from_left, parsed.to_left, block, parsed.timeout, acquire_lock);
+    }
+
+    static std::string move_reply(KeyValueDatabase &db, std::string source, std::string destination, bool from_left, bool to_left, bool block, double timeout, bool acquire_lock)
+    {
+        try {
+            std::optional<std::string> item = db.LMOVE(source, destination, from_left, to_left, block, timeout, acquire_lock);
+            if(!item) {
+                return block ? "*-1\r\n" : "$-1\r\n";
             }
-            fields.push_back({args[i], args[i + 1]});
+            return "$" + std::to_string(item->length()) + "\r\n" + *item + "\r\n";
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
         }
+    }
+};
 
-        StreamId result = db.XADD(stream_key, stream_id, fields, acquire_lock);
+// RPOPLPUSH / BRPOPLPUSH, the LMOVE source destination RIGHT LEFT of older clients
+class RPopLPushCommand : public Command {
+private:
+    bool block;
+public:
+    RPopLPushCommand(bool block_) : block(block_) {}
+    std::string name() const override { return block ? "BRPOPLPUSH" : "RPOPLPUSH"; }
+    int min_args() const override { return block ? 4 : 3; }
+    KeySpec keySpec() const override { return {1, 2, 1}; }
+    bool isWriteCommand() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+    bool mayBlock(const std::vector<std::string>& args) const override { return block; }
 
-        // handle errors using magic values
-        if (result.ms == -1) { 
-             return "-WRONGTYPE Operation against a key holding the wrong kind of value\r\n";
-        }
-        if (result.ms == 0 && result.seq == 0) {
-             return "-ERR The ID specified in XADD must be greater than 0-0\r\n";
-        }
-        if (result.ms == 0 && result.seq == -1) {
-             return "-ERR The ID specified in XADD is equal or smaller than the target stream top item\r\n";
+    std::vector<std::string> rewriteForAof(const std::vector<std::string>& args, const std::string& reply) const override {
+        if(reply == "*-1\r\n" || reply == "$-1\r\n") return {};
+        if(!block) return args;
+        return {"RPOPLPUSH", args[1], args[2]};
+    }
+
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override
+    {
+        //args: RPOPLPUSH source destination, BRPOPLPUSH adds a timeout
+        double wait_time = 0;
+        std::string error;
+        if(block && !parse_block_timeout(args[3], wait_time, error)) {
+            return error;
         }
+        bound = wait_time;
+        return "";
+    }
 
-        std::string ans = result.toString();
-        return "$" + std::to_string(ans.length()) + "\r\n" + ans + "\r\n";
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override
+    {
+        return bindAndExecute(context, args, db, acquire_lock);
+    }
+
+    std::string execute_bound(ClientContext& context, const std::vector<std::string> &args, const std::any& bound, KeyValueDatabase &db, bool acquire_lock) override
+    {
+        return LMoveCommand::move_reply(db, args[1], args[2], false, true, block, std::any_cast<double>(bound), acquire_lock);
     }
 };
 
-class XRANGECommand : public Command {
+// arguments that must be integers, bound as a vector of them by the list commands below
+static std::string bind_integers(const std::vector<std::string> &args, const std::vector<size_t>& positions, std::any& bound) {
+    std::vector<long long> values;
+    for(size_t pos : positions) {
+        long long value = 0;
+        if(!Listpack::stringToInt(args[pos], value)) {
+            return "-ERR value is not an integer or out of range\r\n";
+        }
+        values.push_back(value);
+    }
+    bound = std::move(values);
+    return "";
+}
+
+class LIndexCommand : public Command {
 public:
-    std::string name() const override { return "XRANGE"; }
-    int min_args() const override { return 4; }
+    std::string name() const override { return "LINDEX"; }
+    int min_args() const override { return 3; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
     bool isWriteCommand() const override { return false; }
+    bool isReadOnly() const override { return true; }
     bool sendToMaster() const override { return false; }
     bool isPubSubCommand() const override { return false; }
 
+    //args: LINDEX key index
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override { return bind_integers(args, {2}, bound); }
+
     std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override
     {
-        std::string stream_key = args[1];
-        std::string start = args[2];
-        std::string end = args[3];
+        return bindAndExecute(context, args, db, acquire_lock);
+    }
+
+    std::string execute_bound(ClientContext& context, const std::vector<std::string> &args, const std::any& bound, KeyValueDatabase &db, bool acquire_lock) override
+    {
+        std::string list_key = args[1];
+        long long index = std::any_cast<const std::vector<long long>&>(bound)[0];
+
         try {
-            std::vector<StreamEntry> entries = db.XRANGE(stream_key, start, end, acquire_lock);
-            
-            std::string ans = "*" + std::to_string(entries.size()) + "\r\n";
-            
-            for(const auto& entry : entries) {
-                // for each entry it has 2 values: stream_id and the fields (key:value pairs)
-                ans += "*2\r\n";
-                
-                std::string str_id = entry.id.toString();
-                ans += "$" + std::to_string(str_id.length()) + "\r\n" + str_id + "\r\n";
-                
-                // size is fields.size() * 2 because key and value are separate elements
-                ans += "*" + std::to_string(entry.fields.size() * 2) + "\r\n"; 
-                
-                for(const auto& field : entry.fields) {
-                    ans += "$" + std::to_string(field.first.length()) + "\r\n" + field.first + "\r\n";
-                    ans += "$" + std::to_string(field.second.length()) + "\r\n" + field.second + "\r\n";
-                }
+            std::optional<std::string> item = db.LINDEX(list_key, index, acquire_lock);
+            if(!item) {
+                return "$-1\r\n";
             }
-            return ans;
-
-        } catch (const std::invalid_argument&) {
-            return "-ERR Invalid stream ID specified as stream command argument\r\n";
+            return "$" + std::to_string(item->length()) + "\r\n" + *item + "\r\n";
         } catch (const std::runtime_error& e) {
-            return "-WRONGTYPE Operation against a key holding the wrong kind of value\r\n";
-        } catch (...) {
-            return "-ERR unknown error\r\n";
+            return "-" + std::string(e.what()) + "\r\n";
         }
     }
 };
 
-class XREADCommand : public Command {
-    std::string name() const override { return "XREAD"; }
+class LSetCommand : public Command {
+public:
+    std::string name() const override { return "LSET"; }
     int min_args() const override { return 4; }
-    bool isWriteCommand() const override { return false; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
+    bool isWriteCommand() const override { return true; }
     bool sendToMaster() const override { return false; }
     bool isPubSubCommand() const override { return false; }
 
+    //args: LSET key index element
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override { return bind_integers(args, {2}, bound); }
+
     std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override
     {
-        int count = INT_MAX;
-        bool block = false;
-        int64_t ms;
-        std::vector<std::string> key;
-        std::vector<std::string> id;
-        
-        int pos = 1;
-        if(args[pos] == "count") {
-            count = stoll(args[pos + 1]);
-            pos += 2;
-        }
+        return bindAndExecute(context, args, db, acquire_lock);
+    }
 
-        if(args[pos] == "block") {
-            block = true;
-            ms = stoll(args[pos + 1]);
-            pos += 2;
-        }
+    std::string execute_bound(ClientContext& context, const std::vector<std::string> &args, const std::any& bound, KeyValueDatabase &db, bool acquire_lock) override
+    {
+        std::string list_key = args[1];
+        std::string element = args[3];
+        long long index = std::any_cast<const std::vector<long long>&>(bound)[0];
 
-        if (args[pos] != "streams") {
-            return "-ERR syntax error\r\n"; 
+        try {
+            db.LSET(list_key, index, element, acquire_lock);
+            return "+OK\r\n";
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
         }
+    }
+};
+
+class LRemCommand : public Command {
+public:
+    std::string name() const override { return "LREM"; }
+    int min_args() const override { return 4; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
+    bool isWriteCommand() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+    std::vector<std::string> rewriteForAof(const std::vector<std::string>& args, const std::string& reply) const override { return argsUnlessZero(args, reply); }
 
-        pos++;
+    //args: LREM key count element, a negative count removes from the tail, 0 removes all
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override { return bind_integers(args, {2}, bound); }
 
-        int num_keys = (int)args.size() - pos;
-        if(num_keys % 2 != 0) {
-            return "-ERR wrong number of arguments for XREAD command\r\n";
-        }
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override
+    {
+        return bindAndExecute(context, args, db, acquire_lock);
+    }
 
-        for(int k = pos; k < pos + num_keys / 2; k++) {
-            key.push_back(args[k]);
-        }
-        for(int k = pos + num_keys / 2; k < args.size(); k++) {
-            id.push_back(args[k]);
+    std::string execute_bound(ClientContext& context, const std::vector<std::string> &args, const std::any& bound, KeyValueDatabase &db, bool acquire_lock) override
+    {
+        std::string list_key = args[1];
+        std::string element = args[3];
+        long long count = std::any_cast<const std::vector<long long>&>(bound)[0];
+
+        try {
+            return ":" + std::to_string(db.LREM(list_key, count, element, acquire_lock)) + "\r\n";
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
         }
+    }
+};
+
+class LTrimCommand : public Command {
+public:
+    std::string name() const override { return "LTRIM"; }
+    int min_args() const override { return 4; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
+    bool isWriteCommand() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    //args: LTRIM key start stop
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override { return bind_integers(args, {2, 3}, bound); }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override
+    {
+        return bindAndExecute(context, args, db, acquire_lock);
+    }
+
+    std::string execute_bound(ClientContext& context, const std::vector<std::string> &args, const std::any& bound, KeyValueDatabase &db, bool acquire_lock) override
+    {
+        std::string list_key = args[1];
+        const std::vector<long long>& range = std::any_cast<const std::vector<long long>&>(bound);
 
         try {
-            std::cout << "Block = " << block << " for " << ms << '\n';
-            std::vector<std::pair<std::string, std::vector<StreamEntry> > > entries = db.XREAD(count, block, ms, key, id, acquire_lock);
-            //XREAD returns a vector of pair of stream_key and vector of streamEntry where each entry corresponds to a stream id and the key-value pairs added to this stream
-            
-            if(entries.empty()) {
-                std::cout << "here\n";
-                return "*-1\r\n";
+            db.LTRIM(list_key, range[0], range[1], acquire_lock);
+            return "+OK\r\n";
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+    }
+};
+
+class LPosCommand : public Command {
+private:
+    struct Args {
+        long long rank = 1;
+        long long count = 1;
+        long long maxlen = 0;
+        bool has_count = false; // with COUNT the reply is an array
+    };
+public:
+    std::string name() const override { return "LPOS"; }
+    int min_args() const override { return 3; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
+    bool isWriteCommand() const override { return false; }
+    bool isReadOnly() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override
+    {
+        //args: LPOS key element [RANK rank] [COUNT num-matches] [MAXLEN len]
+        Args parsed;
+        for(size_t i = 3; i < args.size(); i += 2) {
+            std::string option = args[i];
+            std::transform(option.begin(), option.end(), option.begin(), ::toupper);
+            long long value = 0;
+            if(i + 1 >= args.size() || (option != "RANK" && option != "COUNT" && option != "MAXLEN")) {
+                return "-ERR syntax error\r\n";
+            }
+            if(!Listpack::stringToInt(args[i + 1], value)) {
+                return "-ERR value is not an integer or out of range\r\n";
             }
 
-            std::string ans = "*" + std::to_string(entries.size()) + "\r\n";
+            if(option == "RANK") {
+                if(value == 0 || value == LLONG_MIN) {
+                    return "-ERR RANK can't be zero: use 1 to start from the first match, 2 from the second ... or use negative to start from the last match\r\n";
+                }
+                parsed.rank = value;
+            } else if(option == "COUNT") {
+                if(value < 0) {
+                    return "-ERR COUNT can't be negative\r\n";
+                }
+                parsed.count = value;
+                parsed.has_count = true;
+            } else {
+                if(value < 0) {
+                    return "-ERR MAXLEN can't be negative\r\n";
+                }
+                parsed.maxlen = value;
+            }
+        }
+        bound = parsed;
+        return "";
+    }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override
+    {
+        return bindAndExecute(context, args, db, acquire_lock);
+    }
+
+    std::string execute_bound(ClientContext& context, const std::vector<std::string> &args, const std::any& bound, KeyValueDatabase &db, bool acquire_lock) override
+    {
+        const Args& parsed = std::any_cast<const Args&>(bound);
+        std::string list_key = args[1];
+        std::string element = args[2];
+
+        try {
+            std::vector<long long> positions = db.LPOS(list_key, element, parsed.rank, parsed.count, parsed.maxlen, acquire_lock);
+            if(!parsed.has_count) {
+                return positions.empty() ? "$-1\r\n" : ":" + std::to_string(positions[0]) + "\r\n";
+            }
+
+            std::string ans = "*" + std::to_string(positions.size()) + "\r\n";
+            for(long long pos : positions) {
+                ans += ":" + std::to_string(pos) + "\r\n";
+            }
+            return ans;
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+    }
+};
+
+class LInsertCommand : public Command {
+public:
+    std::string name() const override { return "LINSERT"; }
+    int min_args() const override { return 5; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
+    bool isWriteCommand() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override
+    {
+        //args: LINSERT key BEFORE|AFTER pivot element
+        std::string where = args[2];
+        std::transform(where.begin(), where.end(), where.begin(), ::toupper);
+        if(where != "BEFORE" && where != "AFTER") {
+            return "-ERR syntax error\r\n";
+        }
+        bound = where == "BEFORE";
+        return "";
+    }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override
+    {
+        return bindAndExecute(context, args, db, acquire_lock);
+    }
+
+    std::string execute_bound(ClientContext& context, const std::vector<std::string> &args, const std::any& bound, KeyValueDatabase &db, bool acquire_lock) override
+    {
+        std::string list_key = args[1];
+        std::string pivot = args[3];
+        std::string element = args[4];
+
+        try {
+            return ":" + std::to_string(db.LINSERT(list_key, std::any_cast<bool>(bound), pivot, element, acquire_lock)) + "\r\n";
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+    }
+};
+
+class TypeCommand : public Command {
+public:
+    std::string name() const override { return "TYPE"; }
+    int min_args() const override { return 2; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
+    bool isWriteCommand() const override { return false; }
+    bool isReadOnly() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override
+    {
+        std::string key = args[1];
+        std::string type = db.TYPE(key, acquire_lock);
+        return "+" + type + "\r\n";
+    }
+};
+
+class XADDCommand : public Command {
+public:
+    std::string name() const override { return "XADD"; }
+    int min_args() const override { return 5; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
+    bool isWriteCommand() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    // with the id it got instead of * or ms-*, a replay would generate new ones
+    std::vector<std::string> rewriteForAof(const std::vector<std::string>& args, const std::string& reply) const override {
+        std::vector<std::string> logged = args;
+        logged[2] = replyStrings(reply)[0];
+        return logged;
+    }
+
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override
+    {
+        //args: XADD key id|*|ms-* field value [field value ...], bound to the field/value pairs
+        const std::string& stream_id = args[2];
+        if(stream_id != "*") {
+            // ms, ms-seq or ms-*: checked here so a bad id fails before anything runs
+            size_t dash = stream_id.find('-');
+            long long part;
+            if(!Listpack::stringToInt(stream_id.substr(0, dash), part) ||
+               (dash != std::string::npos && stream_id.substr(dash + 1) != "*" && !Listpack::stringToInt(stream_id.substr(dash + 1), part))) {
+                return "-ERR Invalid stream ID specified as stream command argument\r\n";
+            }
+        }
+
+        std::vector<std::pair<std::string, std::string> > fields;
+        for(size_t i = 3; i < args.size(); i += 2) {
+            if(i + 1 == args.size()) {
+                return "-ERR wrong number of arguments for 'xadd' command\r\n";
+            }
+            fields.push_back({args[i], args[i + 1]});
+        }
+
+        bound = std::move(fields);
+        return "";
+    }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override
+    {
+        return bindAndExecute(context, args, db, acquire_lock);
+    }
+
+    std::string execute_bound(ClientContext& context, const std::vector<std::string> &args, const std::any& bound, KeyValueDatabase &db, bool acquire_lock) override
+    {
+        std::string stream_key = args[1];
+        std::string stream_id = args[2];
+        std::vector<std::pair<std::string, std::string> > fields = std::any_cast<const std::vector<std::pair<std::string, std::string> >&>(bound);
+
+        StreamId result = db.XADD(stream_key, stream_id, fields, acquire_lock);
+
+        // handle errors using magic values
+        if (result.ms == -1) { 
+             return "-WRONGTYPE Operation against a key holding the wrong kind of value\r\n";
+        }
+        if (result.ms == 0 && result.seq == 0) {
+             return "-ERR The ID specified in XADD must be greater than 0-0\r\n";
+        }
+        if (result.ms == 0 && result.seq == -1) {
+             return "-ERR The ID specified in XADD is equal or smaller than the target stream top item\r\n";
+        }
+
+        std::string ans = result.toString();
+        return "$" + std::to_string(ans.length()) + "\r\n" + ans + "\r\n";
+    }
+};
+
+class XRANGECommand : public Command {
+public:
+    std::string name() const override { return "XRANGE"; }
+    int min_args() const override { return 4; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
+    bool isWriteCommand() const override { return false; }
+    bool isReadOnly() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    // the ids are parsed again by XRANGE itself, this only checks them when the command is queued
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override
+    {
+        try {
+            StreamId::parse(args[2], false);
+            StreamId::parse(args[3], true);
+        } catch (const std::invalid_argument&) {
+            return "-ERR Invalid stream ID specified as stream command argument\r\n";
+        }
+        return "";
+    }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override
+    {
+        std::string stream_key = args[1];
+        std::string start = args[2];
+        std::string end = args[3];
+        try {
+            std::vector<StreamEntry> entries = db.XRANGE(stream_key, start, end, acquire_lock);
+            
+            std::string ans = "*" + std::to_string(entries.size()) + "\r\n";
+            
+            for(const auto& entry : entries) {
+                // for each entry it has 2 values: stream_id and the fields (key:value pairs)
+                ans += "*2\r\n";
+                
+                std::string str_id = entry.id.toString();
+                ans += "$" + std::to_string(str_id.length()) + "\r\n" + str_id + "\r\n";
+                
+                // size is fields.size() * 2 because key and value are separate elements
+                ans += "*" + std::to_string(entry.fields.size() * 2) + "\r\n"; 
+                
+                for(const auto& field : entry.fields) {
+                    ans += "$" + std::to_string(field.first.length()) + "\r\n" + field.first + "\r\n";
+                    ans += "$" + std::to_string(field.second.length()) + "\r\n" + field.second + "\r\n";
+                }
+            }
+            return ans;
+
+        } catch (const std::invalid_argument&) {
+            return "-ERR Invalid stream ID specified as stream command argument\r\n";
+        } catch (const std::runtime_error& e) {
+            return "-WRONGTYPE Operation against a key holding the wrong kind of value\r\n";
+        } catch (...) {
+            return "-ERR unknown error\r\n";
+        }
+    }
+};
+
+// the keys of XREAD / XREADGROUP: the first half of the arguments after STREAMS, the second half are ids
+static std::vector<std::string> streamKeys(const std::vector<std::string>& args) {
+    for(size_t i = 1; i < args.size(); i++) {
+        std::string arg = args[i];
+        std::transform(arg.begin(), arg.end(), arg.begin(), ::toupper);
+        if(arg == "STREAMS") {
+            size_t count = (args.size() - i - 1) / 2;
+            return std::vector<std::string>(args.begin() + i + 1, args.begin() + i + 1 + count);
+        }
+    }
+    return {};
+}
+
+// the options and STREAMS section of XREAD / XREADGROUP, as bound when the command is queued
+struct StreamReadArgs {
+    int count = INT_MAX;
+    bool block = false;
+    int64_t ms = 0;
+    bool noack = false; // XREADGROUP only
+    std::vector<std::string> keys;
+    std::vector<std::string> ids;
+};
+
+/* parses "[COUNT count] [BLOCK ms] [NOACK] STREAMS key... id..." from args[pos], returns an error reply or an empty string.
+'any_id' is the id that stands for "entries not seen yet" ($ for XREAD, > for XREADGROUP), the others must be valid ids */
+inline std::string parseStreamReadArgs(const std::vector<std::string>& args, size_t pos, const std::string& cmd, const std::string& any_id, StreamReadArgs& read) {
+    for(; pos < args.size(); pos++) {
+        std::string arg = args[pos];
+        std::transform(arg.begin(), arg.end(), arg.begin(), ::toupper);
+
+        long long value = 0;
+        if((arg == "COUNT" || arg == "BLOCK") && pos + 1 < args.size()) {
+            if(!Listpack::stringToInt(args[++pos], value)) {
+                return "-ERR value is not an integer or out of range\r\n";
+            }
+            if(arg == "COUNT") {
+                read.count = value <= 0 || value > INT_MAX ? INT_MAX : (int)value;
+            } else {
+                if(value < 0) return "-ERR timeout is negative\r\n";
+                read.block = true;
+                read.ms = value;
+            }
+        } else if(arg == "NOACK" && any_id == ">") {
+            read.noack = true;
+        } else if(arg == "STREAMS") {
+            break;
+        } else {
+            return "-ERR syntax error\r\n";
+        }
+    }
+
+    if(pos == args.size()) {
+        return "-ERR syntax error\r\n";
+    }
+    pos++;
+
+    size_t num_keys = args.size() - pos;
+    if(num_keys == 0 || num_keys % 2 != 0) {
+        return "-ERR Unbalanced '" + cmd + "' list of streams: for each stream key an ID or '" + any_id + "' must be specified.\r\n";
+    }
+
+    read.keys.assign(args.begin() + pos, args.begin() + pos + num_keys / 2);
+    read.ids.assign(args.begin() + pos + num_keys / 2, args.end());
+    for(const std::string& id : read.ids) {
+        if(id == any_id) continue;
+        try {
+            StreamId::parse(id, false);
+        } catch (const std::invalid_argument&) {
+            return "-ERR Invalid stream ID specified as stream command argument\r\n";
+        }
+    }
+    return "";
+}
+
+class XREADCommand : public Command {
+    std::string name() const override { return "XREAD"; }
+    int min_args() const override { return 4; }
+    KeySpec keySpec() const override { return {}; }
+    std::vector<std::string> keys(const std::vector<std::string>& args) const override { return streamKeys(args); }
+    bool isWriteCommand() const override { return false; }
+    bool isReadOnly() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override
+    {
+        //args: XREAD [COUNT count] [BLOCK ms] STREAMS key... id...
+        StreamReadArgs read;
+        std::string error = parseStreamReadArgs(args, 1, "xread", "$", read);
+        if(!error.empty()) {
+            return error;
+        }
+        bound = std::move(read);
+        return "";
+    }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override
+    {
+        return bindAndExecute(context, args, db, acquire_lock);
+    }
+
+    std::string execute_bound(ClientContext& context, const std::vector<std::string> &args, const std::any& bound, KeyValueDatabase &db, bool acquire_lock) override
+    {
+        const StreamReadArgs& read = std::any_cast<const StreamReadArgs&>(bound);
+
+        try {
+            std::vector<std::pair<std::string, std::vector<StreamEntry> > > entries = db.XREAD(read.count, read.block, read.ms, read.keys, read.ids, acquire_lock);
+            //XREAD returns a vector of pair of stream_key and vector of streamEntry where each entry corresponds to a stream id and the key-value pairs added to this stream
+            
+            if(entries.empty()) {
+                return "*-1\r\n";
+            }
+
+            std::string ans = "*" + std::to_string(entries.size()) + "\r\n";
+
+            for(auto& [stream_key, stream_entry] : entries) {
+                ans += "*2\r\n";
+                ans += "$" + std::to_string(stream_key.length()) + "\r\n" + stream_key + "\r\n";
+
+                ans += "*" + std::to_string(stream_entry.size()) + "\r\n";
+            
+                for(const auto& entry : stream_entry) {
+                    // for each entry it has 2 values: stream_id and the fields (key:value pairs)
+                    ans += "*2\r\n";
+                
+                    std::string stream_id = entry.id.toString();
+                    ans += "$" + std::to_string(stream_id.length()) + "\r\n" + stream_id + "\r\n";
+                
+                    // size is fields.size() * 2 because key and value are separate elements
+                    ans += "*" + std::to_string(entry.fields.size() * 2) + "\r\n"; 
+                
+                    for(const auto& field : entry.fields) {
+                        ans += "$" + std::to_string(field.first.length()) + "\r\n" + field.first + "\r\n";
+                        ans += "$" + std::to_string(field.second.length()) + "\r\n" + field.second + "\r\n";
+                    }
+                }
+            }
+
+            return ans;
+        } catch (const std::invalid_argument&) {
+            return "-ERR Invalid stream ID specified as stream command argument\r\n";
+        } catch (const std::runtime_error& e) {
+            return "-WRONGTYPE Operation against a key holding the wrong kind of value\r\n";
+        }
+    }
+};
+
+// RESP array of stream entries where each entry is [id, [field1, value1, ...]]
+inline std::string streamEntriesToRESP(const std::vector<StreamEntry>& entries) {
+    std::string ans = "*" + std::to_string(entries.size()) + "\r\n";
+    for(const auto& entry : entries) {
+        ans += "*2\r\n";
+
+        std::string stream_id = entry.id.toString();
+        ans += "$" + std::to_string(stream_id.length()) + "\r\n" + stream_id + "\r\n";
+
+        ans += "*" + std::to_string(entry.fields.size() * 2) + "\r\n";
+        for(const auto& field : entry.fields) {
+            ans += "$" + std::to_string(field.first.length()) + "\r\n" + field.first + "\r\n";
+            ans += "$" + std::to_string(field.second.length()) + "\r\n" + field.second + "\r\n";
+        }
+    }
+    return ans;
+}
+
+// RESP array of bulk string ids, used by the JUSTID variants
+inline std::string streamIdsToRESP(const std::vector<StreamId>& ids) {
+    std::string ans = "*" + std::to_string(ids.size()) + "\r\n";
+    for(const auto& id : ids) {
+        std::string str_id = id.toString();
+        ans += "$" + std::to_string(str_id.length()) + "\r\n" + str_id + "\r\n";
+    }
+    return ans;
+}
+
+class XGROUPCommand : public Command {
+public:
+    std::string name() const override { return "XGROUP"; }
+    int min_args() const override { return 2; }
+    KeySpec keySpec() const override { return {2, 2, 1}; }
+    bool isWriteCommand() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    // DESTROY and CREATECONSUMER reply 0 when there was nothing to do, DELCONSUMER replies the pending count it dropped
+    std::vector<std::string> rewriteForAof(const std::vector<std::string>& args, const std::string& reply) const override {
+        std::string sub = args[1];
+        std::transform(sub.begin(), sub.end(), sub.begin(), ::toupper);
+        if(sub == "DELCONSUMER") return args;
+        return argsUnlessZero(args, reply);
+    }
+
+    // the subcommands are dispatched by execute(), this only checks their arguments when the command is queued
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override
+    {
+        std::string subcommand = args[1];
+        std::transform(subcommand.begin(), subcommand.end(), subcommand.begin(), ::toupper);
+
+        if((subcommand == "CREATE" || subcommand == "SETID") && args.size() >= 5) {
+            if(args[4] != "$") {
+                try {
+                    StreamId::parse(args[4], false);
+                } catch (const std::invalid_argument&) {
+                    return "-ERR Invalid stream ID specified as stream command argument\r\n";
+                }
+            }
+            for(size_t i = 5; subcommand == "CREATE" && i < args.size(); i++) {
+                std::string arg = args[i];
+                std::transform(arg.begin(), arg.end(), arg.begin(), ::toupper);
+                if(arg == "ENTRIESREAD" && i + 1 < args.size()) {
+                    i++;
+                } else if(arg != "MKSTREAM") {
+                    return "-ERR syntax error\r\n";
+                }
+            }
+            return "";
+        }
+        if((subcommand == "DESTROY" && args.size() == 4) || ((subcommand == "CREATECONSUMER" || subcommand == "DELCONSUMER") && args.size() == 5)) {
+            return "";
+        }
+        return "-ERR unknown subcommand or wrong number of arguments for 'XGROUP'\r\n";
+    }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override
+    {
+        std::string subcommand = args[1];
+        std::transform(subcommand.begin(), subcommand.end(), subcommand.begin(), ::toupper);
+
+        try {
+            if(subcommand == "CREATE" && args.size() >= 5) {
+                //args: XGROUP CREATE key group id|$ [MKSTREAM]
+                std::string stream_key = args[2], group = args[3], id = args[4];
+                bool mkstream = false;
+                for(size_t i = 5; i < args.size(); i++) {
+                    std::string arg = args[i];
+                    std::transform(arg.begin(), arg.end(), arg.begin(), ::toupper);
+                    if(arg == "MKSTREAM") {
+                        mkstream = true;
+                    } else if(arg == "ENTRIESREAD" && i + 1 < args.size()) {
+                        i++; // lag tracking is not supported, accepted for compatibility
+                    } else {
+                        return "-ERR syntax error\r\n";
+                    }
+                }
+                db.XGROUP_CREATE(stream_key, group, id, mkstream, acquire_lock);
+                return "+OK\r\n";
+            } else if(subcommand == "DESTROY" && args.size() == 4) {
+                std::string stream_key = args[2], group = args[3];
+                return ":" + std::to_string(db.XGROUP_DESTROY(stream_key, group, acquire_lock)) + "\r\n";
+            } else if(subcommand == "CREATECONSUMER" && args.size() == 5) {
+                std::string stream_key = args[2], group = args[3], consumer = args[4];
+                return ":" + std::to_string(db.XGROUP_CREATECONSUMER(stream_key, group, consumer, acquire_lock)) + "\r\n";
+            } else if(subcommand == "DELCONSUMER" && args.size() == 5) {
+                std::string stream_key = args[2], group = args[3], consumer = args[4];
+                return ":" + std::to_string(db.XGROUP_DELCONSUMER(stream_key, group, consumer, acquire_lock)) + "\r\n";
+            } else if(subcommand == "SETID" && args.size() >= 5) {
+                std::string stream_key = args[2], group = args[3], id = args[4];
+                db.XGROUP_SETID(stream_key, group, id, acquire_lock);
+                return "+OK\r\n";
+            }
+        } catch (const std::invalid_argument&) {
+            return "-ERR Invalid stream ID specified as stream command argument\r\n";
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+
+        return "-ERR unknown subcommand or wrong number of arguments for 'XGROUP'\r\n";
+    }
+};
+
+class XREADGROUPCommand : public Command {
+public:
+    std::string name() const override { return "XREADGROUP"; }
+    int min_args() const override { return 7; }
+    KeySpec keySpec() const override { return {}; }
+    std::vector<std::string> keys(const std::vector<std::string>& args) const override { return streamKeys(args); }
+    bool isWriteCommand() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    bool mayBlock(const std::vector<std::string>& args) const override {
+        for(size_t i = 4; i < args.size(); i++) {
+            std::string arg = args[i];
+            std::transform(arg.begin(), arg.end(), arg.begin(), ::toupper);
+            if(arg == "BLOCK") return true;
+            if(arg == "STREAMS") break;
+        }
+        return false;
+    }
+
+    // without BLOCK, the entries it was woken up for are already in the log before it
+    std::vector<std::string> rewriteForAof(const std::vector<std::string>& args, const std::string& reply) const override {
+        if(reply == "*-1\r\n") return {};
+        std::vector<std::string> logged(args.begin(), args.begin() + 4);
+        for(size_t i = 4; i < args.size(); i++) {
+            std::string arg = args[i];
+            std::transform(arg.begin(), arg.end(), arg.begin(), ::toupper);
+            if(arg == "BLOCK" && i + 1 < args.size()) {
+                i++;
+                continue;
+            }
+            logged.push_back(args[i]);
+        }
+        return logged;
+    }
+
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override
+    {
+        //args: XREADGROUP GROUP group consumer [COUNT count] [BLOCK ms] [NOACK] STREAMS key... id...
+        std::string group_arg = args[1];
+        std::transform(group_arg.begin(), group_arg.end(), group_arg.begin(), ::toupper);
+        if(group_arg != "GROUP") {
+            return "-ERR syntax error\r\n";
+        }
+
+        StreamReadArgs read;
+        std::string error = parseStreamReadArgs(args, 4, "xreadgroup", ">", read);
+        if(!error.empty()) {
+            return error;
+        }
+        bound = std::move(read);
+        return "";
+    }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override
+    {
+        return bindAndExecute(context, args, db, acquire_lock);
+    }
+
+    std::string execute_bound(ClientContext& context, const std::vector<std::string> &args, const std::any& bound, KeyValueDatabase &db, bool acquire_lock) override
+    {
+        std::string group = args[2];
+        std::string consumer = args[3];
+        const StreamReadArgs& read = std::any_cast<const StreamReadArgs&>(bound);
+
+        try {
+            std::vector<std::pair<std::string, std::vector<StreamEntry> > > entries = db.XREADGROUP(group, consumer, read.count, read.block, read.ms, read.noack, read.keys, read.ids, acquire_lock);
+
+            if(entries.empty()) {
+                return "*-1\r\n";
+            }
+
+            std::string ans = "*" + std::to_string(entries.size()) + "\r\n";
+            for(auto& [stream_key, stream_entries] : entries) {
+                ans += "*2\r\n";
+                ans += "$" + std::to_string(stream_key.length()) + "\r\n" + stream_key + "\r\n";
+                ans += streamEntriesToRESP(stream_entries);
+            }
+            return ans;
+        } catch (const std::invalid_argument&) {
+            return "-ERR Invalid stream ID specified as stream command argument\r\n";
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+    }
+};
+
+class XACKCommand : public Command {
+public:
+    std::string name() const override { return "XACK"; }
+    int min_args() const override { return 4; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
+    bool isWriteCommand() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+    std::vector<std::string> rewriteForAof(const std::vector<std::string>& args, const std::string& reply) const override { return argsUnlessZero(args, reply); }
+
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override
+    {
+        //args: XACK key group id1 id2..., all the ids are validated before anything is acknowledged
+        std::vector<StreamId> ids;
+        try {
+            for(size_t i = 3; i < args.size(); i++) {
+                ids.push_back(StreamId::parse(args[i], false));
+            }
+        } catch (const std::invalid_argument&) {
+            return "-ERR Invalid stream ID specified as stream command argument\r\n";
+        }
+        bound = std::move(ids);
+        return "";
+    }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override
+    {
+        return bindAndExecute(context, args, db, acquire_lock);
+    }
+
+    std::string execute_bound(ClientContext& context, const std::vector<std::string> &args, const std::any& bound, KeyValueDatabase &db, bool acquire_lock) override
+    {
+        std::string stream_key = args[1];
+        std::string group = args[2];
+        std::vector<StreamId> ids = std::any_cast<const std::vector<StreamId>&>(bound);
+
+        try {
+            int acked = db.XACK(stream_key, group, ids, acquire_lock);
+            return ":" + std::to_string(acked) + "\r\n";
+        } catch (const std::invalid_argument&) {
+            return "-ERR Invalid stream ID specified as stream command argument\r\n";
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+    }
+};
+
+class XPENDINGCommand : public Command {
+private:
+    // the extended form, args.size() == 3 asks for the summary and binds nothing
+    struct Bound {
+        int64_t min_idle = 0;
+        StreamId start;
+        StreamId end;
+        int count;
+        std::string consumer;
+    };
+
+public:
+    std::string name() const override { return "XPENDING"; }
+    int min_args() const override { return 3; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
+    bool isWriteCommand() const override { return false; }
+    bool isReadOnly() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override
+    {
+        //args: XPENDING key group [[IDLE min-idle-time] start end count [consumer]]
+        if(args.size() == 3) return "";
+
+        Bound range;
+        size_t pos = 3;
+        std::string idle_arg = args[pos];
+        std::transform(idle_arg.begin(), idle_arg.end(), idle_arg.begin(), ::toupper);
+        if(idle_arg == "IDLE" && pos + 1 < args.size()) {
+            long long min_idle;
+            if(!Listpack::stringToInt(args[pos + 1], min_idle)) {
+                return "-ERR value is not an integer or out of range\r\n";
+            }
+            range.min_idle = min_idle;
+            pos += 2;
+        }
+
+        if(args.size() - pos < 3 || args.size() - pos > 4) {
+            return "-ERR syntax error\r\n";
+        }
+
+        try {
+            range.start = StreamId::parse(args[pos], false);
+            range.end = StreamId::parse(args[pos + 1], true);
+        } catch (const std::invalid_argument&) {
+            return "-ERR Invalid stream ID specified as stream command argument\r\n";
+        }
+        long long count;
+        if(!Listpack::stringToInt(args[pos + 2], count) || count > INT_MAX) {
+            return "-ERR value is not an integer or out of range\r\n";
+        }
+        range.count = count;
+        range.consumer = (args.size() - pos == 4) ? args[pos + 3] : "";
+
+        bound = std::move(range);
+        return "";
+    }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override
+    {
+        return bindAndExecute(context, args, db, acquire_lock);
+    }
+
+    std::string execute_bound(ClientContext& context, const std::vector<std::string> &args, const std::any& bound, KeyValueDatabase &db, bool acquire_lock) override
+    {
+        std::string stream_key = args[1];
+        std::string group = args[2];
+
+        try {
+            if(args.size() == 3) {
+                StreamPendingSummary summary = db.XPENDING(stream_key, group, acquire_lock);
+
+                std::string ans = "*4\r\n:" + std::to_string(summary.count) + "\r\n";
+                if(summary.count == 0) {
+                    return ans + "$-1\r\n$-1\r\n*-1\r\n";
+                }
+
+                std::string min_id = summary.min_id.toString(), max_id = summary.max_id.toString();
+                ans += "$" + std::to_string(min_id.length()) + "\r\n" + min_id + "\r\n";
+                ans += "$" + std::to_string(max_id.length()) + "\r\n" + max_id + "\r\n";
+                ans += "*" + std::to_string(summary.consumers.size()) + "\r\n";
+                for(auto& [consumer, pending] : summary.consumers) {
+                    std::string str_pending = std::to_string(pending);
+                    ans += "*2\r\n$" + std::to_string(consumer.length()) + "\r\n" + consumer + "\r\n";
+                    ans += "$" + std::to_string(str_pending.length()) + "\r\n" + str_pending + "\r\n";
+                }
+                return ans;
+            }
+
+            Bound range = std::any_cast<const Bound&>(bound);
+            std::vector<StreamPendingInfo> pending = db.XPENDING(stream_key, group, range.min_idle, range.start, range.end, range.count, range.consumer, acquire_lock);
+
+            std::string ans = "*" + std::to_string(pending.size()) + "\r\n";
+            for(const auto& info : pending) {
+                std::string str_id = info.id.toString();
+                ans += "*4\r\n$" + std::to_string(str_id.length()) + "\r\n" + str_id + "\r\n";
+                ans += "$" + std::to_string(info.consumer.length()) + "\r\n" + info.consumer + "\r\n";
+                ans += ":" + std::to_string(info.idle) + "\r\n:" + std::to_string(info.delivery_count) + "\r\n";
+            }
+            return ans;
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+    }
+};
+
+class XCLAIMCommand : public Command {
+private:
+    struct Bound {
+        int64_t min_idle;
+        std::vector<StreamId> ids;
+        int64_t idle = -1;
+        int64_t time = -1;
+        int64_t retry_count = -1;
+        bool force = false;
+        bool justid = false;
+    };
+
+public:
+    std::string name() const override { return "XCLAIM"; }
+    int min_args() const override { return 6; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
+    bool isWriteCommand() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::vector<std::string> rewriteForAof(const std::vector<std::string>& args, const std::string& reply) const override {
+        if(reply == "*0\r\n") return {};
+        return args;
+    }
+
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override
+    {
+        //args: XCLAIM key group consumer min-idle-time id1 id2... [IDLE ms] [TIME ms] [RETRYCOUNT count] [FORCE] [JUSTID] [LASTID id]
+        Bound claim;
+        long long value;
+        if(!Listpack::stringToInt(args[4], value)) {
+            return "-ERR Invalid min-idle-time argument for XCLAIM\r\n";
+        }
+        claim.min_idle = value;
+
+        // ids come first, the first option keyword ends the list
+        size_t pos = 5;
+        for(; pos < args.size(); pos++) {
+            try {
+                claim.ids.push_back(StreamId::parse(args[pos], false));
+            } catch (const std::invalid_argument&) {
+                if(claim.ids.empty()) return "-ERR Invalid stream ID specified as stream command argument\r\n";
+                break;
+            }
+        }
+
+        for(; pos < args.size(); pos++) {
+            std::string arg = args[pos];
+            std::transform(arg.begin(), arg.end(), arg.begin(), ::toupper);
+
+            if(arg == "FORCE") {
+                claim.force = true;
+            } else if(arg == "JUSTID") {
+                claim.justid = true;
+            } else if(pos + 1 < args.size() && (arg == "IDLE" || arg == "TIME" || arg == "RETRYCOUNT")) {
+                if(!Listpack::stringToInt(args[++pos], value)) {
+                    return "-ERR value is not an integer or out of range\r\n";
+                }
+                if(arg == "IDLE") claim.idle = value;
+                else if(arg == "TIME") claim.time = value;
+                else claim.retry_count = value;
+            } else if(pos + 1 < args.size() && arg == "LASTID") {
+                pos++; // lag tracking is not supported, accepted for compatibility
+            } else {
+                return "-ERR Unrecognized XCLAIM option '" + args[pos] + "'\r\n";
+            }
+        }
+
+        bound = std::move(claim);
+        return "";
+    }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override
+    {
+        return bindAndExecute(context, args, db, acquire_lock);
+    }
+
+    std::string execute_bound(ClientContext& context, const std::vector<std::string> &args, const std::any& bound, KeyValueDatabase &db, bool acquire_lock) override
+    {
+        std::string stream_key = args[1];
+        std::string group = args[2];
+        std::string consumer = args[3];
+        Bound claim = std::any_cast<const Bound&>(bound);
+
+        try {
+            std::vector<StreamEntry> claimed = db.XCLAIM(stream_key, group, consumer, claim.min_idle, claim.ids, claim.idle, claim.time, claim.retry_count, claim.force, claim.justid, acquire_lock);
+
+            if(claim.justid) {
+                std::vector<StreamId> claimed_ids;
+                for(const auto& entry : claimed) claimed_ids.push_back(entry.id);
+                return streamIdsToRESP(claimed_ids);
+            }
+            return streamEntriesToRESP(claimed);
+        } catch (const std::invalid_argument&) {
+            return "-ERR Invalid stream ID specified as stream command argument\r\n";
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+    }
+};
+
+class XAUTOCLAIMCommand : public Command {
+private:
+    struct Bound {
+        int64_t min_idle;
+        StreamId start;
+        int count = 100;
+        bool justid = false;
+    };
+
+public:
+    std::string name() const override { return "XAUTOCLAIM"; }
+    int min_args() const override { return 6; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
+    bool isWriteCommand() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    // the reply is [next id, claimed, deleted], nothing changed when both lists are empty
+    std::vector<std::string> rewriteForAof(const std::vector<std::string>& args, const std::string& reply) const override {
+        RESPParser parser(reply);
+        RESPValue value = parser.parse();
+        if(value.array.size() == 3 && value.array[1].array.empty() && value.array[2].array.empty()) return {};
+        return args;
+    }
+
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override
+    {
+        //args: XAUTOCLAIM key group consumer min-idle-time start [COUNT count] [JUSTID]
+        Bound claim;
+        long long value;
+        if(!Listpack::stringToInt(args[4], value)) {
+            return "-ERR Invalid min-idle-time argument for XAUTOCLAIM\r\n";
+        }
+        claim.min_idle = value;
+
+        try {
+            claim.start = StreamId::parse(args[5], false);
+        } catch (const std::invalid_argument&) {
+            return "-ERR Invalid stream ID specified as stream command argument\r\n";
+        }
+
+        for(size_t pos = 6; pos < args.size(); pos++) {
+            std::string arg = args[pos];
+            std::transform(arg.begin(), arg.end(), arg.begin(), ::toupper);
+
+            if(arg == "JUSTID") {
+                claim.justid = true;
+            } else if(arg == "COUNT" && pos + 1 < args.size()) {
+                if(!Listpack::stringToInt(args[++pos], value) || value > INT_MAX) {
+                    return "-ERR value is not an integer or out of range\r\n";
+                }
+                if(value < 1) {
+                    return "-ERR COUNT must be > 0\r\n";
+                }
+                claim.count = value;
+            } else {
+                return "-ERR syntax error\r\n";
+            }
+        }
+
+        bound = std::move(claim);
+        return "";
+    }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override
+    {
+        return bindAndExecute(context, args, db, acquire_lock);
+    }
+
+    std::string execute_bound(ClientContext& context, const std::vector<std::string> &args, const std::any& bound, KeyValueDatabase &db, bool acquire_lock) override
+    {
+        std::string stream_key = args[1];
+        std::string group = args[2];
+        std::string consumer = args[3];
+        const Bound& claim = std::any_cast<const Bound&>(bound);
 
-            for(auto& [stream_key, stream_entry] : entries) {
-                ans += "*2\r\n";
-                ans += "$" + std::to_string(stream_key.length()) + "\r\n" + stream_key + "\r\n";
+        try {
+            StreamAutoClaimResult result = db.XAUTOCLAIM(stream_key, group, consumer, claim.min_idle, claim.start, claim.count, claim.justid, acquire_lock);
 
-                ans += "*" + std::to_string(stream_entry.size()) + "\r\n";
-            
-                for(const auto& entry : stream_entry) {
-                    // for each entry it has 2 values: stream_id and the fields (key:value pairs)
-                    ans += "*2\r\n";
-                
-                    std::string stream_id = entry.id.toString();
-                    ans += "$" + std::to_string(stream_id.length()) + "\r\n" + stream_id + "\r\n";
-                
-                    // size is fields.size() * 2 because key and value are separate elements
-                    ans += "*" + std::to_string(entry.fields.size() * 2) + "\r\n"; 
-                
-                    for(const auto& field : entry.fields) {
-                        ans += "$" + std::to_string(field.first.length()) + "\r\n" + field.first + "\r\n";
-                        ans += "$" + std::to_string(field.second.length()) + "\r\n" + field.second + "\r\n";
-                    }
-                }
-            }
+            std::string next_id = result.next_id.toString();
+            std::string ans = "*3\r\n$" + std::to_string(next_id.length()) + "\r\n" + next_id + "\r\n";
 
+            if(claim.justid) {
+                std::vector<StreamId> claimed_ids;
+                for(const auto& entry : result.claimed) claimed_ids.push_back(entry.id);
+                ans += streamIdsToRESP(claimed_ids);
+            } else {
+                ans += streamEntriesToRESP(result.claimed);
+            }
+            ans += streamIdsToRESP(result.deleted);
             return ans;
         } catch (const std::invalid_argument&) {
             return "-ERR Invalid stream ID specified as stream command argument\r\n";
         } catch (const std::runtime_error& e) {
-            return "-WRONGTYPE Operation against a key holding the wrong kind of value\r\n";
+            return "-" + std::string(e.what()) + "\r\n";
         }
     }
 };
@@ -399,6 +1633,7 @@ class IncrementCommand : public Command {
 public:
     std::string name() const override { return "INCR"; }
     int min_args() const override { return 2; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
     bool isWriteCommand() const override { return true; }
     bool sendToMaster() const override { return false; }
     bool isPubSubCommand() const override { return false; }
@@ -427,6 +1662,7 @@ class MultiCommand : public Command {
 public:
     std::string name() const override { return "MULTI"; }
     int min_args() const override { return 1; }
+    KeySpec keySpec() const override { return {}; }
     bool isWriteCommand() const override { return true; }
     bool sendToMaster() const override { return false; }
     bool isPubSubCommand() const override { return false; }
@@ -444,6 +1680,7 @@ class ExecCommand : public Command {
 public:
     std::string name() const override { return "EXEC"; }
     int min_args() const override { return 1; }
+    KeySpec keySpec() const override { return {}; }
     bool isWriteCommand() const override { return true; }
     bool sendToMaster() const override { return false; }
     bool isPubSubCommand() const override { return false; }
@@ -453,12 +1690,23 @@ public:
             return "-ERR EXEC without MULTI\r\n";
         }
 
-        std::vector<std::string> results = db.EXEC(context.commandQueue, context, db, acquire_lock);
+        // a command was rejected while queueing, so nothing runs
+        if(context.transaction_failed) {
+            context.reset_transaction();
+            db.UNWATCH(context.watch);
+            return "-EXECABORT Transaction discarded because of previous errors.\r\n";
+        }
+
+        std::optional<std::vector<std::string> > results = db.EXEC(context.commandQueue, context, db, acquire_lock);
         
         context.reset_transaction();
+
+        if(!results) {
+            return "*-1\r\n"; // a watched key was modified, nothing was run
+        }
         
-        std::string resp = "*" + std::to_string(results.size()) + "\r\n";
-        for(auto& result : results) resp += result;
+        std::string resp = "*" + std::to_string(results->size()) + "\r\n";
+        for(auto& result : *results) resp += result;
 
         return resp;
     }
@@ -468,6 +1716,7 @@ class DiscardCommand : public Command {
 public:
     std::string name() const override { return "DISCARD"; }
     int min_args() const override { return 1; }
+    KeySpec keySpec() const override { return {}; }
     bool isWriteCommand() const override { return true; }
     bool sendToMaster() const override { return false; }
     bool isPubSubCommand() const override { return false; }
@@ -478,28 +1727,80 @@ public:
         }
         
         context.reset_transaction();
+        db.UNWATCH(context.watch);
 
         return "+OK\r\n";
     }
 };
 
+class WatchCommand : public Command {
+public:
+    std::string name() const override { return "WATCH"; }
+    int min_args() const override { return 2; }
+    KeySpec keySpec() const override { return {1, -1, 1}; }
+    bool isWriteCommand() const override { return false; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        //args: WATCH key [key ...], EXEC aborts if any of them is written before it runs
+        if(context.in_transaction) {
+            return "-ERR WATCH inside MULTI is not allowed\r\n";
+        }
+
+        std::vector<std::string> keys(args.begin() + 1, args.end());
+        db.WATCH(context.watch, keys, acquire_lock);
+        return "+OK\r\n";
+    }
+};
+
+class UnwatchCommand : public Command {
+public:
+    std::string name() const override { return "UNWATCH"; }
+    int min_args() const override { return 1; }
+    KeySpec keySpec() const override { return {}; }
+    bool isWriteCommand() const override { return false; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        db.UNWATCH(context.watch);
+        return "+OK\r\n";
+    }
+};
+
 class InfoCommand : public Command {
 private:
     std::shared_ptr<ServerConfig> config;
+    std::shared_ptr<PersistenceManager> persistence;
+    std::shared_ptr<AOFManager> aof;
 public:
-    InfoCommand(std::shared_ptr<ServerConfig> cfg) : config(cfg) {}
+    InfoCommand(std::shared_ptr<ServerConfig> cfg, std::shared_ptr<PersistenceManager> persistence_, std::shared_ptr<AOFManager> aof_)
+        : config(cfg), persistence(persistence_), aof(aof_) {}
     std::string name() const override { return "INFO"; }
     int min_args() const override { return 0; }
+    KeySpec keySpec() const override { return {}; }
     bool isWriteCommand() const override { return false; }
     bool sendToMaster() const override { return false; }
     bool isPubSubCommand() const override { return false; }
 
     std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        // INFO [section], with no section (or all/default/everything) every section we have
+        std::string section = args.size() > 1 ? args[1] : "default";
+        std::transform(section.begin(), section.end(), section.begin(), ::tolower);
+        bool all = section == "default" || section == "all" || section == "everything";
+
         std::ostringstream oss;
-        oss << "# Replication\r\n";
-        oss << "role:" << config->role << "\r\n";
-        oss << "master_replid:" << config->master_replid << "\r\n";
-        oss << "master_repl_offset:" << config->master_repl_offset << "\r\n";
+        if(all || section == "persistence") {
+            oss << persistence->info() << aof->info();
+        }
+        if(all || section == "replication") {
+            if(all) oss << "\r\n";
+            oss << "# Replication\r\n";
+            oss << "role:" << config->role << "\r\n";
+            oss << "master_replid:" << config->master_replid << "\r\n";
+            oss << "master_repl_offset:" << config->master_repl_offset << "\r\n";
+        }
 
         std::string info = oss.str();
 
@@ -514,6 +1815,7 @@ public:
     REPLCONF(std::shared_ptr<ServerConfig> cfg) : config(cfg) {}
     std::string name() const override { return "REPLCONF"; }
     int min_args() const override { return 0; }
+    KeySpec keySpec() const override { return {}; }
     bool isWriteCommand() const override { return false; }
     bool sendToMaster() const override { return true; }
     bool isPubSubCommand() const override { return false; }
@@ -548,9 +1850,11 @@ public:
     PSYNCCommand(std::shared_ptr<ServerConfig> cfg) : config(cfg) {}
     std::string name() const override { return "PSYNC"; }
     int min_args() const override { return 3; }
+    KeySpec keySpec() const override { return {}; }
     bool isWriteCommand() const override { return false; }
     bool sendToMaster() const override { return false; }
     bool isPubSubCommand() const override { return false; }
+    bool allowedWhileLoading() const override { return false; } // the replica would get part of the dataset
 
     std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
         context.is_replica = true;
@@ -593,6 +1897,7 @@ public:
     WAITCommand(std::shared_ptr<ServerConfig> cfg) : config(cfg) {}
     std::string name() const override { return "WAIT"; }
     int min_args() const override { return 3; }
+    KeySpec keySpec() const override { return {}; }
     bool isWriteCommand() const override { return false; }
     bool sendToMaster() const override { return false; }
     bool isPubSubCommand() const override { return false; }
@@ -640,6 +1945,7 @@ public:
     CONFIGCommand(std::shared_ptr<ServerConfig> cfg) : config(cfg) {}
     std::string name() const override { return "CONFIG"; }
     int min_args() const override { return 3; }
+    KeySpec keySpec() const override { return {}; }
     bool isWriteCommand() const override { return false; }
     bool sendToMaster() const override { return false; }
     bool isPubSubCommand() const override { return false; }
@@ -663,7 +1969,9 @@ class KEYSCommand : public Command {
 public:
     std::string name() const override { return "KEYS"; }
     int min_args() const override { return 2; }
+    KeySpec keySpec() const override { return {0, 0, 1, true}; }
     bool isWriteCommand() const override { return false; }
+    bool isReadOnly() const override { return true; }
     bool sendToMaster() const override { return false; }
     bool isPubSubCommand() const override { return false; }
 
@@ -687,6 +1995,7 @@ public:
     SUBSCRIBECommand(std::shared_ptr<PubSubManager> manager_) { manager = manager_; }
     std::string name() const override { return "SUBSCRIBE"; }
     int min_args() const override { return 2; }
+    KeySpec keySpec() const override { return {}; }
     bool isWriteCommand() const override { return false; }
     bool sendToMaster() const override { return false; }
     bool isPubSubCommand() const override { return true; }
@@ -694,12 +2003,13 @@ public:
     std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
         std::string channel = args[1];
 
-        manager->subscribe(channel, context.client_fd, context.client_mtx);
+        if(context.channels.insert(channel).second) {
+            manager->subscribe(channel, context.client_fd, context.output);
+        }
         context.in_subscribe_mode = true;
-        context.num_channel++;
 
         std::string response = "*3\r\n$9\r\nsubscribe\r\n" + (std::string)"$" + std::to_string(channel.length()) + "\r\n" + channel + "\r\n" + 
-                                    ":" + std::to_string(context.num_channel) + "\r\n";
+                                    ":" + std::to_string(context.num_subscriptions()) + "\r\n";
         return response;
     }
 };
@@ -711,6 +2021,7 @@ public:
     UNSUBSCRIBECommand(std::shared_ptr<PubSubManager> manager_) { manager = manager_; }
     std::string name() const override { return "UNSUBSCRIBE"; }
     int min_args() const override { return 2; }
+    KeySpec keySpec() const override { return {}; }
     bool isWriteCommand() const override { return false; }
     bool sendToMaster() const override { return false; }
     bool isPubSubCommand() const override { return true; }
@@ -718,15 +2029,16 @@ public:
     std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
         std::string channel = args[1];
 
-        manager->unsubscribe(channel, context.client_fd);
-        
-        context.num_channel--;
-        if(context.num_channel == 0) { 
+        if(context.channels.erase(channel)) {
+            manager->unsubscribe(channel, context.client_fd);
+        }
+
+        if(!context.has_subscriptions()) { 
             context.in_subscribe_mode = false;
         }
 
         std::string response = "*3\r\n$11\r\nunsubscribe\r\n" + (std::string)"$" + std::to_string(channel.length()) + "\r\n" + channel + "\r\n" + 
-                                    ":" + std::to_string(context.num_channel) + "\r\n";
+                                    ":" + std::to_string(context.num_subscriptions()) + "\r\n";
         return response;
     }
 };
@@ -738,6 +2050,7 @@ public:
     PUBLISHCommand(std::shared_ptr<PubSubManager> manager_) { manager = manager_; }
     std::string name() const override { return "PUBLISH"; }
     int min_args() const override { return 3; }
+    KeySpec keySpec() const override { return {}; }
     bool isWriteCommand() const override { return false; }
     bool sendToMaster() const override { return false; }
     bool isPubSubCommand() const override { return true; }
@@ -754,37 +2067,265 @@ public:
     }
 };
 
+class PSUBSCRIBECommand : public Command {
+private:
+    std::shared_ptr<PubSubManager> manager;
+public:
+    PSUBSCRIBECommand(std::shared_ptr<PubSubManager> manager_) { manager = manager_; }
+    std::string name() const override { return "PSUBSCRIBE"; }
+    int min_args() const override { return 2; }
+    KeySpec keySpec() const override { return {}; }
+    bool isWriteCommand() const override { return false; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return true; }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        //args: PSUBSCRIBE pattern [pattern ...], one confirmation per pattern
+        std::string response;
+        for(size_t i = 1; i < args.size(); i++) {
+            const std::string& pattern = args[i];
+            if(context.patterns.insert(pattern).second) {
+                manager->psubscribe(pattern, context.client_fd, context.output);
+            }
+            context.in_subscribe_mode = true;
+
+            response += "*3\r\n$10\r\npsubscribe\r\n$" + std::to_string(pattern.length()) + "\r\n" + pattern + "\r\n" +
+                        ":" + std::to_string(context.num_subscriptions()) + "\r\n";
+        }
+        return response;
+    }
+};
+
+class PUNSUBSCRIBECommand : public Command {
+private:
+    std::shared_ptr<PubSubManager> manager;
+public:
+    PUNSUBSCRIBECommand(std::shared_ptr<PubSubManager> manager_) { manager = manager_; }
+    std::string name() const override { return "PUNSUBSCRIBE"; }
+    int min_args() const override { return 1; }
+    KeySpec keySpec() const override { return {}; }
+    bool isWriteCommand() const override { return false; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return true; }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        //args: PUNSUBSCRIBE [pattern ...], without patterns every pattern of the client is dropped
+        std::vector<std::string> patterns(args.begin() + 1, args.end());
+        if(patterns.empty()) {
+            patterns.assign(context.patterns.begin(), context.patterns.end());
+        }
+
+        if(patterns.empty()) {
+            return "*3\r\n$12\r\npunsubscribe\r\n$-1\r\n:" + std::to_string(context.num_subscriptions()) + "\r\n";
+        }
+
+        std::string response;
+        for(const std::string& pattern : patterns) {
+            if(context.patterns.erase(pattern)) {
+                manager->punsubscribe(pattern, context.client_fd);
+            }
+            if(!context.has_subscriptions()) {
+                context.in_subscribe_mode = false;
+            }
+
+            response += "*3\r\n$12\r\npunsubscribe\r\n$" + std::to_string(pattern.length()) + "\r\n" + pattern + "\r\n" +
+                        ":" + std::to_string(context.num_subscriptions()) + "\r\n";
+        }
+        return response;
+    }
+};
+
+class SSUBSCRIBECommand : public Command {
+private:
+    std::shared_ptr<PubSubManager> manager;
+public:
+    SSUBSCRIBECommand(std::shared_ptr<PubSubManager> manager_) { manager = manager_; }
+    std::string name() const override { return "SSUBSCRIBE"; }
+    int min_args() const override { return 2; }
+    KeySpec keySpec() const override { return {}; }
+    bool isWriteCommand() const override { return false; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return true; }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        //args: SSUBSCRIBE shardchannel [shardchannel ...], the count in the replies is of shard channels only
+        std::string response;
+        for(size_t i = 1; i < args.size(); i++) {
+            const std::string& channel = args[i];
+            if(context.shard_channels.insert(channel).second) {
+                manager->ssubscribe(channel, context.client_fd, context.output);
+            }
+            context.in_subscribe_mode = true;
+
+            response += "*3\r\n$10\r\nssubscribe\r\n$" + std::to_string(channel.length()) + "\r\n" + channel + "\r\n" +
+                        ":" + std::to_string(context.shard_channels.size()) + "\r\n";
+        }
+        return response;
+    }
+};
+
+class SUNSUBSCRIBECommand : public Command {
+private:
+    std::shared_ptr<PubSubManager> manager;
+public:
+    SUNSUBSCRIBECommand(std::shared_ptr<PubSubManager> manager_) { manager = manager_; }
+    std::string name() const override { return "SUNSUBSCRIBE"; }
+    int min_args() const override { return 1; }
+    KeySpec keySpec() const override { return {}; }
+    bool isWriteCommand() const override { return false; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return true; }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        //args: SUNSUBSCRIBE [shardchannel ...], without channels every shard channel of the client is dropped
+        std::vector<std::string> channels(args.begin() + 1, args.end());
+        if(channels.empty()) {
+            channels.assign(context.shard_channels.begin(), context.shard_channels.end());
+        }
+
+        if(channels.empty()) {
+            return "*3\r\n$12\r\nsunsubscribe\r\n$-1\r\n:0\r\n";
+        }
+
+        std::string response;
+        for(const std::string& channel : channels) {
+            if(context.shard_channels.erase(channel)) {
+                manager->sunsubscribe(channel, context.client_fd);
+            }
+            if(!context.has_subscriptions()) {
+                context.in_subscribe_mode = false;
+            }
+
+            response += "*3\r\n$12\r\nsunsubscribe\r\n$" + std::to_string(channel.length()) + "\r\n" + channel + "\r\n" +
+                        ":" + std::to_string(context.shard_channels.size()) + "\r\n";
+        }
+        return response;
+    }
+};
+
+class SPUBLISHCommand : public Command {
+private:
+    std::shared_ptr<PubSubManager> manager;
+public:
+    SPUBLISHCommand(std::shared_ptr<PubSubManager> manager_) { manager = manager_; }
+    std::string name() const override { return "SPUBLISH"; }
+    int min_args() const override { return 3; }
+    KeySpec keySpec() const override { return {}; }
+    bool isWriteCommand() const override { return false; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        //args: SPUBLISH shardchannel message
+        return ":" + std::to_string(manager->spublish(args[1], args[2])) + "\r\n";
+    }
+};
+
+// PUBSUB CHANNELS [pattern] | NUMSUB [channel ...] | NUMPAT | SHARDCHANNELS [pattern] | SHARDNUMSUB [channel ...]
+class PUBSUBCommand : public Command {
+private:
+    std::shared_ptr<PubSubManager> manager;
+public:
+    PUBSUBCommand(std::shared_ptr<PubSubManager> manager_) { manager = manager_; }
+    std::string name() const override { return "PUBSUB"; }
+    int min_args() const override { return 2; }
+    KeySpec keySpec() const override { return {}; }
+    bool isWriteCommand() const override { return false; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        std::string sub = args[1];
+        std::transform(sub.begin(), sub.end(), sub.begin(), ::toupper);
+
+        if(sub == "CHANNELS" && args.size() <= 3) {
+            std::vector<std::string> channels = manager->active_channels(args.size() == 3 ? args[2] : "");
+            std::string response = "*" + std::to_string(channels.size()) + "\r\n";
+            for(auto& channel : channels) {
+                response += "$" + std::to_string(channel.length()) + "\r\n" + channel + "\r\n";
+            }
+            return response;
+        }
+        if(sub == "NUMSUB") {
+            std::string response = "*" + std::to_string((args.size() - 2) * 2) + "\r\n";
+            for(size_t i = 2; i < args.size(); i++) {
+                response += "$" + std::to_string(args[i].length()) + "\r\n" + args[i] + "\r\n";
+                response += ":" + std::to_string(manager->num_subscribers(args[i])) + "\r\n";
+            }
+            return response;
+        }
+        if(sub == "SHARDCHANNELS" && args.size() <= 3) {
+            std::vector<std::string> channels = manager->active_shard_channels(args.size() == 3 ? args[2] : "");
+            std::string response = "*" + std::to_string(channels.size()) + "\r\n";
+            for(auto& channel : channels) {
+                response += "$" + std::to_string(channel.length()) + "\r\n" + channel + "\r\n";
+            }
+            return response;
+        }
+        if(sub == "SHARDNUMSUB") {
+            std::string response = "*" + std::to_string((args.size() - 2) * 2) + "\r\n";
+            for(size_t i = 2; i < args.size(); i++) {
+                response += "$" + std::to_string(args[i].length()) + "\r\n" + args[i] + "\r\n";
+                response += ":" + std::to_string(manager->num_shard_subscribers(args[i])) + "\r\n";
+            }
+            return response;
+        }
+        if(sub == "NUMPAT" && args.size() == 2) {
+            return ":" + std::to_string(manager->num_pattern_subscriptions()) + "\r\n";
+        }
+        return "-ERR unknown subcommand or wrong number of arguments for '" + args[1] + "'\r\n";
+    }
+};
+
 class ZAddCommand : public Command {
 public:
     std::string name() const override { return "ZADD"; }
     int min_args() const override { return 2; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
     bool isWriteCommand() const override { return true; }
     bool sendToMaster() const override { return false; }
     bool isPubSubCommand() const override { return false; }
 
-    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
-        std::string set_key = args[1];
-
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override {
+        //args: ZADD key score member [score member ...], bound to the parsed scores
         if((args.size() - 2) & 1) {
             return "-ERR syntax error\r\n";
         }
 
-        int size = (args.size() - 2) / 2;
+        std::vector<double> scores;
+        for(size_t i = 2; i < args.size(); i += 2) {
+            try {
+                size_t pos = 0;
+                scores.push_back(std::stod(args[i], &pos));
+                if(pos != args[i].size()) throw std::invalid_argument(args[i]);
+            } catch (...) {
+                return "-ERR value is not a valid float\r\n";
+            }
+        }
+
+        bound = std::move(scores);
+        return "";
+    }
 
-        std::vector<std::string> members(size);
-        std::vector<double> scores(size);
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        return bindAndExecute(context, args, db, acquire_lock);
+    }
 
-        int cur_idx = 0;
+    std::string execute_bound(ClientContext& context, const std::vector<std::string> &args, const std::any& bound, KeyValueDatabase &db, bool acquire_lock) override {
+        std::string set_key = args[1];
+        std::vector<double> scores = std::any_cast<const std::vector<double>&>(bound);
 
-        for(int i = 2; i < args.size(); i += 2) {
-            scores[cur_idx] = std::stod(args[i]);
-            members[cur_idx] = args[i + 1];
-            cur_idx++;
+        std::vector<std::string> members;
+        for(size_t i = 3; i < args.size(); i += 2) {
+            members.push_back(args[i]);
         }
 
-        int inserted = db.ZADD(set_key, members, scores, acquire_lock);
-
-        return ":" + std::to_string(inserted) + "\r\n";
+        try {
+            int inserted = db.ZADD(set_key, members, scores, acquire_lock);
+            return ":" + std::to_string(inserted) + "\r\n";
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
     }
 };
 
@@ -792,7 +2333,9 @@ class ZRankCommand : public Command {
 public:
     std::string name() const override { return "ZRank"; }
     int min_args() const override { return 3; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
     bool isWriteCommand() const override { return false; }
+    bool isReadOnly() const override { return true; }
     bool sendToMaster() const override { return false; }
     bool isPubSubCommand() const override { return false; }
 
@@ -814,15 +2357,25 @@ class ZRangeCommand : public Command {
 public:
     std::string name() const override { return "ZRANGE"; }
     int min_args() const override { return 4; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
     bool isWriteCommand() const override { return false; }
+    bool isReadOnly() const override { return true; }
     bool sendToMaster() const override { return false; }
     bool isPubSubCommand() const override { return false; }
 
+    //args: ZRANGE key start stop
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override { return bind_integers(args, {2, 3}, bound); }
+
     std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        return bindAndExecute(context, args, db, acquire_lock);
+    }
+
+    std::string execute_bound(ClientContext& context, const std::vector<std::string> &args, const std::any& bound, KeyValueDatabase &db, bool acquire_lock) override {
         std::string set_key = args[1];
+        const std::vector<long long>& range = std::any_cast<const std::vector<long long>&>(bound);
 
-        int start = std::stoi(args[2]);
-        int end = std::stoi(args[3]);
+        int start = std::clamp<long long>(range[0], INT_MIN, INT_MAX);
+        int end = std::clamp<long long>(range[1], INT_MIN, INT_MAX);
 
         std::vector<std::string> members = db.ZRANGE(set_key, start, end, acquire_lock);
 
@@ -840,7 +2393,9 @@ class ZCardCommand : public Command {
 public:
     std::string name() const override { return "ZCARD"; }
     int min_args() const override { return 2; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
     bool isWriteCommand() const override { return false; }
+    bool isReadOnly() const override { return true; }
     bool sendToMaster() const override { return false; }
     bool isPubSubCommand() const override { return false; }
 
@@ -857,7 +2412,9 @@ class ZScoreCommand : public Command {
 public:
     std::string name() const override { return "ZSCORE"; }
     int min_args() const override { return 3; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
     bool isWriteCommand() const override { return false; }
+    bool isReadOnly() const override { return true; }
     bool sendToMaster() const override { return false; }
     bool isPubSubCommand() const override { return false; }
 
@@ -884,9 +2441,11 @@ class ZRemCommand : public Command {
 public:
     std::string name() const override { return "ZREM"; }
     int min_args() const override { return 3; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
     bool isWriteCommand() const override { return true; }
     bool sendToMaster() const override { return false; }
     bool isPubSubCommand() const override { return false; }
+    std::vector<std::string> rewriteForAof(const std::vector<std::string>& args, const std::string& reply) const override { return argsUnlessZero(args, reply); }
 
     std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
         std::string set_key = args[1];
@@ -897,34 +2456,97 @@ public:
             members[i - 2] = args[i];
         }
 
-        int removed = db.ZREM(set_key, members, acquire_lock);
+        try {
+            int removed = db.ZREM(set_key, members, acquire_lock);
+            return ":" + std::to_string(removed) + "\r\n";
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+    }
+};
+
+class ZScanCommand : public Command {
+public:
+    std::string name() const override { return "ZSCAN"; }
+    int min_args() const override { return 3; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
+    bool isWriteCommand() const override { return false; }
+    bool isReadOnly() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override {
+        //args: ZSCAN key cursor [MATCH pattern] [COUNT count]
+        ScanArgs scan;
+        std::string error = parseScanArgs(args, 2, ScanOption::NONE, scan);
+        if(!error.empty()) {
+            return error;
+        }
+        bound = std::move(scan);
+        return "";
+    }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        return bindAndExecute(context, args, db, acquire_lock);
+    }
+
+    std::string execute_bound(ClientContext& context, const std::vector<std::string> &args, const std::any& bound, KeyValueDatabase &db, bool acquire_lock) override {
+        std::string set_key = args[1];
+        const ScanArgs& scan = std::any_cast<const ScanArgs&>(bound);
 
-        return ":" + std::to_string(removed) + "\r\n";
+        try {
+            std::vector<std::pair<std::string, double> > result;
+            uint64_t next_cursor = db.ZSCAN(set_key, scan.cursor, scan.pattern, scan.count, result, acquire_lock);
+
+            std::string next = std::to_string(next_cursor);
+            std::string response = "*2\r\n$" + std::to_string(next.length()) + "\r\n" + next + "\r\n";
+            response += "*" + std::to_string(result.size() * 2) + "\r\n";
+            for(auto& [member, score] : result) {
+                char buf[32];
+                int len = snprintf(buf, sizeof(buf), "%.17g", score);
+                response += "$" + std::to_string(member.length()) + "\r\n" + member + "\r\n";
+                response += "$" + std::to_string(len) + "\r\n" + std::string(buf, len) + "\r\n";
+            }
+            return response;
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
     }
 };
 
+// a float argument of the GEO commands, false if it isn't one
+static bool parseGeoDouble(const std::string& arg, double& value) {
+    try {
+        size_t pos = 0;
+        value = std::stod(arg, &pos);
+        return pos == arg.size();
+    } catch (...) {
+        return false;
+    }
+}
+
 class GeoAddCommand : public Command {
 public:
     std::string name() const override { return "GEOADD"; }
     int min_args() const override { return 5; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
     bool isWriteCommand() const override { return true; }
     bool sendToMaster() const override { return false; }
     bool isPubSubCommand() const override { return false; }
 
-    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
-        std::string set_key = args[1];
-
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override {
+        //args: GEOADD key longitude latitude member [...], bound to the members' geohash scores
         if ((args.size() - 2) % 3 != 0) {
             return "-ERR syntax error\r\n";
         }
 
-        std::vector<std::string> members;
         std::vector<double> scores;
 
         for (size_t i = 2; i < args.size(); i += 3) {
-            double longitude = std::stod(args[i]);
-            double latitude = std::stod(args[i+1]);
-            std::string member = args[i+2];
+            double longitude, latitude;
+            if (!parseGeoDouble(args[i], longitude) || !parseGeoDouble(args[i+1], latitude)) {
+                return "-ERR value is not a valid float\r\n";
+            }
 
             if(longitude > MAX_LONGITUDE || longitude < MIN_LONGITUDE || 
                 latitude > MAX_LATITUDE || latitude < MIN_LATITUDE) {
@@ -933,11 +2555,31 @@ public:
 
             uint64_t geo_code = encode(latitude, longitude);
             scores.push_back(static_cast<double>(geo_code));
-            members.push_back(member);
         }
 
-        int inserted = db.ZADD(set_key, members, scores, acquire_lock);
-        return ":" + std::to_string(inserted) + "\r\n";
+        bound = std::move(scores);
+        return "";
+    }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        return bindAndExecute(context, args, db, acquire_lock);
+    }
+
+    std::string execute_bound(ClientContext& context, const std::vector<std::string> &args, const std::any& bound, KeyValueDatabase &db, bool acquire_lock) override {
+        std::string set_key = args[1];
+        std::vector<double> scores = std::any_cast<const std::vector<double>&>(bound);
+
+        std::vector<std::string> members;
+        for (size_t i = 4; i < args.size(); i += 3) {
+            members.push_back(args[i]);
+        }
+
+        try {
+            int inserted = db.ZADD(set_key, members, scores, acquire_lock);
+            return ":" + std::to_string(inserted) + "\r\n";
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
     }
 };
 
@@ -945,7 +2587,9 @@ class GeoPosCommand : public Command {
 public:
     std::string name() const override { return "GEOPOS"; }
     int min_args() const override { return 3; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
     bool isWriteCommand() const override { return false; }
+    bool isReadOnly() const override { return true; }
     bool sendToMaster() const override { return false; }
     bool isPubSubCommand() const override { return false; }
 
@@ -984,7 +2628,9 @@ class GeoDistCommand : public Command {
 public:
     std::string name() const override { return "GEODIST"; }
     int min_args() const override { return 4; } 
+    KeySpec keySpec() const override { return {1, 1, 1}; }
     bool isWriteCommand() const override { return false; }
+    bool isReadOnly() const override { return true; }
     bool sendToMaster() const override { return false; }
     bool isPubSubCommand() const override { return false; }
 
@@ -1016,19 +2662,25 @@ public:
 };
 
 class GeoSearchCommand : public Command {
+private:
+    struct Bound {
+        double center_lon = 0.0;
+        double center_lat = 0.0;
+        double radius_meters = 0.0;
+        bool sort_asc = true;
+    };
+
 public:
     std::string name() const override { return "GEOSEARCH"; }
     int min_args() const override { return 6; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
     bool isWriteCommand() const override { return false; }
+    bool isReadOnly() const override { return true; }
     bool sendToMaster() const override { return false; }
     bool isPubSubCommand() const override { return false; }
 
-    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
-        std::string set_key = args[1];
-        
-        double center_lon = 0.0, center_lat = 0.0;
-        double radius_meters = 0.0;
-        bool sort_asc = true; 
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override {
+        Bound search;
 
         // Basic parser loop
         for (size_t i = 2; i < args.size(); ++i) {
@@ -1036,22 +2688,37 @@ public:
             std::transform(arg.begin(), arg.end(), arg.begin(), ::toupper);
 
             if (arg == "FROMLONLAT" && i + 2 < args.size()) {
-                center_lon = std::stod(args[++i]);
-                center_lat = std::stod(args[++i]);
+                if (!parseGeoDouble(args[++i], search.center_lon) || !parseGeoDouble(args[++i], search.center_lat)) {
+                    return "-ERR value is not a valid float\r\n";
+                }
             } 
             else if (arg == "BYRADIUS" && i + 2 < args.size()) {
-                radius_meters = std::stod(args[++i]);
+                if (!parseGeoDouble(args[++i], search.radius_meters)) {
+                    return "-ERR need numeric radius\r\n";
+                }
                 std::string unit = args[++i];
             } 
             else if (arg == "ASC") {
-                sort_asc = true;
+                search.sort_asc = true;
             } 
             else if (arg == "DESC") {
-                sort_asc = false;
+                search.sort_asc = false;
             }
         }
 
-        std::vector<std::string> results = db.GEOSEARCH(set_key, center_lon, center_lat, radius_meters, sort_asc, acquire_lock);
+        bound = search;
+        return "";
+    }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        return bindAndExecute(context, args, db, acquire_lock);
+    }
+
+    std::string execute_bound(ClientContext& context, const std::vector<std::string> &args, const std::any& bound, KeyValueDatabase &db, bool acquire_lock) override {
+        std::string set_key = args[1];
+        const Bound& search = std::any_cast<const Bound&>(bound);
+
+        std::vector<std::string> results = db.GEOSEARCH(set_key, search.center_lon, search.center_lat, search.radius_meters, search.sort_asc, acquire_lock);
 
         std::string response = "*" + std::to_string(results.size()) + "\r\n";
         for (const auto& member : results) {
@@ -1068,6 +2735,7 @@ public:
     ACLCommand(std::shared_ptr<ACLManager> aclManager_) : aclManager(aclManager_) {}
     std::string name() const override { return "ACL"; }
     int min_args() const override { return 2; } 
+    KeySpec keySpec() const override { return {}; }
     bool isWriteCommand() const override { return false; }
     bool sendToMaster() const override { return false; }
     bool isPubSubCommand() const override { return false; }
@@ -1133,6 +2801,7 @@ public:
     AuthCommand(std::shared_ptr<ACLManager> aclManager_) : aclManager(aclManager_) {}
     std::string name() const override { return "AUTH"; }
     int min_args() const override { return 3; } 
+    KeySpec keySpec() const override { return {}; }
     bool isWriteCommand() const override { return false; }
     bool sendToMaster() const override { return false; }
     bool isPubSubCommand() const override { return false; }
@@ -0,0 +1,307 @@
+#pragma once
+#include <cstdint>
+#include <climits>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <stdexcept>
+
+/* Contiguous encoding for small collections, byte compatible with the Redis listpack so it can be written to and read from RDB files as is.
+Layout: <total-bytes u32 LE> <num-elements u16 LE> <entry> ... <entry> <0xFF>
+Each entry is <encoding+data> <backlen>, where backlen is the size of encoding+data in 1-5 bytes readable from right to left.
+Canonical integers are stored in the smallest integer encoding, everything else as a string. */
+class Listpack {
+private:
+    static constexpr size_t HEADER_SIZE = 6;
+    static constexpr uint8_t EOF_BYTE = 0xFF;
+    static constexpr uint16_t NUMELE_UNKNOWN = 65535;
+
+    std::string buf;
+
+    static uint32_t read32(const unsigned char* p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24); }
+
+    void setTotalBytes() {
+        uint32_t total = buf.size();
+        for(int i = 0; i < 4; i++) buf[i] = (char)((total >> (8 * i)) & 0xFF);
+    }
+
+    void setNumElements(size_t n) {
+        uint16_t num = n < NUMELE_UNKNOWN ? n : NUMELE_UNKNOWN;
+        buf[4] = (char)(num & 0xFF);
+        buf[5] = (char)(num >> 8);
+    }
+
+    static size_t backlenSize(size_t len) {
+        if(len <= 127) return 1;
+        if(len < 16383) return 2;
+        if(len < 2097151) return 3;
+        if(len < 268435455) return 4;
+        return 5;
+    }
+
+    static void appendBacklen(std::string& out, size_t len) {
+        size_t n = backlenSize(len);
+        // most significant 7-bit group first, every byte but the first has the continuation bit
+        for(size_t i = 0; i < n; i++) {
+            uint8_t byte = (len >> (7 * (n - 1 - i))) & 127;
+            if(i > 0) byte |= 128;
+            out.push_back((char)byte);
+        }
+    }
+
+    // size of encoding+data of the entry at 'pos'
+    size_t encodedSize(size_t pos) const {
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(buf.data()) + pos;
+        uint8_t enc = p[0];
+        if((enc & 0x80) == 0) return 1;                          // 7 bit uint
+        if((enc & 0xC0) == 0x80) return 1 + (enc & 0x3F);        // 6 bit str
+        if((enc & 0xE0) == 0xC0) return 2;                       // 13 bit int
+        if((enc & 0xF0) == 0xE0) return 2 + (((enc & 0x0F) << 8) | p[1]); // 12 bit str
+        switch(enc) {
+            case 0xF0: return 5 + read32(p + 1);                 // 32 bit str
+            case 0xF1: return 3;                                 // 16 bit int
+            case 0xF2: return 4;                                 // 24 bit int
+            case 0xF3: return 5;                                 // 32 bit int
+            case 0xF4: return 9;                                 // 64 bit int
+        }
+        throw std::runtime_error("invalid listpack encoding");
+    }
+
+public:
+    // strict string -> int64 conversion, only canonical representations ("12" but not "012", "+12" or " 12") are stored as integers
+    static bool stringToInt(std::string_view s, long long& value) {
+        if(s.empty() || s.size() > 20) return false;
+        size_t i = 0;
+        bool negative = false;
+        if(s[0] == '-') {
+            negative = true;
+            i = 1;
+            if(s.size() == 1) return false;
+        }
+        if(s[i] == '0') {
+            if(s.size() == 1) { value = 0; return true; }
+            return false;
+        }
+        unsigned long long v = 0;
+        for(; i < s.size(); i++) {
+            if(s[i] < '0' || s[i] > '9') return false;
+            unsigned long long next = v * 10 + (s[i] - '0');
+            if(next / 10 != v) return false;
+            v = next;
+        }
+        if(negative) {
+            if(v > (unsigned long long)LLONG_MAX + 1) return false;
+            value = (long long)(0 - v);
+        } else {
+            if(v > (unsigned long long)LLONG_MAX) return false;
+            value = (long long)v;
+        }
+        return true;
+    }
+
+    // encoding+data+backlen of a single element
+    static std::string encodeEntry(std::string_view value) {
+        std::string out;
+        long long v;
+        if(stringToInt(value, v)) {
+            if(v >= 0 && v <= 127) {
+                out.push_back((char)v);
+            } else if(v >= -4096 && v <= 4095) {
+                uint64_t u = v < 0 ? (1 << 13) + v : v;
+                out.push_back((char)((u >> 8) | 0xC0));
+                out.push_back((char)(u & 0xFF));
+            } else {
+                int bytes;
+                uint8_t enc;
+                if(v >= -32768 && v <= 32767) { bytes = 2; enc = 0xF1; }
+                else if(v >= -8388608 && v <= 8388607) { bytes = 3; enc = 0xF2; }
+                else if(v >= INT32_MIN && v <= INT32_MAX) { bytes = 4; enc = 0xF3; }
+                else { bytes = 8; enc = 0xF4; }
+                out.push_back((char)enc);
+                uint64_t u = (uint64_t)v;
+                for(int i = 0; i < bytes; i++) out.push_back((char)((u >> (8 * i)) & 0xFF));
+            }
+        } else if(value.size() < 64) {
+            out.push_back((char)(0x80 | value.size()));
+            out.append(value);
+        } else if(value.size() < 4096) {
+            out.push_back((char)(0xE0 | (value.size() >> 8)));
+            out.push_back((char)(value.size() & 0xFF));
+            out.append(value);
+        } else {
+            out.push_back((char)0xF0);
+            for(int i = 0; i < 4; i++) out.push_back((char)((value.size() >> (8 * i)) & 0xFF));
+            out.append(value);
+        }
+        appendBacklen(out, out.size());
+        return out;
+    }
+
+    Listpack() {
+        buf.assign(HEADER_SIZE, '\0');
+        buf.push_back((char)EOF_BYTE);
+        setTotalBytes();
+        setNumElements(0);
+    }
+
+    // adopt a serialized listpack (e.g. straight from an RDB file), validating the entries before trusting them
+    static Listpack fromBlob(std::string blob) {
+        Listpack lp;
+        if(blob.size() < HEADER_SIZE + 1 || read32(reinterpret_cast<const unsigned char*>(blob.data())) != blob.size() ||
+           (uint8_t)blob.back() != EOF_BYTE) {
+            throw std::runtime_error("invalid listpack");
+        }
+        lp.buf = std::move(blob);
+
+        size_t count = 0;
+        size_t pos = lp.first();
+        while(pos != lp.endPos()) {
+            size_t len = lp.encodedSize(pos);
+            if(pos + len + backlenSize(len) >= lp.buf.size()) throw std::runtime_error("invalid listpack");
+            pos += len + backlenSize(len);
+            count++;
+        }
+        lp.setNumElements(count);
+        return lp;
+    }
+
+    const std::string& blob() const { return buf; }
+    size_t bytes() const { return buf.size(); }
+
+    size_t size() const {
+        uint16_t num = (uint8_t)buf[4] | ((uint8_t)buf[5] << 8);
+        if(num != NUMELE_UNKNOWN) return num;
+        size_t count = 0;
+        for(size_t pos = first(); pos != endPos(); pos = next(pos)) count++;
+        return count;
+    }
+
+    bool empty() const { return buf.size() == HEADER_SIZE + 1; }
+
+    // entries are addressed by their byte offset, endPos() is the offset of the terminator
+    size_t first() const { return HEADER_SIZE; }
+    size_t endPos() const { return buf.size() - 1; }
+
+    size_t next(size_t pos) const {
+        size_t len = encodedSize(pos);
+        return pos + len + backlenSize(len);
+    }
+
+    // decode the entry at 'pos': returns true and sets 'str' for strings, false and sets 'ival' for integers
+    bool get(size_t pos, std::string_view& str, long long& ival) const {
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(buf.data()) + pos;
+        uint8_t enc = p[0];
+        uint64_t uval, negstart, negmax;
+
+        if((enc & 0x80) == 0) {
+            ival = enc & 0x7F;
+            return false;
+        } else if((enc & 0xC0) == 0x80) {
+            str = std::string_view(buf.data() + pos + 1, enc & 0x3F);
+            return true;
+        } else if((enc & 0xE0) == 0xC0) {
+            uval = ((enc & 0x1F) << 8) | p[1];
+            negstart = (uint64_t)1 << 12;
+            negmax = 8191;
+        } else if((enc & 0xF0) == 0xE0) {
+            str = std::string_view(buf.data() + pos + 2, ((enc & 0x0F) << 8) | p[1]);
+            return true;
+        } else if(enc == 0xF0) {
+            str = std::string_view(buf.data() + pos + 5, read32(p + 1));
+            return true;
+        } else if(enc == 0xF1) {
+            uval = p[1] | (p[2] << 8);
+            negstart = (uint64_t)1 << 15;
+            negmax = UINT16_MAX;
+        } else if(enc == 0xF2) {
+            uval = p[1] | (p[2] << 8) | ((uint64_t)p[3] << 16);
+            negstart = (uint64_t)1 << 23;
+            negmax = 0xFFFFFF;
+        } else if(enc == 0xF3) {
+            uval = read32(p + 1);
+            negstart = (uint64_t)1 << 31;
+            negmax = UINT32_MAX;
+        } else if(enc == 0xF4) {
+            uval = 0;
+            for(int i = 0; i < 8; i++) uval |= (uint64_t)p[1 + i] << (8 * i);
+            ival = (long long)uval;
+            return false;
+        } else {
+            throw std::runtime_error("invalid listpack encoding");
+        }
+
+        // two's complement on 'negstart' bits
+        if(uval >= negstart) {
+            ival = -(long long)(negmax - uval) - 1;
+        } else {
+            ival = (long long)uval;
+        }
+        return false;
+    }
+
+    std::string get(size_t pos) const {
+        std::string_view str;
+        long long ival;
+        if(get(pos, str, ival)) return std::string(str);
+        return std::to_string(ival);
+    }
+
+    bool equals(size_t pos, std::string_view value) const {
+        std::string_view str;
+        long long ival;
+        if(get(pos, str, ival)) return str == value;
+        long long v;
+        return stringToInt(value, v) && v == ival;
+    }
+
+    // first entry equal to 'value' at or after 'pos', looking only at every (skip+1)-th entry (skip=1 walks the keys of a field/value listpack)
+    size_t find(std::string_view value, size_t pos, size_t skip = 0) const {
+        long long needle_int;
+        bool needle_is_int = stringToInt(value, needle_int);
+        size_t skipped = 0;
+
+        while(pos != endPos()) {
+            if(skipped == 0) {
+                std::string_view str;
+                long long ival;
+                bool match = get(pos, str, ival) ? (!needle_is_int && str == value) : (needle_is_int && ival == needle_int);
+                if(match) return pos;
+                skipped = skip;
+            } else {
+                skipped--;
+            }
+            pos = next(pos);
+        }
+        return std::string::npos;
+    }
+
+    void insert(size_t pos, std::string_view value) {
+        size_t count = size();
+        buf.insert(pos, encodeEntry(value));
+        setTotalBytes();
+        setNumElements(count + 1);
+    }
+
+    void append(std::string_view value) { insert(endPos(), value); }
+
+    void replace(size_t pos, std::string_view value) {
+        size_t old_len = next(pos) - pos;
+        buf.replace(pos, old_len, encodeEntry(value));
+        setTotalBytes();
+    }
+
+    // erase 'count' entries starting at 'pos', returns the offset of the entry that followed them
+    size_t erase(size_t pos, size_t count) {
+        size_t total = size();
+        size_t end = pos;
+        size_t removed = 0;
+        while(removed < count && end != endPos()) {
+            end = next(end);
+            removed++;
+        }
+        buf.erase(pos, end - pos);
+        setTotalBytes();
+        setNumElements(total - removed);
+        return pos;
+    }
+};
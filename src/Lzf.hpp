@@ -0,0 +1,134 @@
+#pragma once
+#include <array>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+/* LZF, the compression of RDB strings (the 0xC3 encoding). The stream is a sequence of
+  000LLLLL                          literal run of L+1 bytes (up to 32) that follow
+  LLLooooo oooooooo                 copy L+2 bytes from 'o'+1 bytes back, L 1..6
+  111ooooo LLLLLLLL oooooooo        same with a length of L+9
+so any decoder reads what any encoder wrote. The encoder finds matches through a hash of the next 3 bytes, like liblzf
+in its default (non ultra) mode. */
+
+constexpr size_t LZF_HASH_LOG = 14;
+constexpr size_t LZF_MAX_LITERAL = 32;
+constexpr size_t LZF_MAX_OFFSET = 1 << 13;
+constexpr size_t LZF_MAX_REF = (1 << 8) + (1 << 3);
+
+inline uint32_t lzf_hash(const unsigned char* p) {
+    uint32_t v = (p[0] << 16) | (p[1] << 8) | p[2];
+    return ((v * 2654435761u) >> (32 - LZF_HASH_LOG)) & ((1 << LZF_HASH_LOG) - 1);
+}
+
+// compressed size, 0 when the result doesn't fit in 'out_len' bytes (the caller then stores the data as it is)
+inline size_t lzf_compress(const void* in_data, size_t in_len, void* out_data, size_t out_len) {
+    // positions in the current input, left over entries from an earlier call are caught by the byte compare below
+    static thread_local std::array<uint32_t, 1 << LZF_HASH_LOG> htab{};
+
+    const unsigned char* in = static_cast<const unsigned char*>(in_data);
+    const unsigned char* ip = in;
+    const unsigned char* in_end = in + in_len;
+    unsigned char* out = static_cast<unsigned char*>(out_data);
+    unsigned char* op = out;
+    unsigned char* out_end = out + out_len;
+
+    if (in_len == 0 || out_len == 0) return 0;
+    size_t lit = 0;
+    op++; // header of the first literal run
+
+    while (in_end - ip > 2) {
+        uint32_t h = lzf_hash(ip);
+        size_t ref_pos = htab[h];
+        size_t pos = ip - in;
+        htab[h] = pos;
+
+        if (ref_pos < pos && pos - ref_pos <= LZF_MAX_OFFSET && memcmp(in + ref_pos, ip, 3) == 0) {
+            const unsigned char* ref = in + ref_pos;
+            size_t max_len = std::min<size_t>(in_end - ip, LZF_MAX_REF);
+            size_t len = 3;
+            while (len < max_len && ref[len] == ip[len]) len++;
+
+            // close the literal run (dropping its header if it is empty), then the back reference and a new header
+            if (out_end - op < 4) return 0;
+            if (lit == 0) op--;
+            else op[-(long)lit - 1] = lit - 1;
+
+            size_t off = pos - ref_pos - 1;
+            size_t enc_len = len - 2;
+            if (enc_len < 7) {
+                *op++ = (off >> 8) | (enc_len << 5);
+            } else {
+                *op++ = (off >> 8) | (7 << 5);
+                *op++ = enc_len - 7;
+            }
+            *op++ = off & 0xFF;
+
+            lit = 0;
+            op++;
+            ip += len;
+            continue;
+        }
+
+        if (out_end - op < 2) return 0;
+        *op++ = *ip++;
+        if (++lit == LZF_MAX_LITERAL) {
+            op[-(long)lit - 1] = lit - 1;
+            lit = 0;
+            op++;
+        }
+    }
+
+    while (ip < in_end) {
+        if (out_end - op < 2) return 0;
+        *op++ = *ip++;
+        if (++lit == LZF_MAX_LITERAL) {
+            op[-(long)lit - 1] = lit - 1;
+            lit = 0;
+            op++;
+        }
+    }
+
+    if (lit == 0) op--;
+    else op[-(long)lit - 1] = lit - 1;
+    return op - out;
+}
+
+// decompressed size, 0 if the input is corrupt or expands past 'out_len'
+inline size_t lzf_decompress(const void* in_data, size_t in_len, void* out_data, size_t out_len) {
+    const unsigned char* ip = static_cast<const unsigned char*>(in_data);
+    const unsigned char* in_end = ip + in_len;
+    unsigned char* out = static_cast<unsigned char*>(out_data);
+    unsigned char* op = out;
+    unsigned char* out_end = out + out_len;
+
+    while (ip < in_end) {
+        size_t ctrl = *ip++;
+
+        if (ctrl < 32) {
+            size_t len = ctrl + 1;
+            if ((size_t)(in_end - ip) < len || (size_t)(out_end - op) < len) return 0;
+            memcpy(op, ip, len);
+            op += len;
+            ip += len;
+            continue;
+        }
+
+        size_t len = ctrl >> 5;
+        if (len == 7) {
+            if (ip >= in_end) return 0;
+            len += *ip++;
+        }
+        if (ip >= in_end) return 0;
+        size_t back = ((ctrl & 0x1F) << 8) + *ip++ + 1;
+        len += 2;
+        if ((size_t)(op - out) < back || (size_t)(out_end - op) < len) return 0;
+
+        // the source may overlap what we are writing (runs), so byte by byte
+        const unsigned char* ref = op - back;
+        for (size_t i = 0; i < len; i++) op[i] = ref[i];
+        op += len;
+    }
+    return op - out;
+}
@@ -0,0 +1,117 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <optional>
+#include <cstdint>
+
+/* The interface native modules are compiled against, the only server header a module includes.
+A module is a shared object exporting
+
+    extern "C" int RedisModule_OnLoad(ModuleContext& ctx, const std::vector<std::string>& args); // 0 on success
+    REDIS_MODULE_DECLARE_API_VERSION
+
+and is loaded with --loadmodule "path [args]" or MODULE LOAD path [args]. It only talks to the server through the abstract
+classes below, so the server's own types (the keyspace, the command classes) can change without rebuilding modules; a
+change to this file bumps MODULE_API_VERSION and the loader refuses modules built against another version. */
+
+#define MODULE_API_VERSION 1
+#define REDIS_MODULE_DECLARE_API_VERSION extern "C" int RedisModule_ApiVersion() { return MODULE_API_VERSION; }
+
+class ModuleType; // handle of a custom value type, owned by the server
+
+// Reads and writes the module's values in RDB files, a value must load with the same calls it was saved with
+class ModuleIO {
+public:
+    virtual ~ModuleIO() = default;
+    virtual void save_unsigned(uint64_t value) = 0;
+    virtual void save_signed(int64_t value) = 0;
+    virtual void save_double(double value) = 0;
+    virtual void save_string(const std::string& value) = 0;
+    virtual uint64_t load_unsigned() = 0;
+    virtual int64_t load_signed() = 0;
+    virtual double load_double() = 0;
+    virtual std::string load_string() = 0;
+};
+
+struct ModuleTypeMethods {
+    int encver = 0; // version of the RDB encoding, 0..1023, handed back to rdb_load
+    void (*rdb_save)(ModuleIO& io, const void* value) = nullptr;
+    void* (*rdb_load)(ModuleIO& io, int encver) = nullptr; // nullptr when the data can't be decoded
+    void (*free)(void* value) = nullptr;
+};
+
+/* Key access for a running module command. The command runs under the exclusive db lock, so everything it does through
+here is atomic with respect to other clients. Calls on a key of the wrong type throw std::runtime_error("WRONGTYPE ..."),
+the server turns an exception escaping the handler into an error reply. */
+class ModuleKeys {
+public:
+    virtual ~ModuleKeys() = default;
+
+    virtual std::optional<std::string> get(const std::string& key) = 0;
+    virtual void set(const std::string& key, const std::string& value, long long px = -1) = 0;
+    virtual int del(const std::vector<std::string>& keys) = 0;
+    virtual bool exists(const std::string& key) = 0;
+    virtual std::string type(const std::string& key) = 0;
+    virtual std::optional<long long> incr(const std::string& key) = 0; // nullopt if the value is not an integer
+
+    virtual int rpush(const std::string& key, const std::vector<std::string>& items) = 0;
+    virtual int lpush(const std::string& key, const std::vector<std::string>& items) = 0;
+    virtual std::vector<std::string> lrange(const std::string& key, int start, int end) = 0;
+    virtual std::vector<std::string> lpop(const std::string& key, int count) = 0;
+
+    virtual int hset(const std::string& key, const std::vector<std::pair<std::string, std::string> >& fields) = 0;
+    virtual std::optional<std::string> hget(const std::string& key, const std::string& field) = 0;
+
+    virtual int sadd(const std::string& key, const std::vector<std::string>& members) = 0;
+    virtual bool sismember(const std::string& key, const std::string& member) = 0;
+
+    virtual int zadd(const std::string& key, const std::vector<std::string>& members, const std::vector<double>& scores) = 0;
+    virtual std::optional<double> zscore(const std::string& key, const std::string& member) = 0;
+
+    // values of a custom type, nullptr if the key doesn't exist. set_value takes ownership, type's free() releases it
+    virtual void* get_value(const std::string& key, const ModuleType* type) = 0;
+    virtual void set_value(const std::string& key, const ModuleType* type, void* value) = 0;
+};
+
+// returns the RESP reply of the command
+using ModuleCommandHandler = std::string (*)(ModuleKeys& keys, const std::vector<std::string>& args);
+
+struct ModuleCommandSpec {
+    std::string name;
+    int min_args = 1; // including the command name
+    bool write = true; // propagated to replicas
+    int first_key = 0, last_key = 0, key_step = 1; // like KeySpec, first_key 0 means no keys
+    ModuleCommandHandler handler = nullptr;
+};
+
+// what RedisModule_OnLoad registers through
+class ModuleContext {
+public:
+    virtual ~ModuleContext() = default;
+    virtual void set_name(const std::string& name, int version) = 0;
+    virtual bool create_command(const ModuleCommandSpec& spec) = 0; // false if the name is taken
+    // 'name' is 9 characters of A-Z a-z 0-9 - _ and identifies the type in RDB files, nullptr if invalid or taken
+    virtual const ModuleType* create_type(const std::string& name, const ModuleTypeMethods& methods) = 0;
+};
+
+// helpers to build replies
+namespace module_reply {
+    inline std::string simple(const std::string& s) { return "+" + s + "\r\n"; }
+    inline std::string error(const std::string& s) { return "-" + s + "\r\n"; }
+    inline std::string integer(long long n) { return ":" + std::to_string(n) + "\r\n"; }
+    inline std::string null() { return "$-1\r\n"; }
+    inline std::string bulk(const std::string& s) { return "$" + std::to_string(s.size()) + "\r\n" + s + "\r\n"; }
+
+    // 'elements' are replies built with the helpers above
+    inline std::string array(const std::vector<std::string>& elements) {
+        std::string ans = "*" + std::to_string(elements.size()) + "\r\n";
+        for(const auto& element : elements) ans += element;
+        return ans;
+    }
+
+    inline std::string bulk_array(const std::vector<std::string>& items) {
+        std::string ans = "*" + std::to_string(items.size()) + "\r\n";
+        for(const auto& item : items) ans += bulk(item);
+        return ans;
+    }
+}
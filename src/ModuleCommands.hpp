@@ -0,0 +1,179 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
+#include "Command.hpp"
+#include "KVStore.hpp"
+#include "ModuleAPI.hpp"
+#include "ModuleManager.hpp"
+
+// ModuleKeys over the db, every call runs with the db lock already held by ModuleCommand
+class DatabaseKeys : public ModuleKeys {
+private:
+    KeyValueDatabase& db;
+public:
+    DatabaseKeys(KeyValueDatabase& db_) : db(db_) {}
+
+    std::optional<std::string> get(const std::string& key) override { return db.GET(key, false); }
+    void set(const std::string& key, const std::string& value, long long px) override {
+        long long now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        db.SET(key, value, false, px > 0 ? now + px : -1);
+    }
+    int del(const std::vector<std::string>& keys) override { return db.DEL(keys, false); }
+    bool exists(const std::string& key) override { return db.EXISTS({key}, false) > 0; }
+
+    std::string type(const std::string& key) override {
+        std::string k = key;
+        return db.TYPE(k, false);
+    }
+
+    std::optional<long long> incr(const std::string& key) override {
+        std::string k = key;
+        return db.INCR(k, false);
+    }
+
+    int rpush(const std::string& key, const std::vector<std::string>& items) override {
+        std::string k = key;
+        std::vector<std::string> v = items;
+        return db.RPUSH(k, v, false);
+    }
+
+    int lpush(const std::string& key, const std::vector<std::string>& items) override {
+        std::string k = key;
+        std::vector<std::string> v = items;
+        return db.LPUSH(k, v, false);
+    }
+
+    std::vector<std::string> lrange(const std::string& key, int start, int end) override {
+        std::string k = key;
+        return db.LRANGE(k, start, end, false);
+    }
+
+    std::vector<std::string> lpop(const std::string& key, int count) override {
+        std::string k = key;
+        return db.LPOP(k, count, false);
+    }
+
+    int hset(const std::string& key, const std::vector<std::pair<std::string, std::string> >& fields) override {
+        std::string k = key;
+        std::vector<std::pair<std::string, std::string> > f = fields;
+        return db.HSET(k, f, false);
+    }
+
+    std::optional<std::string> hget(const std::string& key, const std::string& field) override {
+        std::string k = key, f = field;
+        return db.HGET(k, f, false);
+    }
+
+    int sadd(const std::string& key, const std::vector<std::string>& members) override {
+        std::string k = key;
+        std::vector<std::string> m = members;
+        return db.SADD(k, m, false);
+    }
+
+    bool sismember(const std::string& key, const std::string& member) override {
+        std::string k = key;
+        std::vector<std::string> m = {member};
+        return db.SMISMEMBER(k, m, false)[0];
+    }
+
+    int zadd(const std::string& key, const std::vector<std::string>& members, const std::vector<double>& scores) override {
+        std::string k = key;
+        std::vector<std::string> m = members;
+        std::vector<double> s = scores;
+        return db.ZADD(k, m, s, false);
+    }
+
+    std::optional<double> zscore(const std::string& key, const std::string& member) override {
+        std::string k = key, m = member;
+        return db.ZSCORE(k, m, false);
+    }
+
+    void* get_value(const std::string& key, const ModuleType* type) override { return db.MODULE_GET(key, type, false); }
+    void set_value(const std::string& key, const ModuleType* type, void* value) override { db.MODULE_SET(key, type, value, false); }
+};
+
+// a command registered by a module, its handler runs under the exclusive db lock so it is atomic like a transaction
+class ModuleCommand : public Command {
+private:
+    ModuleCommandSpec spec;
+public:
+    ModuleCommand(const ModuleCommandSpec& spec_) : spec(spec_) {}
+    std::string name() const override { return spec.name; }
+    int min_args() const override { return spec.min_args; }
+    // the handler may touch any key through ModuleKeys, so without declared keys EXEC must lock for it anyway
+    KeySpec keySpec() const override { return {spec.first_key, spec.last_key, spec.key_step, spec.first_key == 0}; }
+    bool isWriteCommand() const override { return spec.write; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override
+    {
+        std::string reply;
+        try {
+            db.MODULE_CALL([&]() {
+                DatabaseKeys keys(db);
+                reply = spec.handler(keys, args);
+            }, acquire_lock);
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        } catch (const std::exception& e) {
+            return "-ERR " + spec.name + " failed: " + std::string(e.what()) + "\r\n";
+        }
+        return reply;
+    }
+};
+
+// MODULE LOAD path [arg ...] / MODULE LIST
+class MODULECommand : public Command {
+private:
+    std::shared_ptr<ModuleManager> modules;
+public:
+    MODULECommand(std::shared_ptr<ModuleManager> modules_) : modules(modules_) {}
+    std::string name() const override { return "MODULE"; }
+    int min_args() const override { return 2; }
+    KeySpec keySpec() const override { return {}; }
+    bool isWriteCommand() const override { return false; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+    bool allowedWhileLoading() const override { return false; } // the loader may be calling into the modules
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override
+    {
+        std::string subcommand = args[1];
+        std::transform(subcommand.begin(), subcommand.end(), subcommand.begin(), ::toupper);
+
+        if(subcommand == "LOAD" && args.size() >= 3) {
+            try {
+                modules->load(args[2], std::vector<std::string>(args.begin() + 3, args.end()));
+            } catch (const std::runtime_error& e) {
+                return "-ERR Error loading the extension: " + std::string(e.what()) + "\r\n";
+            }
+            return "+OK\r\n";
+        }
+
+        if(subcommand == "LIST") {
+            std::vector<ModuleManager::LoadedModule> loaded = modules->list();
+            std::string ans = "*" + std::to_string(loaded.size()) + "\r\n";
+            for(const auto& module : loaded) {
+                ans += "*8\r\n";
+                ans += "$4\r\nname\r\n$" + std::to_string(module.name.length()) + "\r\n" + module.name + "\r\n";
+                ans += "$3\r\nver\r\n:" + std::to_string(module.version) + "\r\n";
+                ans += "$4\r\npath\r\n$" + std::to_string(module.path.length()) + "\r\n" + module.path + "\r\n";
+                ans += "$4\r\nargs\r\n*" + std::to_string(module.args.size()) + "\r\n";
+                for(const auto& arg : module.args) {
+                    ans += "$" + std::to_string(arg.length()) + "\r\n" + arg + "\r\n";
+                }
+            }
+            return ans;
+        }
+
+        if(subcommand == "UNLOAD") {
+            return "-ERR modules can't be unloaded\r\n";
+        }
+
+        return "-ERR unknown subcommand or wrong number of arguments for 'MODULE'\r\n";
+    }
+};
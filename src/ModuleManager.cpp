@@ -0,0 +1,143 @@
+#include "ModuleManager.hpp"
+#include "ModuleCommands.hpp"
+#include <dlfcn.h>
+#include <strings.h>
+#include <stdexcept>
+#include <iostream>
+
+static const char* TYPE_NAME_CHARSET = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+bool ModuleType::valid_name(const std::string& name) {
+    if(name.size() != 9) return false;
+    for(char c : name) {
+        if(std::string(TYPE_NAME_CHARSET).find(c) == std::string::npos) return false;
+    }
+    return true;
+}
+
+uint64_t ModuleType::id() const {
+    uint64_t id = 0;
+    for(char c : name) {
+        id = (id << 6) | std::string(TYPE_NAME_CHARSET).find(c);
+    }
+    return (id << 10) | (uint64_t)(methods.encver & 1023);
+}
+
+// what a module registers during RedisModule_OnLoad, applied only if it returns success
+class LoaderContext : public ModuleContext {
+public:
+    std::string name;
+    int version = 0;
+    std::vector<ModuleCommandSpec> commands;
+    std::vector<std::unique_ptr<ModuleType> > types;
+    const std::unordered_map<std::string, std::unique_ptr<ModuleType> >& existing_types;
+    CommandRegistry& registry;
+
+    LoaderContext(const std::unordered_map<std::string, std::unique_ptr<ModuleType> >& existing_types_, CommandRegistry& registry_)
+        : existing_types(existing_types_), registry(registry_) {}
+
+    void set_name(const std::string& name_, int version_) override {
+        name = name_;
+        version = version_;
+    }
+
+    bool create_command(const ModuleCommandSpec& spec) override {
+        if(spec.name.empty() || !spec.handler || registry.getCommand(spec.name)) return false;
+        for(const auto& cmd : commands) {
+            if(strcasecmp(cmd.name.c_str(), spec.name.c_str()) == 0) return false;
+        }
+        commands.push_back(spec);
+        return true;
+    }
+
+    const ModuleType* create_type(const std::string& type_name, const ModuleTypeMethods& methods) override {
+        if(!ModuleType::valid_name(type_name) || existing_types.count(type_name)) return nullptr;
+        if(!methods.rdb_save || !methods.rdb_load || !methods.free || methods.encver < 0 || methods.encver > 1023) return nullptr;
+        for(const auto& type : types) {
+            if(type->name == type_name) return nullptr;
+        }
+        types.push_back(std::make_unique<ModuleType>(ModuleType{type_name, methods}));
+        return types.back().get();
+    }
+};
+
+void ModuleManager::load(const std::string& path, const std::vector<std::string>& args) {
+    std::lock_guard<std::mutex> lock(mtx);
+
+    void* handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if(!handle) {
+        throw std::runtime_error(dlerror());
+    }
+    // dlopen hands back the same handle for a file that is already mapped, running its OnLoad again would reset its state
+    for(const auto& module : modules) {
+        if(module.handle == handle) {
+            dlclose(handle);
+            throw std::runtime_error(path + " is already loaded as " + module.name);
+        }
+    }
+
+    using OnLoad = int (*)(ModuleContext&, const std::vector<std::string>&);
+    using ApiVersion = int (*)();
+    auto on_load = reinterpret_cast<OnLoad>(dlsym(handle, "RedisModule_OnLoad"));
+    auto api_version = reinterpret_cast<ApiVersion>(dlsym(handle, "RedisModule_ApiVersion"));
+    if(!on_load || !api_version) {
+        dlclose(handle);
+        throw std::runtime_error(path + " does not export RedisModule_OnLoad and RedisModule_ApiVersion");
+    }
+    if(api_version() != MODULE_API_VERSION) {
+        dlclose(handle);
+        throw std::runtime_error(path + " was built for module API version " + std::to_string(api_version()) +
+                                 ", the server has version " + std::to_string(MODULE_API_VERSION));
+    }
+
+    LoaderContext ctx(types, registry);
+    int status;
+    try {
+        status = on_load(ctx, args);
+    } catch (const std::exception& e) {
+        dlclose(handle);
+        throw std::runtime_error(path + ": RedisModule_OnLoad threw: " + e.what());
+    }
+    if(status != 0) {
+        dlclose(handle);
+        throw std::runtime_error(path + ": RedisModule_OnLoad failed");
+    }
+
+    if(ctx.name.empty()) {
+        ctx.name = path.substr(path.find_last_of('/') + 1);
+    }
+    for(const auto& module : modules) {
+        if(module.name == ctx.name) {
+            dlclose(handle);
+            throw std::runtime_error("a module named " + ctx.name + " is already loaded");
+        }
+    }
+
+    // from here on the shared object stays mapped for good, values and commands point into it
+    for(auto& type : ctx.types) {
+        std::string type_name = type->name;
+        types[type_name] = std::move(type);
+    }
+    for(const auto& spec : ctx.commands) {
+        if(!registry.tryRegisterCommand(std::make_unique<ModuleCommand>(spec))) {
+            std::cerr << "Module " << ctx.name << ": command " << spec.name << " is already registered, skipped" << std::endl;
+        }
+    }
+
+    modules.push_back({ctx.name, ctx.version, path, args, handle});
+    std::cout << "Module '" << ctx.name << "' loaded from " << path << std::endl;
+}
+
+std::vector<ModuleManager::LoadedModule> ModuleManager::list() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return modules;
+}
+
+const ModuleType* ModuleManager::find_type(uint64_t id) {
+    std::lock_guard<std::mutex> lock(mtx);
+    // the low 10 bits are the encver the value was saved with, rdb_load gets it and deals with older encodings
+    for(const auto& [name, type] : types) {
+        if((type->id() >> 10) == (id >> 10)) return type.get();
+    }
+    return nullptr;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+#include "ModuleAPI.hpp"
+#include "CommandRegistry.hpp"
+
+// a custom value type created by a module, values of it sit in the keyspace as ModuleValue
+class ModuleType {
+public:
+    std::string name; // 9 characters, see ModuleContext::create_type
+    ModuleTypeMethods methods;
+
+    // the 64 bit id RDB files store in front of a value of this type, 6 bits per name character then 10 bits of encver
+    uint64_t id() const;
+    static bool valid_name(const std::string& name);
+};
+
+// Loads modules with dlopen and keeps them for the life of the server. Modules are never unloaded: their commands stay in
+// the registry and their values in the keyspace, both point into the shared object.
+class ModuleManager {
+public:
+    struct LoadedModule {
+        std::string name;
+        int version = 0;
+        std::string path;
+        std::vector<std::string> args;
+        void* handle = nullptr; // from dlopen
+    };
+
+private:
+    CommandRegistry& registry;
+    std::mutex mtx; // one load at a time, guards everything below
+    std::vector<LoadedModule> modules;
+    std::unordered_map<std::string, std::unique_ptr<ModuleType> > types; // by name
+
+public:
+    ModuleManager(CommandRegistry& registry_) : registry(registry_) {}
+
+    // throws std::runtime_error with the reason the module could not be loaded
+    void load(const std::string& path, const std::vector<std::string>& args);
+    std::vector<LoadedModule> list();
+    const ModuleType* find_type(uint64_t id); // the type an RDB value was saved with, nullptr if no module provides it
+};
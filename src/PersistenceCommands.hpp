@@ -0,0 +1,74 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include "Command.hpp"
+#include "PersistenceManager.hpp"
+
+class SaveCommand : public Command {
+private:
+    std::shared_ptr<PersistenceManager> persistence;
+public:
+    SaveCommand(std::shared_ptr<PersistenceManager> persistence_) : persistence(persistence_) {}
+    std::string name() const override { return "SAVE"; }
+    int min_args() const override { return 1; }
+    KeySpec keySpec() const override { return {}; }
+    bool isWriteCommand() const override { return false; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+    bool allowedWhileLoading() const override { return false; } // would overwrite the file with part of it
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        // inside EXEC the transaction holds the db lock, SNAPSHOT must not take it again
+        if(!acquire_lock) {
+            return "-ERR SAVE is not allowed inside MULTI, use BGSAVE\r\n";
+        }
+        std::string error = persistence->save();
+        if(!error.empty()) {
+            return "-" + error + "\r\n";
+        }
+        return "+OK\r\n";
+    }
+};
+
+class BgSaveCommand : public Command {
+private:
+    std::shared_ptr<PersistenceManager> persistence;
+public:
+    BgSaveCommand(std::shared_ptr<PersistenceManager> persistence_) : persistence(persistence_) {}
+    std::string name() const override { return "BGSAVE"; }
+    int min_args() const override { return 1; }
+    KeySpec keySpec() const override { return {}; }
+    bool isWriteCommand() const override { return false; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+    bool allowedWhileLoading() const override { return false; }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        if(!acquire_lock) {
+            return "-ERR BGSAVE is not allowed inside MULTI\r\n";
+        }
+        std::string error = persistence->bgsave();
+        if(!error.empty()) {
+            return "-" + error + "\r\n";
+        }
+        return "+Background saving started\r\n";
+    }
+};
+
+class LastSaveCommand : public Command {
+private:
+    std::shared_ptr<PersistenceManager> persistence;
+public:
+    LastSaveCommand(std::shared_ptr<PersistenceManager> persistence_) : persistence(persistence_) {}
+    std::string name() const override { return "LASTSAVE"; }
+    int min_args() const override { return 1; }
+    KeySpec keySpec() const override { return {}; }
+    bool isWriteCommand() const override { return false; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        return ":" + std::to_string(persistence->lastsave()) + "\r\n";
+    }
+};
@@ -0,0 +1,190 @@
+#include "PersistenceManager.hpp"
+#include "RDBWriter.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <cstdio>
+#include <chrono>
+#include <sstream>
+#include <iostream>
+
+static constexpr int BGSAVE_RETRY_DELAY = 5; // seconds before a failed automatic BGSAVE is tried again
+
+PersistenceManager::PersistenceManager(std::shared_ptr<ServerConfig> config_, KeyValueDatabase& db_) : config(config_), db(db_) {
+    last_save = time(nullptr);
+    cron_thread = std::jthread([this](std::stop_token stop) { cron(stop); });
+}
+
+std::string PersistenceManager::rdb_dir() const {
+    return config->rdb_file_dir.empty() ? "." : config->rdb_file_dir;
+}
+
+std::string PersistenceManager::rdb_path() const {
+    return rdb_dir() + "/" + (config->rdb_file_name.empty() ? "dump.rdb" : config->rdb_file_name);
+}
+
+std::string PersistenceManager::temp_path(pid_t pid) const {
+    return rdb_dir() + "/temp-" + std::to_string(pid) + ".rdb";
+}
+
+bool PersistenceManager::write_file(const std::string& temp_path, bool acquire_lock) {
+    int fd = open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) return false;
+
+    RDBWriter out(fd, config->rdb_compression, config->rdb_checksum);
+    db.SNAPSHOT(out, acquire_lock);
+    bool ok = out.finish() && fsync(fd) == 0;
+    ok = close(fd) == 0 && ok;
+
+    if(!ok || rename(temp_path.c_str(), rdb_path().c_str()) != 0) {
+        unlink(temp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+std::string PersistenceManager::save() {
+    std::lock_guard<std::mutex> lock(mtx);
+    if(child_pid != -1) {
+        return "ERR Background save already in progress";
+    }
+
+    long long dirty = db.DIRTY();
+    if(!write_file(temp_path(getpid()), true)) {
+        return "ERR failed to write " + rdb_path();
+    }
+
+    last_save = time(nullptr);
+    dirty_at_last_save = dirty;
+    return "";
+}
+
+std::string PersistenceManager::start_bgsave() {
+    long long dirty;
+    pid_t pid = db.FORK_SNAPSHOT(dirty);
+    if(pid == 0) {
+        // child: only the forking thread exists here, so nothing but the snapshot and _exit
+        bool ok = write_file(temp_path(getpid()), false);
+        _exit(ok ? 0 : 1);
+    }
+
+    last_bgsave_try = time(nullptr);
+    if(pid < 0) {
+        last_bgsave_ok = false;
+        return "ERR fork failed";
+    }
+
+    child_pid = pid;
+    dirty_at_fork = dirty;
+    bgsave_start = time(nullptr);
+    std::cout << "Background saving started by pid " << pid << std::endl;
+    return "";
+}
+
+std::string PersistenceManager::bgsave() {
+    std::lock_guard<std::mutex> lock(mtx);
+    if(child_pid != -1) {
+        return "ERR Background save already in progress";
+    }
+    return start_bgsave();
+}
+
+void PersistenceManager::reap_child() {
+    int status;
+    if(waitpid(child_pid, &status, WNOHANG) != child_pid) return;
+
+    bool ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    if(ok) {
+        last_save = time(nullptr);
+        dirty_at_last_save = dirty_at_fork;
+        std::cout << "Background saving terminated with success" << std::endl;
+    } else {
+        // a killed child leaves its temp file behind
+        unlink(temp_path(child_pid).c_str());
+        std::cerr << "Background saving error" << std::endl;
+    }
+    last_bgsave_ok = ok;
+    last_bgsave_duration = time(nullptr) - bgsave_start;
+    child_pid = -1;
+}
+
+void PersistenceManager::cron(std::stop_token stop) {
+    while(!stop.stop_requested()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+        std::lock_guard<std::mutex> lock(mtx);
+        if(child_pid != -1) {
+            reap_child();
+            continue;
+        }
+        if(loading()) continue; // a snapshot now would replace the file with part of it
+
+        time_t now = time(nullptr);
+        long long changes = db.DIRTY() - dirty_at_last_save;
+        for(const auto& [seconds, min_changes] : config->save_params) {
+            if(changes >= min_changes && now - last_save > seconds &&
+               (last_bgsave_ok || now - last_bgsave_try > BGSAVE_RETRY_DELAY)) {
+                std::cout << min_changes << " changes in " << seconds << " seconds. Saving..." << std::endl;
+                start_bgsave();
+                break;
+            }
+        }
+    }
+}
+
+time_t PersistenceManager::lastsave() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return last_save;
+}
+
+void PersistenceManager::start_loading() {
+    std::lock_guard<std::mutex> lock(mtx);
+    loading_start = time(nullptr);
+    loading_clock_start = std::chrono::steady_clock::now();
+    loading_total_bytes = 0;
+    loading_loaded_bytes = 0;
+    is_loading.store(true, std::memory_order_release);
+}
+
+void PersistenceManager::loading_progress(size_t loaded_bytes, size_t total_bytes) {
+    std::lock_guard<std::mutex> lock(mtx);
+    loading_loaded_bytes = loaded_bytes;
+    loading_total_bytes = total_bytes;
+}
+
+void PersistenceManager::stop_loading() {
+    std::lock_guard<std::mutex> lock(mtx);
+    dirty_at_last_save = db.DIRTY();
+    last_save = time(nullptr);
+    is_loading.store(false, std::memory_order_release);
+}
+
+std::string PersistenceManager::info() {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::ostringstream oss;
+    oss << "# Persistence\r\n";
+    oss << "loading:" << (loading() ? 1 : 0) << "\r\n";
+    if(loading()) {
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - loading_clock_start).count();
+        double perc = loading_total_bytes ? 100.0 * loading_loaded_bytes / loading_total_bytes : 0;
+        long long bytes_per_sec = elapsed > 0 ? (long long)(loading_loaded_bytes / elapsed) : 0;
+        // 1 until there is a rate to go by, like Redis
+        long long eta = bytes_per_sec > 0 ? (long long)((loading_total_bytes - loading_loaded_bytes) / bytes_per_sec) : 1;
+
+        char perc_str[32];
+        snprintf(perc_str, sizeof(perc_str), "%.2f%%", perc);
+        oss << "loading_start_time:" << loading_start << "\r\n";
+        oss << "loading_total_bytes:" << loading_total_bytes << "\r\n";
+        oss << "loading_loaded_bytes:" << loading_loaded_bytes << "\r\n";
+        oss << "loading_loaded_perc:" << perc_str << "\r\n";
+        oss << "loading_bytes_per_sec:" << bytes_per_sec << "\r\n";
+        oss << "loading_eta_seconds:" << eta << "\r\n";
+    }
+    oss << "rdb_changes_since_last_save:" << db.DIRTY() - dirty_at_last_save << "\r\n";
+    oss << "rdb_bgsave_in_progress:" << (child_pid != -1 ? 1 : 0) << "\r\n";
+    oss << "rdb_last_save_time:" << last_save << "\r\n";
+    oss << "rdb_last_bgsave_status:" << (last_bgsave_ok ? "ok" : "err") << "\r\n";
+    oss << "rdb_last_bgsave_time_sec:" << last_bgsave_duration << "\r\n";
+    oss << "rdb_current_bgsave_time_sec:" << (child_pid != -1 ? time(nullptr) - bgsave_start : -1) << "\r\n";
+    return oss.str();
+}
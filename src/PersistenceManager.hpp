@@ -0,0 +1,65 @@
+#pragma once
+#include <string>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <sys/types.h>
+#include "Config.hpp"
+#include "KVStore.hpp"
+
+/* RDB snapshots: SAVE writes the file from the calling thread, BGSAVE forks and lets the child write its copy-on-write
+view of the keyspace, so clients are only held up by the fork itself. A cron thread reaps the child and starts a BGSAVE
+when one of the `save <seconds> <changes>` points is reached. Files are written to a temp file and renamed over the
+old one, a crash mid-save leaves the previous snapshot in place.
+It also tracks the load of the RDB file at startup, which runs while clients are already being served, for INFO and
+the -LOADING replies. */
+class PersistenceManager {
+private:
+    std::shared_ptr<ServerConfig> config;
+    KeyValueDatabase& db;
+
+    std::mutex mtx; // guards everything below
+    pid_t child_pid = -1; // the BGSAVE child, -1 when none is running
+    long long dirty_at_fork = 0;
+    time_t bgsave_start = 0;
+    long long dirty_at_last_save = 0;
+    time_t last_save = 0;
+    bool last_bgsave_ok = true;
+    time_t last_bgsave_try = 0;
+    long long last_bgsave_duration = -1;
+
+    std::atomic<bool> is_loading{false};
+    time_t loading_start = 0;
+    std::chrono::steady_clock::time_point loading_clock_start;
+    size_t loading_total_bytes = 0;
+    size_t loading_loaded_bytes = 0;
+
+    std::jthread cron_thread; // declared last so it stops before the members it uses are destroyed
+
+    std::string rdb_dir() const;
+    std::string temp_path(pid_t pid) const; // the file a save by process 'pid' writes before the rename
+    void cron(std::stop_token stop);
+    void reap_child(); // mtx held
+    bool write_file(const std::string& temp_path, bool acquire_lock); // writes and renames over rdb_path()
+    std::string start_bgsave(); // mtx held, "" on success
+
+public:
+    PersistenceManager(std::shared_ptr<ServerConfig> config_, KeyValueDatabase& db_);
+
+    // where snapshots go, ./dump.rdb unless --dir / --dbfilename say otherwise
+    std::string rdb_path() const;
+
+    std::string save(); // "" on success, else the error
+    std::string bgsave();
+    time_t lastsave();
+    // the startup load: no automatic saves run until stop_loading(), after which the keyspace matches the file on disk
+    void start_loading();
+    void loading_progress(size_t loaded_bytes, size_t total_bytes);
+    void stop_loading();
+    bool loading() const { return is_loading.load(std::memory_order_acquire); }
+
+    std::string info(); // the # Persistence section of INFO
+};
@@ -18,6 +18,7 @@ class PingCommand : public Command {
 public:
     std::string name() const override { return "PING"; }
     int min_args() const override { return 0; }
+    KeySpec keySpec() const override { return {}; }
     bool isWriteCommand() const override { return false; }
     bool sendToMaster() const override { return false; }
     bool isPubSubCommand() const override { return true; }
@@ -38,6 +39,7 @@ class EchoCommand : public Command
 public:
     std::string name() const override { return "ECHO"; }
     int min_args() const override { return 2; }
+    KeySpec keySpec() const override { return {}; }
     bool isWriteCommand() const override { return false; }
     bool sendToMaster() const override { return false; }
     bool isPubSubCommand() const override { return false; }
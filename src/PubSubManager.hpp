@@ -10,10 +10,15 @@
 #include <shared_mutex>
 #include <unordered_map>
 #include <unordered_set>
+#include <memory>
+#include <mutex>
+#include "GlobMatcher.hpp"
+#include "ClientOutput.hpp"
+#include "Crc16.hpp"
 
 struct Subscriber {
     int fd;
-    std::mutex* mtx; 
+    std::shared_ptr<ClientOutput> output;
 
     bool operator==(const Subscriber& other) const { return fd == other.fd; }
 };
@@ -24,43 +29,244 @@ struct SubscriberHasher {
 
 class PubSubManager {
 private:
-    std::unordered_map<std::string, std::unordered_set<Subscriber, SubscriberHasher>> channels;
+    using SubscriberSet = std::unordered_set<Subscriber, SubscriberHasher>;
+
+    struct PatternSubscribers {
+        GlobPattern matcher;
+        SubscriberSet subscribers;
+    };
+
+    /* Pattern subscriptions are stored in a trie under their literal prefix ("news.*" under "news."), so PUBLISH only walks
+    the channel name down the trie and tests the patterns found on the way instead of every pattern on the server. */
+    struct PatternNode {
+        std::unordered_map<char, std::unique_ptr<PatternNode> > children;
+        std::unordered_map<std::string, PatternSubscribers> patterns;
+    };
+
+    /* Sharded channels (SSUBSCRIBE / SPUBLISH) are spread over shards by their cluster slot, each shard with its own lock,
+    so subscribe churn on one channel only blocks the publishers of channels in the same shard. */
+    static constexpr size_t PUBSUB_SHARDS = 64;
+
+    struct ChannelShard {
+        std::shared_mutex mtx;
+        std::unordered_map<std::string, SubscriberSet> channels;
+    };
+
+    std::unordered_map<std::string, SubscriberSet> channels;
+    ChannelShard shards[PUBSUB_SHARDS];
+    PatternNode pattern_root;
+    size_t num_patterns = 0;
     std::shared_mutex channel_mtx;
 
+    // client-output-buffer-limit for subscribers, 0 disables a limit
+    size_t hard_limit;
+    size_t soft_limit;
+    long long soft_seconds;
+
     std::string format_pub_message(const std::string& channel, const std::string& message) {
         std::string format_message = "*3\r\n$7\r\nmessage\r\n" + (std::string)"$" + std::to_string(channel.length()) + "\r\n" + channel + "\r\n" + 
                                     "$" + std::to_string(message.length()) + "\r\n" + message + "\r\n"; 
         return format_message;
     }
 
+    static ChannelShard& shard_of(ChannelShard* shards, const std::string& channel) {
+        return shards[key_hash_slot(channel) % PUBSUB_SHARDS];
+    }
+
+    std::string format_shard_message(const std::string& channel, const std::string& message) {
+        return "*3\r\n$8\r\nsmessage\r\n$" + std::to_string(channel.length()) + "\r\n" + channel + "\r\n" +
+               "$" + std::to_string(message.length()) + "\r\n" + message + "\r\n";
+    }
+
+    std::string format_pattern_message(const std::string& pattern, const std::string& channel, const std::string& message) {
+        return "*4\r\n$8\r\npmessage\r\n$" + std::to_string(pattern.length()) + "\r\n" + pattern + "\r\n" +
+               "$" + std::to_string(channel.length()) + "\r\n" + channel + "\r\n" +
+               "$" + std::to_string(message.length()) + "\r\n" + message + "\r\n";
+    }
+
+    void remove_pattern(const std::string& pattern, int fd) {
+        // remember the path so trie nodes left empty can be pruned bottom-up
+        std::vector<std::pair<PatternNode*, char> > path;
+        // the matcher must outlive the loop, literalPrefix() returns a reference into it
+        GlobPattern matcher(pattern);
+        PatternNode* node = &pattern_root;
+        for (char c : matcher.literalPrefix()) {
+            auto next = node->children.find(c);
+            if (next == node->children.end()) return;
+            path.push_back({node, c});
+            node = next->second.get();
+        }
+
+        auto it = node->patterns.find(pattern);
+        if (it == node->patterns.end()) return;
+        it->second.subscribers.erase({fd, nullptr});
+        if (!it->second.subscribers.empty()) return;
+
+        node->patterns.erase(it);
+        num_patterns--;
+        while (!path.empty() && node->patterns.empty() && node->children.empty()) {
+            auto [parent, c] = path.back();
+            path.pop_back();
+            parent->children.erase(c);
+            node = parent;
+        }
+    }
+
+    void remove_channel(const std::string& channel, int fd) {
+        auto it = channels.find(channel);
+        if (it == channels.end()) return;
+        it->second.erase({fd, nullptr});
+        if (it->second.empty()) channels.erase(it);
+    }
+
+    // the message is formatted once and the same buffer is queued on every subscriber
+    static int deliver(const SubscriberSet& subscribers, const std::shared_ptr<const std::string>& message) {
+        int count = 0;
+        for (const auto& sub : subscribers) {
+            sub.output->push(message);
+            count++;
+        }
+        return count;
+    }
+
 public:
-    void subscribe(const std::string& channel, int fd, std::mutex& client_mtx) {
+    PubSubManager(size_t hard_limit_ = 32 * 1024 * 1024, size_t soft_limit_ = 8 * 1024 * 1024, long long soft_seconds_ = 60)
+        : hard_limit(hard_limit_), soft_limit(soft_limit_), soft_seconds(soft_seconds_) {}
+
+    void subscribe(const std::string& channel, int fd, const std::shared_ptr<ClientOutput>& output) {
+        output->start_writer(hard_limit, soft_limit, soft_seconds);
         std::unique_lock<std::shared_mutex> lock(channel_mtx);
-        channels[channel].insert({fd, &client_mtx});
+        channels[channel].insert({fd, output});
     }
 
     void unsubscribe(const std::string& channel, int fd) {
         std::unique_lock<std::shared_mutex> lock(channel_mtx);
-        if (channels.count(channel)) {
-            channels[channel].erase({fd, nullptr}); 
-            if (channels[channel].empty()) channels.erase(channel);
+        remove_channel(channel, fd);
+    }
+
+    void psubscribe(const std::string& pattern, int fd, const std::shared_ptr<ClientOutput>& output) {
+        output->start_writer(hard_limit, soft_limit, soft_seconds);
+        std::unique_lock<std::shared_mutex> lock(channel_mtx);
+
+        GlobPattern matcher(pattern);
+        PatternNode* node = &pattern_root;
+        for (char c : matcher.literalPrefix()) {
+            std::unique_ptr<PatternNode>& next = node->children[c];
+            if (!next) next = std::make_unique<PatternNode>();
+            node = next.get();
         }
+
+        auto [it, inserted] = node->patterns.try_emplace(pattern, PatternSubscribers{std::move(matcher), {}});
+        if (inserted) num_patterns++;
+        it->second.subscribers.insert({fd, output});
+    }
+
+    void punsubscribe(const std::string& pattern, int fd) {
+        std::unique_lock<std::shared_mutex> lock(channel_mtx);
+        remove_pattern(pattern, fd);
+    }
+
+    void ssubscribe(const std::string& channel, int fd, const std::shared_ptr<ClientOutput>& output) {
+        output->start_writer(hard_limit, soft_limit, soft_seconds);
+        ChannelShard& shard = shard_of(shards, channel);
+        std::unique_lock<std::shared_mutex> lock(shard.mtx);
+        shard.channels[channel].insert({fd, output});
+    }
+
+    void sunsubscribe(const std::string& channel, int fd) {
+        ChannelShard& shard = shard_of(shards, channel);
+        std::unique_lock<std::shared_mutex> lock(shard.mtx);
+        auto it = shard.channels.find(channel);
+        if (it == shard.channels.end()) return;
+        it->second.erase({fd, nullptr});
+        if (it->second.empty()) shard.channels.erase(it);
+    }
+
+    int spublish(const std::string& channel, const std::string& message) {
+        ChannelShard& shard = shard_of(shards, channel);
+        std::shared_lock<std::shared_mutex> lock(shard.mtx);
+        auto it = shard.channels.find(channel);
+        if (it == shard.channels.end()) return 0;
+        return deliver(it->second, std::make_shared<const std::string>(format_shard_message(channel, message)));
+    }
+
+    // drops every subscription of a disconnecting client
+    void unsubscribe_all(int fd, const std::unordered_set<std::string>& client_channels, const std::unordered_set<std::string>& client_patterns,
+                         const std::unordered_set<std::string>& client_shard_channels) {
+        for (const auto& channel : client_shard_channels) sunsubscribe(channel, fd);
+        if (client_channels.empty() && client_patterns.empty()) return;
+        std::unique_lock<std::shared_mutex> lock(channel_mtx);
+        for (const auto& channel : client_channels) remove_channel(channel, fd);
+        for (const auto& pattern : client_patterns) remove_pattern(pattern, fd);
     }
 
     int publish(const std::string& channel, const std::string& message) {
         std::shared_lock<std::shared_mutex> lock(channel_mtx);
 
+        int count = 0;
+
         auto it = channels.find(channel);
-        if (it == channels.end()) return 0;
+        if (it != channels.end()) {
+            count += deliver(it->second, std::make_shared<const std::string>(format_pub_message(channel, message)));
+        }
 
-        std::string formatted = format_pub_message(channel, message);
-        int count = 0;
-        
-        for (const auto& sub : it->second) {
-            std::unique_lock<std::mutex> write_lock(*(sub.mtx));
-            send(sub.fd, formatted.data(), formatted.length(), MSG_NOSIGNAL);
-            count++;
+        // patterns whose literal prefix is a prefix of the channel lie on the channel's path from the root
+        const PatternNode* node = &pattern_root;
+        size_t depth = 0;
+        while (node) {
+            for (const auto& [pattern, entry] : node->patterns) {
+                if (!entry.matcher.match(channel)) continue;
+                count += deliver(entry.subscribers, std::make_shared<const std::string>(format_pattern_message(pattern, channel, message)));
+            }
+            if (depth == channel.size()) break;
+            auto next = node->children.find(channel[depth++]);
+            node = next == node->children.end() ? nullptr : next->second.get();
         }
         return count;
     }
-};
\ No newline at end of file
+
+    // PUBSUB CHANNELS [pattern]: channels with at least one subscriber
+    std::vector<std::string> active_channels(const std::string& pattern) {
+        std::shared_lock<std::shared_mutex> lock(channel_mtx);
+        GlobPattern matcher(pattern.empty() ? "*" : pattern);
+        std::vector<std::string> result;
+        for (const auto& [channel, subscribers] : channels) {
+            if (matcher.match(channel)) result.push_back(channel);
+        }
+        return result;
+    }
+
+    // PUBSUB SHARDCHANNELS [pattern]
+    std::vector<std::string> active_shard_channels(const std::string& pattern) {
+        GlobPattern matcher(pattern.empty() ? "*" : pattern);
+        std::vector<std::string> result;
+        for (ChannelShard& shard : shards) {
+            std::shared_lock<std::shared_mutex> lock(shard.mtx);
+            for (const auto& [channel, subscribers] : shard.channels) {
+                if (matcher.match(channel)) result.push_back(channel);
+            }
+        }
+        return result;
+    }
+
+    // PUBSUB SHARDNUMSUB
+    size_t num_shard_subscribers(const std::string& channel) {
+        ChannelShard& shard = shard_of(shards, channel);
+        std::shared_lock<std::shared_mutex> lock(shard.mtx);
+        auto it = shard.channels.find(channel);
+        return it == shard.channels.end() ? 0 : it->second.size();
+    }
+
+    // PUBSUB NUMSUB: subscribers of a channel, pattern subscriptions are not counted
+    size_t num_subscribers(const std::string& channel) {
+        std::shared_lock<std::shared_mutex> lock(channel_mtx);
+        auto it = channels.find(channel);
+        return it == channels.end() ? 0 : it->second.size();
+    }
+
+    // PUBSUB NUMPAT: distinct patterns subscribed by any client
+    size_t num_pattern_subscriptions() {
+        std::shared_lock<std::shared_mutex> lock(channel_mtx);
+        return num_patterns;
+    }
+};
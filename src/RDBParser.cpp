@@ -0,0 +1,946 @@
+#include "RDBParser.hpp"
+#include "RDBWriter.hpp"
+#include "ModuleManager.hpp"
+#include "Crc64.hpp"
+#include "Lzf.hpp"
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+// flags of the entries inside a stream node listpack
+static constexpr long long STREAM_ITEM_FLAG_DELETED = 1;
+static constexpr long long STREAM_ITEM_FLAG_SAMEFIELDS = 2;
+
+static uint32_t read32le(const unsigned char* p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24); }
+
+/* Calls fn(entry) for every entry of a ziplist, the encoding of small lists, hashes and zsets before Redis 7.
+Layout: zlbytes(4) zltail(4) zllen(2), entries of prevlen + encoding + data, 0xFF. */
+template <typename Fn>
+static void forEachZiplistEntry(const std::string& zl, Fn&& fn) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(zl.data());
+    size_t size = zl.size();
+    if(size < 11 || read32le(p) != size || p[size - 1] != 0xFF) throw std::runtime_error("invalid ziplist");
+
+    size_t pos = 10;
+    // every entry has to end before the terminator
+    auto need = [&](size_t len) {
+        if(pos + len >= size) throw std::runtime_error("invalid ziplist");
+    };
+
+    while(p[pos] != 0xFF) {
+        need(1);
+        pos += p[pos] == 0xFE ? 5 : 1; // prevlen
+        need(1);
+        uint8_t enc = p[pos];
+
+        if((enc >> 6) != 3) {
+            size_t len;
+            if((enc >> 6) == 0) {
+                len = enc & 0x3F;
+                pos += 1;
+            } else if((enc >> 6) == 1) {
+                need(2);
+                len = ((enc & 0x3F) << 8) | p[pos + 1];
+                pos += 2;
+            } else {
+                need(5);
+                len = __builtin_bswap32(read32le(p + pos + 1));
+                pos += 5;
+            }
+            need(len);
+            fn(std::string(zl.data() + pos, len));
+            pos += len;
+            continue;
+        }
+
+        long long value;
+        size_t len;
+        pos += 1;
+        if(enc == 0xC0) {
+            int16_t v; need(2); memcpy(&v, p + pos, 2); value = v; len = 2;
+        } else if(enc == 0xD0) {
+            int32_t v; need(4); memcpy(&v, p + pos, 4); value = v; len = 4;
+        } else if(enc == 0xE0) {
+            int64_t v; need(8); memcpy(&v, p + pos, 8); value = v; len = 8;
+        } else if(enc == 0xF0) {
+            need(3);
+            int32_t v = (int32_t)((uint32_t)p[pos] << 8 | (uint32_t)p[pos + 1] << 16 | (uint32_t)p[pos + 2] << 24) >> 8;
+            value = v; len = 3;
+        } else if(enc == 0xFE) {
+            need(1); value = (int8_t)p[pos]; len = 1;
+        } else if(enc >= 0xF1 && enc <= 0xFD) {
+            value = (enc & 0x0F) - 1; len = 0; // 4 bit immediate 0..12
+        } else {
+            throw std::runtime_error("invalid ziplist encoding");
+        }
+        fn(std::to_string(value));
+        pos += len;
+    }
+}
+
+static double parseScore(const std::string& s) {
+    char* end;
+    double score = strtod(s.c_str(), &end);
+    if(s.empty() || *end != '\0' || std::isnan(score)) throw std::runtime_error("invalid zset score");
+    return score;
+}
+
+// module values are a sequence of opcode tagged values, each load_* checks it reads what the module saved
+class RDBModuleLoader : public ModuleIO {
+private:
+    RDBParser& rdb;
+
+    void expect(uint64_t opcode) {
+        if(rdb.readLength() != opcode) throw std::runtime_error("module value doesn't match what its rdb_load reads");
+    }
+
+public:
+    RDBModuleLoader(RDBParser& rdb_) : rdb(rdb_) {}
+
+    void save_unsigned(uint64_t value) override { throw std::logic_error("saving while loading"); }
+    void save_signed(int64_t value) override { throw std::logic_error("saving while loading"); }
+    void save_double(double value) override { throw std::logic_error("saving while loading"); }
+    void save_string(const std::string& value) override { throw std::logic_error("saving while loading"); }
+
+    uint64_t load_unsigned() override { expect(RDBWriter::MODULE_OPCODE_UINT); return rdb.readLength(); }
+    int64_t load_signed() override { expect(RDBWriter::MODULE_OPCODE_SINT); return (int64_t)rdb.readLength(); }
+    double load_double() override { expect(RDBWriter::MODULE_OPCODE_DOUBLE); return rdb.readBinaryDouble(); }
+    std::string load_string() override { expect(RDBWriter::MODULE_OPCODE_STRING); return rdb.readString(); }
+};
+
+struct RDBParser::Record {
+    uint8_t type;
+    long long expiry_at;
+    const unsigned char* begin; // the key
+    const unsigned char* end; // just past the value
+};
+
+struct RDBParser::RecordQueue {
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::deque<std::vector<Record> > batches;
+    size_t max_batches;
+    bool closed = false; // no more batches are coming
+    std::exception_ptr error; // the first failure of any thread, everyone stops
+
+    RecordQueue(size_t max_batches_) : max_batches(max_batches_) {}
+
+    // false when the load failed and the walk should stop
+    bool push(std::vector<Record>&& batch) {
+        std::unique_lock<std::mutex> lock(mtx);
+        cv.wait(lock, [&] { return batches.size() < max_batches || error; });
+        if (error) return false;
+        batches.push_back(std::move(batch));
+        cv.notify_all();
+        return true;
+    }
+
+    bool pop(std::vector<Record>& batch) {
+        std::unique_lock<std::mutex> lock(mtx);
+        cv.wait(lock, [&] { return !batches.empty() || closed || error; });
+        if (error || batches.empty()) return false;
+        batch = std::move(batches.front());
+        batches.pop_front();
+        cv.notify_all();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mtx);
+        closed = true;
+        cv.notify_all();
+    }
+
+    void fail(std::exception_ptr e) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (!error) error = e;
+        batches.clear();
+        cv.notify_all();
+    }
+};
+
+// unmaps the file on every way out of load()
+struct FileMapping {
+    void* addr = MAP_FAILED;
+    size_t len = 0;
+    ~FileMapping() {
+        if (addr != MAP_FAILED) munmap(addr, len);
+    }
+};
+
+void RDBParser::load(const std::string& path, KeyValueDatabase& db, ModuleManager* modules, Progress progress, size_t* rdb_size) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cout << "Unable to open the rdb file" << std::endl;
+        return;
+    }
+
+    struct stat st;
+    FileMapping mapping;
+    if (fstat(fd, &st) == 0 && st.st_size >= 9) {
+        mapping.len = st.st_size;
+        mapping.addr = mmap(nullptr, mapping.len, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (mapping.addr == MAP_FAILED) {
+        throw std::runtime_error("not an RDB file or can't map it");
+    }
+    madvise(mapping.addr, mapping.len, MADV_SEQUENTIAL);
+
+    const unsigned char* data = static_cast<const unsigned char*>(mapping.addr);
+    if (memcmp(data, "REDIS", 5) != 0) {
+        throw std::runtime_error("not an RDB file");
+    }
+    int version = 0;
+    for (int i = 5; i < 9; i++) {
+        if (data[i] < '0' || data[i] > '9') throw std::runtime_error("not an RDB file");
+        version = version * 10 + (data[i] - '0');
+    }
+    if (version < 1 || version > MAX_RDB_VERSION) {
+        throw std::runtime_error("can't handle RDB format version " + std::to_string(version));
+    }
+
+    // version 5 and later end with the CRC64 of everything before it, computed while the keys load. When more data
+    // follows, where the snapshot ends is only known once it is read
+    bool has_checksum = version >= 5 && mapping.len >= 17;
+    uint64_t computed = 0;
+    std::jthread crc_thread;
+    if (has_checksum && !rdb_size) {
+        crc_thread = std::jthread([&computed, data, len = mapping.len] { computed = crc64(0, data, len - 8); });
+    }
+
+    RDBParser parser(data + 9, data + mapping.len, db, modules, version);
+    parser.file_start = data;
+    parser.progress = progress;
+    if (progress) progress(0, mapping.len);
+    parser.loadEntries();
+
+    if (version >= 5) {
+        uint64_t stored;
+        parser.readExact(&stored, 8);
+        if (rdb_size) {
+            computed = crc64(0, data, parser.pos - data - 8);
+        } else if (parser.pos != parser.end) {
+            throw std::runtime_error("data after the end of the RDB file");
+        }
+        crc_thread = std::jthread(); // joins
+        // 0 when the writer didn't compute it
+        if (stored != 0 && stored != computed) throw std::runtime_error("wrong RDB checksum");
+    }
+    if (rdb_size) *rdb_size = parser.pos - data;
+    if (progress) progress(parser.pos - data, mapping.len);
+    std::cout << "Finished reading rdb file" << std::endl;
+}
+
+const unsigned char* RDBParser::take(size_t len) {
+    if ((size_t)(end - pos) < len) throw std::runtime_error("unexpected end of the RDB file");
+    const unsigned char* at = pos;
+    pos += len;
+    return at;
+}
+
+void RDBParser::readExact(void* out, size_t len) {
+    memcpy(out, take(len), len);
+}
+
+uint64_t RDBParser::readLength(bool& is_encoded) {
+    uint8_t first = readByte();
+    is_encoded = false;
+
+    switch (first >> 6) {
+        case 0:
+            // 00: length is in the remaining 6 bits
+            return first & 0x3F;
+        case 1:
+            // 01: length is in 6 bits from this byte + 8 bits from the second byte
+            return ((first & 0x3F) << 8) | readByte();
+        case 2: {
+            // 10: 32 or 64 bit big endian length in the following bytes
+            if (first == 0x80) {
+                uint32_t len;
+                readExact(&len, 4);
+                return __builtin_bswap32(len);
+            }
+            if (first == 0x81) {
+                uint64_t len;
+                readExact(&len, 8);
+                return __builtin_bswap64(len);
+            }
+            throw std::runtime_error("invalid length encoding");
+        }
+        default:
+            // 11: a special string encoding, the low 6 bits say which
+            is_encoded = true;
+            return first & 0x3F;
+    }
+}
+
+uint64_t RDBParser::readLength() {
+    bool is_encoded;
+    uint64_t len = readLength(is_encoded);
+    if (is_encoded) throw std::runtime_error("string encoding where a length was expected");
+    return len;
+}
+
+std::string RDBParser::readString() {
+    bool is_encoded;
+    uint64_t len = readLength(is_encoded);
+
+    if (is_encoded) {
+        if (len == ENC_INT8) {
+            int8_t val;
+            readExact(&val, 1);
+            return std::to_string(val);
+        } else if (len == ENC_INT16) {
+            int16_t val;
+            readExact(&val, 2);
+            return std::to_string(val);
+        } else if (len == ENC_INT32) {
+            int32_t val;
+            readExact(&val, 4);
+            return std::to_string(val);
+        } else if (len == ENC_LZF) {
+            uint64_t compressed_len = readLength();
+            uint64_t original_len = readLength();
+            const unsigned char* compressed = take(compressed_len);
+            // no LZF stream expands more than ~90 times, anything claiming more is corrupt
+            if (original_len > compressed_len * 128) throw std::runtime_error("invalid LZF string lengths");
+            std::string s(original_len, '\0');
+            if (lzf_decompress(compressed, compressed_len, s.data(), original_len) != original_len) {
+                throw std::runtime_error("invalid LZF compressed string");
+            }
+            return s;
+        }
+        throw std::runtime_error("unsupported string encoding " + std::to_string(len));
+    }
+
+    // take() first, so a corrupt length can't turn into a huge allocation
+    const unsigned char* data = take(len);
+    return std::string(reinterpret_cast<const char*>(data), len);
+}
+
+void RDBParser::skipString() {
+    bool is_encoded;
+    uint64_t len = readLength(is_encoded);
+
+    if (!is_encoded) {
+        take(len);
+    } else if (len == ENC_INT8) {
+        take(1);
+    } else if (len == ENC_INT16) {
+        take(2);
+    } else if (len == ENC_INT32) {
+        take(4);
+    } else if (len == ENC_LZF) {
+        uint64_t compressed_len = readLength();
+        readLength();
+        take(compressed_len);
+    } else {
+        throw std::runtime_error("unsupported string encoding " + std::to_string(len));
+    }
+}
+
+double RDBParser::readBinaryDouble() {
+    double value;
+    readExact(&value, 8);
+    return value;
+}
+
+double RDBParser::readStringDouble() {
+    uint8_t len = readByte();
+    if (len == 253) return NAN;
+    if (len == 254) return INFINITY;
+    if (len == 255) return -INFINITY;
+    const unsigned char* data = take(len);
+    return parseScore(std::string(reinterpret_cast<const char*>(data), len));
+}
+
+int64_t RDBParser::readMillis() {
+    int64_t ms;
+    readExact(&ms, 8);
+    return ms;
+}
+
+StreamId RDBParser::readStreamId() {
+    uint64_t be[2];
+    readExact(be, 16);
+    return {(int64_t)__builtin_bswap64(be[0]), (int64_t)__builtin_bswap64(be[1])};
+}
+
+static long long current_time_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void RDBParser::loadEntries() {
+    size_t threads = std::clamp<size_t>(std::thread::hardware_concurrency(), 1, MAX_DECODER_THREADS);
+    RecordQueue queue(threads * MAX_QUEUED_BATCHES);
+    std::vector<std::jthread> decoders;
+    for (size_t i = 0; i < threads; i++) {
+        decoders.emplace_back([this, &queue] { decodeBatches(queue); });
+    }
+
+    std::vector<Record> batch;
+    const unsigned char* batch_start = pos;
+    auto hand_over = [&]() {
+        bool ok = batch.empty() || queue.push(std::move(batch));
+        batch.clear();
+        batch_start = pos;
+        if (progress) progress(pos - file_start, end - file_start);
+        return ok;
+    };
+
+    try {
+        long long expiry_at = -1;
+        bool done = false;
+
+        while (!done) {
+            uint8_t opcode = readByte();
+
+            switch (opcode) {
+                case OPCODE_EOF:
+                    done = true;
+                    break;
+                case OPCODE_AUX:
+                    // metadata like redis-ver, nothing we need
+                    skipString();
+                    skipString();
+                    break;
+                case OPCODE_SELECTDB: {
+                    uint64_t index = readLength();
+                    if (index != 0) std::cout << "Loading the keys of db " << index << " into db 0" << std::endl;
+                    break;
+                }
+                case OPCODE_RESIZEDB: {
+                    // sizes of the main and the expires hash table, the keyspace is sized once instead of growing
+                    uint64_t db_size = readLength();
+                    readLength();
+                    db.RESERVE(db_size, true);
+                    break;
+                }
+                case OPCODE_EXPIRETIME_MS:
+                    expiry_at = readMillis();
+                    break;
+                case OPCODE_EXPIRETIME: {
+                    // expiry in seconds, unsigned int of 4 bytes in little-endian
+                    uint32_t seconds;
+                    readExact(&seconds, 4);
+                    expiry_at = (long long)seconds * 1000;
+                    break;
+                }
+                case OPCODE_IDLE:
+                    readLength(); // LRU idle time of the next key, we keep no eviction data
+                    break;
+                case OPCODE_FREQ:
+                    readByte(); // LFU counter of the next key
+                    break;
+                case OPCODE_SLOT_INFO:
+                    // cluster slot sizes: slot, keys, expires
+                    readLength();
+                    readLength();
+                    readLength();
+                    break;
+                case OPCODE_MODULE_AUX: {
+                    uint64_t module_id = readLength();
+                    if (readLength() != RDBWriter::MODULE_OPCODE_UINT) throw std::runtime_error("invalid module aux field");
+                    readLength(); // when: before or after the keyspace
+                    // module types have no aux callbacks here, the data is skipped whole
+                    skipModuleValue();
+                    std::cout << "Skipped aux data of module type id " << module_id << std::endl;
+                    break;
+                }
+                case OPCODE_FUNCTION2:
+                    // no scripting here, the library code is dropped
+                    skipString();
+                    std::cout << "Skipped a function library, functions are not supported" << std::endl;
+                    break;
+                case OPCODE_FUNCTION_PRE_GA:
+                    throw std::runtime_error("pre-GA function format is not supported");
+                case TYPE_MODULE_2: {
+                    std::string key = readString();
+                    std::vector<KeyValueDatabase::LoadedKey> loaded;
+                    loaded.push_back({std::move(key), loadModuleValue(), ObjType::MODULE, expiry_at});
+                    if (expiry_at == -1 || expiry_at >= current_time_ms()) db.LOAD_KEYS(loaded, true);
+                    expiry_at = -1;
+                    break;
+                }
+                default: {
+                    Record record = {opcode, expiry_at, pos, nullptr};
+                    skipString();
+                    skipValue(opcode);
+                    record.end = pos;
+                    batch.push_back(record);
+                    expiry_at = -1;
+
+                    if (batch.size() >= BATCH_RECORDS || (size_t)(pos - batch_start) >= BATCH_BYTES) {
+                        done = !hand_over(); // a decoder failed
+                    }
+                    break;
+                }
+            }
+        }
+        hand_over();
+    } catch (...) {
+        queue.fail(std::current_exception());
+    }
+
+    queue.close();
+    decoders.clear(); // joins them
+    if (queue.error) std::rethrow_exception(queue.error);
+}
+
+void RDBParser::decodeBatches(RecordQueue& queue) {
+    std::vector<Record> batch;
+    try {
+        while (queue.pop(batch)) {
+            long long now = current_time_ms();
+            std::vector<KeyValueDatabase::LoadedKey> loaded;
+            loaded.reserve(batch.size());
+
+            for (const Record& record : batch) {
+                RDBParser value_parser(record.begin, record.end, db, modules, version);
+                std::string key = value_parser.readString();
+                Value value;
+                ObjType obj_type;
+                bool keep = value_parser.decodeValue(record.type, value, obj_type);
+                if (value_parser.pos != record.end) throw std::runtime_error("malformed value of key '" + key + "'");
+                if (!keep || (record.expiry_at != -1 && record.expiry_at < now)) continue;
+                loaded.push_back({std::move(key), std::move(value), obj_type, record.expiry_at});
+            }
+            db.LOAD_KEYS(loaded, true);
+        }
+    } catch (...) {
+        queue.fail(std::current_exception());
+    }
+}
+
+void RDBParser::skipModuleValue() {
+    while (true) {
+        uint64_t opcode = readLength();
+        if (opcode == RDBWriter::MODULE_OPCODE_EOF) return;
+
+        if (opcode == RDBWriter::MODULE_OPCODE_SINT || opcode == RDBWriter::MODULE_OPCODE_UINT) {
+            readLength();
+        } else if (opcode == RDBWriter::MODULE_OPCODE_FLOAT) {
+            take(4);
+        } else if (opcode == RDBWriter::MODULE_OPCODE_DOUBLE) {
+            take(8);
+        } else if (opcode == RDBWriter::MODULE_OPCODE_STRING) {
+            skipString();
+        } else {
+            throw std::runtime_error("invalid module value opcode");
+        }
+    }
+}
+
+void RDBParser::skipValue(uint8_t type) {
+    switch (type) {
+        case TYPE_STRING:
+        case TYPE_LIST_ZIPLIST:
+        case TYPE_SET_INTSET:
+        case TYPE_ZSET_ZIPLIST:
+        case TYPE_HASH_ZIPLIST:
+        case TYPE_HASH_LISTPACK:
+        case TYPE_ZSET_LISTPACK:
+        case TYPE_SET_LISTPACK:
+            // a single string or blob
+            skipString();
+            break;
+        case TYPE_LIST:
+        case TYPE_SET:
+        case TYPE_LIST_QUICKLIST: {
+            uint64_t len = readLength();
+            for (uint64_t i = 0; i < len; i++) skipString();
+            break;
+        }
+        case TYPE_HASH:
+        case TYPE_HASH_METADATA: {
+            if (type == TYPE_HASH_METADATA) take(8); // min field expire time
+            uint64_t len = readLength();
+            for (uint64_t i = 0; i < len; i++) {
+                if (type == TYPE_HASH_METADATA) readLength(); // field ttl
+                skipString();
+                skipString();
+            }
+            break;
+        }
+        case TYPE_ZSET:
+        case TYPE_ZSET_2: {
+            uint64_t len = readLength();
+            for (uint64_t i = 0; i < len; i++) {
+                skipString();
+                if (type == TYPE_ZSET_2) {
+                    take(8);
+                } else {
+                    uint8_t score_len = readByte();
+                    if (score_len < 253) take(score_len); // 253..255 are nan, inf and -inf
+                }
+            }
+            break;
+        }
+        case TYPE_LIST_QUICKLIST_2: {
+            uint64_t nodes = readLength();
+            for (uint64_t i = 0; i < nodes; i++) {
+                readLength(); // container
+                skipString();
+            }
+            break;
+        }
+        case TYPE_STREAM_LISTPACKS:
+        case TYPE_STREAM_LISTPACKS_2:
+        case TYPE_STREAM_LISTPACKS_3: {
+            uint64_t nodes = readLength();
+            for (uint64_t i = 0; i < nodes; i++) {
+                skipString(); // master id
+                skipString(); // listpack
+            }
+            // length and last id, then first id, max deleted id and entries added
+            int lengths = type == TYPE_STREAM_LISTPACKS ? 3 : 8;
+            for (int i = 0; i < lengths; i++) readLength();
+
+            uint64_t num_groups = readLength();
+            for (uint64_t g = 0; g < num_groups; g++) {
+                skipString();
+                readLength();
+                readLength();
+                if (type != TYPE_STREAM_LISTPACKS) readLength();
+
+                uint64_t pel_size = readLength();
+                for (uint64_t i = 0; i < pel_size; i++) {
+                    take(16 + 8); // id and delivery time
+                    readLength();
+                }
+                uint64_t num_consumers = readLength();
+                for (uint64_t c = 0; c < num_consumers; c++) {
+                    skipString();
+                    take(type == TYPE_STREAM_LISTPACKS_3 ? 16 : 8); // seen time, active time
+                    uint64_t owned = readLength();
+                    if (owned > (uint64_t)(end - pos) / 16) throw std::runtime_error("unexpected end of the RDB file");
+                    take(owned * 16);
+                }
+            }
+            break;
+        }
+        default:
+            throw std::runtime_error("unsupported value type " + std::to_string(type));
+    }
+}
+
+bool RDBParser::decodeValue(uint8_t type, Value& value, ObjType& obj_type) {
+    switch (type) {
+        case TYPE_STRING:
+            value = readString();
+            obj_type = ObjType::STRING;
+            return true;
+        case TYPE_LIST:
+        case TYPE_LIST_ZIPLIST:
+        case TYPE_LIST_QUICKLIST:
+        case TYPE_LIST_QUICKLIST_2: {
+            RedisList list = loadList(type);
+            bool empty = list.empty();
+            value = std::move(list);
+            obj_type = ObjType::LIST;
+            return !empty;
+        }
+        case TYPE_SET:
+        case TYPE_SET_INTSET:
+        case TYPE_SET_LISTPACK: {
+            RedisSet set = loadSet(type);
+            bool empty = set.empty();
+            value = std::move(set);
+            obj_type = ObjType::SET;
+            return !empty;
+        }
+        case TYPE_ZSET:
+        case TYPE_ZSET_2:
+        case TYPE_ZSET_ZIPLIST:
+        case TYPE_ZSET_LISTPACK: {
+            ZSet zset = loadZSet(type);
+            bool empty = zset.score_set.empty();
+            value = std::move(zset);
+            obj_type = ObjType::ZSET;
+            return !empty;
+        }
+        case TYPE_HASH:
+        case TYPE_HASH_ZIPLIST:
+        case TYPE_HASH_LISTPACK:
+        case TYPE_HASH_METADATA: {
+            RedisHash hash = loadHash(type);
+            bool empty = hash.empty();
+            value = std::move(hash);
+            obj_type = ObjType::HASH;
+            return !empty;
+        }
+        case TYPE_STREAM_LISTPACKS:
+        case TYPE_STREAM_LISTPACKS_2:
+        case TYPE_STREAM_LISTPACKS_3:
+            value = loadStream(type);
+            obj_type = ObjType::STREAM;
+            return true;
+        default:
+            throw std::runtime_error("unsupported value type " + std::to_string(type));
+    }
+}
+
+RedisList RDBParser::loadList(uint8_t type) {
+    RedisList list;
+
+    if (type == TYPE_LIST) {
+        uint64_t len = readLength();
+        for (uint64_t i = 0; i < len; i++) list.push_back(readString());
+    } else if (type == TYPE_LIST_ZIPLIST) {
+        forEachZiplistEntry(readString(), [&](std::string item) { list.push_back(std::move(item)); });
+    } else if (type == TYPE_LIST_QUICKLIST) {
+        uint64_t nodes = readLength();
+        for (uint64_t i = 0; i < nodes; i++) {
+            forEachZiplistEntry(readString(), [&](std::string item) { list.push_back(std::move(item)); });
+        }
+    } else {
+        uint64_t nodes = readLength();
+        for (uint64_t i = 0; i < nodes; i++) {
+            uint64_t container = readLength();
+            std::string data = readString();
+            if (container == QUICKLIST_NODE_PLAIN) {
+                // an element too big for a listpack gets a node of its own
+                list.push_back(std::move(data));
+            } else if (container == QUICKLIST_NODE_PACKED) {
+                Listpack lp = Listpack::fromBlob(std::move(data));
+                for (size_t pos = lp.first(); pos != lp.endPos(); pos = lp.next(pos)) list.push_back(lp.get(pos));
+            } else {
+                throw std::runtime_error("invalid quicklist node container");
+            }
+        }
+    }
+    return list;
+}
+
+RedisSet RDBParser::loadSet(uint8_t type) {
+    RedisSet set;
+
+    if (type == TYPE_SET) {
+        uint64_t len = readLength();
+        for (uint64_t i = 0; i < len; i++) set.add(readString());
+    } else if (type == TYPE_SET_INTSET) {
+        // encoding(4) length(4) then the sorted little endian integers, taken over as our intset
+        std::string blob = readString();
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(blob.data());
+        if (blob.size() < 8) throw std::runtime_error("invalid intset");
+        uint32_t width = read32le(p);
+        uint32_t count = read32le(p + 4);
+        if ((width != 2 && width != 4 && width != 8) || blob.size() != 8 + (size_t)width * count) {
+            throw std::runtime_error("invalid intset");
+        }
+
+        std::vector<int64_t> ints(count);
+        for (uint32_t i = 0; i < count; i++) {
+            const unsigned char* at = p + 8 + (size_t)i * width;
+            if (width == 2) { int16_t v; memcpy(&v, at, 2); ints[i] = v; }
+            else if (width == 4) { int32_t v; memcpy(&v, at, 4); ints[i] = v; }
+            else { int64_t v; memcpy(&v, at, 8); ints[i] = v; }
+            if (i > 0 && ints[i] <= ints[i - 1]) throw std::runtime_error("invalid intset");
+        }
+        set = RedisSet::fromSortedInts(std::move(ints));
+    } else {
+        Listpack lp = Listpack::fromBlob(readString());
+        for (size_t pos = lp.first(); pos != lp.endPos(); pos = lp.next(pos)) set.add(lp.get(pos));
+    }
+    return set;
+}
+
+ZSet RDBParser::loadZSet(uint8_t type) {
+    ZSet zset;
+
+    // the file has the members in score order, ascending for the compact encodings and descending for the skiplist
+    // ones, so every insert goes right next to the hint
+    auto add = [&](std::string member, double score, bool descending) {
+        if (std::isnan(score)) throw std::runtime_error("zset score is NaN");
+        if (!zset.score_map.try_emplace(member, score).second) throw std::runtime_error("duplicate zset member");
+        zset.score_set.emplace_hint(descending ? zset.score_set.begin() : zset.score_set.end(), ZSetNode{std::move(member), score});
+    };
+
+    if (type == TYPE_ZSET || type == TYPE_ZSET_2) {
+        uint64_t len = readLength();
+        zset.score_map.reserve(len);
+        for (uint64_t i = 0; i < len; i++) {
+            std::string member = readString();
+            double score = type == TYPE_ZSET_2 ? readBinaryDouble() : readStringDouble();
+            add(std::move(member), score, true);
+        }
+    } else if (type == TYPE_ZSET_ZIPLIST) {
+        std::vector<std::string> items;
+        forEachZiplistEntry(readString(), [&](std::string item) { items.push_back(std::move(item)); });
+        if (items.size() % 2 != 0) throw std::runtime_error("invalid zset ziplist");
+        for (size_t i = 0; i < items.size(); i += 2) add(std::move(items[i]), parseScore(items[i + 1]), false);
+    } else {
+        Listpack lp = Listpack::fromBlob(readString());
+        if (lp.size() % 2 != 0) throw std::runtime_error("invalid zset listpack");
+        zset.score_map.reserve(lp.size() / 2);
+        for (size_t pos = lp.first(); pos != lp.endPos(); ) {
+            size_t score_pos = lp.next(pos);
+            add(lp.get(pos), parseScore(lp.get(score_pos)), false);
+            pos = lp.next(score_pos);
+        }
+    }
+    return zset;
+}
+
+RedisHash RDBParser::loadHash(uint8_t type) {
+    if (type == TYPE_HASH_LISTPACK) {
+        return RedisHash::fromListpack(Listpack::fromBlob(readString()));
+    }
+
+    if (type == TYPE_HASH_ZIPLIST) {
+        // same field/value layout as our listpack, only the entry encoding differs
+        Listpack lp;
+        forEachZiplistEntry(readString(), [&](std::string item) { lp.append(item); });
+        return RedisHash::fromListpack(std::move(lp));
+    }
+
+    // hash-metadata prefixes each field with its TTL, relative to the earliest one: 0 for none, else expire time - min + 1
+    int64_t min_expiry = type == TYPE_HASH_METADATA ? readMillis() : 0;
+
+    RedisHash hash;
+    uint64_t len = readLength();
+    for (uint64_t i = 0; i < len; i++) {
+        uint64_t ttl = type == TYPE_HASH_METADATA ? readLength() : 0;
+        std::string field = readString();
+        std::string value = readString();
+        hash.set(field, value);
+        if (ttl != 0) hash.setExpiry(field, min_expiry + (long long)ttl - 1);
+    }
+    return hash;
+}
+
+Stream RDBParser::loadStream(uint8_t type) {
+    Stream stream;
+
+    /* Each node is keyed by its master id and holds a listpack: the master entry (count, deleted, the master fields, 0)
+    then per entry flags, ms and seq relative to the master id, the fields (only the values with SAMEFIELDS) and lp-count. */
+    uint64_t nodes = readLength();
+    for (uint64_t n = 0; n < nodes; n++) {
+        std::string node_key = readString();
+        if (node_key.size() != 16) throw std::runtime_error("invalid stream node key");
+        uint64_t be[2];
+        memcpy(be, node_key.data(), 16);
+        StreamId master = {(int64_t)__builtin_bswap64(be[0]), (int64_t)__builtin_bswap64(be[1])};
+
+        Listpack lp = Listpack::fromBlob(readString());
+        size_t pos = lp.first();
+        auto next_str = [&]() {
+            if (pos == lp.endPos()) throw std::runtime_error("truncated stream node");
+            std::string s = lp.get(pos);
+            pos = lp.next(pos);
+            return s;
+        };
+        auto next_int = [&]() {
+            if (pos == lp.endPos()) throw std::runtime_error("truncated stream node");
+            std::string_view str;
+            long long value;
+            if (lp.get(pos, str, value) && !Listpack::stringToInt(str, value)) throw std::runtime_error("invalid stream node");
+            pos = lp.next(pos);
+            return value;
+        };
+
+        long long count = next_int();
+        long long deleted = next_int();
+        long long num_master_fields = next_int();
+        std::vector<std::string> master_fields;
+        for (long long i = 0; i < num_master_fields; i++) master_fields.push_back(next_str());
+        next_int(); // master entry terminator
+
+        for (long long i = 0; i < count + deleted; i++) {
+            long long flags = next_int();
+            StreamId id = {master.ms + next_int(), master.seq + next_int()};
+            StreamEntry entry = {id, {}};
+            if (flags & STREAM_ITEM_FLAG_SAMEFIELDS) {
+                for (const std::string& field : master_fields) entry.fields.emplace_back(field, next_str());
+            } else {
+                long long num_fields = next_int();
+                for (long long f = 0; f < num_fields; f++) {
+                    std::string field = next_str();
+                    entry.fields.emplace_back(std::move(field), next_str());
+                }
+            }
+            next_int(); // lp-count, for walking the node backwards
+            if (!(flags & STREAM_ITEM_FLAG_DELETED)) stream.entries.emplace_hint(stream.entries.end(), id, std::move(entry));
+        }
+    }
+
+    readLength(); // number of entries, we count them in the map
+    stream.last_id.ms = readLength();
+    stream.last_id.seq = readLength();
+    if (type != TYPE_STREAM_LISTPACKS) {
+        // first id, max deleted id and entries added, all derived from the entries here
+        for (int i = 0; i < 5; i++) readLength();
+    }
+
+    uint64_t num_groups = readLength();
+    for (uint64_t g = 0; g < num_groups; g++) {
+        std::string name = readString();
+        StreamConsumerGroup group;
+        group.last_delivered_id.ms = readLength();
+        group.last_delivered_id.seq = readLength();
+        if (type != TYPE_STREAM_LISTPACKS) readLength(); // entries read
+
+        uint64_t pel_size = readLength();
+        for (uint64_t i = 0; i < pel_size; i++) {
+            StreamId id = readStreamId();
+            int64_t delivery_time = readMillis();
+            int64_t delivery_count = readLength();
+            group.pel.emplace_hint(group.pel.end(), id, StreamPendingEntry{"", delivery_time, delivery_count});
+        }
+
+        // the consumers list the ids they own, which gives the owner of every PEL entry
+        uint64_t num_consumers = readLength();
+        for (uint64_t c = 0; c < num_consumers; c++) {
+            std::string consumer_name = readString();
+            int64_t seen_time = readMillis();
+            int64_t active_time = type == TYPE_STREAM_LISTPACKS_3 ? readMillis() : seen_time;
+            StreamConsumer& consumer = group.consumers[consumer_name];
+            consumer = StreamConsumer{consumer_name, seen_time, active_time, {}};
+
+            uint64_t owned = readLength();
+            for (uint64_t i = 0; i < owned; i++) {
+                StreamId id = readStreamId();
+                auto it = group.pel.find(id);
+                if (it == group.pel.end()) throw std::runtime_error("consumer owns an id missing from the group PEL");
+                it->second.consumer = consumer_name;
+                consumer.pending.insert(id);
+            }
+        }
+        stream.groups.emplace(std::move(name), std::move(group));
+    }
+    return stream;
+}
+
+ModuleValue RDBParser::loadModuleValue() {
+    uint64_t id = readLength();
+    const ModuleType* type = modules ? modules->find_type(id) : nullptr;
+    if (!type) {
+        throw std::runtime_error("value of module type id " + std::to_string(id) + " but no loaded module provides it, use --loadmodule");
+    }
+
+    RDBModuleLoader loader(*this);
+    void* value = type->methods.rdb_load(loader, id & 1023);
+    if (!value) throw std::runtime_error("rdb_load of module type " + type->name + " failed");
+
+    auto free_value = type->methods.free;
+    std::shared_ptr<void> owned(value, [free_value](void* p) { free_value(p); });
+    if (readLength() != RDBWriter::MODULE_OPCODE_EOF) {
+        throw std::runtime_error("rdb_load of module type " + type->name + " left data unread");
+    }
+    return ModuleValue{type, std::move(owned)};
+}
@@ -1,173 +1,123 @@
 #pragma once
-#include <fstream>
 #include <string>
-#include <iostream>
-#include <chrono>
+#include <cstdint>
+#include <functional>
 #include "KVStore.hpp"
 
-class RDBParser
-{
+class ModuleManager;
+
+/* Loads an RDB file (up to version 12) into the keyspace. The file is mmapped and read by a pipeline: this thread walks
+the records, skipping over the values to find where each one ends, and hands batches of them to decoder threads that
+build the values and move each batch into the keyspace under a single lock. The CRC64 at the end is computed over the
+mapping by another thread at the same time.
+Every value type Redis 7 writes is understood, as well as the older ziplist and quicklist encodings found in dumps of
+earlier versions. Listpack hashes and intsets are adopted as they are in the file, the other types are decoded into our
+own structures. Module values are handed to the rdb_load of the module that registered their type (on the walking thread,
+modules don't expect to be called concurrently), module aux data and function libraries are skipped. */
+class RDBParser {
 public:
-    static void load(const std::string &path, KeyValueDatabase &db)
-    {
-        std::ifstream file(path, std::ios::binary);
-
-        if (!file.is_open()) {
-            std::cout << "Unable to open the rdb file" << std::endl;
-            return;
-        }
-
-        char header[6];
-        file.read(header, 5);
-        header[5] = '\0';
-        if (std::string(header) != "REDIS") {
-            return;
-        }
-
-        file.seekg(4, std::ios::cur);
-
-        while (file)
-        {
-            unsigned char opcode;
-            file.read(reinterpret_cast<char *>(&opcode), 1);
-
-            // eof
-            if (opcode == 0xFF) {
-                std::cout << "Finished reading rdb file" << std::endl;
-                break;
-            }
-
-            if (opcode == 0xFA) {
-                // read metadata like redis ver
-                readString(file);
-                readString(file);
-                continue;
-            }
-
-            if (opcode == 0xFE) {
-                // meta data of db followed by index
-                readLength(file);
-                continue;
-            }
-            if (opcode == 0xFB) {
-                // meta data of hash table: hashtable size + expiry hash table size
-                readLength(file);
-                readLength(file);
-                continue;
-            }
-
-            long long expiry_ms = -1;
-            unsigned char value_type;
-
-            if (opcode == 0xFD) {
-                // expiry in seconds, unsigned int of 4 bytes in little-endian
-                uint32_t seconds;
-                file.read(reinterpret_cast<char *>(&seconds), 4);
-                expiry_ms = (long long)seconds * 1000;
-                file.read(reinterpret_cast<char *>(&value_type), 1);
-            } else if (opcode == 0xFC) {
-                // expiry in ms, unsigned long of 8 bytes in little-endian
-                file.read(reinterpret_cast<char *>(&expiry_ms), 8);
-                file.read(reinterpret_cast<char *>(&value_type), 1);
-            } else {
-                value_type = opcode;
-            }
-
-            // value type opcode
-            std::string key = readString(file);
-            std::string value;
-            if (value_type == 0) { 
-                value = readString(file);
-            } else {
-                continue; 
-            }
-
-            long long current_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-                                       std::chrono::system_clock::now().time_since_epoch())
-                                       .count();
-
-            if (expiry_ms != -1) {
-                std::cout << "extracted: " << key << " : " << value << " expiry: " << expiry_ms << " current: " << current_ms << std::endl;
-                if (expiry_ms < current_ms) {
-                    continue;
-                }
-                // convert absolute timestamp to relative duration for expiry logic
-                expiry_ms = expiry_ms - current_ms;
-            }
-
-            db.SET(key, value, true, expiry_ms);
-        }
-    }
+    static constexpr int MAX_RDB_VERSION = 12;
+
+    static constexpr size_t MAX_DECODER_THREADS = 8;
+    static constexpr size_t BATCH_RECORDS = 512; // a batch is handed over when it has this many keys
+    static constexpr size_t BATCH_BYTES = 1 << 20; // or this many encoded bytes
+    static constexpr size_t MAX_QUEUED_BATCHES = 4; // per decoder, bounds how far the walk runs ahead
+
+    // RDB value types
+    static constexpr uint8_t TYPE_STRING = 0;
+    static constexpr uint8_t TYPE_LIST = 1;
+    static constexpr uint8_t TYPE_SET = 2;
+    static constexpr uint8_t TYPE_ZSET = 3;
+    static constexpr uint8_t TYPE_HASH = 4;
+    static constexpr uint8_t TYPE_ZSET_2 = 5;
+    static constexpr uint8_t TYPE_MODULE_PRE_GA = 6;
+    static constexpr uint8_t TYPE_MODULE_2 = 7;
+    static constexpr uint8_t TYPE_HASH_ZIPMAP = 9;
+    static constexpr uint8_t TYPE_LIST_ZIPLIST = 10;
+    static constexpr uint8_t TYPE_SET_INTSET = 11;
+    static constexpr uint8_t TYPE_ZSET_ZIPLIST = 12;
+    static constexpr uint8_t TYPE_HASH_ZIPLIST = 13;
+    static constexpr uint8_t TYPE_LIST_QUICKLIST = 14;
+    static constexpr uint8_t TYPE_STREAM_LISTPACKS = 15;
+    static constexpr uint8_t TYPE_HASH_LISTPACK = 16;
+    static constexpr uint8_t TYPE_ZSET_LISTPACK = 17;
+    static constexpr uint8_t TYPE_LIST_QUICKLIST_2 = 18;
+    static constexpr uint8_t TYPE_STREAM_LISTPACKS_2 = 19;
+    static constexpr uint8_t TYPE_SET_LISTPACK = 20;
+    static constexpr uint8_t TYPE_STREAM_LISTPACKS_3 = 21;
+    static constexpr uint8_t TYPE_HASH_METADATA = 24;
+
+    // opcodes
+    static constexpr uint8_t OPCODE_SLOT_INFO = 0xF4;
+    static constexpr uint8_t OPCODE_FUNCTION2 = 0xF5;
+    static constexpr uint8_t OPCODE_FUNCTION_PRE_GA = 0xF6;
+    static constexpr uint8_t OPCODE_MODULE_AUX = 0xF7;
+    static constexpr uint8_t OPCODE_IDLE = 0xF8;
+    static constexpr uint8_t OPCODE_FREQ = 0xF9;
+    static constexpr uint8_t OPCODE_AUX = 0xFA;
+    static constexpr uint8_t OPCODE_RESIZEDB = 0xFB;
+    static constexpr uint8_t OPCODE_EXPIRETIME_MS = 0xFC;
+    static constexpr uint8_t OPCODE_EXPIRETIME = 0xFD;
+    static constexpr uint8_t OPCODE_SELECTDB = 0xFE;
+    static constexpr uint8_t OPCODE_EOF = 0xFF;
+
+    // quicklist-2 node containers
+    static constexpr uint64_t QUICKLIST_NODE_PLAIN = 1;
+    static constexpr uint64_t QUICKLIST_NODE_PACKED = 2;
+
+    // special string encodings, the low 6 bits of a length byte with the 11 prefix
+    static constexpr uint64_t ENC_INT8 = 0;
+    static constexpr uint64_t ENC_INT16 = 1;
+    static constexpr uint64_t ENC_INT32 = 2;
+    static constexpr uint64_t ENC_LZF = 3;
+
+    // called as the walk moves through the file, with how far it got and the file size
+    using Progress = std::function<void(size_t loaded_bytes, size_t total_bytes)>;
+
+    /* A missing file is an empty dataset. A file we can't make sense of throws std::runtime_error, the keys read before
+    the bad spot stay loaded. 'modules' may be nullptr when no module types can be present. With 'rdb_size' the snapshot
+    may be followed by other data (the commands of an AOF), its length is stored there. */
+    static void load(const std::string& path, KeyValueDatabase& db, ModuleManager* modules, Progress progress = nullptr, size_t* rdb_size = nullptr);
 
 private:
-    static uint32_t readLength(std::ifstream &file)
-    {
-        unsigned char first_byte;
-        file.read(reinterpret_cast<char *>(&first_byte), 1);
-
-        // mask of first 2 bits
-        uint8_t type = (first_byte & 0xC0) >> 6;
-
-        if (type == 0x00)
-        {
-            // 00: length is in the remaining 6 bits
-            return first_byte & 0x3F;
-        }
-        else if (type == 0x01)
-        {
-            // 01: length is in 6 bits from this byte + 8 bits from the second byte
-            unsigned char second_byte;
-            file.read(reinterpret_cast<char *>(&second_byte), 1);
-            return ((first_byte & 0x3F) << 8) | second_byte;
-        }
-        else if (type == 0x02)
-        {
-            // 10: 32-bit length. Read 4 more bytes.
-            uint32_t length;
-            // redis uses Big Endian for these lengths so we read it directly into memory.
-            file.read(reinterpret_cast<char *>(&length), 4);
-            // most modern systems are Little Endian but lengths are encoded in big endian so we need to swap bytes:
-            length = __builtin_bswap32(length);
-            return length;
-        }
-
-        // 11: special encoding (Integers converted to strings), handled in readString
-        return first_byte & 0x3F;
-    }
-    static std::string readString(std::ifstream &file)
-    {
-        // if the first byte indicates a special integer encoding
-        unsigned char first_byte = file.peek();
-        uint8_t type = (first_byte & 0xC0) >> 6;
-
-        if (type == 0x03) {   
-            file.ignore(1); // consume the type byte
-            uint8_t enc_type = first_byte & 0x3F;
-            if (enc_type == 0)
-            { // 8-bit integer
-                int8_t val;
-                file.read(reinterpret_cast<char *>(&val), 1);
-                return std::to_string(val);
-            }
-            else if (enc_type == 1)
-            { // 16-bit integer
-                int16_t val;
-                file.read(reinterpret_cast<char *>(&val), 2);
-                return std::to_string(val);
-            }
-            else if (enc_type == 2)
-            { // 32-bit integer
-                int32_t val;
-                file.read(reinterpret_cast<char *>(&val), 4);
-                return std::to_string(val);
-            }
-        }
-
-        // read length, then read data
-        uint32_t len = readLength(file);
-        std::string s;
-        s.resize(len);
-        file.read(&s[0], len);
-        return s;
-    }
-};
\ No newline at end of file
+    friend class RDBModuleLoader; // reads the values of a module type through the helpers below
+
+    struct Record; // a key and its still encoded value, as spans of the mapping
+    struct RecordQueue; // batches of records on their way to the decoders
+
+    const unsigned char* pos;
+    const unsigned char* end;
+    KeyValueDatabase& db;
+    ModuleManager* modules;
+    int version;
+    const unsigned char* file_start = nullptr; // for the offsets given to 'progress'
+    Progress progress;
+
+    RDBParser(const unsigned char* begin_, const unsigned char* end_, KeyValueDatabase& db_, ModuleManager* modules_, int version_)
+        : pos(begin_), end(end_), db(db_), modules(modules_), version(version_) {}
+
+    const unsigned char* take(size_t len); // the next 'len' bytes, throws when the input ends first
+    uint8_t readByte() { return *take(1); }
+    void readExact(void* out, size_t len);
+    uint64_t readLength();
+    uint64_t readLength(bool& is_encoded); // is_encoded: the special string encodings of the 11 prefix, value is the kind
+    std::string readString();
+    void skipString();
+    double readBinaryDouble();
+    double readStringDouble(); // the ASCII scores of the first zset type
+    int64_t readMillis(); // 8 bytes little endian
+    StreamId readStreamId(); // 128 bit big endian, as in the PELs and node keys
+
+    void loadEntries();
+    void decodeBatches(RecordQueue& queue); // a decoder thread
+    void skipModuleValue(); // the opcode tagged values of a module aux field
+    void skipValue(uint8_t type); // moves past a value without decoding it
+    bool decodeValue(uint8_t type, Value& value, ObjType& obj_type); // false for an empty collection, which is dropped
+
+    RedisList loadList(uint8_t type);
+    RedisSet loadSet(uint8_t type);
+    ZSet loadZSet(uint8_t type);
+    RedisHash loadHash(uint8_t type);
+    Stream loadStream(uint8_t type);
+    ModuleValue loadModuleValue();
+};
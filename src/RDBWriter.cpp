@@ -0,0 +1,369 @@
+#include "RDBWriter.hpp"
+#include "ModuleManager.hpp"
+#include "Crc64.hpp"
+#include "Lzf.hpp"
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <chrono>
+#include <stdexcept>
+
+void RDBWriter::flush() {
+    if(checksum) crc = crc64(crc, buf.data(), buf.size());
+    size_t written = 0;
+    while(!failed && written < buf.size()) {
+        ssize_t n = ::write(fd, buf.data() + written, buf.size() - written);
+        if(n < 0) {
+            if(errno == EINTR) continue;
+            failed = true;
+            break;
+        }
+        written += n;
+    }
+    buf.clear();
+}
+
+void RDBWriter::write(const void* data, size_t len) {
+    if(buf.size() + len > BUFFER_SIZE) {
+        flush();
+        // a chunk bigger than the buffer goes straight through
+        if(len > BUFFER_SIZE) {
+            buf.assign(static_cast<const char*>(data), len);
+            flush();
+            return;
+        }
+    }
+    buf.append(static_cast<const char*>(data), len);
+}
+
+void RDBWriter::writeLength(uint64_t len) {
+    unsigned char out[9];
+    if(len < (1 << 6)) {
+        out[0] = len;
+        write(out, 1);
+    } else if(len < (1 << 14)) {
+        out[0] = 0x40 | (len >> 8);
+        out[1] = len & 0xFF;
+        write(out, 2);
+    } else if(len <= UINT32_MAX) {
+        out[0] = 0x80;
+        uint32_t be = __builtin_bswap32((uint32_t)len);
+        memcpy(out + 1, &be, 4);
+        write(out, 5);
+    } else {
+        out[0] = 0x81;
+        uint64_t be = __builtin_bswap64(len);
+        memcpy(out + 1, &be, 8);
+        write(out, 9);
+    }
+}
+
+void RDBWriter::writeInteger(long long value) {
+    unsigned char out[5];
+    if(value >= INT8_MIN && value <= INT8_MAX) {
+        out[0] = 0xC0;
+        out[1] = (uint8_t)(int8_t)value;
+        write(out, 2);
+    } else if(value >= INT16_MIN && value <= INT16_MAX) {
+        out[0] = 0xC1;
+        int16_t v = value;
+        memcpy(out + 1, &v, 2);
+        write(out, 3);
+    } else if(value >= INT32_MIN && value <= INT32_MAX) {
+        out[0] = 0xC2;
+        int32_t v = value;
+        memcpy(out + 1, &v, 4);
+        write(out, 5);
+    } else {
+        std::string s = std::to_string(value);
+        writeLength(s.size());
+        write(s.data(), s.size());
+    }
+}
+
+void RDBWriter::writeString(const std::string& s) {
+    // like rdbTryIntegerEncoding, only strings that read back exactly the same are int encoded
+    long long value;
+    if(s.size() <= 11 && Listpack::stringToInt(s, value) && value >= INT32_MIN && value <= INT32_MAX) {
+        writeInteger(value);
+        return;
+    }
+
+    // like rdbSaveLzfStringObject, compressed only when that saves at least 4 bytes
+    if(compress && s.size() >= MIN_COMPRESS_LEN) {
+        lzf_buf.resize(s.size() - 4);
+        size_t compressed = lzf_compress(s.data(), s.size(), lzf_buf.data(), lzf_buf.size());
+        if(compressed > 0) {
+            writeByte(ENC_LZF);
+            writeLength(compressed);
+            writeLength(s.size());
+            write(lzf_buf.data(), compressed);
+            return;
+        }
+    }
+    writeLength(s.size());
+    write(s.data(), s.size());
+}
+
+void RDBWriter::writeDouble(double value) {
+    write(&value, 8);
+}
+
+void RDBWriter::writeMillis(int64_t ms) {
+    write(&ms, 8);
+}
+
+std::string RDBWriter::streamIdKey(const StreamId& id) {
+    std::string key(16, '\0');
+    uint64_t be[2] = {__builtin_bswap64((uint64_t)id.ms), __builtin_bswap64((uint64_t)id.seq)};
+    memcpy(&key[0], be, 16);
+    return key;
+}
+
+void RDBWriter::writeStreamId(const StreamId& id) {
+    std::string key = streamIdKey(id);
+    write(key.data(), key.size());
+}
+
+void RDBWriter::writeHeader(size_t db_size, size_t expires_size) {
+    write("REDIS0012", 9);
+
+    long long now_s = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    auto aux = [&](const std::string& field, const std::string& value) {
+        writeByte(OPCODE_AUX);
+        writeString(field);
+        writeString(value);
+    };
+    aux("redis-ver", "7.4.0");
+    aux("redis-bits", "64");
+    aux("ctime", std::to_string(now_s));
+    aux("aof-base", "0");
+
+    writeByte(OPCODE_SELECTDB);
+    writeLength(0);
+    writeByte(OPCODE_RESIZEDB);
+    writeLength(db_size);
+    writeLength(expires_size);
+}
+
+void RDBWriter::writeKey(const std::string& key, long long expiry_at, uint8_t type) {
+    if(expiry_at != -1) {
+        writeByte(OPCODE_EXPIRETIME_MS);
+        writeMillis(expiry_at);
+    }
+    writeByte(type);
+    writeString(key);
+}
+
+void RDBWriter::writeList(const RedisList& list) {
+    // quicklist 2: a count of nodes, then each node as <container = PACKED> <listpack>
+    std::vector<Listpack> nodes;
+    for(const std::string& item : list) {
+        if(nodes.empty() || nodes.back().bytes() + item.size() > LIST_NODE_BYTES) {
+            nodes.emplace_back();
+        }
+        nodes.back().append(item);
+    }
+
+    writeLength(nodes.size());
+    for(const Listpack& lp : nodes) {
+        writeLength(2); // QUICKLIST_NODE_CONTAINER_PACKED
+        writeString(lp.blob());
+    }
+}
+
+void RDBWriter::writeSet(const RedisSet& set) {
+    if(set.isIntset()) {
+        // the intset blob: <encoding u32> <length u32> <members in the smallest width that fits them all>, little endian
+        const std::vector<int64_t>& ints = set.intset();
+        uint32_t width = 2;
+        for(int64_t value : ints) {
+            if(value < INT32_MIN || value > INT32_MAX) width = 8;
+            else if((value < INT16_MIN || value > INT16_MAX) && width < 4) width = 4;
+        }
+
+        std::string blob(8 + ints.size() * width, '\0');
+        uint32_t length = ints.size();
+        memcpy(&blob[0], &width, 4);
+        memcpy(&blob[4], &length, 4);
+        for(size_t i = 0; i < ints.size(); i++) {
+            if(width == 2) { int16_t v = ints[i]; memcpy(&blob[8 + i * 2], &v, 2); }
+            else if(width == 4) { int32_t v = ints[i]; memcpy(&blob[8 + i * 4], &v, 4); }
+            else { int64_t v = ints[i]; memcpy(&blob[8 + i * 8], &v, 8); }
+        }
+        writeString(blob);
+        return;
+    }
+
+    writeLength(set.size());
+    set.forEach([&](const std::string& member) { writeString(member); });
+}
+
+void RDBWriter::writeZSet(const ZSet& zset) {
+    // tail first, like Redis, so a loader inserting at the head of its skiplist never walks it
+    writeLength(zset.score_set.size());
+    for(auto it = zset.score_set.rbegin(); it != zset.score_set.rend(); it++) {
+        writeString(it->member);
+        writeDouble(it->score);
+    }
+}
+
+void RDBWriter::writeHash(const RedisHash& hash, long long now) {
+    if(typeOf(hash) == TYPE_HASH_LISTPACK) {
+        writeString(hash.listpack().blob());
+        return;
+    }
+
+    if(typeOf(hash) == TYPE_HASH) {
+        writeLength(hash.size(now));
+        hash.forEach(now, [&](const std::string& field, const std::string& value) {
+            writeString(field);
+            writeString(value);
+        });
+        return;
+    }
+
+    /* hash-metadata: the earliest field TTL, then per field <ttl> <field> <value> where ttl is 0 for a field without one,
+    else its expire time minus that minimum plus 1, so it stays small enough for a short length encoding */
+    long long min_expiry = -1;
+    hash.forEach(now, [&](const std::string& field, const std::string&) {
+        long long at = hash.expiry(field);
+        if(at != -1 && (min_expiry == -1 || at < min_expiry)) min_expiry = at;
+    });
+    if(min_expiry == -1) min_expiry = now; // the fields that had a TTL all expired
+
+    writeMillis(min_expiry);
+    writeLength(hash.size(now));
+    hash.forEach(now, [&](const std::string& field, const std::string& value) {
+        long long at = hash.expiry(field);
+        writeLength(at == -1 ? 0 : at - min_expiry + 1);
+        writeString(field);
+        writeString(value);
+    });
+}
+
+void RDBWriter::writeStream(const Stream& stream) {
+    /* The entries go in listpack nodes keyed by their first ("master") id, like the stream rax of Redis. A node starts
+    with the master entry <count> <deleted> <#fields> <field>... <0>, the fields of its first entry. Each entry is then
+    <flags> <ms-diff> <seq-diff> [<#fields> <field>] <value>... <lp-count>, the fields being left out (SAMEFIELDS) when
+    they are the master fields. */
+    std::vector<std::pair<StreamId, Listpack> > nodes;
+    std::vector<std::string> master_fields;
+    size_t node_count = 0;
+
+    for(const auto& [id, entry] : stream.entries) {
+        if(nodes.empty() || node_count >= STREAM_NODE_ENTRIES || nodes.back().second.bytes() >= STREAM_NODE_BYTES) {
+            if(!nodes.empty()) nodes.back().second.replace(nodes.back().second.first(), std::to_string(node_count));
+            nodes.emplace_back(id, Listpack());
+            node_count = 0;
+
+            Listpack& master = nodes.back().second;
+            master_fields.clear();
+            for(const auto& field : entry.fields) master_fields.push_back(field.first);
+            master.append("1"); // count, fixed up when the node is closed
+            master.append("0"); // deleted
+            master.append(std::to_string(master_fields.size()));
+            for(const auto& field : master_fields) master.append(field);
+            master.append("0");
+        }
+
+        const StreamId& master_id = nodes.back().first;
+        Listpack& lp = nodes.back().second;
+
+        bool same_fields = entry.fields.size() == master_fields.size();
+        for(size_t i = 0; same_fields && i < master_fields.size(); i++) {
+            same_fields = entry.fields[i].first == master_fields[i];
+        }
+
+        lp.append(same_fields ? "2" : "0"); // STREAM_ITEM_FLAG_SAMEFIELDS
+        lp.append(std::to_string(id.ms - master_id.ms));
+        lp.append(std::to_string(id.seq - master_id.seq));
+        if(!same_fields) lp.append(std::to_string(entry.fields.size()));
+        for(const auto& [field, value] : entry.fields) {
+            if(!same_fields) lp.append(field);
+            lp.append(value);
+        }
+        size_t lp_count = entry.fields.size() + 3;
+        if(!same_fields) lp_count += entry.fields.size() + 1;
+        lp.append(std::to_string(lp_count));
+        node_count++;
+    }
+    if(!nodes.empty()) nodes.back().second.replace(nodes.back().second.first(), std::to_string(node_count));
+
+    writeLength(nodes.size());
+    for(const auto& [master_id, lp] : nodes) {
+        writeString(streamIdKey(master_id));
+        writeString(lp.blob());
+    }
+
+    // nothing is ever deleted from a stream here, so every entry added is still in it
+    StreamId first_id = stream.entries.empty() ? StreamId{0, 0} : stream.entries.begin()->first;
+    writeLength(stream.entries.size());
+    writeLength(stream.last_id.ms);
+    writeLength(stream.last_id.seq);
+    writeLength(first_id.ms);
+    writeLength(first_id.seq);
+    writeLength(0); // max deleted entry id
+    writeLength(0);
+    writeLength(stream.entries.size()); // entries added
+
+    writeLength(stream.groups.size());
+    for(const auto& [name, group] : stream.groups) {
+        writeString(name);
+        writeLength(group.last_delivered_id.ms);
+        writeLength(group.last_delivered_id.seq);
+        auto read_end = stream.entries.upper_bound(group.last_delivered_id);
+        writeLength(std::distance(stream.entries.begin(), read_end)); // entries read
+
+        writeLength(group.pel.size());
+        for(const auto& [id, nack] : group.pel) {
+            writeStreamId(id);
+            writeMillis(nack.delivery_time);
+            writeLength(nack.delivery_count);
+        }
+
+        writeLength(group.consumers.size());
+        for(const auto& [consumer_name, consumer] : group.consumers) {
+            writeString(consumer_name);
+            writeMillis(consumer.seen_time);
+            writeMillis(consumer.active_time);
+            writeLength(consumer.pending.size());
+            for(const StreamId& id : consumer.pending) writeStreamId(id);
+        }
+    }
+}
+
+// ModuleIO that tags every value a module saves with its module opcode
+class RDBModuleSaver : public ModuleIO {
+private:
+    RDBWriter& out;
+public:
+    RDBModuleSaver(RDBWriter& out_) : out(out_) {}
+
+    void save_unsigned(uint64_t value) override { out.writeLength(RDBWriter::MODULE_OPCODE_UINT); out.writeLength(value); }
+    void save_signed(int64_t value) override { out.writeLength(RDBWriter::MODULE_OPCODE_SINT); out.writeLength((uint64_t)value); }
+    void save_double(double value) override { out.writeLength(RDBWriter::MODULE_OPCODE_DOUBLE); out.writeDouble(value); }
+    void save_string(const std::string& value) override { out.writeLength(RDBWriter::MODULE_OPCODE_STRING); out.writeString(value); }
+
+    uint64_t load_unsigned() override { throw std::logic_error("loading while saving"); }
+    int64_t load_signed() override { throw std::logic_error("loading while saving"); }
+    double load_double() override { throw std::logic_error("loading while saving"); }
+    std::string load_string() override { throw std::logic_error("loading while saving"); }
+};
+
+void RDBWriter::writeModuleValue(const ModuleValue& value) {
+    writeLength(value.type->id());
+    RDBModuleSaver saver(*this);
+    value.type->methods.rdb_save(saver, value.value.get());
+    writeLength(MODULE_OPCODE_EOF);
+}
+
+bool RDBWriter::finish() {
+    writeByte(OPCODE_EOF);
+    flush();
+    // covers everything up to and including the EOF opcode, 0 tells the loader it was not computed
+    uint64_t sum = checksum ? crc : 0;
+    write(&sum, 8);
+    flush();
+    return !failed;
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <string>
+#include <cstdint>
+#include "KVStore.hpp"
+#include "ModuleAPI.hpp"
+
+/* Serializes the keyspace as a Redis RDB v12 file. Output goes through one large buffer flushed with write(2), no stdio
+or iostream state, so it is safe to run in a BGSAVE child right after fork(). The CRC64 of the file is folded in at each
+flush. Values use the encodings Redis 7 writes: strings (integers in the compact int encodings, longer ones LZF
+compressed when that saves space), quicklist-2 lists of listpacks, intset or
+plain sets, listpack or plain hashes (hash-metadata when fields have a TTL), zset-2 with binary scores, stream-listpacks-3 streams with their consumer groups,
+and module-2 values saved by the module's rdb_save callback. */
+class RDBWriter {
+public:
+    // RDB value types
+    static constexpr uint8_t TYPE_STRING = 0;
+    static constexpr uint8_t TYPE_SET = 2;
+    static constexpr uint8_t TYPE_ZSET_2 = 5;
+    static constexpr uint8_t TYPE_HASH = 4;
+    static constexpr uint8_t TYPE_MODULE_2 = 7;
+    static constexpr uint8_t TYPE_SET_INTSET = 11;
+    static constexpr uint8_t TYPE_HASH_LISTPACK = 16;
+    static constexpr uint8_t TYPE_LIST_QUICKLIST_2 = 18;
+    static constexpr uint8_t TYPE_STREAM_LISTPACKS_3 = 21;
+    static constexpr uint8_t TYPE_HASH_METADATA = 24; // RDB 12, a plain hash with the TTL of each field
+
+    // opcodes
+    static constexpr uint8_t OPCODE_AUX = 0xFA;
+    static constexpr uint8_t OPCODE_RESIZEDB = 0xFB;
+    static constexpr uint8_t OPCODE_EXPIRETIME_MS = 0xFC;
+    static constexpr uint8_t OPCODE_SELECTDB = 0xFE;
+    static constexpr uint8_t OPCODE_EOF = 0xFF;
+
+    static constexpr uint8_t ENC_LZF = 0xC3; // length byte of an LZF compressed string
+    static constexpr size_t MIN_COMPRESS_LEN = 21; // shorter strings are never worth it
+
+    // module value opcodes, each value a module saves is tagged with one so the loader can check what it reads
+    static constexpr uint64_t MODULE_OPCODE_EOF = 0;
+    static constexpr uint64_t MODULE_OPCODE_SINT = 1;
+    static constexpr uint64_t MODULE_OPCODE_UINT = 2;
+    static constexpr uint64_t MODULE_OPCODE_FLOAT = 3; // never written by our ModuleIO, only skipped when loading
+    static constexpr uint64_t MODULE_OPCODE_DOUBLE = 4;
+    static constexpr uint64_t MODULE_OPCODE_STRING = 5;
+
+    static constexpr size_t BUFFER_SIZE = 4 * 1024 * 1024;
+    static constexpr size_t LIST_NODE_BYTES = 8 * 1024; // list-max-listpack-size -2
+    static constexpr size_t STREAM_NODE_ENTRIES = 100; // stream-node-max-entries
+    static constexpr size_t STREAM_NODE_BYTES = 4096; // stream-node-max-bytes
+
+private:
+    int fd = -1;
+    std::string buf;
+    bool failed = false;
+    bool compress;
+    bool checksum;
+    uint64_t crc = 0; // of everything flushed so far
+    std::string lzf_buf;
+
+    void flush();
+
+public:
+    RDBWriter(int fd_, bool compress_, bool checksum_) : fd(fd_), compress(compress_), checksum(checksum_) { buf.reserve(BUFFER_SIZE); }
+
+    void write(const void* data, size_t len);
+    void writeByte(uint8_t byte) { write(&byte, 1); }
+    void writeLength(uint64_t len);
+    void writeString(const std::string& s); // int encoded when s is a small canonical integer, else LZF when it helps
+    void writeInteger(long long value); // as a string, int encoded when it fits in 32 bits
+    void writeDouble(double value); // 8 bytes little endian, as in zset-2
+    void writeMillis(int64_t ms); // 8 bytes little endian
+    void writeStreamId(const StreamId& id); // raw, as in the PELs
+    static std::string streamIdKey(const StreamId& id); // 128 bit big endian, the rax key form
+
+    void writeHeader(size_t db_size, size_t expires_size);
+    void writeKey(const std::string& key, long long expiry_at, uint8_t type);
+    void writeList(const RedisList& list);
+    void writeSet(const RedisSet& set);
+    void writeZSet(const ZSet& zset);
+    void writeHash(const RedisHash& hash, long long now);
+    void writeStream(const Stream& stream);
+    void writeModuleValue(const ModuleValue& value);
+
+    static uint8_t typeOf(const RedisSet& set) { return set.isIntset() ? TYPE_SET_INTSET : TYPE_SET; }
+    static uint8_t typeOf(const RedisHash& hash) {
+        if(hash.hasFieldExpiry()) return TYPE_HASH_METADATA;
+        return hash.isListpack() ? TYPE_HASH_LISTPACK : TYPE_HASH;
+    }
+
+    // EOF opcode and checksum, then flush. false if any write failed
+    bool finish();
+};
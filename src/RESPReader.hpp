@@ -58,7 +58,9 @@ public:
             
             std::string full_array = header;
             for (int i = 0; i < count; ++i) {
-                full_array += read_next_message(); 
+                std::string element = read_next_message();
+                if (element.empty()) return ""; // connection closed in the middle of the frame
+                full_array += element;
             }
             return full_array;
         }
@@ -70,7 +72,7 @@ public:
             if (len == -1) return header; // Null bulk string
 
             size_t total_needed = len + 2; // data + \r\n
-            ensure_capacity(total_needed);
+            if (!ensure_capacity(total_needed)) return "";
             std::string data = buffer.substr(0, total_needed);
             buffer.erase(0, total_needed);
             return header + data;
@@ -0,0 +1,180 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstddef>
+
+/* Ordered set of key names as a compressed radix tree: every edge carries a run of bytes, so namespaced keys like
+"tenant:42:orders:..." share their common prefix once. Children are kept sorted by their first byte (compared unsigned,
+the same order as std::string), so an in-order walk yields keys lexicographically and a prefix query only descends the
+prefix and then visits the matching subtree. */
+class RadixTree {
+private:
+    struct Node {
+        std::string edge; // bytes on the edge from the parent to this node
+        bool terminal = false; // a key ends here
+        std::vector<std::unique_ptr<Node> > children; // sorted by edge[0]
+    };
+
+    Node root;
+    size_t count = 0;
+
+    static unsigned char first(const Node& node) { return (unsigned char)node.edge[0]; }
+
+    static size_t commonPrefix(std::string_view a, std::string_view b) {
+        size_t n = std::min(a.size(), b.size()), i = 0;
+        while(i < n && a[i] == b[i]) i++;
+        return i;
+    }
+
+    // child whose edge starts with 'c', or the position where it would be inserted
+    static std::vector<std::unique_ptr<Node> >::iterator childSlot(Node& node, unsigned char c) {
+        return std::lower_bound(node.children.begin(), node.children.end(), c, [](const std::unique_ptr<Node>& child, unsigned char value) {
+            return first(*child) < value;
+        });
+    }
+
+    static const Node* child(const Node& node, unsigned char c) {
+        auto it = std::lower_bound(node.children.begin(), node.children.end(), c, [](const std::unique_ptr<Node>& child, unsigned char value) {
+            return first(*child) < value;
+        });
+        return it != node.children.end() && first(**it) == c ? it->get() : nullptr;
+    }
+
+    // a non-terminal node with a single child is folded into it to keep the tree compressed
+    static void mergeWithChild(Node& node) {
+        std::unique_ptr<Node> only = std::move(node.children[0]);
+        node.edge += only->edge;
+        node.terminal = only->terminal;
+        node.children = std::move(only->children);
+    }
+
+    bool eraseFrom(Node& node, std::string_view key) {
+        if(key.empty()) {
+            if(!node.terminal) return false;
+            node.terminal = false;
+            return true;
+        }
+
+        auto it = childSlot(node, (unsigned char)key[0]);
+        if(it == node.children.end() || first(**it) != (unsigned char)key[0]) return false;
+
+        Node& next = **it;
+        if(!key.starts_with(next.edge)) return false;
+        if(!eraseFrom(next, key.substr(next.edge.size()))) return false;
+
+        if(!next.terminal && next.children.empty()) {
+            node.children.erase(it);
+        } else if(!next.terminal && next.children.size() == 1) {
+            mergeWithChild(next);
+        }
+        return true;
+    }
+
+    /* in-order walk of the subtree below 'node' whose path is 'path', emitting keys greater than 'after' when 'bounded'.
+    Subtrees entirely before 'after' are skipped without being visited. Returns false once 'fn' asks to stop. */
+    template <typename Fn>
+    static bool walk(const Node& node, std::string& path, std::string_view after, bool bounded, Fn& fn) {
+        if(node.terminal && (!bounded || std::string_view(path) > after)) {
+            if(!fn(path)) return false;
+        }
+
+        for(const auto& next : node.children) {
+            size_t old_size = path.size();
+            path += next->edge;
+
+            bool next_bounded = bounded;
+            bool skip = false;
+            if(bounded) {
+                std::string_view p(path);
+                if(after.starts_with(p)) next_bounded = true; // 'after' lies inside this subtree
+                else if(p < after) skip = true; // the whole subtree sorts before 'after'
+                else next_bounded = false; // everything below sorts after 'after'
+            }
+
+            bool keep_going = skip || walk(*next, path, after, next_bounded, fn);
+            path.resize(old_size);
+            if(!keep_going) return false;
+        }
+        return true;
+    }
+
+public:
+    size_t size() const { return count; }
+
+    void clear() {
+        root = Node();
+        count = 0;
+    }
+
+    // returns false if the key was already present
+    bool insert(std::string_view key) {
+        Node* node = &root;
+        while(true) {
+            if(key.empty()) {
+                if(node->terminal) return false;
+                node->terminal = true;
+                count++;
+                return true;
+            }
+
+            auto it = childSlot(*node, (unsigned char)key[0]);
+            if(it == node->children.end() || first(**it) != (unsigned char)key[0]) {
+                auto leaf = std::make_unique<Node>();
+                leaf->edge = std::string(key);
+                leaf->terminal = true;
+                node->children.insert(it, std::move(leaf));
+                count++;
+                return true;
+            }
+
+            Node& next = **it;
+            size_t common = commonPrefix(key, next.edge);
+            if(common < next.edge.size()) {
+                // split the edge: a new node for the shared part, the old node keeps the rest
+                auto split = std::make_unique<Node>();
+                split->edge = next.edge.substr(0, common);
+                std::unique_ptr<Node> old = std::move(*it);
+                old->edge.erase(0, common);
+                split->children.push_back(std::move(old));
+                *it = std::move(split);
+            }
+            node = it->get();
+            key.remove_prefix(common);
+        }
+    }
+
+    // returns false if the key was not present
+    bool erase(std::string_view key) {
+        if(!eraseFrom(root, key)) return false;
+        count--;
+        return true;
+    }
+
+    /* Calls fn(key) in lexicographic order for the keys starting with 'prefix' that sort after 'after' (all of them when
+    'after' is empty), until fn returns false. Costs O(prefix length + visited keys). */
+    template <typename Fn>
+    void forEachWithPrefix(std::string_view prefix, std::string_view after, Fn&& fn) const {
+        const Node* node = &root;
+        std::string path;
+        std::string_view rest = prefix;
+
+        // descend the prefix, it may end in the middle of an edge
+        while(!rest.empty()) {
+            const Node* next = child(*node, (unsigned char)rest[0]);
+            if(!next) return;
+            size_t common = commonPrefix(rest, next->edge);
+            if(common < rest.size() && common < next->edge.size()) return;
+            path += next->edge;
+            rest.remove_prefix(common);
+            node = next;
+        }
+
+        bool bounded = !after.empty();
+        if(bounded && std::string_view(path) > after && !after.starts_with(path)) bounded = false;
+        if(bounded && !after.starts_with(path) && std::string_view(path) < after) return;
+        walk(*node, path, after, bounded, fn);
+    }
+};
@@ -108,8 +108,14 @@ private:
               response = "-ERR wrong number of arguments\r\n";
             } else {
               if(dummy_context.in_transaction && cmd->name() != "EXEC" && cmd->name() != "DISCARD") {
-                response = "+QUEUED\r\n";
-                dummy_context.commandQueue.push_back({cmd, std::move(args)});
+                std::any bound;
+                response = cmd->bind(args, bound);
+                if(response.empty()) {
+                  response = "+QUEUED\r\n";
+                  dummy_context.commandQueue.push_back({cmd, std::move(args), std::move(bound)});
+                } else {
+                  dummy_context.transaction_failed = true;
+                }
               } else {
                 response = cmd->execute(dummy_context, args, db, true);
               }
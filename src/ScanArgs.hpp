@@ -0,0 +1,58 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <stdexcept>
+#include <algorithm>
+#include "Listpack.hpp"
+
+// The arguments of SCAN / HSCAN / SSCAN / ZSCAN, bound when the command is queued
+struct ScanArgs {
+    uint64_t cursor = 0;
+    std::string pattern; // empty matches everything
+    long long count = 10;
+    std::string type; // SCAN TYPE, lower-cased
+    bool novalues = false; // HSCAN NOVALUES
+};
+
+// the options a command accepts on top of MATCH and COUNT
+enum class ScanOption { NONE, TYPE, NOVALUES };
+
+// parses "cursor [MATCH pattern] [COUNT count] [extra]" starting at args[idx], returns an error reply or an empty string
+inline std::string parseScanArgs(const std::vector<std::string>& args, size_t idx, ScanOption extra, ScanArgs& scan) {
+    try {
+        size_t parsed;
+        scan.cursor = std::stoull(args[idx], &parsed);
+        if(parsed != args[idx].size()) throw std::invalid_argument("cursor");
+    } catch (...) {
+        return "-ERR invalid cursor\r\n";
+    }
+
+    for(size_t i = idx + 1; i < args.size(); i++) {
+        std::string option = args[i];
+        std::transform(option.begin(), option.end(), option.begin(), ::toupper);
+
+        if(option == "MATCH" && i + 1 < args.size()) {
+            scan.pattern = args[++i];
+            if(scan.pattern == "*") scan.pattern.clear();
+        } else if(option == "COUNT" && i + 1 < args.size()) {
+            if(!Listpack::stringToInt(args[++i], scan.count)) {
+                return "-ERR value is not an integer or out of range\r\n";
+            }
+            if(scan.count < 1) {
+                return "-ERR syntax error\r\n";
+            }
+        } else if(extra == ScanOption::TYPE && option == "TYPE" && i + 1 < args.size()) {
+            scan.type = args[++i];
+            std::transform(scan.type.begin(), scan.type.end(), scan.type.begin(), ::tolower);
+            if(scan.type != "string" && scan.type != "list" && scan.type != "hash" && scan.type != "set" && scan.type != "zset" && scan.type != "stream") {
+                return "-ERR unknown type name '" + args[i] + "'\r\n";
+            }
+        } else if(extra == ScanOption::NOVALUES && option == "NOVALUES") {
+            scan.novalues = true;
+        } else {
+            return "-ERR syntax error\r\n";
+        }
+    }
+    return "";
+}
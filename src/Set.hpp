@@ -0,0 +1,138 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <variant>
+#include <cstdint>
+#include <algorithm>
+#include "Dict.hpp"
+#include "Listpack.hpp"
+
+enum class SetOp {INTER, UNION, DIFF};
+
+/* Members of a SET key. While every member is a canonical integer and there are at most MAX_INTSET_ENTRIES of them
+the set is an intset: a sorted array of int64, 8 bytes per member, intersected with the SIMD kernels of SimdHelper.hpp.
+Anything else converts it to a Dict of strings for good, as in Redis. */
+class RedisSet {
+public:
+    static constexpr size_t MAX_INTSET_ENTRIES = 512;
+
+private:
+    std::vector<int64_t> ints; // sorted, used while is_intset
+    Dict<std::string, std::monostate> table;
+    bool is_intset = true;
+
+    void convertToTable() {
+        table.reserve(ints.size() + 1);
+        for(int64_t value : ints) table.try_emplace(std::to_string(value));
+        ints.clear();
+        ints.shrink_to_fit();
+        is_intset = false;
+    }
+
+    static bool toInt(const std::string& member, int64_t& value) {
+        long long parsed;
+        if(!Listpack::stringToInt(member, parsed)) return false;
+        value = parsed;
+        return true;
+    }
+
+public:
+    // adopt an already sorted and deduplicated array, e.g. the result of an intset intersection
+    static RedisSet fromSortedInts(std::vector<int64_t> values) {
+        RedisSet set;
+        set.ints = std::move(values);
+        if(set.ints.size() > MAX_INTSET_ENTRIES) set.convertToTable();
+        return set;
+    }
+
+    bool isIntset() const { return is_intset; }
+    const std::vector<int64_t>& intset() const { return ints; }
+    std::string encoding() const { return is_intset ? "intset" : "hashtable"; }
+
+    size_t size() const { return is_intset ? ints.size() : table.size(); }
+    bool empty() const { return size() == 0; }
+
+    bool contains(const std::string& member) const {
+        if(is_intset) {
+            int64_t value;
+            return toInt(member, value) && std::binary_search(ints.begin(), ints.end(), value);
+        }
+        return table.count(member) > 0;
+    }
+
+    // returns true if the member was added
+    bool add(const std::string& member) {
+        if(is_intset) {
+            int64_t value;
+            if(toInt(member, value)) {
+                auto it = std::lower_bound(ints.begin(), ints.end(), value);
+                if(it != ints.end() && *it == value) return false;
+                ints.insert(it, value);
+                if(ints.size() > MAX_INTSET_ENTRIES) convertToTable();
+                return true;
+            }
+            convertToTable();
+        }
+        return table.try_emplace(member).second;
+    }
+
+    bool remove(const std::string& member) {
+        if(is_intset) {
+            int64_t value;
+            if(!toInt(member, value)) return false;
+            auto it = std::lower_bound(ints.begin(), ints.end(), value);
+            if(it == ints.end() || *it != value) return false;
+            ints.erase(it);
+            return true;
+        }
+        return table.erase(member) > 0;
+    }
+
+    template <typename Fn>
+    void forEach(Fn&& fn) const {
+        if(is_intset) {
+            for(int64_t value : ints) fn(std::to_string(value));
+            return;
+        }
+        for(auto& [member, unused] : table) fn(member);
+    }
+
+    // one SSCAN step, an intset is returned whole with cursor 0 like in Redis
+    template <typename Fn>
+    uint64_t scan(uint64_t cursor, size_t count, Fn&& fn) const {
+        if(is_intset) {
+            forEach(fn);
+            return 0;
+        }
+
+        size_t visited = 0;
+        size_t max_steps = count * 10;
+        do {
+            cursor = table.scan(cursor, [&](const std::pair<const std::string, std::monostate>& kv) {
+                fn(kv.first);
+                visited++;
+            });
+        } while(cursor != 0 && visited < count && --max_steps > 0);
+        return cursor;
+    }
+
+    // random member of a non-empty set
+    template <typename RNG>
+    std::string random(RNG& rng) const {
+        if(is_intset) return std::to_string(ints[rng() % ints.size()]);
+        return table.random(rng)->first;
+    }
+
+    template <typename RNG>
+    std::string pop(RNG& rng) {
+        if(is_intset) {
+            size_t idx = rng() % ints.size();
+            int64_t value = ints[idx];
+            ints.erase(ints.begin() + idx);
+            return std::to_string(value);
+        }
+        std::string member = table.random(rng)->first;
+        table.erase(member);
+        return member;
+    }
+};
@@ -0,0 +1,405 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "Command.hpp"
+#include "KVStore.hpp"
+#include "ClientContext.hpp"
+#include "ScanArgs.hpp"
+
+// RESP array of bulk strings, the reply of SMEMBERS and the set algebra commands
+inline std::string setMembersToRESP(const std::vector<std::string>& members) {
+    std::string ans = "*" + std::to_string(members.size()) + "\r\n";
+    for(const auto& member : members) {
+        ans += "$" + std::to_string(member.length()) + "\r\n" + member + "\r\n";
+    }
+    return ans;
+}
+
+class SAddCommand : public Command {
+public:
+    std::string name() const override { return "SADD"; }
+    int min_args() const override { return 3; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
+    bool isWriteCommand() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+    std::vector<std::string> rewriteForAof(const std::vector<std::string>& args, const std::string& reply) const override { return argsUnlessZero(args, reply); }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        std::string set_key = args[1];
+        std::vector<std::string> members(args.begin() + 2, args.end());
+
+        try {
+            return ":" + std::to_string(db.SADD(set_key, members, acquire_lock)) + "\r\n";
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+    }
+};
+
+class SRemCommand : public Command {
+public:
+    std::string name() const override { return "SREM"; }
+    int min_args() const override { return 3; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
+    bool isWriteCommand() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+    std::vector<std::string> rewriteForAof(const std::vector<std::string>& args, const std::string& reply) const override { return argsUnlessZero(args, reply); }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        std::string set_key = args[1];
+        std::vector<std::string> members(args.begin() + 2, args.end());
+
+        try {
+            return ":" + std::to_string(db.SREM(set_key, members, acquire_lock)) + "\r\n";
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+    }
+};
+
+// SISMEMBER key member / SMISMEMBER key member...
+class SIsMemberCommand : public Command {
+private:
+    bool multi;
+
+public:
+    SIsMemberCommand(bool multi) : multi(multi) {}
+
+    std::string name() const override { return multi ? "SMISMEMBER" : "SISMEMBER"; }
+    int min_args() const override { return 3; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
+    bool isWriteCommand() const override { return false; }
+    bool isReadOnly() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        std::string set_key = args[1];
+
+        if(!multi && args.size() != 3) {
+            return "-ERR wrong number of arguments for 'sismember' command\r\n";
+        }
+        std::vector<std::string> members(args.begin() + 2, args.end());
+
+        try {
+            std::vector<bool> result = db.SMISMEMBER(set_key, members, acquire_lock);
+            if(!multi) {
+                return result[0] ? ":1\r\n" : ":0\r\n";
+            }
+
+            std::string response = "*" + std::to_string(result.size()) + "\r\n";
+            for(bool is_member : result) {
+                response += is_member ? ":1\r\n" : ":0\r\n";
+            }
+            return response;
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+    }
+};
+
+class SMembersCommand : public Command {
+public:
+    std::string name() const override { return "SMEMBERS"; }
+    int min_args() const override { return 2; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
+    bool isWriteCommand() const override { return false; }
+    bool isReadOnly() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        std::string set_key = args[1];
+
+        try {
+            return setMembersToRESP(db.SMEMBERS(set_key, acquire_lock));
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+    }
+};
+
+class SCardCommand : public Command {
+public:
+    std::string name() const override { return "SCARD"; }
+    int min_args() const override { return 2; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
+    bool isWriteCommand() const override { return false; }
+    bool isReadOnly() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        std::string set_key = args[1];
+
+        try {
+            return ":" + std::to_string(db.SCARD(set_key, acquire_lock)) + "\r\n";
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+    }
+};
+
+class SPopCommand : public Command {
+public:
+    std::string name() const override { return "SPOP"; }
+    int min_args() const override { return 2; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
+    bool isWriteCommand() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    // the members are picked at random, so the log removes the ones that were
+    std::vector<std::string> rewriteForAof(const std::vector<std::string>& args, const std::string& reply) const override {
+        if(reply == "$-1\r\n") return {};
+        std::vector<std::string> members = replyStrings(reply);
+        if(members.empty()) return {};
+        std::vector<std::string> srem = {"SREM", args[1]};
+        srem.insert(srem.end(), members.begin(), members.end());
+        return srem;
+    }
+
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override {
+        //args: SPOP key [count]
+        long long count = 1;
+        if(args.size() > 2) {
+            if(!Listpack::stringToInt(args[2], count) || count < 0 || count > INT_MAX) {
+                return "-ERR value is out of range, must be positive\r\n";
+            }
+        }
+        bound = count;
+        return "";
+    }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        return bindAndExecute(context, args, db, acquire_lock);
+    }
+
+    std::string execute_bound(ClientContext& context, const std::vector<std::string> &args, const std::any& bound, KeyValueDatabase &db, bool acquire_lock) override {
+        std::string set_key = args[1];
+        long long count = std::any_cast<long long>(bound);
+
+        try {
+            std::vector<std::string> popped = db.SPOP(set_key, count, acquire_lock);
+            if(args.size() > 2) {
+                return setMembersToRESP(popped);
+            }
+            if(popped.empty()) {
+                return "$-1\r\n";
+            }
+            return "$" + std::to_string(popped[0].length()) + "\r\n" + popped[0] + "\r\n";
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+    }
+};
+
+class SRandMemberCommand : public Command {
+public:
+    std::string name() const override { return "SRANDMEMBER"; }
+    int min_args() const override { return 2; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
+    bool isWriteCommand() const override { return false; }
+    bool isReadOnly() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override {
+        //args: SRANDMEMBER key [count], a negative count may return the same member several times
+        long long count = 1;
+        if(args.size() > 2) {
+            if(!Listpack::stringToInt(args[2], count) || count < -LLONG_MAX / 2 || count > LLONG_MAX / 2) {
+                return "-ERR value is out of range\r\n";
+            }
+        }
+        bound = count;
+        return "";
+    }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        return bindAndExecute(context, args, db, acquire_lock);
+    }
+
+    std::string execute_bound(ClientContext& context, const std::vector<std::string> &args, const std::any& bound, KeyValueDatabase &db, bool acquire_lock) override {
+        std::string set_key = args[1];
+        long long count = std::any_cast<long long>(bound);
+
+        try {
+            std::vector<std::string> members = db.SRANDMEMBER(set_key, count, acquire_lock);
+            if(args.size() > 2) {
+                return setMembersToRESP(members);
+            }
+            if(members.empty()) {
+                return "$-1\r\n";
+            }
+            return "$" + std::to_string(members[0].length()) + "\r\n" + members[0] + "\r\n";
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+    }
+};
+
+class SScanCommand : public Command {
+public:
+    std::string name() const override { return "SSCAN"; }
+    int min_args() const override { return 3; }
+    KeySpec keySpec() const override { return {1, 1, 1}; }
+    bool isWriteCommand() const override { return false; }
+    bool isReadOnly() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override {
+        //args: SSCAN key cursor [MATCH pattern] [COUNT count]
+        ScanArgs scan;
+        std::string error = parseScanArgs(args, 2, ScanOption::NONE, scan);
+        if(!error.empty()) {
+            return error;
+        }
+        bound = std::move(scan);
+        return "";
+    }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        return bindAndExecute(context, args, db, acquire_lock);
+    }
+
+    std::string execute_bound(ClientContext& context, const std::vector<std::string> &args, const std::any& bound, KeyValueDatabase &db, bool acquire_lock) override {
+        std::string set_key = args[1];
+        const ScanArgs& scan = std::any_cast<const ScanArgs&>(bound);
+
+        try {
+            std::vector<std::string> result;
+            uint64_t next_cursor = db.SSCAN(set_key, scan.cursor, scan.pattern, scan.count, result, acquire_lock);
+
+            std::string next = std::to_string(next_cursor);
+            return "*2\r\n$" + std::to_string(next.length()) + "\r\n" + next + "\r\n" + setMembersToRESP(result);
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+    }
+};
+
+// SINTER / SUNION / SDIFF key...
+class SetOpCommand : public Command {
+private:
+    SetOp op;
+
+public:
+    SetOpCommand(SetOp op) : op(op) {}
+
+    std::string name() const override {
+        switch(op) {
+            case SetOp::INTER: return "SINTER";
+            case SetOp::UNION: return "SUNION";
+            default: return "SDIFF";
+        }
+    }
+    int min_args() const override { return 2; }
+    KeySpec keySpec() const override { return {1, -1, 1}; }
+    bool isWriteCommand() const override { return false; }
+    bool isReadOnly() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        std::vector<std::string> keys(args.begin() + 1, args.end());
+
+        try {
+            return setMembersToRESP(db.SETOP(op, keys, acquire_lock));
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+    }
+};
+
+// SINTERSTORE / SUNIONSTORE / SDIFFSTORE destination key...
+class SetOpStoreCommand : public Command {
+private:
+    SetOp op;
+
+public:
+    SetOpStoreCommand(SetOp op) : op(op) {}
+
+    std::string name() const override {
+        switch(op) {
+            case SetOp::INTER: return "SINTERSTORE";
+            case SetOp::UNION: return "SUNIONSTORE";
+            default: return "SDIFFSTORE";
+        }
+    }
+    int min_args() const override { return 3; }
+    KeySpec keySpec() const override { return {1, -1, 1}; }
+    bool isWriteCommand() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        std::string dest_key = args[1];
+        std::vector<std::string> keys(args.begin() + 2, args.end());
+
+        try {
+            return ":" + std::to_string(db.SETOPSTORE(op, dest_key, keys, acquire_lock)) + "\r\n";
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+    }
+};
+
+class SInterCardCommand : public Command {
+public:
+    std::string name() const override { return "SINTERCARD"; }
+    int min_args() const override { return 3; }
+    KeySpec keySpec() const override { return {}; }
+    std::vector<std::string> keys(const std::vector<std::string>& args) const override { return keysAfterNumkeys(args, 1); }
+    bool isWriteCommand() const override { return false; }
+    bool isReadOnly() const override { return true; }
+    bool sendToMaster() const override { return false; }
+    bool isPubSubCommand() const override { return false; }
+
+    std::string bind(const std::vector<std::string> &args, std::any& bound) const override {
+        //args: SINTERCARD numkeys key... [LIMIT limit], bound to the limit
+        long long num_keys;
+        if(!Listpack::stringToInt(args[1], num_keys) || num_keys <= 0) {
+            return "-ERR numkeys should be greater than 0\r\n";
+        }
+        if((size_t)num_keys > args.size() - 2) {
+            return "-ERR Number of keys can't be greater than number of args\r\n";
+        }
+
+        long long limit = 0;
+        for(size_t i = 2 + num_keys; i < args.size(); i++) {
+            std::string option = args[i];
+            std::transform(option.begin(), option.end(), option.begin(), ::toupper);
+
+            if(option == "LIMIT" && i + 1 < args.size()) {
+                if(!Listpack::stringToInt(args[++i], limit) || limit < 0) {
+                    return "-ERR LIMIT can't be negative\r\n";
+                }
+            } else {
+                return "-ERR syntax error\r\n";
+            }
+        }
+
+        bound = limit;
+        return "";
+    }
+
+    std::string execute(ClientContext& context, const std::vector<std::string> &args, KeyValueDatabase &db, bool acquire_lock) override {
+        return bindAndExecute(context, args, db, acquire_lock);
+    }
+
+    std::string execute_bound(ClientContext& context, const std::vector<std::string> &args, const std::any& bound, KeyValueDatabase &db, bool acquire_lock) override {
+        std::vector<std::string> keys = keysAfterNumkeys(args, 1);
+        long long limit = std::any_cast<long long>(bound);
+
+        try {
+            return ":" + std::to_string(db.SINTERCARD(keys, limit, acquire_lock)) + "\r\n";
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+    }
+};
@@ -0,0 +1,293 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define REDIS_SIMD_X86 1
+#endif
+
+/* Vectorized kernels for the hot loops of the set/bitmap types. The build has no -march flags, so every SSE/AVX2 kernel
+is compiled with a target attribute and picked at runtime from the CPU features, with a portable scalar fallback. */
+namespace simd {
+
+#ifdef REDIS_SIMD_X86
+inline bool has_avx2() {
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+
+inline bool has_sse41() {
+    static const bool supported = __builtin_cpu_supports("sse4.1");
+    return supported;
+}
+
+inline bool has_popcnt() {
+    static const bool supported = __builtin_cpu_supports("popcnt");
+    return supported;
+}
+#endif
+
+// merge intersection of two sorted arrays of unique integers, writes the common values to 'out' in order
+inline size_t intersect_scalar(const int64_t* a, size_t na, const int64_t* b, size_t nb, int64_t* out) {
+    size_t i = 0, j = 0, k = 0;
+    while(i < na && j < nb) {
+        if(a[i] < b[j]) {
+            i++;
+        } else if(b[j] < a[i]) {
+            j++;
+        } else {
+            out[k++] = a[i];
+            i++;
+            j++;
+        }
+    }
+    return k;
+}
+
+// for very different sizes: exponential search of every element of the small array in the rest of the large one
+inline size_t intersect_galloping(const int64_t* small, size_t ns, const int64_t* large, size_t nl, int64_t* out) {
+    size_t k = 0, lo = 0;
+    for(size_t i = 0; i < ns && lo < nl; i++) {
+        int64_t value = small[i];
+        size_t step = 1, hi = lo;
+        while(hi < nl && large[hi] < value) {
+            lo = hi + 1;
+            hi += step;
+            step <<= 1;
+        }
+        hi = std::min(hi + 1, nl);
+        lo = std::lower_bound(large + lo, large + hi, value) - large;
+        if(lo < nl && large[lo] == value) out[k++] = value;
+    }
+    return k;
+}
+
+#ifdef REDIS_SIMD_X86
+/* Block intersection: compare a block of 'a' against every rotation of a block of 'b', emit the lanes of 'a' that matched,
+then advance whichever block has the smaller maximum (both when equal). Both inputs are unique so nothing is emitted twice. */
+__attribute__((target("sse4.1")))
+inline size_t intersect_sse41(const int64_t* a, size_t na, const int64_t* b, size_t nb, int64_t* out) {
+    size_t i = 0, j = 0, k = 0;
+    while(i + 2 <= na && j + 2 <= nb) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + j));
+        __m128i vb_rot = _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2));
+        __m128i eq = _mm_or_si128(_mm_cmpeq_epi64(va, vb), _mm_cmpeq_epi64(va, vb_rot));
+        int mask = _mm_movemask_pd(_mm_castsi128_pd(eq));
+
+        if(mask & 1) out[k++] = a[i];
+        if(mask & 2) out[k++] = a[i + 1];
+
+        int64_t a_max = a[i + 1], b_max = b[j + 1];
+        if(a_max <= b_max) i += 2;
+        if(b_max <= a_max) j += 2;
+    }
+    return k + intersect_scalar(a + i, na - i, b + j, nb - j, out + k);
+}
+
+__attribute__((target("avx2")))
+inline size_t intersect_avx2(const int64_t* a, size_t na, const int64_t* b, size_t nb, int64_t* out) {
+    size_t i = 0, j = 0, k = 0;
+    while(i + 4 <= na && j + 4 <= nb) {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + j));
+        __m256i rot1 = _mm256_permute4x64_epi64(vb, _MM_SHUFFLE(0, 3, 2, 1));
+        __m256i rot2 = _mm256_permute4x64_epi64(vb, _MM_SHUFFLE(1, 0, 3, 2));
+        __m256i rot3 = _mm256_permute4x64_epi64(vb, _MM_SHUFFLE(2, 1, 0, 3));
+        __m256i eq = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi64(va, vb), _mm256_cmpeq_epi64(va, rot1)),
+                                     _mm256_or_si256(_mm256_cmpeq_epi64(va, rot2), _mm256_cmpeq_epi64(va, rot3)));
+        int mask = _mm256_movemask_pd(_mm256_castsi256_pd(eq));
+
+        while(mask) {
+            int lane = __builtin_ctz(mask);
+            out[k++] = a[i + lane];
+            mask &= mask - 1;
+        }
+
+        int64_t a_max = a[i + 3], b_max = b[j + 3];
+        if(a_max <= b_max) i += 4;
+        if(b_max <= a_max) j += 4;
+    }
+    return k + intersect_scalar(a + i, na - i, b + j, nb - j, out + k);
+}
+#endif
+
+// intersection of two sorted arrays of unique integers, 'out' needs room for min(na, nb) values
+inline size_t intersect_sorted(const int64_t* a, size_t na, const int64_t* b, size_t nb, int64_t* out) {
+    if(na > nb) {
+        std::swap(a, b);
+        std::swap(na, nb);
+    }
+    if(na == 0) return 0;
+
+    // the block kernels touch every element of both sides, a skewed pair is cheaper with binary searches
+    if(na * 32 < nb) return intersect_galloping(a, na, b, nb, out);
+
+#ifdef REDIS_SIMD_X86
+    if(has_avx2()) return intersect_avx2(a, na, b, nb, out);
+    if(has_sse41()) return intersect_sse41(a, na, b, nb, out);
+#endif
+    return intersect_scalar(a, na, b, nb, out);
+}
+
+// number of set bits in n bytes, a word at a time
+inline uint64_t popcount_scalar(const uint8_t* p, size_t n) {
+    uint64_t count = 0;
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, p + i, 8);
+        count += __builtin_popcountll(word);
+    }
+    for(; i < n; i++) count += __builtin_popcount(p[i]);
+    return count;
+}
+
+#ifdef REDIS_SIMD_X86
+// same loop, but compiled to the POPCNT instruction instead of the generic bit-twiddling fallback
+__attribute__((target("popcnt")))
+inline uint64_t popcount_popcnt(const uint8_t* p, size_t n) {
+    uint64_t count = 0;
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, p + i, 8);
+        count += __builtin_popcountll(word);
+    }
+    for(; i < n; i++) count += __builtin_popcount(p[i]);
+    return count;
+}
+
+/* Nibble lookup popcount (Mula): pshufb maps each nibble to its bit count, byte counters are summed for up to 8 blocks
+(at most 64 per byte, no overflow) and then folded into 64-bit lanes with psadbw. */
+__attribute__((target("avx2")))
+inline uint64_t popcount_avx2(const uint8_t* p, size_t n) {
+    const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low_mask = _mm256_set1_epi8(0x0F);
+    __m256i total = _mm256_setzero_si256();
+
+    size_t i = 0;
+    while(i + 32 <= n) {
+        __m256i local = _mm256_setzero_si256();
+        for(int block = 0; block < 8 && i + 32 <= n; block++, i += 32) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+            __m256i lo = _mm256_and_si256(v, low_mask);
+            __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask);
+            local = _mm256_add_epi8(local, _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo), _mm256_shuffle_epi8(lookup, hi)));
+        }
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(local, _mm256_setzero_si256()));
+    }
+
+    uint64_t lanes[4];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), total);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + popcount_popcnt(p + i, n - i);
+}
+#endif
+
+inline uint64_t popcount(const uint8_t* p, size_t n) {
+#ifdef REDIS_SIMD_X86
+    // below a few blocks the AVX2 setup does not pay off
+    if(n >= 256 && has_avx2()) return popcount_avx2(p, n);
+    if(has_popcnt()) return popcount_popcnt(p, n);
+#endif
+    return popcount_scalar(p, n);
+}
+
+enum class BitOp {AND, OR, XOR, NOT};
+
+// dst = dst <op> src over n bytes, NOT ignores the old dst: dst = ~src
+inline void bitop_scalar(BitOp op, uint8_t* dst, const uint8_t* src, size_t n) {
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8) {
+        uint64_t a, b;
+        std::memcpy(&a, dst + i, 8);
+        std::memcpy(&b, src + i, 8);
+        switch(op) {
+            case BitOp::AND: a &= b; break;
+            case BitOp::OR: a |= b; break;
+            case BitOp::XOR: a ^= b; break;
+            case BitOp::NOT: a = ~b; break;
+        }
+        std::memcpy(dst + i, &a, 8);
+    }
+    for(; i < n; i++) {
+        switch(op) {
+            case BitOp::AND: dst[i] &= src[i]; break;
+            case BitOp::OR: dst[i] |= src[i]; break;
+            case BitOp::XOR: dst[i] ^= src[i]; break;
+            case BitOp::NOT: dst[i] = ~src[i]; break;
+        }
+    }
+}
+
+#ifdef REDIS_SIMD_X86
+__attribute__((target("avx2")))
+inline void bitop_avx2(BitOp op, uint8_t* dst, const uint8_t* src, size_t n) {
+    const __m256i ones = _mm256_set1_epi8(-1);
+    size_t i = 0;
+    for(; i + 32 <= n; i += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        switch(op) {
+            case BitOp::AND: a = _mm256_and_si256(a, b); break;
+            case BitOp::OR: a = _mm256_or_si256(a, b); break;
+            case BitOp::XOR: a = _mm256_xor_si256(a, b); break;
+            case BitOp::NOT: a = _mm256_xor_si256(b, ones); break;
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), a);
+    }
+    bitop_scalar(op, dst + i, src + i, n - i);
+}
+#endif
+
+inline void bitop(BitOp op, uint8_t* dst, const uint8_t* src, size_t n) {
+#ifdef REDIS_SIMD_X86
+    if(n >= 64 && has_avx2()) return bitop_avx2(op, dst, src, n);
+#endif
+    bitop_scalar(op, dst, src, n);
+}
+
+// dst[i] = max(dst[i], src[i]), used to merge unpacked HyperLogLog registers
+inline void max_u8_scalar(uint8_t* dst, const uint8_t* src, size_t n) {
+    for(size_t i = 0; i < n; i++) dst[i] = std::max(dst[i], src[i]);
+}
+
+#ifdef REDIS_SIMD_X86
+__attribute__((target("avx2")))
+inline void max_u8_avx2(uint8_t* dst, const uint8_t* src, size_t n) {
+    size_t i = 0;
+    for(; i + 32 <= n; i += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_max_epu8(a, b));
+    }
+    max_u8_scalar(dst + i, src + i, n - i);
+}
+
+// SSE2 is part of x86-64, no dispatch needed
+inline void max_u8_sse2(uint8_t* dst, const uint8_t* src, size_t n) {
+    size_t i = 0;
+    for(; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_max_epu8(a, b));
+    }
+    max_u8_scalar(dst + i, src + i, n - i);
+}
+#endif
+
+inline void max_u8(uint8_t* dst, const uint8_t* src, size_t n) {
+#ifdef REDIS_SIMD_X86
+    if(has_avx2()) return max_u8_avx2(dst, src, n);
+#if defined(__SSE2__)
+    return max_u8_sse2(dst, src, n);
+#endif
+#endif
+    max_u8_scalar(dst, src, n);
+}
+
+} // namespace simd
@@ -1,7 +1,7 @@
 #pragma once
 #include <set>
-#include <unordered_map>
 #include <string>
+#include "Dict.hpp"
 
 struct ZSetNode {
     std::string member;
@@ -14,6 +14,6 @@ struct ZSetNode {
 };
 
 struct ZSet {
-    std::unordered_map<std::string, double> score_map;
+    Dict<std::string, double> score_map; // Dict so ZSCAN cursors survive rehashes
     std::set<ZSetNode> score_set;
 };
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include <unordered_map>
 #include <chrono>
 #include<map>
+#include<set>
 
 struct StreamId {
     int64_t ms;
@@ -53,9 +54,69 @@ struct StreamEntry {
     std::vector<std::pair<std::string, std::string> > fields;
 };
 
+struct StreamPendingSummary {
+    int64_t count = 0;
+    StreamId min_id = {0, 0};
+    StreamId max_id = {0, 0};
+    std::vector<std::pair<std::string, int64_t> > consumers; // consumer name, #pending entries
+};
+
+struct StreamPendingInfo {
+    StreamId id;
+    std::string consumer;
+    int64_t idle;
+    int64_t delivery_count;
+};
+
+struct StreamAutoClaimResult {
+    StreamId next_id = {0, 0}; // cursor for the next XAUTOCLAIM call, 0-0 when the whole PEL was scanned
+    std::vector<StreamEntry> claimed;
+    std::vector<StreamId> deleted; // pending ids whose entries no longer exist in the stream
+};
+
+// An entry of a consumer group's Pending Entries List: delivered to a consumer but not yet acknowledged
+struct StreamPendingEntry {
+    std::string consumer;
+    int64_t delivery_time;
+    int64_t delivery_count;
+};
+
+struct StreamConsumer {
+    std::string name;
+    int64_t seen_time = 0; // last time the consumer interacted with the group
+    int64_t active_time = -1; // last time the consumer was delivered or claimed an entry
+    std::set<StreamId> pending; // ids owned by this consumer, the details live in the group PEL
+};
+
+struct StreamConsumerGroup {
+    StreamId last_delivered_id = {0, 0};
+    // ordered by id so XPENDING/XAUTOCLAIM can range over it, same as the entries of the stream itself
+    std::map<StreamId, StreamPendingEntry> pel;
+    std::map<std::string, StreamConsumer> consumers;
+
+    StreamConsumer& getConsumer(const std::string& name, int64_t now) {
+        auto it = consumers.find(name);
+        if(it == consumers.end()) {
+            it = consumers.emplace(name, StreamConsumer{name, now, -1, {}}).first;
+        }
+        return it->second;
+    }
+
+    // hand over the ownership of a pending entry to another consumer
+    void assign(const StreamId& id, StreamPendingEntry& nack, StreamConsumer& consumer) {
+        if(nack.consumer != consumer.name) {
+            auto old_owner = consumers.find(nack.consumer);
+            if(old_owner != consumers.end()) old_owner->second.pending.erase(id);
+            nack.consumer = consumer.name;
+        }
+        consumer.pending.insert(id);
+    }
+};
+
 struct Stream {
     std::map<StreamId, StreamEntry> entries;
     StreamId last_id = {0, 0};
+    std::map<std::string, StreamConsumerGroup> groups;
 
     StreamId add(StreamId& id, std::vector<std::pair<std::string, std::string> >& fields) {
         if (id.ms == -1 && id.seq == -1) {
@@ -118,7 +179,6 @@ struct Stream {
         auto it = entries.upper_bound(start);
         int cnt = 0;
         while(it != entries.end() && cnt < count) {
-            std::cout << cnt << "\n";
             query.push_back(it->second);
             it++;
             cnt++;
@@ -126,5 +186,70 @@ struct Stream {
         return query;
     }
 
+    // XREADGROUP with '>': deliver entries never delivered to any consumer of the group and move them to the PEL
+    std::vector<StreamEntry> readGroup(StreamConsumerGroup& group, const std::string& consumer_name, int count, bool noack, int64_t now) {
+        std::vector<StreamEntry> query;
+        StreamConsumer& consumer = group.getConsumer(consumer_name, now);
+        consumer.seen_time = now;
+
+        auto it = entries.upper_bound(group.last_delivered_id);
+        int cnt = 0;
+        while(it != entries.end() && cnt < count) {
+            group.last_delivered_id = it->first;
+            if(!noack) {
+                // the id can already be pending if the group was moved back with XGROUP SETID
+                auto [nack_it, inserted] = group.pel.try_emplace(it->first, StreamPendingEntry{consumer_name, now, 1});
+                if(!inserted) {
+                    nack_it->second.delivery_time = now;
+                    nack_it->second.delivery_count++;
+                }
+                group.assign(it->first, nack_it->second, consumer);
+            }
+            query.push_back(it->second);
+            it++;
+            cnt++;
+        }
+
+        if(!query.empty()) consumer.active_time = now;
+        return query;
+    }
+
+    // XREADGROUP with an explicit id: re-deliver the consumer's own pending entries with id greater than 'start'
+    std::vector<StreamEntry> readPending(StreamConsumerGroup& group, const std::string& consumer_name, int count, const StreamId& start, int64_t now) {
+        std::vector<StreamEntry> query;
+        StreamConsumer& consumer = group.getConsumer(consumer_name, now);
+        consumer.seen_time = now;
+
+        auto it = consumer.pending.upper_bound(start);
+        int cnt = 0;
+        while(it != consumer.pending.end() && cnt < count) {
+            auto entry = entries.find(*it);
+            if(entry != entries.end()) {
+                query.push_back(entry->second);
+            } else {
+                query.push_back({*it, {}});
+            }
+            StreamPendingEntry& nack = group.pel[*it];
+            nack.delivery_time = now;
+            nack.delivery_count++;
+            it++;
+            cnt++;
+        }
+        return query;
+    }
+
+    int ack(StreamConsumerGroup& group, const std::vector<StreamId>& ids) {
+        int acked = 0;
+        for(const StreamId& id : ids) {
+            auto nack = group.pel.find(id);
+            if(nack == group.pel.end()) continue;
+
+            auto owner = group.consumers.find(nack->second.consumer);
+            if(owner != group.consumers.end()) owner->second.pending.erase(id);
+            group.pel.erase(nack);
+            acked++;
+        }
+        return acked;
+    }
 };
 
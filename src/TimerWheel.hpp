@@ -0,0 +1,101 @@
+#pragma once
+#include <list>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <cstddef>
+
+/* Hashed timer wheel: SLOTS buckets of TICK_MS each, a timer lives in the slot of its deadline tick and timers further
+away than one revolution just stay in their slot until their round comes. Scheduling and cancelling are O(1) (the handle
+is the timer's position in its slot), expiring only visits the slots of the ticks that passed, so thousands of blocked
+clients cost one ticking thread instead of one OS timer each. */
+template <typename T>
+class TimerWheel {
+public:
+    static constexpr long long TICK_MS = 10;
+    static constexpr size_t SLOTS = 512;
+
+private:
+    struct Timer {
+        long long tick; // deadline
+        T payload;
+    };
+    using Slot = std::list<Timer>;
+
+    std::mutex mtx;
+    std::vector<Slot> slots = std::vector<Slot>(SLOTS);
+    long long current_tick = now_ticks(); // every tick up to this one has been expired
+    size_t pending = 0;
+
+    static long long now_ms() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static long long now_ticks() { return now_ms() / TICK_MS; }
+
+public:
+    struct Handle {
+        size_t slot;
+        typename Slot::iterator node;
+    };
+
+    // fires no earlier than timeout_ms from now, rounded up to the next tick
+    Handle schedule(long long timeout_ms, T payload) {
+        std::lock_guard<std::mutex> lock(mtx);
+        long long tick = (now_ms() + timeout_ms + TICK_MS - 1) / TICK_MS;
+        if(tick <= current_tick) tick = current_tick + 1;
+
+        size_t slot = tick % SLOTS;
+        slots[slot].push_back({tick, payload});
+        pending++;
+        return {slot, std::prev(slots[slot].end())};
+    }
+
+    // the timer must not have fired yet
+    void cancel(const Handle& handle) {
+        std::lock_guard<std::mutex> lock(mtx);
+        slots[handle.slot].erase(handle.node);
+        pending--;
+    }
+
+    // whether expire() would fire anything now, cheap enough to poll every tick
+    bool due() {
+        std::lock_guard<std::mutex> lock(mtx);
+        if(pending == 0) return false;
+
+        long long now = now_ticks();
+        for(long long tick = current_tick + 1; tick <= now && tick <= current_tick + (long long)SLOTS; tick++) {
+            for(const Timer& timer : slots[tick % SLOTS]) {
+                if(timer.tick <= now) return true;
+            }
+        }
+        return false;
+    }
+
+    // removes every timer whose deadline passed and calls fn(payload) for it, fn may schedule or cancel other timers
+    template <typename Fn>
+    void expire(Fn&& fn) {
+        std::vector<T> fired;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            long long now = now_ticks();
+            // after a long stall one revolution visits every slot
+            long long last = std::min(now, current_tick + (long long)SLOTS);
+            for(long long tick = current_tick + 1; tick <= last; tick++) {
+                Slot& slot = slots[tick % SLOTS];
+                for(auto it = slot.begin(); it != slot.end(); ) {
+                    if(it->tick <= now) {
+                        fired.push_back(it->payload);
+                        it = slot.erase(it);
+                        pending--;
+                    } else {
+                        it++;
+                    }
+                }
+            }
+            current_tick = now;
+        }
+
+        for(T& payload : fired) fn(payload);
+    }
+};
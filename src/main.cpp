@@ -9,23 +9,35 @@
 #include <netdb.h>
 #include <thread>
 #include <algorithm>
+#include <sstream>
 #include "KVStore.hpp" 
 #include "RESPParser.hpp"
+#include "RESPReader.hpp"
 #include "Command.hpp"
 #include "CommandRegistry.hpp"
 #include "PingEchoCommand.hpp"
 #include "GetSetCommand.hpp"
+#include "KeyCommands.hpp"
 #include "ListCommands.hpp"
+#include "HashCommands.hpp"
+#include "SetCommands.hpp"
+#include "BitmapCommands.hpp"
+#include "HLLCommands.hpp"
 #include "ClientContext.hpp"
 #include "Config.hpp"
 #include "ReplicationManager.hpp"
 #include "RDBParser.hpp"
 #include "PubSubManager.hpp"
+#include "PersistenceManager.hpp"
+#include "PersistenceCommands.hpp"
+#include "AOFManager.hpp"
 #include "ACLManager.hpp"
+#include "ModuleCommands.hpp"
 
-void handleClient(int client_fd, KeyValueDatabase &db, CommandRegistry &registry, std::shared_ptr<ServerConfig> config, std:: shared_ptr<ACLManager> aclManager) 
+void handleClient(int client_fd, KeyValueDatabase &db, CommandRegistry &registry, std::shared_ptr<ServerConfig> config, std:: shared_ptr<ACLManager> aclManager, std::shared_ptr<PubSubManager> pubsub, std::shared_ptr<PersistenceManager> persistence, std::shared_ptr<AOFManager> aof) 
 {
-  char buffer[1024];
+  // buffers the socket so a command split across several recv() calls, or several pipelined commands in one, are framed correctly
+  RESPReader reader(client_fd);
   ClientContext context(client_fd);
 
   if(aclManager->nopass()) {
@@ -34,20 +46,22 @@ void handleClient(int client_fd, KeyValueDatabase &db, CommandRegistry &registry
 
   while (true)
   {
-    ssize_t bytes_read = recv(client_fd, buffer, sizeof(buffer), 0);
-    if (bytes_read <= 0)
+    //Get the next complete command from client as RESP string
+    std::string inputString = reader.read_next_message();
+    if (inputString.empty())
     {
       std::cout << "Client disconnected\n";
       break;
     }
-    //Get the input from client in char* as RESP string
-    std::string inputString(buffer, bytes_read);
 
     //Break the RESP concatenated string as RESPValue array
     RESPParser parser(inputString);
     RESPValue input = parser.parse();
     //From the RESPValue array, get the inputs as vector of string
     std::vector<std::string> args = parser.extractArgs(input);
+    if (args.empty()) {
+      continue;
+    }
     
     //Find the Command which we have to execute
     std::string cmdName = args[0];
@@ -58,19 +72,37 @@ void handleClient(int client_fd, KeyValueDatabase &db, CommandRegistry &registry
 
     if (!cmd) {
       response = "-ERR unknown command\r\n";
+      if(context.in_transaction) context.transaction_failed = true;
     } else if(context.authenticated_user.empty() && cmd->name() != "AUTH" && cmd->name() != "QUIT") {
       response = "-NOAUTH Authentication required.\r\n";
     } else if (args.size() < cmd->min_args()) {
       response = "-ERR wrong number of arguments\r\n";
+      if(context.in_transaction) context.transaction_failed = true;
+    } else if (persistence->loading() && !cmd->canRunWhileLoading(args)) {
+      response = "-LOADING Redis is loading the dataset in memory\r\n";
+      if(context.in_transaction) context.transaction_failed = true;
     } else {
-      if(context.in_transaction && cmd->name() != "EXEC" && cmd->name() != "DISCARD") {
-        response = "+QUEUED\r\n";
-        context.commandQueue.push_back({cmd, std::move(args)});
+      if(context.in_transaction && cmd->name() != "EXEC" && cmd->name() != "DISCARD" && cmd->name() != "WATCH") {
+        // arguments are checked and parsed now, a bad one fails the whole transaction at EXEC
+        std::any bound;
+        response = cmd->bind(args, bound);
+        if(response.empty()) {
+          response = "+QUEUED\r\n";
+          context.commandQueue.push_back({cmd, std::move(args), std::move(bound)});
+        } else {
+          context.transaction_failed = true;
+        }
       } else {
         if(context.in_subscribe_mode && !cmd->isPubSubCommand()) {
           response = "-ERR Can't execute '" + cmd->name() + "': only (P|S)SUBSCRIBE / (P|S)UNSUBSCRIBE / PING / QUIT / RESET are allowed in this context\r\n";
         } else {
+          // writes reach the AOF in the order they were applied, for EXEC that is what it is about to run
+          std::unique_lock<std::mutex> aof_order = aof->order(cmd, args);
+          std::vector<QueuedCommand> queued;
+          if (aof->enabled() && cmd->name() == "EXEC") queued = context.commandQueue;
+
           response = cmd->execute(context, args, db, true);
+          aof->log(cmd, args, response, queued, aof_order);
         }
   
         if (cmd->isWriteCommand() && config->role == "master") {
@@ -89,11 +121,14 @@ void handleClient(int client_fd, KeyValueDatabase &db, CommandRegistry &registry
     }
 
     if (!response.empty()) {
-      std::unique_lock<std::mutex> write_lock(context.client_mtx);
-      send(client_fd, response.data(), response.length(), 0);
+      context.output->reply(response);
     }
   }
 
+  // nothing may write to the fd once it is closed and possibly reused by a new connection
+  pubsub->unsubscribe_all(client_fd, context.channels, context.patterns, context.shard_channels);
+  db.UNWATCH(context.watch);
+  context.output->stop();
   close(client_fd);
 }
 
@@ -101,41 +136,109 @@ int main(int argc, char **argv)
 {
   KeyValueDatabase db;
   CommandRegistry registry;
-  std::shared_ptr<PubSubManager> manager = std::make_shared<PubSubManager>();
   std::shared_ptr<ServerConfig> config = parse_args(argc, argv);
+  std::shared_ptr<PubSubManager> manager = std::make_shared<PubSubManager>(config->pubsub_hard_limit, config->pubsub_soft_limit, config->pubsub_soft_seconds);
   std::shared_ptr<ACLManager> aclManager = std::make_unique<ACLManager>();
+  std::shared_ptr<ModuleManager> modules = std::make_shared<ModuleManager>(registry);
+  std::shared_ptr<PersistenceManager> persistence = std::make_shared<PersistenceManager>(config, db);
+  std::shared_ptr<AOFManager> aof = std::make_shared<AOFManager>(config);
 
-  std::string full_path = config->rdb_file_dir + "/" + config->rdb_file_name;
-  RDBParser::load(full_path, db);
-
-  if (config->role == "slave") {
-    // we use stack-allocated manager to start the handshake thread, so that in meantime we can start accepting client
-    std::thread replication_thread([&config, &db, &registry]() {
-        ReplicationManager manager(config, db, registry);
-        manager.startHandshake();
-    });
-    replication_thread.detach(); 
+  if (config->key_index) {
+    db.ENABLE_KEY_INDEX();
   }
 
   registry.registerCommand(std::make_unique<PingCommand>());
   registry.registerCommand(std::make_unique<EchoCommand>());
   registry.registerCommand(std::make_unique<SetCommand>());
   registry.registerCommand(std::make_unique<GetCommand>());
+  registry.registerCommand(std::make_unique<MGetCommand>());
+  registry.registerCommand(std::make_unique<MSetCommand>(false));
+  registry.registerCommand(std::make_unique<MSetCommand>(true));
+  registry.registerCommand(std::make_unique<DelCommand>(false));
+  registry.registerCommand(std::make_unique<DelCommand>(true));
+  registry.registerCommand(std::make_unique<ExistsCommand>());
+  registry.registerCommand(std::make_unique<TouchCommand>());
+  registry.registerCommand(std::make_unique<ScanCommand>());
+  registry.registerCommand(std::make_unique<ScanPrefixCommand>());
   registry.registerCommand(std::make_unique<RPUSH>());
   registry.registerCommand(std::make_unique<LPUSH>());
   registry.registerCommand(std::make_unique<LRANGE>());
   registry.registerCommand(std::make_unique<LLEN>());
-  registry.registerCommand(std::make_unique<LPOP>());
-  registry.registerCommand(std::make_unique<BLPOP>());
+  registry.registerCommand(std::make_unique<ListPopCommand>(true));
+  registry.registerCommand(std::make_unique<ListPopCommand>(false));
+  registry.registerCommand(std::make_unique<BlockingPopCommand>(true));
+  registry.registerCommand(std::make_unique<BlockingPopCommand>(false));
+  registry.registerCommand(std::make_unique<MultiPopCommand>(false));
+  registry.registerCommand(std::make_unique<MultiPopCommand>(true));
+  registry.registerCommand(std::make_unique<LMoveCommand>(false));
+  registry.registerCommand(std::make_unique<LMoveCommand>(true));
+  registry.registerCommand(std::make_unique<RPopLPushCommand>(false));
+  registry.registerCommand(std::make_unique<RPopLPushCommand>(true));
+  registry.registerCommand(std::make_unique<LIndexCommand>());
+  registry.registerCommand(std::make_unique<LSetCommand>());
+  registry.registerCommand(std::make_unique<LRemCommand>());
+  registry.registerCommand(std::make_unique<LTrimCommand>());
+  registry.registerCommand(std::make_unique<LPosCommand>());
+  registry.registerCommand(std::make_unique<LInsertCommand>());
   registry.registerCommand(std::make_unique<TypeCommand>());
   registry.registerCommand(std::make_unique<XADDCommand>());
   registry.registerCommand(std::make_unique<XRANGECommand>());
   registry.registerCommand(std::make_unique<XREADCommand>());
+  registry.registerCommand(std::make_unique<XGROUPCommand>());
+  registry.registerCommand(std::make_unique<XREADGROUPCommand>());
+  registry.registerCommand(std::make_unique<XACKCommand>());
+  registry.registerCommand(std::make_unique<XPENDINGCommand>());
+  registry.registerCommand(std::make_unique<XCLAIMCommand>());
+  registry.registerCommand(std::make_unique<XAUTOCLAIMCommand>());
+  registry.registerCommand(std::make_unique<HSetCommand>());
+  registry.registerCommand(std::make_unique<HGetCommand>());
+  registry.registerCommand(std::make_unique<HMGetCommand>());
+  registry.registerCommand(std::make_unique<HDelCommand>());
+  registry.registerCommand(std::make_unique<HGetAllCommand>());
+  registry.registerCommand(std::make_unique<HIncrByCommand>());
+  registry.registerCommand(std::make_unique<HLenCommand>());
+  registry.registerCommand(std::make_unique<HExistsCommand>());
+  registry.registerCommand(std::make_unique<HScanCommand>());
+  registry.registerCommand(std::make_unique<HExpireCommand>(false));
+  registry.registerCommand(std::make_unique<HExpireCommand>(true));
+  registry.registerCommand(std::make_unique<HExpireCommand>(false, true));
+  registry.registerCommand(std::make_unique<HExpireCommand>(true, true));
+  registry.registerCommand(std::make_unique<HTTLCommand>(false));
+  registry.registerCommand(std::make_unique<HTTLCommand>(true));
+  registry.registerCommand(std::make_unique<HPersistCommand>());
+  registry.registerCommand(std::make_unique<SAddCommand>());
+  registry.registerCommand(std::make_unique<SRemCommand>());
+  registry.registerCommand(std::make_unique<SIsMemberCommand>(false));
+  registry.registerCommand(std::make_unique<SIsMemberCommand>(true));
+  registry.registerCommand(std::make_unique<SMembersCommand>());
+  registry.registerCommand(std::make_unique<SCardCommand>());
+  registry.registerCommand(std::make_unique<SPopCommand>());
+  registry.registerCommand(std::make_unique<SRandMemberCommand>());
+  registry.registerCommand(std::make_unique<SScanCommand>());
+  registry.registerCommand(std::make_unique<SetOpCommand>(SetOp::INTER));
+  registry.registerCommand(std::make_unique<SetOpCommand>(SetOp::UNION));
+  registry.registerCommand(std::make_unique<SetOpCommand>(SetOp::DIFF));
+  registry.registerCommand(std::make_unique<SetOpStoreCommand>(SetOp::INTER));
+  registry.registerCommand(std::make_unique<SetOpStoreCommand>(SetOp::UNION));
+  registry.registerCommand(std::make_unique<SetOpStoreCommand>(SetOp::DIFF));
+  registry.registerCommand(std::make_unique<SInterCardCommand>());
+  registry.registerCommand(std::make_unique<SetBitCommand>());
+  registry.registerCommand(std::make_unique<GetBitCommand>());
+  registry.registerCommand(std::make_unique<BitCountCommand>());
+  registry.registerCommand(std::make_unique<BitPosCommand>());
+  registry.registerCommand(std::make_unique<BitOpCommand>());
+  registry.registerCommand(std::make_unique<BitFieldCommand>(false));
+  registry.registerCommand(std::make_unique<BitFieldCommand>(true));
+  registry.registerCommand(std::make_unique<PFAddCommand>());
+  registry.registerCommand(std::make_unique<PFCountCommand>());
+  registry.registerCommand(std::make_unique<PFMergeCommand>());
   registry.registerCommand(std::make_unique<IncrementCommand>());
   registry.registerCommand(std::make_unique<MultiCommand>());
   registry.registerCommand(std::make_unique<ExecCommand>());
   registry.registerCommand(std::make_unique<DiscardCommand>());
-  registry.registerCommand(std::make_unique<InfoCommand>(config));
+  registry.registerCommand(std::make_unique<WatchCommand>());
+  registry.registerCommand(std::make_unique<UnwatchCommand>());
+  registry.registerCommand(std::make_unique<InfoCommand>(config, persistence, aof));
   registry.registerCommand(std::make_unique<REPLCONF>(config));
   registry.registerCommand(std::make_unique<PSYNCCommand>(config));
   registry.registerCommand(std::make_unique<WAITCommand>(config));
@@ -144,18 +247,77 @@ int main(int argc, char **argv)
   registry.registerCommand(std::make_unique<SUBSCRIBECommand>(manager));
   registry.registerCommand(std::make_unique<UNSUBSCRIBECommand>(manager));
   registry.registerCommand(std::make_unique<PUBLISHCommand>(manager));
+  registry.registerCommand(std::make_unique<PSUBSCRIBECommand>(manager));
+  registry.registerCommand(std::make_unique<PUNSUBSCRIBECommand>(manager));
+  registry.registerCommand(std::make_unique<PUBSUBCommand>(manager));
+  registry.registerCommand(std::make_unique<SSUBSCRIBECommand>(manager));
+  registry.registerCommand(std::make_unique<SUNSUBSCRIBECommand>(manager));
+  registry.registerCommand(std::make_unique<SPUBLISHCommand>(manager));
   registry.registerCommand(std::make_unique<ZAddCommand>());
   registry.registerCommand(std::make_unique<ZRankCommand>());
   registry.registerCommand(std::make_unique<ZRangeCommand>());
   registry.registerCommand(std::make_unique<ZCardCommand>());
   registry.registerCommand(std::make_unique<ZScoreCommand>());
   registry.registerCommand(std::make_unique<ZRemCommand>());
+  registry.registerCommand(std::make_unique<ZScanCommand>());
   registry.registerCommand(std::make_unique<GeoAddCommand>());
   registry.registerCommand(std::make_unique<GeoPosCommand>());
   registry.registerCommand(std::make_unique<GeoDistCommand>());
   registry.registerCommand(std::make_unique<GeoSearchCommand>());
   registry.registerCommand(std::make_unique<ACLCommand>(aclManager));
   registry.registerCommand(std::make_unique<AuthCommand>(aclManager));
+  registry.registerCommand(std::make_unique<MODULECommand>(modules));
+  registry.registerCommand(std::make_unique<SaveCommand>(persistence));
+  registry.registerCommand(std::make_unique<BgSaveCommand>(persistence));
+  registry.registerCommand(std::make_unique<LastSaveCommand>(persistence));
+
+  // modules come after the built-in commands, which they can't replace, and before the RDB file, which may hold their types
+  for (const std::string& line : config->load_modules) {
+    std::istringstream in(line);
+    std::string path, arg;
+    std::vector<std::string> module_args;
+    in >> path;
+    while (in >> arg) module_args.push_back(arg);
+    try {
+      modules->load(path, module_args);
+    } catch (const std::runtime_error& e) {
+      std::cerr << "Failed to load module " << path << ": " << e.what() << std::endl;
+      return 1;
+    }
+  }
+
+  // the dataset loads in the background so the server accepts connections (and answers health checks) right away,
+  // commands that touch keys get -LOADING until it is done. With appendonly the AOF is the dataset, if there is one
+  persistence->start_loading();
+  std::thread loader_thread([config, &db, &registry, modules, persistence, aof]() {
+    bool from_aof = aof->enabled() && aof->exists();
+    std::string source = from_aof ? aof->path() : persistence->rdb_path();
+    try {
+      auto progress = [&persistence](size_t loaded_bytes, size_t total_bytes) {
+        persistence->loading_progress(loaded_bytes, total_bytes);
+      };
+      if (from_aof) {
+        aof->load(registry, db, modules.get(), progress);
+      } else {
+        RDBParser::load(source, db, modules.get(), progress);
+      }
+      aof->start(db);
+    } catch (const std::runtime_error& e) {
+      // serving part of the dataset as if it were all of it would be worse than not serving
+      std::cerr << "Failed to load " << source << ": " << e.what() << std::endl;
+      std::exit(1);
+    }
+    persistence->stop_loading();
+
+    if (config->role == "slave") {
+      // only once our own file is in, so the commands streamed by the master apply on top of it. The manager lives on
+      // this thread's stack for the whole handshake while the main thread keeps accepting clients
+      ReplicationManager manager(config, db, registry);
+      manager.startHandshake();
+    }
+  });
+  loader_thread.detach();
+
 
 
   std::cout << std::unitbuf;
@@ -224,7 +386,7 @@ int main(int argc, char **argv)
     std::cout << "New Client Connected! Spawning thread...\n";
 
     // New thread for this client; We use std::thread and pass the routine + arguments
-    std::thread client_thread(handleClient, client_fd, std::ref(db), std::ref(registry), config, aclManager);
+    std::thread client_thread(handleClient, client_fd, std::ref(db), std::ref(registry), config, aclManager, manager, persistence, aof);
 
     // Detaching the thread so main can continue running waiting for new clients
     client_thread.detach();